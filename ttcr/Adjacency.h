@@ -0,0 +1,111 @@
+//
+//  Adjacency.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_Adjacency_h
+#define ttcr_Adjacency_h
+
+#include <cstddef>
+#include <vector>
+
+namespace ttcr {
+
+    // Lists of indices stored in compressed sparse row format: the lists
+    // are contiguous in a single array, and list n spans values
+    // [offsets[n], offsets[n+1]).  Used for the nodes of the cells of a
+    // grid, in place of one std::vector per cell.  List n is accessed with
+    // operator[], as with a std::vector<std::vector<T2>>.
+    template<typename T2>
+    class Adjacency {
+    public:
+        class range {
+        public:
+            range(const T2 *f, const T2 *l) : first(f), last(l) {}
+
+            const T2* begin() const { return first; }
+            const T2* end() const { return last; }
+            const T2* data() const { return first; }
+            size_t size() const { return static_cast<size_t>(last-first); }
+            bool empty() const { return first == last; }
+            const T2& operator[](const size_t i) const { return first[i]; }
+
+        private:
+            const T2 *first;
+            const T2 *last;
+        };
+
+        // n empty lists
+        explicit Adjacency(const size_t n=0) : offsets(n+1, 0), values() {}
+
+        size_t size() const { return offsets.size()-1; }
+
+        range operator[](const size_t n) const {
+            return range(values.data()+offsets[n], values.data()+offsets[n+1]);
+        }
+
+        void clear() {
+            offsets.assign(1, 0);
+            values.clear();
+        }
+
+        // adds a list after the last one
+        void append(const T2 *first, const T2 *last) {
+            values.insert(values.end(), first, last);
+            offsets.push_back(values.size());
+        }
+
+        // Node n is put in the lists of the cells owning it, for all lists
+        // at once (a pass to count, a pass to fill).  Nodes are in
+        // increasing order in each list.
+        template<typename NODE>
+        void buildFromOwners(const std::vector<NODE>& nodes) {
+            const size_t n = size();
+            offsets.assign(n+1, 0);
+            for ( size_t nn=0; nn<nodes.size(); ++nn ) {
+                for ( size_t no=0; no<nodes[nn].getOwners().size(); ++no ) {
+                    ++offsets[ nodes[nn].getOwners()[no]+1 ];
+                }
+            }
+            for ( size_t i=0; i<n; ++i ) {
+                offsets[i+1] += offsets[i];
+            }
+            values.resize(offsets[n]);
+            std::vector<size_t> next(offsets.begin(), offsets.end()-1);
+            for ( size_t nn=0; nn<nodes.size(); ++nn ) {
+                for ( size_t no=0; no<nodes[nn].getOwners().size(); ++no ) {
+                    values[ next[ nodes[nn].getOwners()[no] ]++ ] = static_cast<T2>(nn);
+                }
+            }
+        }
+
+        // memory used, in bytes
+        size_t getSize() const {
+            return sizeof(*this) + offsets.capacity()*sizeof(size_t) +
+            values.capacity()*sizeof(T2);
+        }
+
+    private:
+        std::vector<size_t> offsets;
+        std::vector<T2> values;
+    };
+
+}
+
+#endif
@@ -0,0 +1,58 @@
+//
+//  Barrier.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_Barrier_h
+#define ttcr_Barrier_h
+
+#include <atomic>
+#include <thread>
+
+namespace ttcr {
+
+    // Reusable barrier for a fixed number of threads.  Waiting threads spin
+    // (yielding) since the barrier is meant to be crossed at a high rate,
+    // e.g. once per plane of nodes in a sweep.
+    class Barrier {
+    public:
+        explicit Barrier(const size_t n) : nThreads(n), count(n), generation(0) {}
+
+        void wait() {
+            const size_t gen = generation.load();
+            if ( count.fetch_sub(1) == 1 ) {
+                // last thread in: reset for next use and release the others
+                count.store(nThreads);
+                generation.fetch_add(1);
+            } else {
+                while ( generation.load() == gen ) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        const size_t nThreads;
+        std::atomic<size_t> count;
+        std::atomic<size_t> generation;
+    };
+
+}
+
+#endif
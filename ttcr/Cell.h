@@ -98,6 +98,10 @@ namespace ttcr {
             cell.v = source.getDistance( node );
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + slowness.capacity()*sizeof(T);
+        }
+        
     private:
         std::vector<T> slowness;
     };
@@ -174,6 +178,10 @@ namespace ttcr {
             cell.v2 = fabs(node.z - source.getZ());
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + (slowness.capacity()+xi.capacity())*sizeof(T);
+        }
+        
     private:
         std::vector<T> slowness;
         std::vector<T> xi;        // anisotropy ratio, xi = sz / sx, *** squared ***
@@ -267,6 +275,11 @@ namespace ttcr {
             cell.v2 = fabs(node.z - source.getZ());
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + (slowness.capacity()+xi.capacity()+tAngle.capacity()+
+                                    ca.capacity()+sa.capacity())*sizeof(T);
+        }
+        
     private:
         std::vector<T> slowness;
         std::vector<T> xi;        // anisotropy ratio, xi = sz / sx, *** squared ***
@@ -373,6 +386,11 @@ namespace ttcr {
             return source.getDistance( node ) / v;
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + (Vp0.capacity()+Vs0.capacity()+
+                                    epsilon.capacity()+delta.capacity())*sizeof(T);
+        }
+        
     private:
         T sign;
         std::vector<T> Vp0;
@@ -446,6 +464,10 @@ namespace ttcr {
             return source.getDistance( node ) / v;
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + (Vs0.capacity()+gamma.capacity())*sizeof(T);
+        }
+        
     private:
         std::vector<T> Vs0;
         std::vector<T> gamma;
@@ -531,6 +553,10 @@ namespace ttcr {
             return slowness[cellNo] * std::sqrt( chi[cellNo]*lx*lx + psi[cellNo]*ly*ly + lz*lz );
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + (slowness.capacity()+chi.capacity()+psi.capacity())*sizeof(T);
+        }
+        
     private:
         std::vector<T> slowness;  // this vector contains sz
         std::vector<T> chi;       // anisotropy ratio, chi = sx / sz, *** squared ***
@@ -640,6 +666,11 @@ namespace ttcr {
             return source.getDistance( node ) / v;
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + (Vp0.capacity()+Vs0.capacity()+
+                                    epsilon.capacity()+delta.capacity())*sizeof(T);
+        }
+        
     private:
         T sign;
         std::vector<T> Vp0;
@@ -719,6 +750,10 @@ namespace ttcr {
             return source.getDistance( node ) / v;
         }
         
+        size_t getSize() const {
+            return sizeof(*this) + (Vs0.capacity()+gamma.capacity())*sizeof(T);
+        }
+        
     private:
         std::vector<T> Vs0;
         std::vector<T> gamma;
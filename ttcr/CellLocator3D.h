@@ -0,0 +1,183 @@
+//
+//  CellLocator3D.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_CellLocator3D_h
+#define ttcr_CellLocator3D_h
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "ttcr_t.h"
+
+namespace ttcr {
+
+    // Uniform bucket grid over the bounding boxes of tetrahedra, used to
+    // restrict point location to a handful of candidate cells.  Each bucket
+    // holds the indices of the cells whose (padded) bounding box overlaps it,
+    // in increasing order, so that the first cell found in a bucket is the
+    // same as with a linear scan over all cells.
+    template<typename T1, typename T2>
+    class CellLocator3D {
+    public:
+        typedef typename std::vector<T2>::const_iterator const_iterator;
+
+        CellLocator3D() : xmin(), h(), nb{ 0,0,0 }, offsets(), cells() {}
+
+        void build(const std::vector<sxyz<T1>>& no,
+                   const std::vector<tetrahedronElem<T2>>& tet,
+                   const T1 pad=small) {
+
+            offsets.clear();
+            cells.clear();
+            nb[0] = nb[1] = nb[2] = 0;
+            if ( tet.empty() ) return;
+
+            sxyz<T1> xmax = no[ tet[0].i[0] ];
+            xmin = xmax;
+            for ( size_t nt=0; nt<tet.size(); ++nt ) {
+                sxyz<T1> p0, p1;
+                getBounds(no, tet[nt], p0, p1);
+                xmin.x = xmin.x < p0.x ? xmin.x : p0.x;
+                xmin.y = xmin.y < p0.y ? xmin.y : p0.y;
+                xmin.z = xmin.z < p0.z ? xmin.z : p0.z;
+                xmax.x = xmax.x > p1.x ? xmax.x : p1.x;
+                xmax.y = xmax.y > p1.y ? xmax.y : p1.y;
+                xmax.z = xmax.z > p1.z ? xmax.z : p1.z;
+            }
+            xmin.x -= pad; xmin.y -= pad; xmin.z -= pad;
+            xmax.x += pad; xmax.y += pad; xmax.z += pad;
+
+            // about four cells per bucket
+            T1 dx[3] = { xmax.x-xmin.x, xmax.y-xmin.y, xmax.z-xmin.z };
+            T1 d = std::cbrt( 4 * dx[0]*dx[1]*dx[2] / tet.size() );
+            for ( size_t n=0; n<3; ++n ) {
+                nb[n] = d>0 ? static_cast<size_t>( dx[n]/d ) : 1;
+                if ( nb[n] < 1 ) nb[n] = 1;
+                if ( nb[n] > 1024 ) nb[n] = 1024;
+                h[n] = dx[n] / nb[n];
+                if ( h[n] <= 0 ) h[n] = 1;
+            }
+
+            // two passes: count cells per bucket, then fill
+            offsets.assign( nb[0]*nb[1]*nb[2]+1, 0 );
+            size_t imin[3], imax[3];
+            for ( size_t nt=0; nt<tet.size(); ++nt ) {
+                getRange(no, tet[nt], pad, imin, imax);
+                for ( size_t k=imin[2]; k<=imax[2]; ++k )
+                    for ( size_t j=imin[1]; j<=imax[1]; ++j )
+                        for ( size_t i=imin[0]; i<=imax[0]; ++i )
+                            offsets[ (k*nb[1]+j)*nb[0]+i+1 ]++;
+            }
+            for ( size_t n=1; n<offsets.size(); ++n )
+                offsets[n] += offsets[n-1];
+
+            cells.resize( offsets.back() );
+            std::vector<size_t> next( offsets.begin(), offsets.end()-1 );
+            for ( T2 nt=0; nt<tet.size(); ++nt ) {
+                getRange(no, tet[nt], pad, imin, imax);
+                for ( size_t k=imin[2]; k<=imax[2]; ++k )
+                    for ( size_t j=imin[1]; j<=imax[1]; ++j )
+                        for ( size_t i=imin[0]; i<=imax[0]; ++i )
+                            cells[ next[ (k*nb[1]+j)*nb[0]+i ]++ ] = nt;
+            }
+        }
+
+        // cells that may contain pt (empty range if pt is outside the grid)
+        std::pair<const_iterator,const_iterator> getCandidates(const sxyz<T1>& pt) const {
+            size_t i, j, k;
+            if ( !getIndex(pt.x-xmin.x, 0, i) ||
+                 !getIndex(pt.y-xmin.y, 1, j) ||
+                 !getIndex(pt.z-xmin.z, 2, k) ) {
+                return std::make_pair(cells.end(), cells.end());
+            }
+            size_t b = (k*nb[1]+j)*nb[0]+i;
+            return std::make_pair(cells.begin()+offsets[b], cells.begin()+offsets[b+1]);
+        }
+
+        size_t getSize() const {
+            return offsets.size()*sizeof(size_t) + cells.size()*sizeof(T2);
+        }
+
+        // about the size of a locator of nCells tetrahedra, the bounding box
+        // of a tetrahedron overlapping 8 buckets or so
+        static size_t estimateSize(const size_t nCells) {
+            return (nCells/4+1)*sizeof(size_t) + 8*nCells*sizeof(T2);
+        }
+
+    private:
+        sxyz<T1> xmin;
+        T1 h[3];
+        size_t nb[3];
+        std::vector<size_t> offsets;
+        std::vector<T2> cells;
+
+        bool getIndex(const T1 d, const size_t n, size_t& i) const {
+            if ( d < 0 ) return false;
+            i = static_cast<size_t>( d/h[n] );
+            if ( i >= nb[n] ) {
+                // point on the upper bound falls in the last bucket
+                if ( d > h[n]*nb[n] ) return false;
+                i = nb[n]-1;
+            }
+            return true;
+        }
+
+        size_t clampIndex(const T1 d, const size_t n) const {
+            if ( d <= 0 ) return 0;
+            size_t i = static_cast<size_t>( d/h[n] );
+            return i < nb[n] ? i : nb[n]-1;
+        }
+
+        void getBounds(const std::vector<sxyz<T1>>& no,
+                       const tetrahedronElem<T2>& t,
+                       sxyz<T1>& p0, sxyz<T1>& p1) const {
+            p0 = no[ t.i[0] ];
+            p1 = p0;
+            for ( size_t n=1; n<4; ++n ) {
+                const sxyz<T1>& p = no[ t.i[n] ];
+                p0.x = p0.x < p.x ? p0.x : p.x;
+                p0.y = p0.y < p.y ? p0.y : p.y;
+                p0.z = p0.z < p.z ? p0.z : p.z;
+                p1.x = p1.x > p.x ? p1.x : p.x;
+                p1.y = p1.y > p.y ? p1.y : p.y;
+                p1.z = p1.z > p.z ? p1.z : p.z;
+            }
+        }
+
+        void getRange(const std::vector<sxyz<T1>>& no,
+                      const tetrahedronElem<T2>& t, const T1 pad,
+                      size_t imin[], size_t imax[]) const {
+            sxyz<T1> p0, p1;
+            getBounds(no, t, p0, p1);
+            imin[0] = clampIndex(p0.x-pad-xmin.x, 0);
+            imin[1] = clampIndex(p0.y-pad-xmin.y, 1);
+            imin[2] = clampIndex(p0.z-pad-xmin.z, 2);
+            imax[0] = clampIndex(p1.x+pad-xmin.x, 0);
+            imax[1] = clampIndex(p1.y+pad-xmin.y, 1);
+            imax[2] = clampIndex(p1.z+pad-xmin.z, 2);
+        }
+    };
+
+}
+
+#endif
@@ -26,6 +26,7 @@
 #ifndef ttcr_Grid2D_h
 #define ttcr_Grid2D_h
 
+#include "Instrumentation.h"
 #include "ttcr_t.h"
 
 namespace ttcr {
@@ -104,6 +105,9 @@ namespace ttcr {
         virtual size_t getNumberOfNodes() const { return 1; }
         virtual size_t getNumberOfCells() const { return 1; }
         
+        // grid index of the nodes of the input file, when they were renumbered
+        virtual void setInputOrder(const std::vector<T2>&) {}
+        
         virtual void saveTT(const std::string &, const int, const size_t nt=0,
                             const bool vtkFormat=0) const {}
         
@@ -127,6 +131,10 @@ namespace ttcr {
         
         virtual const size_t getNthreads() const { return 1; }
         
+        // phase timings and operation counters, see Instrumentation.h
+        const Instrumentation& getInstrumentation() const { return instrumentation; }
+        void resetInstrumentation() const { instrumentation.reset(); }
+        
         virtual int projectPts(std::vector<S>&) const { return 1; }
         
 #ifdef VTK
@@ -135,6 +143,11 @@ namespace ttcr {
         virtual void saveModelVTR(const std::string &, const double*,
                                   const bool saveSlowness=true) const {}
 #endif
+        
+    protected:
+        Grid2D(const size_t nt=1) : instrumentation(nt) {}
+        
+        mutable Instrumentation instrumentation;
     };
     
 }
@@ -13,6 +13,7 @@
 
 #include "Grid2Drn.h"
 #include "Node2Dn.h"
+#include "RowIndex.h"
 
 namespace ttcr {
     
@@ -211,15 +212,14 @@ namespace ttcr {
                                      std::vector<T1>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
         // Set Tx pts
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         int npts = 1;
         if ( weno3 == true) npts = 2;
         this->initFSM(Tx, t0, frozen, npts, threadNo);
@@ -320,20 +320,19 @@ namespace ttcr {
                                      std::vector<std::vector<T1>*>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
         if ( traveltimes.size() != Rx.size() ) {
             traveltimes.resize( Rx.size() );
         }
         
         // Set Tx pts
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         int npts = 1;
         if ( weno3 == true) npts = 2;
         this->initFSM(Tx, t0, frozen, npts, threadNo);
@@ -498,7 +497,9 @@ namespace ttcr {
         }
         
         siv<T1> cell;
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             this->getRaypath(Tx, Rx[n], r_data[n], threadNo);
             
             for (size_t ns=0; ns<r_data[n].size()-1; ++ns) {
@@ -506,15 +507,10 @@ namespace ttcr {
                 cell.i = this->getCellNo( m );
                 cell.v = r_data[n][ns].getDistance( r_data[n][ns+1] );
                 
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
             }
@@ -48,10 +48,13 @@
 
 #include "Grid2Drc.h"
 #include "Node2Dcsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2, typename CELL>
+    template<typename T1, typename T2, typename CELL,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid2Drcsp : public Grid2Drc<T1,T2,Node2Dcsp<T1,T2>,CELL> {
     public:
         Grid2Drcsp(const T2 nx, const T2 nz, const T1 ddx, const T1 ddz,
@@ -113,25 +116,19 @@ namespace ttcr {
         
         void buildGridNodes();
         
-        void propagate(std::priority_queue<Node2Dcsp<T1,T2>*,
-                       std::vector<Node2Dcsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+        void propagate(QUEUE<Node2Dcsp<T1,T2>,T1>& queue,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
                        const size_t threadNo) const;
         
-        void propagate_lw(std::priority_queue<Node2Dcsp<T1,T2>*,
-                          std::vector<Node2Dcsp<T1,T2>*>,
-                          CompareNodePtr<T1>>& queue,
+        void propagate_lw(QUEUE<Node2Dcsp<T1,T2>,T1>& queue,
                           std::vector<bool>& inQueue,
                           std::vector<bool>& frozen,
                           const size_t threadNo) const;
         
         void initQueue(const std::vector<sxz<T1>>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<Node2Dcsp<T1,T2>*,
-                       std::vector<Node2Dcsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<Node2Dcsp<T1,T2>,T1>& queue,
                        std::vector<Node2Dcsp<T1,T2>>& txNodes,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
@@ -139,9 +136,7 @@ namespace ttcr {
         
         void initBand(const std::vector<sxz<T1>>& Tx,
                       const std::vector<T1>& t0,
-                      std::priority_queue<Node2Dcsp<T1,T2>*,
-                      std::vector<Node2Dcsp<T1,T2>*>,
-                      CompareNodePtr<T1>>& queue,
+                      QUEUE<Node2Dcsp<T1,T2>,T1>& queue,
                       std::vector<Node2Dcsp<T1,T2>>& txNodes,
                       std::vector<bool>& inQueue,
                       std::vector<bool>& frozen,
@@ -156,22 +151,22 @@ namespace ttcr {
                          const size_t threadNo) const;
         
         T1 get_tt_corr(const siv2<T1>& cell,
-                       const Grid2Drcsp<T1,T2,CELL> *grid,
+                       const Grid2Drcsp<T1,T2,CELL,QUEUE> *grid,
                        const size_t i) const {
             return cell.v*(this->slowness[cell.i] - grid->slowness[i]);
         }
         
     private:
         Grid2Drcsp() {}
-        Grid2Drcsp(const Grid2Drcsp<T1,T2,CELL>& g) {}
-        Grid2Drcsp<T1,T2,CELL>& operator=(const Grid2Drcsp<T1,T2,CELL>& g) {}
+        Grid2Drcsp(const Grid2Drcsp<T1,T2,CELL,QUEUE>& g) {}
+        Grid2Drcsp<T1,T2,CELL,QUEUE>& operator=(const Grid2Drcsp<T1,T2,CELL,QUEUE>& g) {}
         
     };
     
-    template<typename T1, typename T2, typename CELL>
-    Grid2Drcsp<T1,T2,CELL>::Grid2Drcsp(const T2 nx, const T2 nz, const T1 ddx, const T1 ddz,
-                                       const T1 minx, const T1 minz, const T2 nnx, const T2 nnz,
-                                       const size_t nt) :
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    Grid2Drcsp<T1,T2,CELL,QUEUE>::Grid2Drcsp(const T2 nx, const T2 nz, const T1 ddx, const T1 ddz,
+                                             const T1 minx, const T1 minz, const T2 nnx, const T2 nnz,
+                                             const size_t nt) :
     Grid2Drc<T1,T2,Node2Dcsp<T1,T2>,CELL>(nx,nz,ddx,ddz,minx,minz,nt),
     nsnx(nnx), nsnz(nnz), nsgx(0), nsgz(0)
     {
@@ -179,8 +174,8 @@ namespace ttcr {
         this->buildGridNeighbors();
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::buildGridNodes() {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::buildGridNodes() {
         
         this->nodes.resize( // noeuds secondaires
                            this->ncx*nsnx*(this->ncz+1) +
@@ -296,16 +291,15 @@ namespace ttcr {
     
     
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::initQueue(const std::vector<sxz<T1>>& Tx,
-                                           const std::vector<T1>& t0,
-                                           std::priority_queue<Node2Dcsp<T1,T2>*,
-                                           std::vector<Node2Dcsp<T1,T2>*>,
-                                           CompareNodePtr<T1>>& queue,
-                                           std::vector<Node2Dcsp<T1,T2>>& txNodes,
-                                           std::vector<bool>& inQueue,
-                                           std::vector<bool>& frozen,
-                                           const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::initQueue(const std::vector<sxz<T1>>& Tx,
+                                                 const std::vector<T1>& t0,
+                                                 QUEUE<Node2Dcsp<T1,T2>,T1>& queue,
+                                                 std::vector<Node2Dcsp<T1,T2>>& txNodes,
+                                                 std::vector<bool>& inQueue,
+                                                 std::vector<bool>& frozen,
+                                                 const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -314,6 +308,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     queue.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inQueue[nn] = true;
                     frozen[nn] = true;
                     break;
@@ -328,6 +323,7 @@ namespace ttcr {
                                                              txNodes.size()-1) );
                 
                 queue.push( &(txNodes.back()) );
+                this->instrumentation.count(threadNo, QUEUE_PUSH);
                 inQueue.push_back( true );
                 frozen.push_back( true );
             }
@@ -335,16 +331,15 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::initBand(const std::vector<sxz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          std::priority_queue<Node2Dcsp<T1,T2>*,
-                                          std::vector<Node2Dcsp<T1,T2>*>,
-                                          CompareNodePtr<T1>>& narrow_band,
-                                          std::vector<Node2Dcsp<T1,T2>>& txNodes,
-                                          std::vector<bool>& inBand,
-                                          std::vector<bool>& frozen,
-                                          const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::initBand(const std::vector<sxz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                QUEUE<Node2Dcsp<T1,T2>,T1>& narrow_band,
+                                                std::vector<Node2Dcsp<T1,T2>>& txNodes,
+                                                std::vector<bool>& inBand,
+                                                std::vector<bool>& frozen,
+                                                const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -353,6 +348,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     narrow_band.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inBand[nn] = true;
                     frozen[nn] = true;
                     
@@ -365,6 +361,7 @@ namespace ttcr {
                                 T2 neibNo = this->neighbors[cellNo][k];
                                 if ( neibNo == nn ) continue;
                                 T1 dt = this->cells.computeDt(this->nodes[nn], this->nodes[neibNo], cellNo);
+                                this->instrumentation.count(threadNo, LOCAL_UPDATE);
                                 
                                 if ( t0[n]+dt < this->nodes[neibNo].getTT(threadNo) ) {
                                     this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
@@ -373,8 +370,12 @@ namespace ttcr {
                                     
                                     if ( !inBand[neibNo] ) {
                                         narrow_band.push( &(this->nodes[neibNo]) );
+                                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                                         inBand[neibNo] = true;
                                         frozen[neibNo] = true;
+                                    } else {
+                                        narrow_band.update( &(this->nodes[neibNo]) );
+                                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                     }
                                 }
                             }
@@ -391,9 +392,11 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->cells.computeDt(this->nodes[neibNo], Tx[n], cellNo);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
                     narrow_band.push( &(this->nodes[neibNo]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inBand[neibNo] = true;
                     frozen[neibNo] = true;
                     
@@ -403,23 +406,21 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<sxz<T1>>& Rx,
-                                          std::vector<T1>& traveltimes,
-                                          const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<sxz<T1>>& Rx,
+                                                std::vector<T1>& traveltimes,
+                                                const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dcsp<T1,T2>*, std::vector<Node2Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node2Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -438,23 +439,21 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<const std::vector<sxz<T1>>*>& Rx,
-                                          std::vector<std::vector<T1>*>& traveltimes,
-                                          const size_t threadNo) const {
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<const std::vector<sxz<T1>>*>& Rx,
+                                                std::vector<std::vector<T1>*>& traveltimes,
+                                                const size_t threadNo) const {
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dcsp<T1,T2>*, std::vector<Node2Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node2Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -475,24 +474,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<sxz<T1>>& Rx,
-                                          std::vector<T1>& traveltimes,
-                                          std::vector<std::vector<sxz<T1>>>& r_data,
-                                          const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<sxz<T1>>& Rx,
+                                                std::vector<T1>& traveltimes,
+                                                std::vector<std::vector<sxz<T1>>>& r_data,
+                                                const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dcsp<T1,T2>*, std::vector<Node2Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         std::vector<Node2Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
         std::vector<bool> frozen( this->nodes.size(), false );
@@ -517,6 +514,7 @@ namespace ttcr {
             
             traveltimes[n] = getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                            threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node2Dcsp<T1,T2>> *node_p;
@@ -567,25 +565,23 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<const std::vector<sxz<T1>>*>& Rx,
-                                          std::vector<std::vector<T1>*>& traveltimes,
-                                          std::vector<std::vector<std::vector<sxz<T1>>>*>& r_data,
-                                          const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<const std::vector<sxz<T1>>*>& Rx,
+                                                std::vector<std::vector<T1>*>& traveltimes,
+                                                std::vector<std::vector<std::vector<sxz<T1>>>*>& r_data,
+                                                const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dcsp<T1,T2>*, std::vector<Node2Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node2Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -618,6 +614,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = getTraveltime((*Rx[nr])[n], this->nodes,
                                                       nodeParentRx, cellParentRx,
                                                       threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
                 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -685,25 +682,23 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<sxz<T1>>& Rx,
-                                          std::vector<T1>& traveltimes,
-                                          std::vector<std::vector<sxz<double>>>& r_data,
-                                          std::vector<std::vector<siv2<double>>>& l_data,
-                                          const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<sxz<T1>>& Rx,
+                                                std::vector<T1>& traveltimes,
+                                                std::vector<std::vector<sxz<double>>>& r_data,
+                                                std::vector<std::vector<siv2<double>>>& l_data,
+                                                const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dcsp<T1,T2>*, std::vector<Node2Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         std::vector<Node2Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
         std::vector<bool> frozen( this->nodes.size(), false );
@@ -730,10 +725,13 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             
             traveltimes[n] = getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                            threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node2Dcsp<T1,T2>> *node_p;
@@ -754,15 +752,10 @@ namespace ttcr {
                 
                 //cell.v = (*node_p)[iParent].getDistance( child );
                 this->cells.computeDistance( (*node_p)[iParent], child, cell);
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -788,15 +781,10 @@ namespace ttcr {
             
             //cell.v = (*node_p)[iParent].getDistance( child );
             this->cells.computeDistance( (*node_p)[iParent], child, cell);
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -818,24 +806,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<sxz<T1>>& Rx,
-                                          std::vector<T1>& traveltimes,
-                                          std::vector<std::vector<siv2<double>>>& l_data,
-                                          const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<sxz<T1>>& Rx,
+                                                std::vector<T1>& traveltimes,
+                                                std::vector<std::vector<siv2<double>>>& l_data,
+                                                const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dcsp<T1,T2>*, std::vector<Node2Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         std::vector<Node2Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
         std::vector<bool> frozen( this->nodes.size(), false );
@@ -856,10 +842,13 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             
             traveltimes[n] = getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                            threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node2Dcsp<T1,T2>> *node_p;
@@ -876,15 +865,10 @@ namespace ttcr {
             while ( (*node_p)[iParent].getNodeParent(threadNo) != std::numeric_limits<T2>::max() ) {
                 
                 this->cells.computeDistance( (*node_p)[iParent], child, cell);
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -909,15 +893,10 @@ namespace ttcr {
            
             //cell.v = (*node_p)[iParent].getDistance( child );
             this->cells.computeDistance( (*node_p)[iParent], child, cell);
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc] += cell;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -930,16 +909,17 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::propagate( std::priority_queue<Node2Dcsp<T1,T2>*, std::vector<Node2Dcsp<T1,T2>*>,
-                                           CompareNodePtr<T1>>& queue,
-                                           std::vector<bool>& inQueue,
-                                           std::vector<bool>& frozen,
-                                           const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::propagate( QUEUE<Node2Dcsp<T1,T2>,T1>& queue,
+                                                 std::vector<bool>& inQueue,
+                                                 std::vector<bool>& frozen,
+                                                 const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !queue.empty() ) {
             const Node2Dcsp<T1,T2>* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
             
@@ -955,6 +935,7 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->cells.computeDt(*source, this->nodes[neibNo], cellNo);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     if ( source->getTT(threadNo)+dt < this->nodes[neibNo].getTT(threadNo) ) {
                         this->nodes[neibNo].setTT( source->getTT(threadNo)+dt, threadNo );
@@ -963,7 +944,11 @@ namespace ttcr {
                         
                         if ( !inQueue[neibNo] ) {
                             queue.push( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                             inQueue[neibNo] = true;
+                        } else {
+                            queue.update( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                         }
                     }
                 }
@@ -971,17 +956,17 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid2Drcsp<T1,T2,CELL>::propagate_lw(std::priority_queue<Node2Dcsp<T1,T2>*,
-                                              std::vector<Node2Dcsp<T1,T2>*>,
-                                              CompareNodePtr<T1>>& queue,
-                                              std::vector<bool>& inQueue,
-                                              std::vector<bool>& frozen,
-                                              const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid2Drcsp<T1,T2,CELL,QUEUE>::propagate_lw(QUEUE<Node2Dcsp<T1,T2>,T1>& queue,
+                                                    std::vector<bool>& inQueue,
+                                                    std::vector<bool>& frozen,
+                                                    const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         // lightweight method where cell/node parent are not stored
         while ( !queue.empty() ) {
             const Node2Dcsp<T1,T2>* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
             
@@ -995,12 +980,17 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->cells.computeDt(*source, this->nodes[neibNo], cellNo);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     if ( source->getTT(threadNo)+dt < this->nodes[neibNo].getTT(threadNo) ) {
                         this->nodes[neibNo].setTT( source->getTT(threadNo)+dt, threadNo );
                         if ( !inQueue[neibNo] ) {
                             queue.push( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                             inQueue[neibNo] = true;
+                        } else {
+                            queue.update( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                         }
                     }
                 }
@@ -1008,10 +998,11 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    T1 Grid2Drcsp<T1,T2,CELL>::getTraveltime(const sxz<T1>& Rx,
-                                             const std::vector<Node2Dcsp<T1,T2>>& nodes,
-                                             const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    T1 Grid2Drcsp<T1,T2,CELL,QUEUE>::getTraveltime(const sxz<T1>& Rx,
+                                                   const std::vector<Node2Dcsp<T1,T2>>& nodes,
+                                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
             if ( nodes[nn] == Rx ) {
@@ -1035,11 +1026,12 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename CELL>
-    T1 Grid2Drcsp<T1,T2,CELL>::getTraveltime(const sxz<T1>& Rx,
-                                             const std::vector<Node2Dcsp<T1,T2>>& nodes,
-                                             T2& nodeParentRx, T2& cellParentRx,
-                                             const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    T1 Grid2Drcsp<T1,T2,CELL,QUEUE>::getTraveltime(const sxz<T1>& Rx,
+                                                   const std::vector<Node2Dcsp<T1,T2>>& nodes,
+                                                   T2& nodeParentRx, T2& cellParentRx,
+                                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
             if ( nodes[nn] == Rx ) {
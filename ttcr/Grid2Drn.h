@@ -45,7 +45,9 @@
 
 #include <boost/math/special_functions/sign.hpp>
 
+#include "Adjacency.h"
 #include "Grid2D.h"
+#include "Node.h"
 
 namespace ttcr {
     
@@ -100,6 +102,11 @@ namespace ttcr {
         const T2 getNcx() const { return ncx; }
         const T2 getNcz() const { return ncz; }
         
+        // reinitialize traveltimes & parents of all nodes for thread threadNo
+        void reinitNodes(const size_t threadNo) const {
+            storage.reinit(threadNo, nodes.size());
+        }
+        
     protected:
         size_t nThreads;
         T1 dx;           // cell size in x
@@ -113,8 +120,11 @@ namespace ttcr {
         
         mutable std::vector<NODE> nodes;
         
-        std::vector<std::vector<T2>> neighbors;  // nodes common to a cell
+        Adjacency<T2> neighbors;                 // nodes common to a cell
+        mutable threadStorage<T1,T2> storage;   // traveltimes & parents of nodes
+        mutable std::vector<threadWorkspace> workspace;  // flags of nodes, for each thread
         void buildGridNeighbors();
+        void attachStorage();
         
         T1 computeDt(const NODE& source, const NODE& node) const {
             return (node.getNodeSlowness()+source.getNodeSlowness())/2 * source.getDistance( node );
@@ -124,7 +134,7 @@ namespace ttcr {
             return (slo+source.getNodeSlowness())/2 * source.getDistance( node );
         }
         
-        void checkPts(const std::vector<sxz<T1>>&) const;
+        void checkPts(const std::vector<sxz<T1>>&, const size_t threadNo=0) const;
         
         bool inPolygon(const sxz<T1>& p, const sxz<T1> poly[], const size_t N) const;
         
@@ -168,15 +178,15 @@ namespace ttcr {
             j = static_cast<long long>( small + (pt.z-zmin)/dz );
         }
         
-        void sweep(const std::vector<bool>& frozen,
+        void sweep(const NodeFlags& frozen,
                    const size_t threadNo) const;
-        void sweep45(const std::vector<bool>& frozen,
+        void sweep45(const NodeFlags& frozen,
                      const size_t threadNo) const;
-        void sweep_xz(const std::vector<bool>& frozen,
+        void sweep_xz(const NodeFlags& frozen,
                       const size_t threadNo) const;
-        void sweep_weno3(const std::vector<bool>& frozen,
+        void sweep_weno3(const NodeFlags& frozen,
                          const size_t threadNo) const;
-        void sweep_weno3_xz(const std::vector<bool>& frozen,
+        void sweep_weno3_xz(const NodeFlags& frozen,
                             const size_t threadNo) const;
         
         void update_node(const size_t, const size_t, const size_t=0) const;
@@ -186,7 +196,7 @@ namespace ttcr {
         void update_node_weno3_xz(const size_t, const size_t, const size_t=0) const;
         
         void initFSM(const std::vector<sxz<T1>>& Tx,
-                     const std::vector<T1>& t0, std::vector<bool>& frozen,
+                     const std::vector<T1>& t0, NodeFlags& frozen,
                      const int npts, const size_t threadNo) const;
         
         T1 getSlowness(const sxz<T1>& Rx) const;
@@ -200,24 +210,36 @@ namespace ttcr {
     
     template<typename T1, typename T2, typename NODE>
     Grid2Drn<T1,T2,NODE>::Grid2Drn(const T2 nx, const T2 nz, const T1 ddx, const T1 ddz,
-                                   const T1 minx, const T1 minz, const size_t nt) : nThreads(nt),
+                                   const T1 minx, const T1 minz, const size_t nt) :
+    Grid2D<T1,T2,sxz<T1>>(nt), nThreads(nt),
     dx(ddx), dz(ddz), xmin(minx), zmin(minz), xmax(minx+nx*ddx), zmax(minz+nz*ddz),
     ncx(nx), ncz(nz),
-    nodes(std::vector<NODE>( (ncx+1) * (ncz+1), NODE(nt) )),
-    neighbors(std::vector<std::vector<T2>>(ncx*ncz))
+    nodes(std::vector<NODE>( (ncx+1) * (ncz+1), NODE(nt, sharedStorage_t()) )),
+    neighbors(ncx*ncz),
+    storage(),
+    workspace(nt)
     { }
     
     template<typename T1, typename T2, typename NODE>
     void Grid2Drn<T1,T2,NODE>::buildGridNeighbors() {
-        for ( T2 n=0; n<nodes.size(); ++n ) {
-            for ( size_t n2=0; n2<nodes[n].getOwners().size(); ++n2) {
-                neighbors[ nodes[n].getOwners()[n2] ].push_back(n);
-            }
+        // Index the neighbors nodes of each cell
+        neighbors.buildFromOwners(nodes);
+        attachStorage();
+    }
+    
+    // per-thread values of the nodes are held in storage, thread by thread
+    template<typename T1, typename T2, typename NODE>
+    void Grid2Drn<T1,T2,NODE>::attachStorage() {
+        NODE::allocateStorage(storage, nodes.size(), nThreads);
+        for ( size_t n=0; n<nodes.size(); ++n ) {
+            nodes[n].setStorage(storage, n, nodes.size());
         }
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid2Drn<T1,T2,NODE>::checkPts(const std::vector<sxz<T1>>& pts) const {
+    void Grid2Drn<T1,T2,NODE>::checkPts(const std::vector<sxz<T1>>& pts,
+                                        const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, CHECK_PTS);
         for (size_t n=0; n<pts.size(); ++n) {
             if ( pts[n].x < xmin || pts[n].x > xmax ||
                 pts[n].z < zmin || pts[n].z > zmax ) {
@@ -274,6 +296,7 @@ namespace ttcr {
     
     template<typename T1, typename T2, typename NODE>
     T1 Grid2Drn<T1,T2,NODE>::getTraveltime(const sxz<T1> &pt, const size_t nt) const {
+        PhaseTimer phaseTimer(this->instrumentation, nt, GET_TT);
         
         // bilinear interpolation if not on node
         
@@ -334,6 +357,7 @@ namespace ttcr {
     T1 Grid2Drn<T1,T2,NODE>::getTraveltime(const sxz<T1>& Rx,
                                            T2& nodeParentRx, T2& cellParentRx,
                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
             if ( nodes[nn] == Rx ) {
@@ -698,7 +722,7 @@ namespace ttcr {
         
         // compute average gradient for cell (i,j)
         
-        static const size_t nnz = ncz+1;
+        const size_t nnz = ncz+1;
         
         g.x = 0.5*(( nodes[(i+1)*nnz+j].getTT(nt)+nodes[(i+1)*nnz+j+1].getTT(nt) ) -
                    ( nodes[    i*nnz+j].getTT(nt)+nodes[    i*nnz+j+1].getTT(nt) ))/dx;
@@ -726,6 +750,7 @@ namespace ttcr {
                                           const sxz<T1> &Rx,
                                           std::vector<sxz<T1>> &r_data,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         r_data.push_back( Rx );
         
@@ -796,6 +821,7 @@ namespace ttcr {
                                               const sxz<T1> &Rx,
                                               std::vector<sxz<T1>> &r_data,
                                               const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         r_data.push_back( Rx );
         
@@ -1438,8 +1464,9 @@ namespace ttcr {
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid2Drn<T1,T2,NODE>::sweep(const std::vector<bool>& frozen,
+    void Grid2Drn<T1,T2,NODE>::sweep(const NodeFlags& frozen,
                                      const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         //    std::cout << '\n';
         //    for ( int j=ncz; j>=0; --j ) {
@@ -1516,8 +1543,9 @@ namespace ttcr {
     
     
     template<typename T1, typename T2, typename NODE>
-    void Grid2Drn<T1,T2,NODE>::sweep45(const std::vector<bool>& frozen,
+    void Grid2Drn<T1,T2,NODE>::sweep45(const NodeFlags& frozen,
                                        const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         // sweep first direction
         for ( size_t i=0; i<=ncx; ++i ) {
@@ -1557,8 +1585,9 @@ namespace ttcr {
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid2Drn<T1,T2,NODE>::sweep_xz(const std::vector<bool>& frozen,
+    void Grid2Drn<T1,T2,NODE>::sweep_xz(const NodeFlags& frozen,
                                         const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         // sweep first direction
         for ( size_t i=0; i<=ncx; ++i ) {
@@ -1598,8 +1627,9 @@ namespace ttcr {
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid2Drn<T1,T2,NODE>::sweep_weno3(const std::vector<bool>& frozen,
+    void Grid2Drn<T1,T2,NODE>::sweep_weno3(const NodeFlags& frozen,
                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         // sweep first direction
         for ( size_t i=0; i<=ncx; ++i ) {
@@ -1639,8 +1669,9 @@ namespace ttcr {
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid2Drn<T1,T2,NODE>::sweep_weno3_xz(const std::vector<bool>& frozen,
+    void Grid2Drn<T1,T2,NODE>::sweep_weno3_xz(const NodeFlags& frozen,
                                               const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         // sweep first direction
         for ( size_t i=0; i<=ncx; ++i ) {
@@ -1682,6 +1713,7 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE>
     void Grid2Drn<T1,T2,NODE>::update_node(const size_t i, const size_t j,
                                            const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         T1 a, b, t;
         if (i==0)
@@ -1719,6 +1751,7 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE>
     void Grid2Drn<T1,T2,NODE>::update_node45(const size_t i, const size_t j,
                                              const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         // stencil rotated pi/4
         
         T1 a, b, t;
@@ -1781,6 +1814,7 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE>
     void Grid2Drn<T1,T2,NODE>::update_node_xz(const size_t i, const size_t j,
                                               const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         T1 a, b, t;
         if (i==0)
@@ -1823,6 +1857,7 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE>
     void Grid2Drn<T1,T2,NODE>::update_node_weno3(const size_t i, const size_t j,
                                                  const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         // not valid if dx != dz
         
@@ -1979,6 +2014,7 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE>
     void Grid2Drn<T1,T2,NODE>::update_node_weno3_xz(const size_t i, const size_t j,
                                                     const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         T1 a, b, t;
         if (i==0) {
@@ -2122,8 +2158,9 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE>
     void Grid2Drn<T1,T2,NODE>::initFSM(const std::vector<sxz<T1>>& Tx,
                                        const std::vector<T1>& t0,
-                                       std::vector<bool>& frozen, const int npts,
+                                       NodeFlags& frozen, const int npts,
                                        const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -13,10 +13,13 @@
 
 #include "Grid2Drn.h"
 #include "Node2Dnsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2>
+    template<typename T1, typename T2,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid2Drnsp : public Grid2Drn<T1,T2,Node2Dnsp<T1,T2>> {
     public:
         Grid2Drnsp(const T2 nx, const T2 nz, const T1 ddx, const T1 ddz,
@@ -87,34 +90,30 @@ namespace ttcr {
         
         void interpSlownessSecondary();
         
-        void propagate(std::priority_queue<Node2Dnsp<T1,T2>*,
-                       std::vector<Node2Dnsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+        void propagate(QUEUE<Node2Dnsp<T1,T2>,T1>& queue,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        const size_t threadNo) const;
         
         void initQueue(const std::vector<sxz<T1>>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<Node2Dnsp<T1,T2>*,
-                       std::vector<Node2Dnsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<Node2Dnsp<T1,T2>,T1>& queue,
                        std::vector<Node2Dnsp<T1,T2>>& txNodes,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        const size_t threadNo) const;
         
     private:
         Grid2Drnsp() {}
-        Grid2Drnsp(const Grid2Drnsp<T1,T2>& g) {}
-        Grid2Drnsp<T1,T2>& operator=(const Grid2Drnsp<T1,T2>& g) {}
+        Grid2Drnsp(const Grid2Drnsp<T1,T2,QUEUE>& g) {}
+        Grid2Drnsp<T1,T2,QUEUE>& operator=(const Grid2Drnsp<T1,T2,QUEUE>& g) {}
         
     };
     
-    template<typename T1, typename T2>
-    Grid2Drnsp<T1,T2>::Grid2Drnsp(const T2 nx, const T2 nz, const T1 ddx, const T1 ddz,
-                                  const T1 minx, const T1 minz, const T2 nnx, const T2 nnz,
-                                  const size_t nt) :
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    Grid2Drnsp<T1,T2,QUEUE>::Grid2Drnsp(const T2 nx, const T2 nz, const T1 ddx, const T1 ddz,
+                                        const T1 minx, const T1 minz, const T2 nnx, const T2 nnz,
+                                        const size_t nt) :
     Grid2Drn<T1,T2,Node2Dnsp<T1,T2>>(nx,nz,ddx,ddz,minx,minz,nt),
     nsnx(nnx), nsnz(nnz), nsgx(0), nsgz(0),
     nPrimary((nx+1) * (nz+1))
@@ -123,15 +122,15 @@ namespace ttcr {
         this->buildGridNeighbors();
     }
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::buildGridNodes() {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::buildGridNodes() {
         
         this->nodes.resize( // noeuds secondaires
                            this->ncx*nsnx*(this->ncz+1) +
                            this->ncz*nsnz*(this->ncx+1) +
                            // noeuds primaires
                            (this->ncx+1) * (this->ncz+1),
-                           Node2Dnsp<T1,T2>(this->nThreads));
+                           Node2Dnsp<T1,T2>(this->nThreads, sharedStorage_t()));
         
         
         T1 dxs = this->dx/(nsnx+1);
@@ -254,8 +253,8 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::interpSlownessSecondary() {  // TODO : test this
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::interpSlownessSecondary() {  // TODO : test this
         
         T1 dxs = this->dx/(nsnx+1);
         T1 dzs = this->dz/(nsnz+1);
@@ -302,16 +301,15 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::initQueue(const std::vector<sxz<T1>>& Tx,
-                                      const std::vector<T1>& t0,
-                                      std::priority_queue<Node2Dnsp<T1,T2>*,
-                                      std::vector<Node2Dnsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<Node2Dnsp<T1,T2>>& txNodes,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::initQueue(const std::vector<sxz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            QUEUE<Node2Dnsp<T1,T2>,T1>& queue,
+                                            std::vector<Node2Dnsp<T1,T2>>& txNodes,
+                                            NodeFlags& inQueue,
+                                            NodeFlags& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -320,6 +318,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     queue.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inQueue[nn] = true;
                     frozen[nn] = true;
                     break;
@@ -334,6 +333,7 @@ namespace ttcr {
                                                              txNodes.size()-1) );
                 
                 queue.push( &(txNodes.back()) );
+                this->instrumentation.count(threadNo, QUEUE_PUSH);
                 inQueue.push_back( true );
                 frozen.push_back( true );
             }
@@ -341,27 +341,25 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+        
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dnsp<T1,T2>*, std::vector<Node2Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node2Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -376,28 +374,26 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dnsp<T1,T2>*, std::vector<Node2Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node2Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -414,27 +410,25 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxz<T1>>>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxz<T1>>>& r_data,
+                                           const size_t threadNo) const {
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dnsp<T1,T2>*, std::vector<Node2Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+        
+        this->reinitNodes( threadNo );
+        
+        QUEUE<Node2Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         std::vector<Node2Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -456,6 +450,7 @@ namespace ttcr {
             
             traveltimes[n] = this->getTraveltime(Rx[n], nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node2Dnsp<T1,T2>> *node_p;
@@ -506,29 +501,27 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     std::vector<std::vector<std::vector<sxz<T1>>>*>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           std::vector<std::vector<std::vector<sxz<T1>>>*>& r_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dnsp<T1,T2>*, std::vector<Node2Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node2Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node2Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -557,6 +550,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = this->getTraveltime((*Rx[nr])[n],
                                                             nodeParentRx, cellParentRx,
                                                             threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
                 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -624,28 +618,26 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::raytrace(const std::vector<sxz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxz<double>>>& r_data,
-                                     std::vector<std::vector<siv<double>>>& l_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxz<double>>>& r_data,
+                                           std::vector<std::vector<siv<double>>>& l_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node2Dnsp<T1,T2>*, std::vector<Node2Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        this->reinitNodes( threadNo );
+        
+        QUEUE<Node2Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         std::vector<Node2Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -669,10 +661,13 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             
             traveltimes[n] = this->getTraveltime(Rx[n], nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node2Dnsp<T1,T2>> *node_p;
@@ -692,15 +687,10 @@ namespace ttcr {
                 r_tmp.push_back( child );
                 
                 cell.v = (*node_p)[iParent].getDistance( child );
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -725,15 +715,10 @@ namespace ttcr {
             r_tmp.push_back( child );
             
             cell.v = (*node_p)[iParent].getDistance( child );
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -756,16 +741,17 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid2Drnsp<T1,T2>::propagate( std::priority_queue<Node2Dnsp<T1,T2>*, std::vector<Node2Dnsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid2Drnsp<T1,T2,QUEUE>::propagate( QUEUE<Node2Dnsp<T1,T2>,T1>& queue,
+                                            NodeFlags& inQueue,
+                                            NodeFlags& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !queue.empty() ) {
             const Node2Dnsp<T1,T2>* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
             
@@ -781,6 +767,7 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->computeDt(*source, this->nodes[neibNo]);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     if ( source->getTT(threadNo)+dt < this->nodes[neibNo].getTT(threadNo) ) {
                         this->nodes[neibNo].setTT( source->getTT(threadNo)+dt, threadNo );
@@ -789,7 +776,11 @@ namespace ttcr {
                         
                         if ( !inQueue[neibNo] ) {
                             queue.push( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                             inQueue[neibNo] = true;
+                        } else {
+                            queue.update( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                         }
                     }
                 }
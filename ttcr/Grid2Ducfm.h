@@ -48,10 +48,12 @@
 #include <queue>
 
 #include "Grid2Duc.h"
+#include "PriorityQueue.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2, typename NODE, typename S>
+    template<typename T1, typename T2, typename NODE, typename S,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid2Ducfm : public Grid2Duc<T1,T2,NODE,S> {
     public:
         Grid2Ducfm(const std::vector<S>& no,
@@ -98,26 +100,22 @@ namespace ttcr {
         
         void initBand(const std::vector<S>& Tx,
                       const std::vector<T1>& t0,
-                      std::priority_queue<NODE*,
-                      std::vector<NODE*>,
-                      CompareNodePtr<T1>>&,
+                      QUEUE<NODE,T1>&,
                       std::vector<NODE>&,
                       std::vector<bool>&,
                       std::vector<bool>&,
                       const size_t) const;
         
-        void propagate(std::priority_queue<NODE*,
-                       std::vector<NODE*>,
-                       CompareNodePtr<T1>>&,
+        void propagate(QUEUE<NODE,T1>&,
                        std::vector<bool>&,
                        std::vector<bool>&,
                        const size_t) const;
         
     };
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducfm<T1,T2,NODE,S>::buildGridNodes(const std::vector<S>& no,
-                                                  const size_t nt) {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducfm<T1,T2,NODE,S,QUEUE>::buildGridNodes(const std::vector<S>& no,
+                                                        const size_t nt) {
         
         // primary nodes
         for ( T2 n=0; n<no.size(); ++n ) {
@@ -155,23 +153,21 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducfm<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducfm<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<NODE,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -190,24 +186,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducfm<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<const std::vector<S>*>& Rx,
-                                            std::vector<std::vector<T1>*>& traveltimes,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducfm<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<const std::vector<S>*>& Rx,
+                                                  std::vector<std::vector<T1>*>& traveltimes,
+                                                  const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<NODE,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
         std::vector<bool> inBand( this->nodes.size(), false );
@@ -229,24 +223,22 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducfm<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            std::vector<std::vector<S>>& r_data,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducfm<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  std::vector<std::vector<S>>& r_data,
+                                                  const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<NODE,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -272,25 +264,23 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducfm<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<const std::vector<S>*>& Rx,
-                                            std::vector<std::vector<T1>*>& traveltimes,
-                                            std::vector<std::vector<std::vector<S>>*>& r_data,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducfm<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<const std::vector<S>*>& Rx,
+                                                  std::vector<std::vector<T1>*>& traveltimes,
+                                                  std::vector<std::vector<std::vector<S>>*>& r_data,
+                                                  const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<NODE,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
         std::vector<bool> inBand( this->nodes.size(), false );
@@ -323,16 +313,15 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducfm<T1,T2,NODE,S>::initBand(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            std::priority_queue<NODE*,
-                                            std::vector<NODE*>,
-                                            CompareNodePtr<T1>>& narrow_band,
-                                            std::vector<NODE>& txNodes,
-                                            std::vector<bool>& inBand,
-                                            std::vector<bool>& frozen,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducfm<T1,T2,NODE,S,QUEUE>::initBand(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  QUEUE<NODE,T1>& narrow_band,
+                                                  std::vector<NODE>& txNodes,
+                                                  std::vector<bool>& inBand,
+                                                  std::vector<bool>& frozen,
+                                                  const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -341,6 +330,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     narrow_band.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inBand[nn] = true;
                     frozen[nn] = true;
                     
@@ -353,14 +343,19 @@ namespace ttcr {
                                 T2 neibNo = this->neighbors[cellNo][k];
                                 if ( neibNo == nn ) continue;
                                 T1 dt = this->computeDt(this->nodes[nn], this->nodes[neibNo], cellNo);
+                                this->instrumentation.count(threadNo, LOCAL_UPDATE);
                                 
                                 if ( t0[n]+dt < this->nodes[neibNo].getTT(threadNo) ) {
                                     this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
                                     
                                     if ( !inBand[neibNo] ) {
                                         narrow_band.push( &(this->nodes[neibNo]) );
+                                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                                         inBand[neibNo] = true;
                                         frozen[neibNo] = true;
+                                    } else {
+                                        narrow_band.update( &(this->nodes[neibNo]) );
+                                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                     }
                                 }
                             }
@@ -378,9 +373,11 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->computeDt(this->nodes[neibNo], Tx[n], cellNo);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
                     narrow_band.push( &(this->nodes[neibNo]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inBand[neibNo] = true;
                     frozen[neibNo] = true;
                     
@@ -389,19 +386,19 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducfm<T1,T2,NODE,S>::propagate(std::priority_queue<NODE*,
-                                             std::vector<NODE*>,
-                                             CompareNodePtr<T1>>& narrow_band,
-                                             std::vector<bool>& inNarrowBand,
-                                             std::vector<bool>& frozen,
-                                             const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducfm<T1,T2,NODE,S,QUEUE>::propagate(QUEUE<NODE,T1>& narrow_band,
+                                                   std::vector<bool>& inNarrowBand,
+                                                   std::vector<bool>& frozen,
+                                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         //    size_t n=1;
         while ( !narrow_band.empty() ) {
             
             const NODE* source = narrow_band.top();
             narrow_band.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inNarrowBand[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;   // marked as known
             
@@ -419,7 +416,11 @@ namespace ttcr {
                     
                     if ( !inNarrowBand[neibNo] ) {
                         narrow_band.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inNarrowBand[neibNo] = true;
+                    } else {
+                        narrow_band.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
@@ -192,8 +192,8 @@ namespace ttcr {
                                             std::vector<T1>& traveltimes,
                                             const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
@@ -269,9 +269,9 @@ namespace ttcr {
                                             std::vector<std::vector<T1>*>& traveltimes,
                                             const size_t threadNo) const {
         
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
@@ -403,6 +403,7 @@ namespace ttcr {
                                           const std::vector<T1>& t0,
                                           std::vector<bool>& frozen,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -34,10 +34,13 @@
 
 #include "Grid2Duc.h"
 #include "Node2Dcsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 
 namespace ttcr {
 
-    template<typename T1, typename T2, typename NODE, typename S>
+    template<typename T1, typename T2, typename NODE, typename S,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid2Ducsp : public Grid2Duc<T1,T2,NODE,S> {
     public:
         Grid2Ducsp(const std::vector<S>& no,
@@ -93,27 +96,23 @@ namespace ttcr {
 
         void initQueue(const std::vector<S>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<NODE*,
-                       std::vector<NODE*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<NODE,T1>& queue,
                        std::vector<NODE>& txNodes,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
                        const size_t threadNo) const;
 
-        void propagate(std::priority_queue<NODE*,
-                       std::vector<NODE*>,
-                       CompareNodePtr<T1>>& queue,
+        void propagate(QUEUE<NODE,T1>& queue,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
                        const size_t threadNo) const;
 
     };
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::buildGridNodes(const std::vector<S>& no,
-                                                  const int nsecondary,
-                                                  const size_t nt) {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::buildGridNodes(const std::vector<S>& no,
+                                                        const int nsecondary,
+                                                        const size_t nt) {
 
         // primary nodes
         for ( T2 n=0; n<no.size(); ++n ) {
@@ -171,23 +170,21 @@ namespace ttcr {
         this->nodes.shrink_to_fit();
     }
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  const size_t threadNo) const {
 
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
 
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
 
         std::vector<NODE> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -206,24 +203,22 @@ namespace ttcr {
         }
     }
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<const std::vector<S>*>& Rx,
-                                            std::vector<std::vector<T1>*>& traveltimes,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<const std::vector<S>*>& Rx,
+                                                  std::vector<std::vector<T1>*>& traveltimes,
+                                                  const size_t threadNo) const {
 
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
 
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
 
         std::vector<NODE> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -245,24 +240,22 @@ namespace ttcr {
         }
     }
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            std::vector<std::vector<S>>& r_data,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  std::vector<std::vector<S>>& r_data,
+                                                  const size_t threadNo) const {
 
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
 
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
 
         std::vector<NODE> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -288,6 +281,7 @@ namespace ttcr {
 
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx,
                                                  cellParentRx, threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
 
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -348,25 +342,23 @@ namespace ttcr {
         }
     }
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<const std::vector<S>*>& Rx,
-                                            std::vector<std::vector<T1>*>& traveltimes,
-                                            std::vector<std::vector<std::vector<S>>*>& r_data,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<const std::vector<S>*>& Rx,
+                                                  std::vector<std::vector<T1>*>& traveltimes,
+                                                  std::vector<std::vector<std::vector<S>>*>& r_data,
+                                                  const size_t threadNo) const {
 
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
 
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
 
         std::vector<NODE> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -399,6 +391,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = this->getTraveltime((*Rx[nr])[n], this->nodes,
                                                             nodeParentRx, cellParentRx,
                                                             threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -460,25 +453,23 @@ namespace ttcr {
         }
     }
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            std::vector<std::vector<S>>& r_data,
-                                            std::vector<std::vector<siv<T1>>>& l_data,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  std::vector<std::vector<S>>& r_data,
+                                                  std::vector<std::vector<siv<T1>>>& l_data,
+                                                  const size_t threadNo) const {
 
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
 
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
 
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
 
         std::vector<NODE> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -506,9 +497,12 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
 
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
 
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -542,15 +536,10 @@ namespace ttcr {
                 r_tmp.push_back( child );
 
                 cell.v = (*node_p)[iParent].getDistance( child );
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
 
@@ -574,15 +563,10 @@ namespace ttcr {
             r_tmp.push_back( child );
 
             cell.v = (*node_p)[iParent].getDistance( child );
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
 
@@ -603,16 +587,15 @@ namespace ttcr {
     }
 
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::initQueue(const std::vector<S>& Tx,
-                                             const std::vector<T1>& t0,
-                                             std::priority_queue<NODE*,
-                                             std::vector<NODE*>,
-                                             CompareNodePtr<T1>>& queue,
-                                             std::vector<NODE>& txNodes,
-                                             std::vector<bool>& inQueue,
-                                             std::vector<bool>& frozen,
-                                             const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::initQueue(const std::vector<S>& Tx,
+                                                   const std::vector<T1>& t0,
+                                                   QUEUE<NODE,T1>& queue,
+                                                   std::vector<NODE>& txNodes,
+                                                   std::vector<bool>& inQueue,
+                                                   std::vector<bool>& frozen,
+                                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
 
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -621,6 +604,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     queue.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inQueue[nn] = true;
                     frozen[nn] = true;
                     break;
@@ -634,6 +618,7 @@ namespace ttcr {
                                                              txNodes.size()-1) );
 
                 queue.push( &(txNodes.back()) );
+                this->instrumentation.count(threadNo, QUEUE_PUSH);
                 inQueue.push_back( true );
                 frozen.push_back( true );
             }
@@ -641,13 +626,12 @@ namespace ttcr {
     }
 
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Ducsp<T1,T2,NODE,S>::propagate(std::priority_queue<NODE*,
-                                             std::vector<NODE*>,
-                                             CompareNodePtr<T1>>& queue,
-                                             std::vector<bool>& inQueue,
-                                             std::vector<bool>& frozen,
-                                             const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Ducsp<T1,T2,NODE,S,QUEUE>::propagate(QUEUE<NODE,T1>& queue,
+                                                   std::vector<bool>& inQueue,
+                                                   std::vector<bool>& frozen,
+                                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
 
 #ifdef DEBUG_OF
         std::string fname;
@@ -658,6 +642,7 @@ namespace ttcr {
 
             const NODE* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
 
@@ -699,6 +684,7 @@ namespace ttcr {
 #endif
                     // compute dt
                     T1 dt = this->computeDt(*source, this->nodes[neibNo], cellNo);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
 
                     if (source->getTT(threadNo)+dt < this->nodes[neibNo].getTT(threadNo)) {
                         this->nodes[neibNo].setTT( source->getTT(threadNo)+dt, threadNo );
@@ -707,7 +693,11 @@ namespace ttcr {
 
                         if ( !inQueue[neibNo] ) {
                             queue.push( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                             inQueue[neibNo] = true;
+                        } else {
+                            queue.update( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                         }
                     }
                 }
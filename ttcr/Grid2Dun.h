@@ -33,9 +33,11 @@
 
 #include <boost/math/special_functions/sign.hpp>
 
+#include "Adjacency.h"
 #include "Grad.h"
 #include "Grid2D.h"
 #include "Interpolator.h"
+#include "Node.h"
 
 namespace ttcr {
     
@@ -45,11 +47,12 @@ namespace ttcr {
         Grid2Dun(const std::vector<S>& no,
                  const std::vector<triangleElem<T2>>& tri,
                  const size_t nt=1) :
+        Grid2D<T1,T2,S>(nt),
         nThreads(nt),
         nPrimary(static_cast<T2>(no.size())),
-        nodes(std::vector<NODE>(no.size(), NODE(nt))),
-        neighbors(std::vector<std::vector<T2>>(tri.size())),
-        triangles(), virtualNodes()
+        nodes(std::vector<NODE>(no.size(), NODE(nt, sharedStorage_t()))),
+        neighbors(tri.size()),
+        triangles(), virtualNodes(), storage(), workspace(nt)
         {
             for (auto it=tri.begin(); it!=tri.end(); ++it) {
                 triangles.push_back( *it );
@@ -86,7 +89,8 @@ namespace ttcr {
             nodes[nn].setTT(tt, nt);
         }
         
-        size_t getNumberOfNodes(bool primary=false) const {
+        size_t getNumberOfNodes() const { return nodes.size(); }
+        size_t getNumberOfNodes(const bool primary) const {
             if ( primary ) {
                 size_t nn = 0;
                 for ( size_t n=0; n<nodes.size(); ++n ) {
@@ -123,6 +127,8 @@ namespace ttcr {
             return zmax;
         }
         
+        void setInputOrder(const std::vector<T2>& o) { inputOrder = o; }
+        
         void saveTT(const std::string &, const int, const size_t nt=0,
                     const bool vtkFormat=0) const;
         
@@ -139,20 +145,33 @@ namespace ttcr {
         
         const size_t getNthreads() const { return nThreads; }
         
+        // reinitialize traveltimes & parents of all nodes for thread threadNo
+        void reinitNodes(const size_t threadNo) const {
+            storage.reinit(threadNo, nodes.size());
+        }
+        
     protected:
         const size_t nThreads;
         T2 nPrimary;
         mutable std::vector<NODE> nodes;
-        std::vector<std::vector<T2>> neighbors;  // nodes common to a cell
+        Adjacency<T2> neighbors;                 // nodes common to a cell
         std::vector<triangleElemAngle<T1,T2>> triangles;
+        std::vector<T2> inputOrder;  // grid index of input nodes, empty if not renumbered
         std::map<T2, virtualNode<T1,NODE>> virtualNodes;
+        mutable threadStorage<T1,T2> storage;   // traveltimes & parents of nodes
+        mutable std::vector<threadWorkspace> workspace;  // flags of nodes, for each thread
         
         void buildGridNeighbors() {
             // Index the neighbors nodes of each cell
-            for ( T2 n=0; n<nodes.size(); ++n ) {
-                for ( size_t n2=0; n2<nodes[n].getOwners().size(); ++n2) {
-                    neighbors[ nodes[n].getOwners()[n2] ].push_back(n);
-                }
+            neighbors.buildFromOwners(nodes);
+            attachStorage();
+        }
+        
+        // per-thread values of the nodes are held in storage, thread by thread
+        void attachStorage() {
+            NODE::allocateStorage(storage, nodes.size(), nThreads);
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                nodes[n].setStorage(storage, n, nodes.size());
             }
         }
         
@@ -187,8 +206,8 @@ namespace ttcr {
                          const size_t threadNo) const;
         
         
-        void checkPts(const std::vector<sxz<T1>>&) const;
-        void checkPts(const std::vector<sxyz<T1>>&) const;
+        void checkPts(const std::vector<sxz<T1>>&, const size_t threadNo=0) const;
+        void checkPts(const std::vector<sxyz<T1>>&, const size_t threadNo=0) const;
         
         bool insideTriangle(const sxz<T1>&, const T2) const;
         bool insideTriangle(const sxyz<T1>&, const T2) const;
@@ -216,6 +235,7 @@ namespace ttcr {
     T1 Grid2Dun<T1,T2,NODE,S>::getTraveltime(const S& Rx,
                                              const std::vector<NODE>& nodes,
                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
             if ( nodes[nn] == Rx ) {
@@ -246,6 +266,7 @@ namespace ttcr {
                                              const std::vector<NODE>& nodes,
                                              T2& nodeParentRx, T2& cellParentRx,
                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
             if ( nodes[nn] == Rx ) {
@@ -331,7 +352,9 @@ namespace ttcr {
     }
 
     template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dun<T1,T2,NODE,S>::checkPts(const std::vector<sxz<T1>>& pts) const {
+    void Grid2Dun<T1,T2,NODE,S>::checkPts(const std::vector<sxz<T1>>& pts,
+                                          const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, CHECK_PTS);
         
         for (size_t n=0; n<pts.size(); ++n) {
             bool found = false;
@@ -358,7 +381,9 @@ namespace ttcr {
     }
     
     template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dun<T1,T2,NODE,S>::checkPts(const std::vector<sxyz<T1>>& pts) const {
+    void Grid2Dun<T1,T2,NODE,S>::checkPts(const std::vector<sxyz<T1>>& pts,
+                                          const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, CHECK_PTS);
         
         for (size_t n=0; n<pts.size(); ++n) {
             bool found = false;
@@ -494,9 +519,11 @@ namespace ttcr {
                 nMax = static_cast<T2>(nodes.size());
             }
             for ( T2 n=0; n<nMax; ++n ) {
-                fout << nodes[n].getX() << '\t'
-                << nodes[n].getZ() << '\t'
-                << nodes[n].getTT(nt) << '\n';
+                // primary nodes are written in the order of the input file
+                T2 nn = n<inputOrder.size() ? inputOrder[n] : n;
+                fout << nodes[nn].getX() << '\t'
+                << nodes[nn].getZ() << '\t'
+                << nodes[nn].getTT(nt) << '\n';
             }
             fout.close();
         }
@@ -721,6 +748,7 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE, typename S>
     void Grid2Dun<T1,T2,NODE,S>::localSolver(NODE *vertexC,
                                              const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         static const double pi2 = pi / 2.;
         T2 i0, i1, i2;
@@ -802,6 +830,7 @@ namespace ttcr {
                                                const sxz<T1> &Rx,
                                                std::vector<sxz<T1>> &r_data,
                                                const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         T1 minDist = small;
         r_data.push_back( Rx );
@@ -88,7 +88,7 @@ namespace ttcr {
                             const size_t);
         
         void initTx(const std::vector<S>& Tx, const std::vector<T1>& t0,
-                    std::vector<bool>& frozen, const size_t threadNo) const;
+                    NodeFlags& frozen, const size_t threadNo) const;
         
         
     };
@@ -172,14 +172,13 @@ namespace ttcr {
                                             std::vector<T1>& traveltimes,
                                             const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         initTx(Tx, t0, frozen, threadNo);
         
         std::vector<T1> times( this->nodes.size() );
@@ -249,15 +248,14 @@ namespace ttcr {
                                             std::vector<std::vector<T1>*>& traveltimes,
                                             const size_t threadNo) const {
         
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         initTx(Tx, t0, frozen, threadNo);
         
         std::vector<T1> times( this->nodes.size() );
@@ -380,8 +378,9 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE, typename S>
     void Grid2Dunfs<T1,T2,NODE,S>::initTx(const std::vector<S>& Tx,
                                           const std::vector<T1>& t0,
-                                          std::vector<bool>& frozen,
+                                          NodeFlags& frozen,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
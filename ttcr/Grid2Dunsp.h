@@ -32,10 +32,13 @@
 #include <stdexcept>
 
 #include "Grid2Dun.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2, typename NODE, typename S>
+    template<typename T1, typename T2, typename NODE, typename S,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid2Dunsp : public Grid2Dun<T1,T2,NODE,S> {
     public:
         Grid2Dunsp(const std::vector<S>& no,
@@ -133,26 +136,22 @@ namespace ttcr {
         
         void initQueue(const std::vector<S>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<NODE*,
-                       std::vector<NODE*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<NODE,T1>& queue,
                        std::vector<NODE>& txNodes,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        const size_t threadNo) const;
         
-        void propagate(std::priority_queue<NODE*,
-                       std::vector<NODE*>,
-                       CompareNodePtr<T1>>& queue,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+        void propagate(QUEUE<NODE,T1>& queue,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        const size_t threadNo) const;
         
     };
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::buildGridNodes(const std::vector<S>& no,
-                                                  const size_t nt) {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::buildGridNodes(const std::vector<S>& no,
+                                                        const size_t nt) {
         
         // primary nodes
         for ( T2 n=0; n<no.size(); ++n ) {
@@ -169,7 +168,7 @@ namespace ttcr {
         this->nodes.reserve( nNodes + estLineNo*nsecondary );
         
         // edge nodes
-        NODE tmpNode(nt);
+        NODE tmpNode(nt, sharedStorage_t());
         for ( T2 ntri=0; ntri<this->triangles.size(); ++ntri ) {
             
             for ( size_t nl=0; nl<3; ++nl ) {
@@ -212,8 +211,8 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::interpSlownessSecondary() {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::interpSlownessSecondary() {
         
         T2 nNodes = this->nPrimary;
         
@@ -254,27 +253,25 @@ namespace ttcr {
     
     
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+        
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -289,28 +286,26 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<const std::vector<S>*>& Rx,
-                                            std::vector<std::vector<T1>*>& traveltimes,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<const std::vector<S>*>& Rx,
+                                                  std::vector<std::vector<T1>*>& traveltimes,
+                                                  const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -328,28 +323,26 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            std::vector<std::vector<S>>& r_data,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  std::vector<std::vector<S>>& r_data,
+                                                  const size_t threadNo) const {
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+        
+        this->reinitNodes( threadNo );
+        
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -371,6 +364,7 @@ namespace ttcr {
             
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx,
                                                  cellParentRx, threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -431,29 +425,27 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<const std::vector<S>*>& Rx,
-                                            std::vector<std::vector<T1>*>& traveltimes,
-                                            std::vector<std::vector<std::vector<S>>*>& r_data,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<const std::vector<S>*>& Rx,
+                                                  std::vector<std::vector<T1>*>& traveltimes,
+                                                  std::vector<std::vector<std::vector<S>>*>& r_data,
+                                                  const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -482,6 +474,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = this->getTraveltime((*Rx[nr])[n], this->nodes,
                                                             nodeParentRx, cellParentRx,
                                                             threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
                 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -543,29 +536,27 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            std::vector<std::vector<S>>& r_data,
-                                            std::vector<std::vector<siv<T1>>>& l_data,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  std::vector<std::vector<S>>& r_data,
+                                                  std::vector<std::vector<siv<T1>>>& l_data,
+                                                  const size_t threadNo) const {
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+        
+        this->reinitNodes( threadNo );
+        
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -589,10 +580,13 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -626,15 +620,10 @@ namespace ttcr {
                 r_tmp.push_back( child );
                 
                 cell.v = (*node_p)[iParent].getDistance( child );
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -658,15 +647,10 @@ namespace ttcr {
             r_tmp.push_back( child );
             
             cell.v = (*node_p)[iParent].getDistance( child );
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -686,29 +670,27 @@ namespace ttcr {
         }
     }
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            std::vector<std::vector<S>>& r_data,
-                                            T1& v0,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  std::vector<std::vector<S>>& r_data,
+                                                  T1& v0,
+                                                  const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        this->reinitNodes( threadNo );
+        
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -736,6 +718,7 @@ namespace ttcr {
             
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -797,30 +780,28 @@ namespace ttcr {
         }
     }
 
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::raytrace(const std::vector<S>& Tx,
-                                            const std::vector<T1>& t0,
-                                            const std::vector<S>& Rx,
-                                            std::vector<T1>& traveltimes,
-                                            std::vector<std::vector<S>>& r_data,
-                                            T1& v0,
-                                            std::vector<std::vector<sijv<T1>>>& m_data,
-                                            const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::raytrace(const std::vector<S>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  const std::vector<S>& Rx,
+                                                  std::vector<T1>& traveltimes,
+                                                  std::vector<std::vector<S>>& r_data,
+                                                  T1& v0,
+                                                  std::vector<std::vector<sijv<T1>>>& m_data,
+                                                  const size_t threadNo) const {
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< NODE*, std::vector<NODE*>,
-        CompareNodePtr<T1>> queue( cmp );
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+        
+        this->reinitNodes( threadNo );
+        
+        QUEUE<NODE,T1> queue(threadNo, this->nodes.size());
         
         std::vector<NODE> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -853,12 +834,15 @@ namespace ttcr {
         v0 = Tx.size() / v0;
         
         //std::cout << "\nTx: " << Tx[0].x << ' ' << Tx[0].y << ' ' << Tx[0].z << std::endl;
+        RowIndex& rowIndex = this->workspace[threadNo].row;
         for (size_t n=0; n<Rx.size(); ++n) {
             //std::cout << "  Rx: " << Rx[n].x << ' ' << Rx[n].y << ' ' << Rx[n].z << std::endl;
             m.i = n;
+            rowIndex.clear();
             
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -925,15 +909,10 @@ namespace ttcr {
                         //std::cout << "       *it = " << *it << std::endl;
                         m.j = *it;
                         m.v = -1.0 / v * ds * w[nn++]/sum_w;
-                        bool found = false;
-                        for ( size_t nm=0; nm<m_data[n].size(); ++nm ) {
-                            if ( m_data[n][nm].j == m.j ) {
-                                m_data[n][nm].v += m.v;
-                                found = true;
-                                break;
-                            }
-                        }
-                        if ( found == false ) {
+                        size_t nm = rowIndex.insert(m.j, m_data[n].size());
+                        if ( nm < m_data[n].size() ) {
+                            m_data[n][nm].v += m.v;
+                        } else {
                             m_data[n].push_back(m);
                         }
                     }
@@ -984,15 +963,10 @@ namespace ttcr {
             for ( size_t nn=0; nn<3; ++nn ) {
                 m.j = this->triangles[cell].i[nn];
                 m.v = -1.0 / v * ds * w[nn]/sum_w;
-                bool found = false;
-                for ( size_t nnn=0; nnn<m_data[n].size(); ++nnn ) {
-                    if ( m_data[n][nnn].j == m.j ) {
-                        m_data[n][nnn].v += m.v;
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nnn = rowIndex.insert(m.j, m_data[n].size());
+                if ( nnn < m_data[n].size() ) {
+                    m_data[n][nnn].v += m.v;
+                } else {
                     m_data[n].push_back(m);
                 }
             }
@@ -1007,16 +981,15 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::initQueue(const std::vector<S>& Tx,
-                                             const std::vector<T1>& t0,
-                                             std::priority_queue<NODE*,
-                                             std::vector<NODE*>,
-                                             CompareNodePtr<T1>>& queue,
-                                             std::vector<NODE>& txNodes,
-                                             std::vector<bool>& inQueue,
-                                             std::vector<bool>& frozen,
-                                             const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::initQueue(const std::vector<S>& Tx,
+                                                   const std::vector<T1>& t0,
+                                                   QUEUE<NODE,T1>& queue,
+                                                   std::vector<NODE>& txNodes,
+                                                   NodeFlags& inQueue,
+                                                   NodeFlags& frozen,
+                                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -1025,6 +998,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     queue.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inQueue[nn] = true;
                     frozen[nn] = true;
                     break;
@@ -1040,6 +1014,7 @@ namespace ttcr {
                 txNodes.back().setNodeSlowness( this->computeSlowness( Tx[n], cellNo) );
                 
                 queue.push( &(txNodes.back()) );
+                this->instrumentation.count(threadNo, QUEUE_PUSH);
                 inQueue.push_back( true );
                 frozen.push_back( true );
             }
@@ -1047,18 +1022,18 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2, typename NODE, typename S>
-    void Grid2Dunsp<T1,T2,NODE,S>::propagate(std::priority_queue<NODE*,
-                                             std::vector<NODE*>,
-                                             CompareNodePtr<T1>>& queue,
-                                             std::vector<bool>& inQueue,
-                                             std::vector<bool>& frozen,
-                                             const size_t threadNo) const {
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    void Grid2Dunsp<T1,T2,NODE,S,QUEUE>::propagate(QUEUE<NODE,T1>& queue,
+                                                   NodeFlags& inQueue,
+                                                   NodeFlags& frozen,
+                                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         //    size_t n=1;
         while ( !queue.empty() ) {
             
             const NODE* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
             
@@ -1074,6 +1049,7 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->computeDt(*source, this->nodes[neibNo]);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     if (source->getTT(threadNo)+dt < this->nodes[neibNo].getTT(threadNo)) {
                         this->nodes[neibNo].setTT( source->getTT(threadNo)+dt, threadNo );
@@ -1082,7 +1058,11 @@ namespace ttcr {
                         
                         if ( !inQueue[neibNo] ) {
                             queue.push( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                             inQueue[neibNo] = true;
+                        } else {
+                            queue.update( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                         }
                     }
                 }
@@ -1090,9 +1070,9 @@ namespace ttcr {
         }
     }
  
-    template<typename T1, typename T2, typename NODE, typename S>
-    int Grid2Dunsp<T1,T2,NODE,S>::computeD(const std::vector<sxyz<T1>>& pts,
-                                           std::vector<std::vector<siv<T1>>>& d_data) const{
+    template<typename T1, typename T2, typename NODE, typename S, template<typename,typename> class QUEUE>
+    int Grid2Dunsp<T1,T2,NODE,S,QUEUE>::computeD(const std::vector<sxyz<T1>>& pts,
+                                                 std::vector<std::vector<siv<T1>>>& d_data) const{
         
         for ( size_t n=0; n<pts.size(); ++n ) {
             bool found = false;
@@ -27,6 +27,7 @@
 #ifndef ttcr_Grid3D_h
 #define ttcr_Grid3D_h
 
+#include "Instrumentation.h"
 #include "ttcr_t.h"
 
 namespace ttcr {
@@ -95,15 +96,31 @@ namespace ttcr {
                              std::vector<std::vector<siv<T1>>>& l_data,
                              const size_t threadNo=0) const {}
 
+        // several shots with the same receivers; grids able to propagate
+        // shots together override this
+        virtual void raytrace(const std::vector<const std::vector<sxyz<T1>>*>& Tx,
+                             const std::vector<const std::vector<T1>*>& t0,
+                             const std::vector<sxyz<T1>>& Rx,
+                             std::vector<std::vector<T1>*>& traveltimes,
+                             const size_t threadNo=0) const {
+            for ( size_t n=0; n<Tx.size(); ++n ) {
+                raytrace(*Tx[n], *t0[n], Rx, *traveltimes[n], threadNo);
+            }
+        }
+
         virtual void setSlowness(const std::vector<T1>& s) {}
         virtual void setChi(const std::vector<T1>& x) {}
         virtual void setPsi(const std::vector<T1>& x) {}
         
         virtual void setSourceRadius(const double) {}
+        virtual void setSourceRefinement(const int) {}
         
         virtual size_t getNumberOfNodes() const { return 1; }
         virtual size_t getNumberOfCells() const { return 1; }
         
+        // grid index of the nodes of the input file, when they were renumbered
+        virtual void setInputOrder(const std::vector<T2>&) {}
+        
         virtual void saveTT(const std::string &, const int, const size_t nt=0,
                             const bool vtkFormat=0) const {}
         
@@ -116,9 +133,28 @@ namespace ttcr {
         
         virtual const int get_niter() const { return 1; }
         virtual const int get_niterw() const { return 1; }
+        virtual const std::vector<T1> get_change(const size_t threadNo=0) const {
+            return std::vector<T1>();
+        }
+        virtual const std::vector<double> get_iteration_time(const size_t threadNo=0) const {
+            return std::vector<double>();
+        }
         
         virtual const size_t getNthreads() const { return 1; }
         
+        // memory used by the grid, in bytes: data shared by all threads, data
+        // of one thread (values & flags of the nodes, and queue when all
+        // nodes are in it), and total for getNthreads() threads
+        virtual size_t getSharedMemorySize() const { return 0; }
+        virtual size_t getThreadMemorySize() const { return 0; }
+        size_t getMemorySize() const {
+            return getSharedMemorySize() + getNthreads()*getThreadMemorySize();
+        }
+        
+        // phase timings and operation counters, see Instrumentation.h
+        const Instrumentation& getInstrumentation() const { return instrumentation; }
+        void resetInstrumentation() const { instrumentation.reset(); }
+        
 #ifdef VTK
         virtual void saveModelVTU(const std::string &, const bool saveSlowness=true,
                                   const bool savePhysicalEntity=false) const {}
@@ -126,6 +162,11 @@ namespace ttcr {
                                   const bool saveSlowness=true,
                                   const int verbose=0) const {}
 #endif
+        
+    protected:
+        Grid3D(const size_t nt=1) : instrumentation(nt) {}
+        
+        mutable Instrumentation instrumentation;
     };
     
 }
@@ -43,6 +43,7 @@
 #include <queue>
 #include <sstream>
 #include <stdexcept>
+#include <string>
 #include <vector>
 #include <ctime>
 
@@ -54,7 +55,9 @@
 #include "vtkXMLRectilinearGridWriter.h"
 #endif
 
+#include "Adjacency.h"
 #include "Grid3D.h"
+#include "GridCache.h"
 
 namespace ttcr {
     
@@ -66,6 +69,7 @@ namespace ttcr {
                  const T1 ddx, const T1 ddy, const T1 ddz,
                  const T1 minx, const T1 miny, const T1 minz,
                  const size_t nt=1) :
+        Grid3D<T1,T2>(nt),
         nThreads(nt),
         dx(ddx), dy(ddy), dz(ddz),
         xmin(minx), ymin(miny), zmin(minz),
@@ -73,7 +77,7 @@ namespace ttcr {
         ncx(nx), ncy(ny), ncz(nz),
         nodes(std::vector<NODE>((nx+1)*(ny+1)*(nz+1), NODE(nt))),
         cells(CELL(nx*ny*nz)),
-        neighbors(std::vector<std::vector<T2>>(nx*ny*nz))
+        neighbors(nx*ny*nz)
         { }
         
         virtual ~Grid3Drc() {}
@@ -141,16 +145,16 @@ namespace ttcr {
         void saveTT(const std::string &, const int, const size_t nt=0,
                     const bool vtkFormat=0) const;
         
+        // save nodes, owners & neighbors of the built grid, key identifying
+        // the data the grid was built from (see GridCache.h)
+        void saveGridCache(const std::string &, const uint64_t key) const;
+        
         //    size_t getSlownessSize() const {
         //        return slowness.size()*sizeof(T1);
         //    }
         
         size_t getNeighborsSize() const {
-            size_t n_elem = 0;
-            for ( size_t n=0; n<neighbors.size(); ++n ) {
-                n_elem += neighbors[n].size();
-            }
-            return n_elem*sizeof(size_t);
+            return neighbors.getSize();
         }
         
         size_t getNodesSize() const {
@@ -161,6 +165,32 @@ namespace ttcr {
             return size;
         }
         
+        size_t getSharedMemorySize() const {
+            size_t size = sizeof(*this) + cells.getSize() + neighbors.getSize() +
+            (nodes.capacity()-nodes.size())*sizeof(NODE);
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                size += nodes[n].getSharedSize();
+            }
+            return size;
+        }
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(nodes.size());
+        }
+        
+        // memory needed by nNodes nodes and nCells cells holding nNodesCell
+        // nodes each, to estimate the size of a grid before building it
+        static size_t estimateSharedMemorySize(const size_t nNodes,
+                                               const size_t nCells,
+                                               const size_t nNodesCell) {
+            // nodes & their owners, neighbors, and slowness of the cells
+            return nNodes*NODE::estimateSharedSize() + (nCells+1)*sizeof(size_t) +
+            2*nCells*nNodesCell*sizeof(T2) + nCells*sizeof(T1);
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // values of the nodes, and frozen & inQueue flags (std::vector<bool>)
+            return nNodes*NODE::getThreadSize() + (nNodes+3)/4;
+        }
+        
         virtual const int get_niter() const { return 0; }
         virtual const int get_niterw() const { return 0; }
         
@@ -193,7 +223,7 @@ namespace ttcr {
         mutable std::vector<NODE> nodes;
         
         CELL cells;   // column-wise (z axis) slowness vector of the cells, NOT used by Grid3Dcinterp
-        std::vector<std::vector<T2>> neighbors;  // nodes common to a cell
+        Adjacency<T2> neighbors;                 // nodes common to a cell
         
         
         T2 getCellNo(const sxyz<T1>& pt) const {
@@ -229,10 +259,14 @@ namespace ttcr {
             k = static_cast<long long>( small + (pt.z-zmin)/dz );
         }
         
-        void checkPts(const std::vector<sxyz<T1>>&) const;
+        void checkPts(const std::vector<sxyz<T1>>&, const size_t threadNo=0) const;
         
         void buildGridNeighbors();
         
+        // replaces the building of nodes and buildGridNeighbors, returns
+        // false if the file cannot be used
+        bool loadGridCache(const std::string &, const uint64_t key);
+        
         T1 getTraveltime(const sxyz<T1>& Rx,
                          const std::vector<NODE>& nodes,
                          const size_t threadNo) const;
@@ -251,19 +285,86 @@ namespace ttcr {
     
     
     
+    template<typename T1, typename T2, typename NODE, typename CELL>
+    void Grid3Drc<T1,T2,NODE,CELL>::saveGridCache(const std::string &fname,
+                                                  const uint64_t key) const {
+        GridCacheWriter cache(fname, key, sizeof(T1), sizeof(T2),
+                              nodes.size(), neighbors.size());
+        std::vector<T1> xyz(3*nodes.size());
+        std::vector<int> primary(nodes.size());
+        for ( size_t n=0; n<nodes.size(); ++n ) {
+            xyz[3*n] = nodes[n].getX();
+            xyz[3*n+1] = nodes[n].getY();
+            xyz[3*n+2] = nodes[n].getZ();
+            primary[n] = nodes[n].isPrimary();
+        }
+        cache.write(xyz);
+        cache.write(primary);
+        cache.template writeLists<T2>(nodes.size(), [this](const size_t n) -> const std::vector<T2>& {
+            return nodes[n].getOwners();
+        });
+        cache.template writeLists<T2>(neighbors.size(), [this](const size_t n) {
+            return neighbors[n];
+        });
+        cache.close();
+    }
+    
+    template<typename T1, typename T2, typename NODE, typename CELL>
+    bool Grid3Drc<T1,T2,NODE,CELL>::loadGridCache(const std::string &fname,
+                                                  const uint64_t key) {
+        const size_t nPrimary = (ncx+1) * (ncy+1) * (ncz+1);
+        try {
+            GridCacheReader cache(fname);
+            if ( !cache.template matches<T1,T2>(key) ||
+                 cache.getNnodes() < nPrimary || cache.getNcells() != neighbors.size() ) {
+                return false;
+            }
+            std::vector<T1> xyz;
+            std::vector<int> primary;
+            cache.read(xyz);
+            cache.read(primary);
+            if ( xyz.size() != 3*cache.getNnodes() || primary.size() != cache.getNnodes() ) {
+                return false;
+            }
+            nodes.clear();
+            nodes.resize(cache.getNnodes(), NODE(nThreads));
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                nodes[n].setXYZindex( xyz[3*n], xyz[3*n+1], xyz[3*n+2], static_cast<T2>(n) );
+                nodes[n].setPrimary( primary[n] != 0 );
+            }
+            cache.template readLists<T2>([this](const size_t n, const T2 *first, const T2 *last) {
+                if ( n >= nodes.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                for ( const T2 *o=first; o!=last; ++o ) nodes[n].pushOwner( *o );
+            });
+            neighbors.clear();
+            cache.template readLists<T2>([this](const size_t n, const T2 *first, const T2 *last) {
+                if ( n != neighbors.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                neighbors.append(first, last);
+            });
+            if ( neighbors.size() != ncx*ncy*ncz ) {
+                throw std::runtime_error("Error: grid cache corrupted.");
+            }
+        } catch ( std::exception& ) {
+            // back to the state of a grid whose nodes are not built
+            nodes.clear();
+            nodes.resize(nPrimary, NODE(nThreads));
+            neighbors = Adjacency<T2>(ncx*ncy*ncz);
+            return false;
+        }
+        return true;
+    }
+    
     template<typename T1, typename T2, typename NODE, typename CELL>
     void Grid3Drc<T1,T2,NODE,CELL>::buildGridNeighbors() {
         
         // Index the neighbors nodes of each cell
-        for ( T2 n=0; n<nodes.size(); ++n ) {
-            for ( size_t n2=0; n2<nodes[n].getOwners().size(); ++n2) {
-                neighbors[ nodes[n].getOwners()[n2] ].push_back(n);
-            }
-        }
+        neighbors.buildFromOwners(nodes);
     }
     
     template<typename T1, typename T2, typename NODE, typename CELL>
-    void Grid3Drc<T1,T2,NODE,CELL>::checkPts(const std::vector<sxyz<T1>>& pts) const {
+    void Grid3Drc<T1,T2,NODE,CELL>::checkPts(const std::vector<sxyz<T1>>& pts,
+                                             const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, CHECK_PTS);
         
         // Check if the points from a vector are in the grid
         for ( size_t n=0; n<pts.size(); ++n ) {
@@ -282,6 +383,7 @@ namespace ttcr {
     T1 Grid3Drc<T1,T2,NODE,CELL>::getTraveltime(const sxyz<T1>& Rx,
                                                 const std::vector<NODE>& nodes,
                                                 const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         // Calculate and return the traveltime for a Rx point.
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
@@ -309,6 +411,7 @@ namespace ttcr {
                                                 const std::vector<NODE>& nodes,
                                                 T2& nodeParentRx, T2& cellParentRx,
                                                 const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         // Calculate and return the traveltime for a Rx point.
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
@@ -13,6 +13,7 @@
 
 #include "Grid3Drn.h"
 #include "Node3Dn.h"
+#include "RowIndex.h"
 
 namespace ttcr {
     
@@ -22,8 +23,8 @@ namespace ttcr {
         Grid3Drcfs(const T2 nx, const T2 ny, const T2 nz, const T1 ddx,
                    const T1 minx, const T1 miny, const T1 minz,
                    const T1 eps, const int maxit, const bool w,
-                   const size_t nt=1) :
-        Grid3Drn<T1,T2,Node3Dn<T1,T2>>(nx, ny, nz, ddx, ddx, ddx, minx, miny, minz, nt),
+                   const size_t nt=1, const size_t nts=1) :
+        Grid3Drn<T1,T2,Node3Dn<T1,T2>>(nx, ny, nz, ddx, ddx, ddx, minx, miny, minz, nt, false, nts),
         epsilon(eps), nitermax(maxit), niter(0), niterw(0), weno3(w)
         {
             buildGridNodes();
@@ -79,6 +80,15 @@ namespace ttcr {
                      std::vector<std::vector<siv<T1>>>& l_data,
                      const size_t threadNo=0) const;
         
+        // memory needed by a grid of nx*ny*nz cells (see Grid3D::getMemorySize)
+        static void estimateMemorySize(const size_t nx, const size_t ny, const size_t nz,
+                                       size_t& shared, size_t& thread) {
+            const size_t nNodes = (nx+1) * (ny+1) * (nz+1);
+            shared = sizeof(Grid3Drcfs) +
+            Grid3Drn<T1,T2,Node3Dn<T1,T2>>::estimateSharedMemorySize(nNodes, nx*ny*nz, 8);
+            thread = Grid3Drn<T1,T2,Node3Dn<T1,T2>>::estimateThreadMemorySize(nNodes);
+        }
+        
     protected:
         T1 epsilon;
         int nitermax;
@@ -310,22 +320,19 @@ namespace ttcr {
                                      std::vector<T1>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
         // Set Tx pts
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         int npts = 1;
         if ( weno3 == true) npts = 2;
         this->initFSM(Tx, t0, frozen, npts, threadNo);
         
-        std::vector<T1> times( this->nodes.size() );
-        for ( size_t n=0; n<this->nodes.size(); ++n )
-            times[n] = this->nodes[n].getTT( threadNo );
+        this->itLog[threadNo].clear();
         
         T1 change = std::numeric_limits<T1>::max();
         if ( weno3 == true ) {
@@ -335,40 +342,24 @@ namespace ttcr {
                 throw std::logic_error("Error: WENO stencil needs dx equal to dz");
             }
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
             change = std::numeric_limits<T1>::max();
             while ( change >= epsilon && niterw<nitermax ) {
-                this->sweep_weno3(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep_weno3(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niterw++;
             }
         } else {
             niter=0;
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
         }
@@ -389,27 +380,24 @@ namespace ttcr {
                                      std::vector<std::vector<T1>*>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
         if ( traveltimes.size() != Rx.size() ) {
             traveltimes.resize( Rx.size() );
         }
         
         // Set Tx pts
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         int npts = 1;
         if ( weno3 == true) npts = 2;
         this->initFSM(Tx, t0, frozen, npts, threadNo);
         
-        std::vector<T1> times( this->nodes.size() );
-        for ( size_t n=0; n<this->nodes.size(); ++n )
-            times[n] = this->nodes[n].getTT( threadNo );
+        this->itLog[threadNo].clear();
         
         T1 change = std::numeric_limits<T1>::max();
         if ( weno3 == true ) {
@@ -419,40 +407,24 @@ namespace ttcr {
                 throw std::logic_error("Error: WENO stencil needs dx equal to dz");
             }
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
             change = std::numeric_limits<T1>::max();
             while ( change >= epsilon && niterw<nitermax ) {
-                this->sweep_weno3(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep_weno3(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niterw++;
             }
         } else {
             niter=0;
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
         }
@@ -532,7 +504,9 @@ namespace ttcr {
         }
         
         siv<T1> cell;
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             this->getRaypath(Tx, Rx[n], r_data, threadNo);
             
             for (size_t ns=0; ns<r_data.size()-1; ++ns) {
@@ -540,15 +514,10 @@ namespace ttcr {
                 cell.i = this->getCellNo( m );
                 cell.v = r_data[ns].getDistance( r_data[ns+1] );
                 
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
             }
@@ -582,7 +551,9 @@ namespace ttcr {
         }
         
         siv<T1> cell;
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             this->getRaypath(Tx, Rx[n], r_data[n], threadNo);
             
             for (size_t ns=0; ns<r_data[n].size()-1; ++ns) {
@@ -590,15 +561,10 @@ namespace ttcr {
                 cell.i = this->getCellNo( m );
                 cell.v = r_data[n][ns].getDistance( r_data[n][ns+1] );
                 
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
             }
@@ -39,14 +39,18 @@
 #include <iostream>
 #include <map>
 #include <queue>
+#include <string>
 #include <vector>
 
 #include "Grid3Drc.h"
 #include "Node3Dcsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2, typename CELL>
+    template<typename T1, typename T2, typename CELL,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid3Drcsp : public Grid3Drc<T1,T2,Node3Dcsp<T1,T2>,CELL> {
     public:
         
@@ -55,18 +59,30 @@ namespace ttcr {
          x cells size, y cells size, z cells size,
          x origin, y origin, z origin,
          nb sec. cells in x, nb sec. cells in y, nb sec. cells in z,
-         index of the thread)
+         number of threads, grid cache file)
          */
         Grid3Drcsp(const T2 nx, const T2 ny, const T2 nz,
                    const T1 ddx, const T1 ddy, const T1 ddz,
                    const T1 minx, const T1 miny, const T1 minz,
                    const T2 nnx, const T2 nny, const T2 nnz,
-                   const size_t nt) :
+                   const size_t nt, const std::string& cacheFile="") :
         Grid3Drc<T1,T2,Node3Dcsp<T1,T2>,CELL>(nx, ny, nz, ddx, ddy, ddz, minx, miny, minz, nt),
         nsnx(nnx), nsny(nny), nsnz(nnz)
         {
+            // nodes & neighbors are read from cacheFile if it was built
+            // for the same grid, otherwise they are built and saved in it
+            GridCacheKey key;
+            if ( !cacheFile.empty() ) {
+                key.add("Grid3Drcsp");
+                key.add(nx); key.add(ny); key.add(nz);
+                key.add(ddx); key.add(ddy); key.add(ddz);
+                key.add(minx); key.add(miny); key.add(minz);
+                key.add(nnx); key.add(nny); key.add(nnz);
+                if ( this->loadGridCache(cacheFile, key.value()) ) return;
+            }
             buildGridNodes();
             this->buildGridNeighbors();
+            if ( !cacheFile.empty() ) this->saveGridCache(cacheFile, key.value());
         }
         
         ~Grid3Drcsp() {
@@ -118,6 +134,37 @@ namespace ttcr {
         const T2 getNsny() const { return nsny; }
         const T2 getNsnz() const { return nsnz; }
         
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(this->nodes.size());
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // queue holding all nodes at worst
+            return Grid3Drc<T1,T2,Node3Dcsp<T1,T2>,CELL>::estimateThreadMemorySize(nNodes) +
+            nNodes*QUEUE<Node3Dcsp<T1,T2>,T1>::getNodeSize();
+        }
+        
+        // number of nodes of a grid of nx*ny*nz cells with nnx, nny & nnz
+        // secondary nodes, and memory it needs (see Grid3D::getMemorySize)
+        static size_t countNodes(const size_t nx, const size_t ny, const size_t nz,
+                                 const size_t nnx, const size_t nny, const size_t nnz) {
+            return // secondary nodes on the edges
+            nx*nnx*((ny+1)*(nz+1)) + ny*nny*((nx+1)*(nz+1)) + nz*nnz*((nx+1)*(ny+1)) +
+            // secondary nodes on the faces
+            (nnx*nny)*(nx*ny*(nz+1)) + (nnx*nnz)*(nx*nz*(ny+1)) + (nny*nnz)*(ny*nz*(nx+1)) +
+            // primary nodes
+            (nx+1) * (ny+1) * (nz+1);
+        }
+        static void estimateMemorySize(const size_t nx, const size_t ny, const size_t nz,
+                                       const size_t nnx, const size_t nny, const size_t nnz,
+                                       size_t& shared, size_t& thread) {
+            const size_t nNodes = countNodes(nx, ny, nz, nnx, nny, nnz);
+            // corners, and secondary nodes on the 12 edges & 6 faces
+            const size_t nNodesCell = 8 + 4*(nnx+nny+nnz) + 2*(nnx*nny+nnx*nnz+nny*nnz);
+            shared = sizeof(Grid3Drcsp) +
+            Grid3Drc<T1,T2,Node3Dcsp<T1,T2>,CELL>::estimateSharedMemorySize(nNodes, nx*ny*nz, nNodesCell);
+            thread = estimateThreadMemorySize(nNodes);
+        }
+        
     private:
         T2 nsnx;                 // number of secondary nodes in x
         T2 nsny;                 // number of secondary nodes in y
@@ -127,77 +174,54 @@ namespace ttcr {
         
         void initQueue(const std::vector<sxyz<T1>>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<Node3Dcsp<T1,T2>*,
-                       std::vector<Node3Dcsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                        std::vector<Node3Dcsp<T1,T2>>& txNodes,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
                        const size_t threadNo) const;
         
-        void propagate(std::priority_queue<Node3Dcsp<T1,T2>*,
-                       std::vector<Node3Dcsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+        void propagate(QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
                        size_t threadNo) const;
         
-        void propagate_lw(std::priority_queue<Node3Dcsp<T1,T2>*,
-                          std::vector<Node3Dcsp<T1,T2>*>,
-                          CompareNodePtr<T1>>& queue,
+        void propagate_lw(QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                           std::vector<bool>& inQueue,
                           std::vector<bool>& frozen,
                           size_t threadNo) const;
         
         void prepropagate(const Node3Dcsp<T1,T2>& node,
-                          std::priority_queue<Node3Dcsp<T1,T2>*,
-                          std::vector<Node3Dcsp<T1,T2>*>,
-                          CompareNodePtr<T1>>& queue,
+                          QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                           std::vector<bool>& inQueue,
                           std::vector<bool>& frozen,
                           size_t threadNo) const;
         
         void initQueue2(const std::vector<sxyz<T1>>& Tx,
                         const std::vector<T1>& t0,
-                        std::priority_queue<Node3Dcsp<T1,T2>*,
-                        std::deque<Node3Dcsp<T1,T2>*>,
-                        CompareNodePtr<T1>>& queue,
+                        QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                         std::vector<Node3Dcsp<T1,T2>>& txNodes,
                         std::vector<bool>& inQueue,
                         std::vector<bool>& frozen,
                         const size_t threadNo) const;
         
-        void propagate2(std::priority_queue<Node3Dcsp<T1,T2>*,
-                        std::deque<Node3Dcsp<T1,T2>*>,
-                        CompareNodePtr<T1>>& queue,
+        void propagate2(QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                         std::vector<bool>& inQueue,
                         std::vector<bool>& frozen,
                         size_t threadNo) const;
         
         void prepropagate2(const Node3Dcsp<T1,T2>& node,
-                           std::priority_queue<Node3Dcsp<T1,T2>*,
-                           std::deque<Node3Dcsp<T1,T2>*>,
-                           CompareNodePtr<T1>>& queue,
+                           QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                            std::vector<bool>& inQueue,
                            std::vector<bool>& frozen,
                            size_t threadNo) const;
     };
     
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::buildGridNodes() {
-        
-        
-        this->nodes.resize(// secondary nodes on the edges
-                           this->ncx*nsnx*((this->ncy+1)*(this->ncz+1)) +
-                           this->ncy*nsny*((this->ncx+1)*(this->ncz+1)) +
-                           this->ncz*nsnz*((this->ncx+1)*(this->ncy+1)) +
-                           // secondary nodes on the faces
-                           (nsnx*nsny)*(this->ncx*this->ncy*(this->ncz+1))+
-                           (nsnx*nsnz)*(this->ncx*this->ncz*(this->ncy+1))+
-                           (nsny*nsnz)*(this->ncy*this->ncz*(this->ncx+1))+
-                           // primary nodes
-                           (this->ncx+1) * (this->ncy+1) * (this->ncz+1),
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::buildGridNodes() {
+        
+        
+        this->nodes.resize(countNodes(this->ncx, this->ncy, this->ncz, nsnx, nsny, nsnz),
                            Node3Dcsp<T1,T2>(this->nThreads));
         
         // Create the grid, assign a number for each node and find the owners
@@ -475,16 +499,15 @@ namespace ttcr {
     
     
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::initQueue(const std::vector<sxyz<T1>>& Tx,
-                                           const std::vector<T1>& t0,
-                                           std::priority_queue<Node3Dcsp<T1,T2>*,
-                                           std::vector<Node3Dcsp<T1,T2>*>,
-                                           CompareNodePtr<T1>>& queue,
-                                           std::vector<Node3Dcsp<T1,T2>>& txNodes,
-                                           std::vector<bool>& inQueue,
-                                           std::vector<bool>& frozen,
-                                           const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::initQueue(const std::vector<sxyz<T1>>& Tx,
+                                                 const std::vector<T1>& t0,
+                                                 QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                                 std::vector<Node3Dcsp<T1,T2>>& txNodes,
+                                                 std::vector<bool>& inQueue,
+                                                 std::vector<bool>& frozen,
+                                                 const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         //Find the starting nodes of the transmitters Tx and start the queue list
         for ( size_t n=0; n<Tx.size(); ++n ) {
@@ -521,17 +544,17 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::propagate( std::priority_queue<Node3Dcsp<T1,T2>*,
-                                           std::vector<Node3Dcsp<T1,T2>*>,
-                                           CompareNodePtr<T1>>& queue,
-                                           std::vector<bool>& inQueue,
-                                           std::vector<bool>& frozen,
-                                           size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::propagate( QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                                 std::vector<bool>& inQueue,
+                                                 std::vector<bool>& frozen,
+                                                 size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !queue.empty() ) {
             const Node3Dcsp<T1,T2>* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
             
@@ -547,6 +570,7 @@ namespace ttcr {
                     if (ttsource < this->nodes[neibNo].getTT(threadNo)){
                         // Compute dt
                         T1 dt = this->cells.computeDt(*source, this->nodes[neibNo], cellNo);
+                        this->instrumentation.count(threadNo, LOCAL_UPDATE);
                         
                         if ( ttsource +dt < this->nodes[neibNo].getTT( threadNo ) ) {
                             this->nodes[neibNo].setTT( ttsource +dt, threadNo );
@@ -556,7 +580,11 @@ namespace ttcr {
                             
                             if ( !inQueue[neibNo] ) {
                                 queue.push( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_PUSH);
                                 inQueue[neibNo] = true;
+                            } else {
+                                queue.update( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_UPDATE);
                             }
                         }
                     }
@@ -565,17 +593,17 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::propagate_lw(std::priority_queue<Node3Dcsp<T1,T2>*,
-                                              std::vector<Node3Dcsp<T1,T2>*>,
-                                              CompareNodePtr<T1>>& queue,
-                                              std::vector<bool>& inQueue,
-                                              std::vector<bool>& frozen,
-                                              size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::propagate_lw(QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                                    std::vector<bool>& inQueue,
+                                                    std::vector<bool>& frozen,
+                                                    size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         // lightweight method where cell/node parent are not stored
         while ( !queue.empty() ) {
             const Node3Dcsp<T1,T2>* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
             
@@ -591,12 +619,17 @@ namespace ttcr {
 //                    if (ttsource < this->nodes[neibNo].getTT(threadNo)){
                         // Compute dt
                         T1 dt = this->cells.computeDt(*source, this->nodes[neibNo], cellNo);
+                        this->instrumentation.count(threadNo, LOCAL_UPDATE);
                         
                         if ( ttsource+dt < this->nodes[neibNo].getTT( threadNo ) ) {
                             this->nodes[neibNo].setTT( ttsource+dt, threadNo );
                             if ( !inQueue[neibNo] ) {
                                 queue.push( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_PUSH);
                                 inQueue[neibNo] = true;
+                            } else {
+                                queue.update( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_UPDATE);
                             }
                         }
 //                    }
@@ -605,14 +638,12 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::prepropagate(const Node3Dcsp<T1,T2>& node,
-                                              std::priority_queue<Node3Dcsp<T1,T2>*,
-                                              std::vector<Node3Dcsp<T1,T2>*>,
-                                              CompareNodePtr<T1>>& queue,
-                                              std::vector<bool>& inQueue,
-                                              std::vector<bool>& frozen,
-                                              size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::prepropagate(const Node3Dcsp<T1,T2>& node,
+                                                    QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                                    std::vector<bool>& inQueue,
+                                                    std::vector<bool>& frozen,
+                                                    size_t threadNo) const {
         
         // This function can be used to "prepropagate" each Tx nodes one first time
         // during "initQueue", before running "propagate".
@@ -631,6 +662,7 @@ namespace ttcr {
                 
                 // compute dt
                 T1 dt = this->cells.computeDt(node, this->nodes[neibNo], cellNo);
+                this->instrumentation.count(threadNo, LOCAL_UPDATE);
                 
                 if ( node.getTT( threadNo )+dt < this->nodes[neibNo].getTT( threadNo ) ) {
                     this->nodes[neibNo].setTT( node.getTT( threadNo )+dt, threadNo );
@@ -639,23 +671,26 @@ namespace ttcr {
                     
                     if ( !inQueue[neibNo] ) {
                         queue.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inQueue[neibNo] = true;
+                    } else {
+                        queue.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::initQueue2(const std::vector<sxyz<T1>>& Tx,
-                                            const std::vector<T1>& t0,
-                                            std::priority_queue<Node3Dcsp<T1,T2>*,
-                                            std::deque<Node3Dcsp<T1,T2>*>,
-                                            CompareNodePtr<T1>>& queue,
-                                            std::vector<Node3Dcsp<T1,T2>>& txNodes,
-                                            std::vector<bool>& inQueue,
-                                            std::vector<bool>& frozen,
-                                            const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::initQueue2(const std::vector<sxyz<T1>>& Tx,
+                                                  const std::vector<T1>& t0,
+                                                  QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                                  std::vector<Node3Dcsp<T1,T2>>& txNodes,
+                                                  std::vector<bool>& inQueue,
+                                                  std::vector<bool>& frozen,
+                                                  const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         //Find the starting nodes of the transmitters Tx and start the queue list
         for ( size_t n=0; n<Tx.size(); ++n ) {
@@ -690,17 +725,17 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::propagate2( std::priority_queue<Node3Dcsp<T1,T2>*,
-                                            std::deque<Node3Dcsp<T1,T2>*>,
-                                            CompareNodePtr<T1>>& queue,
-                                            std::vector<bool>& inQueue,
-                                            std::vector<bool>& frozen,
-                                            size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::propagate2( QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                                  std::vector<bool>& inQueue,
+                                                  std::vector<bool>& frozen,
+                                                  size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !queue.empty() ) {
             const Node3Dcsp<T1,T2>* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             for ( size_t no=0; no<source->getOwners().size(); ++no ) {
                 T2 cellNo = source->getOwners()[no];
@@ -714,6 +749,7 @@ namespace ttcr {
                     if (ttsource < this->nodes[neibNo].getTT(threadNo)){
                         // Compute dt
                         T1 dt = this->cells.computeDt(source, &(this->nodes[neibNo]), cellNo);
+                        this->instrumentation.count(threadNo, LOCAL_UPDATE);
                         
                         if ( ttsource +dt < this->nodes[neibNo].getTT( threadNo ) ) {
                             this->nodes[neibNo].setTT( ttsource +dt, threadNo );
@@ -723,7 +759,11 @@ namespace ttcr {
                             
                             if ( !inQueue[neibNo] ) {
                                 queue.push( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_PUSH);
                                 inQueue[neibNo] = true;
+                            } else {
+                                queue.update( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_UPDATE);
                             }
                         }
                     }
@@ -733,14 +773,12 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::prepropagate2(const Node3Dcsp<T1,T2>& node,
-                                               std::priority_queue<Node3Dcsp<T1,T2>*,
-                                               std::deque<Node3Dcsp<T1,T2>*>,
-                                               CompareNodePtr<T1>>& queue,
-                                               std::vector<bool>& inQueue,
-                                               std::vector<bool>& frozen,
-                                               size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::prepropagate2(const Node3Dcsp<T1,T2>& node,
+                                                     QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                                     std::vector<bool>& inQueue,
+                                                     std::vector<bool>& frozen,
+                                                     size_t threadNo) const {
         
         // This function can be used to "prepropagate" each Tx nodes one first time
         // during "initQueue", before running "propagate".
@@ -759,6 +797,7 @@ namespace ttcr {
                 
                 // compute dt
                 T1 dt = this->cells.computeDt(&node, &(this->nodes[neibNo]), cellNo);
+                this->instrumentation.count(threadNo, LOCAL_UPDATE);
                 
                 if ( node.getTT( threadNo )+dt < this->nodes[neibNo].getTT( threadNo ) ) {
                     this->nodes[neibNo].setTT( node.getTT( threadNo )+dt, threadNo );
@@ -767,32 +806,34 @@ namespace ttcr {
                     
                     if ( !inQueue[neibNo] ) {
                         queue.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inQueue[neibNo] = true;
+                    } else {
+                        queue.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<sxyz<T1>>& Rx,
-                                          std::vector<T1>& traveltimes,
-                                          const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<sxyz<T1>>& Rx,
+                                                std::vector<T1>& traveltimes,
+                                                const size_t threadNo) const {
         
         // Primary function
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue(cmp);
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         // txNodes: Extra nodes if the sources points are not on an existing node
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         // inQueue lists the nodes waiting in the queue
@@ -813,24 +854,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                          std::vector<std::vector<T1>*>& traveltimes,
-                                          const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                                std::vector<std::vector<T1>*>& traveltimes,
+                                                const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -851,26 +890,24 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<sxyz<T1>>& Rx,
-                                          std::vector<T1>& traveltimes,
-                                          std::vector<std::vector<sxyz<T1>>>& r_data,
-                                          const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<sxyz<T1>>& Rx,
+                                                std::vector<T1>& traveltimes,
+                                                std::vector<std::vector<sxyz<T1>>>& r_data,
+                                                const size_t threadNo) const {
         
         // Primary function
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue(cmp);
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         // txNodes: Extra nodes if the sources points are not on an existing node
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         // inQueue lists the nodes waiting in the queue
@@ -897,6 +934,7 @@ namespace ttcr {
         for (size_t n=0; n<Rx.size(); ++n) {
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node3Dcsp<T1,T2>> *node_p;
@@ -951,25 +989,23 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                          std::vector<std::vector<T1>*>& traveltimes,
-                                          std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
-                                          const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                                std::vector<std::vector<T1>*>& traveltimes,
+                                                std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
+                                                const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -1002,6 +1038,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = this->getTraveltime((*Rx[nr])[n], this->nodes,
                                                             nodeParentRx, cellParentRx,
                                                             threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
                 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -1063,27 +1100,25 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                          const std::vector<T1>& t0,
-                                          const std::vector<sxyz<T1>>& Rx,
-                                          std::vector<T1>& traveltimes,
-                                          std::vector<std::vector<sxyz<T1>>>& r_data,
-                                          std::vector<std::vector<siv<T1>>>& l_data,
-                                          const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                                const std::vector<T1>& t0,
+                                                const std::vector<sxyz<T1>>& Rx,
+                                                std::vector<T1>& traveltimes,
+                                                std::vector<std::vector<sxyz<T1>>>& r_data,
+                                                std::vector<std::vector<siv<T1>>>& l_data,
+                                                const size_t threadNo) const {
         
         // Primary function
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue(cmp);
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         // txNodes: Extra nodes if the sources points are not on an existing node
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         // inQueue lists the nodes waiting in the queue
@@ -1114,9 +1149,12 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node3Dcsp<T1,T2>> *node_p;
@@ -1137,15 +1175,10 @@ namespace ttcr {
                 r_tmp.push_back( child );
                 
                 cell.v = (*node_p)[iParent].getDistance( child );
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -1171,15 +1204,10 @@ namespace ttcr {
             r_tmp.push_back( child );
             
             cell.v = (*node_p)[iParent].getDistance( child );
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -1203,25 +1231,23 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2, typename CELL>
-    void Grid3Drcsp<T1,T2,CELL>::raytrace2(const std::vector<sxyz<T1>>& Tx,
-                                           const std::vector<T1>& t0,
-                                           const std::vector<sxyz<T1>>& Rx,
-                                           std::vector<T1>& traveltimes,
-                                           const size_t threadNo) const {
+    template<typename T1, typename T2, typename CELL, template<typename,typename> class QUEUE>
+    void Grid3Drcsp<T1,T2,CELL,QUEUE>::raytrace2(const std::vector<sxyz<T1>>& Tx,
+                                                 const std::vector<T1>& t0,
+                                                 const std::vector<sxyz<T1>>& Rx,
+                                                 std::vector<T1>& traveltimes,
+                                                 const size_t threadNo) const {
         
         // Primary function
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::deque<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue(cmp);
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         // txNodes: Extra nodes if the sources points are not on an existing node
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         // inQueue lists the nodes waiting in the queue
@@ -33,6 +33,7 @@
 #include <queue>
 #include <sstream>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include <ctime>
 
@@ -46,8 +47,12 @@
 #include "vtkXMLRectilinearGridWriter.h"
 #endif
 
+#include "Adjacency.h"
+#include "Barrier.h"
 #include "Grid3D.h"
 #include "Interpolator.h"
+#include "Node.h"
+#include "RowIndex.h"
 
 namespace ttcr {
     
@@ -59,19 +64,26 @@ namespace ttcr {
          Grid3Drn<T1,T2>::Grid3Drn(nb cells in x, nb cells in y, nb cells in z,
          x cells size, y cells size, z cells size,
          x origin, y origin, z origin,
-         index of the thread)
+         number of threads, inverse distance,
+         number of threads updating each sweep)
          */
         Grid3Drn(const T2 nx, const T2 ny, const T2 nz,
                  const T1 ddx, const T1 ddy, const T1 ddz,
                  const T1 minx, const T1 miny, const T1 minz,
-                 const size_t nt=1, const bool invDist=false) :
+                 const size_t nt=1, const bool invDist=false,
+                 const size_t nts=1) :
+        Grid3D<T1,T2>(nt),
         nThreads(nt),
+        nThreadsSweep(nts>0 ? nts : 1),
         dx(ddx), dy(ddy), dz(ddz),
         xmin(minx), ymin(miny), zmin(minz),
         xmax(minx+nx*ddx), ymax(miny+ny*ddy), zmax(minz+nz*ddz),
         ncx(nx), ncy(ny), ncz(nz),
-        nodes(std::vector<NODE>((nx+1)*(ny+1)*(nz+1), NODE(nt))),
-        neighbors(std::vector<std::vector<T2>>(nx*ny*nz))
+        nodes(std::vector<NODE>((nx+1)*(ny+1)*(nz+1), NODE(nt, sharedStorage_t()))),
+        neighbors(nx*ny*nz),
+        storage(),
+        workspace(nt),
+        itLog(nt)
         {    }
         
         virtual ~Grid3Drn() {}
@@ -129,25 +141,53 @@ namespace ttcr {
         }
         
         size_t getNeighborsSize() const {
-            size_t n_elem = 0;
-            for ( size_t n=0; n<neighbors.size(); ++n ) {
-                n_elem += neighbors[n].size();
-            }
-            return n_elem*sizeof(size_t);
+            return neighbors.getSize();
         }
         size_t getNodesSize() const {
             size_t size = 0;
             for ( size_t n=0; n<nodes.size(); ++n ) {
                 size += nodes[n].getSize();
             }
+            return size + storage.getSize();
+        }
+        
+        size_t getSharedMemorySize() const {
+            size_t size = sizeof(*this) + neighbors.getSize() +
+            (nodes.capacity()-nodes.size())*sizeof(NODE);
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                size += nodes[n].getSharedSize();
+            }
             return size;
         }
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(nodes.size());
+        }
+        
+        // memory needed by nNodes nodes and nCells cells holding nNodesCell
+        // nodes each, to estimate the size of a grid before building it
+        static size_t estimateSharedMemorySize(const size_t nNodes,
+                                               const size_t nCells,
+                                               const size_t nNodesCell) {
+            // nodes & their owners, and neighbors
+            return nNodes*NODE::estimateSharedSize() + (nCells+1)*sizeof(size_t) +
+            2*nCells*nNodesCell*sizeof(T2);
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // values of the nodes in storage, and frozen & inQueue flags
+            return nNodes*(NODE::getThreadSize() + 2*sizeof(uint32_t));
+        }
         
         void saveTT(const std::string &, const int, const size_t nt=0,
                     const bool vtkFormat=0) const;
         
         virtual const int get_niter() const { return 0; }
         virtual const int get_niterw() const { return 0; }
+        const std::vector<T1> get_change(const size_t threadNo=0) const {
+            return itLog[threadNo].change;
+        }
+        const std::vector<double> get_iteration_time(const size_t threadNo=0) const {
+            return itLog[threadNo].time;
+        }
         
         const size_t getNthreads() const { return nThreads; }
         const T1 getXmin() const { return xmin; }
@@ -160,8 +200,14 @@ namespace ttcr {
         const T2 getNcy() const { return ncy; }
         const T2 getNcz() const { return ncz; }
         
+        // reinitialize traveltimes & parents of all nodes for thread threadNo
+        void reinitNodes(const size_t threadNo) const {
+            storage.reinit(threadNo, nodes.size());
+        }
+        
     protected:
         size_t nThreads;	     // number of threads
+        size_t nThreadsSweep;    // number of threads updating each sweep (FSM)
         T1 dx;                   // cell size in x
         T1 dy;			         // cell size in y
         T1 dz;                   // cell size in z
@@ -178,9 +224,13 @@ namespace ttcr {
         bool inverseDistance;
         
         mutable std::vector<NODE> nodes;
-        std::vector<std::vector<T2>> neighbors;  // nodes common to a cell
+        Adjacency<T2> neighbors;                 // nodes common to a cell
+        mutable threadStorage<T1,T2> storage;   // traveltimes & parents of nodes
+        mutable std::vector<threadWorkspace> workspace;  // flags of nodes, for each thread
+        mutable std::vector<iterationLog<T1>> itLog;  // FSM convergence, for each thread
         
         void buildGridNeighbors();
+        void attachStorage();
         
         T2 getCellNo(const sxyz<T1>& pt) const {
             T1 x = xmax-pt.x < small ? xmax-.5*dx : pt.x;
@@ -214,7 +264,7 @@ namespace ttcr {
             k = static_cast<long long>( small + (pt.z-zmin)/dz );
         }
         
-        void checkPts(const std::vector<sxyz<T1>>&) const;
+        void checkPts(const std::vector<sxyz<T1>>&, const size_t threadNo=0) const;
         
         T1 computeDt(const NODE& source, const NODE& node) const {
             return (node.getNodeSlowness()+source.getNodeSlowness())/2. * source.getDistance( node );
@@ -264,17 +314,31 @@ namespace ttcr {
         
         T1 computeSlowness(const sxyz<T1>& Rx ) const;
         
-        void sweep(const std::vector<bool>& frozen,
-                   const size_t threadNo) const;
-        void sweep_weno3(const std::vector<bool>& frozen,
-                         const size_t threadNo) const;
-        
-        void update_node(const size_t, const size_t, const size_t, const size_t=0) const;
-        void update_node_weno3(const size_t, const size_t, const size_t, const size_t=0) const;
+        // sweeps return the sum of the decrease of traveltime at all nodes
+        T1 sweep(const NodeFlags& frozen,
+                 const size_t threadNo) const;
+        T1 sweep_weno3(const NodeFlags& frozen,
+                       const size_t threadNo) const;
+        T1 sweep_planes(const NodeFlags& frozen,
+                        const size_t threadNo,
+                        const bool weno3) const;
+        
+        T1 update_node(const size_t, const size_t, const size_t, const size_t=0) const;
+        T1 update_node_weno3(const size_t, const size_t, const size_t, const size_t=0) const;
+        // nodes updated by a sweep in the 8 directions, when instrumented
+        void countSweepUpdates(const NodeFlags& frozen, const size_t threadNo) const {
+            if ( Instrumentation::enabled() ) {
+                size_t n = 0;
+                for ( size_t i=0; i<frozen.size(); ++i ) {
+                    if ( !frozen[i] ) ++n;
+                }
+                this->instrumentation.count(threadNo, LOCAL_UPDATE, 8*n);
+            }
+        }
         
         void initFSM(const std::vector<sxyz<T1>>& Tx,
                      const std::vector<T1>& t0,
-                     std::vector<bool>& frozen,
+                     NodeFlags& frozen,
                      const int npts,
                      const size_t threadNo) const;
         
@@ -290,17 +354,24 @@ namespace ttcr {
     template<typename T1, typename T2, typename NODE>
     void Grid3Drn<T1,T2,NODE>::buildGridNeighbors() {
         
-        //Index the neighbors nodes of each cell
-        for ( T2 n=0; n<nodes.size(); ++n ) {
-            for ( size_t n2=0; n2<nodes[n].getOwners().size(); ++n2) {
-                T2 check = nodes[n].getOwners()[n2];
-                neighbors[ check ].push_back(n);
-            }
+        // Index the neighbors nodes of each cell
+        neighbors.buildFromOwners(nodes);
+        attachStorage();
+    }
+    
+    // per-thread values of the nodes are held in storage, thread by thread
+    template<typename T1, typename T2, typename NODE>
+    void Grid3Drn<T1,T2,NODE>::attachStorage() {
+        NODE::allocateStorage(storage, nodes.size(), nThreads);
+        for ( size_t n=0; n<nodes.size(); ++n ) {
+            nodes[n].setStorage(storage, n, nodes.size());
         }
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Drn<T1,T2,NODE>::checkPts(const std::vector<sxyz<T1>>& pts) const {
+    void Grid3Drn<T1,T2,NODE>::checkPts(const std::vector<sxyz<T1>>& pts,
+                                        const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, CHECK_PTS);
         
         // Check if the points from a vector are in the grid
         for ( size_t n=0; n<pts.size(); ++n ) {
@@ -318,9 +389,10 @@ namespace ttcr {
     
     template<typename T1, typename T2, typename NODE>
     T1 Grid3Drn<T1,T2,NODE>::getTraveltime(const sxyz<T1> &pt, const size_t nt) const {
+        PhaseTimer phaseTimer(this->instrumentation, nt, GET_TT);
         
-        static const size_t nnx = ncx+1;
-        static const size_t nny = ncy+1;
+        const size_t nnx = ncx+1;
+        const size_t nny = ncy+1;
         
         // trilinear interpolation if not on node
         
@@ -490,6 +562,7 @@ namespace ttcr {
     T1 Grid3Drn<T1,T2,NODE>::getTraveltime(const sxyz<T1>& Rx,
                                            T2& nodeParentRx, T2& cellParentRx,
                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
         // Calculate and return the traveltime for a Rx point.
         for ( size_t nn=0; nn<nodes.size(); ++nn ) {
@@ -562,8 +635,8 @@ namespace ttcr {
         
         // compute average gradient for voxel (i,j,k)
         
-        static const size_t nnx = ncx+1;
-        static const size_t nny = ncy+1;
+        const size_t nnx = ncx+1;
+        const size_t nny = ncy+1;
         
         g.x = 0.25*(nodes[(    k*nny+j  )*nnx+i+1].getTT(nt) - nodes[(    k*nny+j  )*nnx+i  ].getTT(nt) +
                     nodes[(    k*nny+j+1)*nnx+i+1].getTT(nt) - nodes[(    k*nny+j+1)*nnx+i  ].getTT(nt) +
@@ -629,6 +702,7 @@ namespace ttcr {
                                           const sxyz<T1> &Rx,
                                           std::vector<sxyz<T1>> &r_data,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         r_data.push_back( Rx );
         
@@ -710,9 +784,10 @@ namespace ttcr {
                                           std::vector<sijv<T1>>& m_data,
                                           const size_t RxNo,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
-        static const size_t nnx = ncx+1;
-        static const size_t nny = ncy+1;
+        const size_t nnx = ncx+1;
+        const size_t nny = ncy+1;
 
         r_data.push_back( Rx );
         
@@ -726,6 +801,13 @@ namespace ttcr {
         sijv<T1> m;
         m.i = RxNo;
         
+        // m_data may already hold terms
+        RowIndex& rowIndex = workspace[threadNo].row;
+        rowIndex.clear();
+        for ( size_t nm=0; nm<m_data.size(); ++nm ) {
+            rowIndex.insert(m_data[nm].j, nm);
+        }
+        
         // distance between opposite nodes of a voxel
         static const T1 maxDist = sqrt( dx*dx + dy*dy + dz*dz );
         sxyz<T1> g;
@@ -802,15 +884,10 @@ namespace ttcr {
                         m.j = (kv*nny+jv)*nnx+iv;
                         m.v = -s * ds * dvdv;
                         
-                        bool found = false;
-                        for ( size_t nm=0; nm<m_data.size(); ++nm ) {
-                            if ( m_data[nm].j == m.j ) {
-                                m_data[nm].v += m.v;
-                                found = true;
-                                break;
-                            }
-                        }
-                        if ( found == false ) {
+                        size_t nm = rowIndex.insert(m.j, m_data.size());
+                        if ( nm < m_data.size() ) {
+                            m_data[nm].v += m.v;
+                        } else {
                             m_data.push_back(m);
                         }
                         
@@ -846,15 +923,10 @@ namespace ttcr {
                                 m.j = (kv*nny+jv)*nnx+iv;
                                 m.v = -s * ds * dvdv;
                                 
-                                bool found = false;
-                                for ( size_t nm=0; nm<m_data.size(); ++nm ) {
-                                    if ( m_data[nm].j == m.j ) {
-                                        m_data[nm].v += m.v;
-                                        found = true;
-                                        break;
-                                    }
-                                }
-                                if ( found == false ) {
+                                size_t nm = rowIndex.insert(m.j, m_data.size());
+                                if ( nm < m_data.size() ) {
+                                    m_data[nm].v += m.v;
+                                } else {
                                     m_data.push_back(m);
                                 }
                                 
@@ -875,6 +947,7 @@ namespace ttcr {
                                               const sxyz<T1> &Rx,
                                               std::vector<sxyz<T1>> &r_data,
                                               const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         r_data.push_back( Rx );
         
@@ -1423,15 +1496,23 @@ namespace ttcr {
     
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Drn<T1,T2,NODE>::sweep(const std::vector<bool>& frozen,
-                                     const size_t threadNo) const {
+    T1 Grid3Drn<T1,T2,NODE>::sweep(const NodeFlags& frozen,
+                                   const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
+        countSweepUpdates(frozen, threadNo);
+        
+        if ( nThreadsSweep > 1 ) {
+            return sweep_planes(frozen, threadNo, false);
+        }
+        
+        T1 change = 0.0;
         
         // sweep first direction
         for ( size_t k=0; k<=ncz; ++k ) {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
@@ -1441,7 +1522,7 @@ namespace ttcr {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
@@ -1451,7 +1532,7 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
@@ -1461,7 +1542,7 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
@@ -1471,7 +1552,7 @@ namespace ttcr {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
@@ -1481,7 +1562,7 @@ namespace ttcr {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
@@ -1491,7 +1572,7 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
@@ -1501,16 +1582,82 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node(i, j, k, threadNo);
+                        change += update_node(i, j, k, threadNo);
                     }
                 }
             }
         }
+        return change;
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Drn<T1,T2,NODE>::update_node(const size_t i, const size_t j, const size_t k,
-                                           const size_t threadNo) const {
+    T1 Grid3Drn<T1,T2,NODE>::sweep_planes(const NodeFlags& frozen,
+                                          const size_t threadNo,
+                                          const bool weno3) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
+        
+        // The stencils only involve nodes along the axes, so the lines of
+        // nodes along x lying on a plane j+k = l (counted in the sweep
+        // direction) do not depend on each other and only depend on planes
+        // already done.  Planes are processed in order and their lines are
+        // shared among the threads: results are the same as with the serial
+        // sweep.
+        const size_t nPlanes = ncy+ncz+1;
+        Barrier barrier(nThreadsSweep);
+        
+        std::vector<T1> change(nThreadsSweep, 0.0);
+        
+        auto work = [this, &frozen, &barrier, &change, threadNo, weno3, nPlanes](const size_t nt) {
+            T1 sum = 0.0;
+            // same order of directions as in sweep: i reversed first, then j, then k
+            for ( size_t dir=0; dir<8; ++dir ) {
+                const bool ri = (dir & 1) != 0;
+                const bool rj = (dir & 2) != 0;
+                const bool rk = (dir & 4) != 0;
+                
+                for ( size_t l=0; l<nPlanes; ++l ) {
+                    const size_t kmin = l > ncy ? l-ncy : 0;
+                    const size_t kmax = l < ncz ? l : ncz;
+                    const size_t nLines = kmax-kmin+1;
+                    const size_t first = kmin + nt*nLines/nThreadsSweep;
+                    const size_t last = kmin + (nt+1)*nLines/nThreadsSweep;
+                    
+                    for ( size_t kk=first; kk<last; ++kk ) {
+                        const size_t j = rj ? ncy-(l-kk) : l-kk;
+                        const size_t k = rk ? ncz-kk : kk;
+                        for ( size_t ii=0; ii<=ncx; ++ii ) {
+                            const size_t i = ri ? ncx-ii : ii;
+                            if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
+                                if ( weno3 )
+                                    sum += update_node_weno3(i, j, k, threadNo);
+                                else
+                                    sum += update_node(i, j, k, threadNo);
+                            }
+                        }
+                    }
+                    barrier.wait();
+                }
+            }
+            change[nt] = sum;
+        };
+        
+        std::vector<std::thread> threads(nThreadsSweep-1);
+        for ( size_t nt=1; nt<nThreadsSweep; ++nt ) {
+            threads[nt-1] = std::thread(work, nt);
+        }
+        work(0);
+        for ( size_t nt=0; nt<threads.size(); ++nt ) {
+            threads[nt].join();
+        }
+        for ( size_t nt=1; nt<nThreadsSweep; ++nt ) {
+            change[0] += change[nt];
+        }
+        return change[0];
+    }
+    
+    template<typename T1, typename T2, typename NODE>
+    T1 Grid3Drn<T1,T2,NODE>::update_node(const size_t i, const size_t j, const size_t k,
+                                         const size_t threadNo) const {
         T1 a1, a2, a3, t;
         
         if (k==0)
@@ -1563,21 +1710,32 @@ namespace ttcr {
             }
         }
         
-        if ( t<nodes[(k*(ncy+1)+j)*(ncx+1)+i].getTT(threadNo) )
+        T1 t0 = nodes[(k*(ncy+1)+j)*(ncx+1)+i].getTT(threadNo);
+        if ( t<t0 ) {
             nodes[(k*(ncy+1)+j)*(ncx+1)+i].setTT(t,threadNo);
-        
+            return t0-t;
+        }
+        return 0.0;
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Drn<T1,T2,NODE>::sweep_weno3(const std::vector<bool>& frozen,
-                                           const size_t threadNo) const {
+    T1 Grid3Drn<T1,T2,NODE>::sweep_weno3(const NodeFlags& frozen,
+                                         const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
+        countSweepUpdates(frozen, threadNo);
+        
+        if ( nThreadsSweep > 1 ) {
+            return sweep_planes(frozen, threadNo, true);
+        }
+        
+        T1 change = 0.0;
         
         // sweep first direction
         for ( size_t k=0; k<=ncz; ++k ) {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
@@ -1587,7 +1745,7 @@ namespace ttcr {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
@@ -1597,7 +1755,7 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
@@ -1607,7 +1765,7 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
@@ -1617,7 +1775,7 @@ namespace ttcr {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
@@ -1627,7 +1785,7 @@ namespace ttcr {
             for ( size_t j=0; j<=ncy; ++j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
@@ -1637,7 +1795,7 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( size_t i=0; i<=ncx; ++i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
@@ -1647,18 +1805,19 @@ namespace ttcr {
             for ( long int j=ncy; j>=0; --j ) {
                 for ( long int i=ncx; i>=0; --i ) {
                     if ( !frozen[ (k*(ncy+1)+j)*(ncx+1)+i ] ) {
-                        update_node_weno3(i, j, k, threadNo);
+                        change += update_node_weno3(i, j, k, threadNo);
                     }
                 }
             }
         }
+        return change;
     }
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Drn<T1,T2,NODE>::update_node_weno3(const size_t i,
-                                                 const size_t j,
-                                                 const size_t k,
-                                                 const size_t threadNo) const {
+    T1 Grid3Drn<T1,T2,NODE>::update_node_weno3(const size_t i,
+                                               const size_t j,
+                                               const size_t k,
+                                               const size_t threadNo) const {
         T1 a1, a2, a3, t;
         
         if (k==0) {
@@ -1945,17 +2104,21 @@ namespace ttcr {
             }
         }
         
-        if ( t<nodes[(k*(ncy+1)+j)*(ncx+1)+i].getTT(threadNo) )
+        T1 t0 = nodes[(k*(ncy+1)+j)*(ncx+1)+i].getTT(threadNo);
+        if ( t<t0 ) {
             nodes[(k*(ncy+1)+j)*(ncx+1)+i].setTT(t,threadNo);
-        
+            return t0-t;
+        }
+        return 0.0;
     }
     
     template<typename T1, typename T2, typename NODE>
     void Grid3Drn<T1,T2,NODE>::initFSM(const std::vector<sxyz<T1>>& Tx,
                                        const std::vector<T1>& t0,
-                                       std::vector<bool>& frozen,
+                                       NodeFlags& frozen,
                                        const int npts,
                                        const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
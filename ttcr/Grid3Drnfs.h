@@ -9,10 +9,14 @@
 #ifndef Grid3Drnfs_h
 #define Grid3Drnfs_h
 
+#include <algorithm>
+#include <cmath>
 #include <utility>
 
 #include "Grid3Drn.h"
 #include "Node3Dn.h"
+#include "RowIndex.h"
+#include "SourceRegion.h"
 
 namespace ttcr {
     
@@ -22,9 +26,10 @@ namespace ttcr {
         Grid3Drnfs(const T2 nx, const T2 ny, const T2 nz, const T1 ddx,
                    const T1 minx, const T1 miny, const T1 minz,
                    const T1 eps, const int maxit, const bool w,
-                   const size_t nt=1) :
-        Grid3Drn<T1,T2,Node3Dn<T1,T2>>(nx, ny, nz, ddx, ddx, ddx, minx, miny, minz, nt),
-        epsilon(eps), nitermax(maxit), niter(0), niterw(0), weno3(w)
+                   const size_t nt=1, const size_t nts=1) :
+        Grid3Drn<T1,T2,Node3Dn<T1,T2>>(nx, ny, nz, ddx, ddx, ddx, minx, miny, minz, nt, false, nts),
+        epsilon(eps), nitermax(maxit), niter(0), niterw(0), weno3(w),
+        source_radius(0.0), source_refinement(0)
         {
             buildGridNodes();
             this->buildGridNeighbors();
@@ -37,6 +42,9 @@ namespace ttcr {
         const int get_niter() const { return niter; }
         const int get_niterw() const { return niterw; }
         
+        void setSourceRadius(const double r) { source_radius = r; }
+        void setSourceRefinement(const int r) { source_refinement = r; }
+        
         void raytrace(const std::vector<sxyz<T1>>& Tx,
                      const std::vector<T1>& t0,
                      const std::vector<sxyz<T1>>& Rx,
@@ -88,15 +96,47 @@ namespace ttcr {
                      std::vector<std::vector<siv<T1>>>& l_data,
                      const size_t threadNo=0) const;
         
+        void raytrace(const std::vector<const std::vector<sxyz<T1>>*>& Tx,
+                     const std::vector<const std::vector<T1>*>& t0,
+                     const std::vector<sxyz<T1>>& Rx,
+                     std::vector<std::vector<T1>*>& traveltimes,
+                     const size_t threadNo=0) const;
+        
+        // memory needed by a grid of nx*ny*nz cells (see Grid3D::getMemorySize)
+        static void estimateMemorySize(const size_t nx, const size_t ny, const size_t nz,
+                                       size_t& shared, size_t& thread) {
+            const size_t nNodes = (nx+1) * (ny+1) * (nz+1);
+            shared = sizeof(Grid3Drnfs) +
+            Grid3Drn<T1,T2,Node3Dn<T1,T2>>::estimateSharedMemorySize(nNodes, nx*ny*nz, 8);
+            thread = Grid3Drn<T1,T2,Node3Dn<T1,T2>>::estimateThreadMemorySize(nNodes);
+        }
+        
     protected:
         T1 epsilon;
         int nitermax;
         mutable int niter;
         mutable int niterw;
         bool weno3;
+        T1 source_radius;
+        int source_refinement;   // ratio of cell sizes of the grid & source region grids
         
         void buildGridNodes();
         
+        // Shots propagated together share the sweeps: the traveltimes of
+        // nLanes shots are stored next to each other for every node, and the
+        // slowness & neighbours of a node are read once for all of them.
+        enum { nLanes = 8 };
+        T1 sweep_lanes(std::vector<T1>& tt, const std::vector<char>& frozen,
+                       const size_t threadNo) const;
+        T1 update_node_lanes(const size_t i, const size_t j, const size_t k,
+                             T1 *tt, const char *frozen) const;
+        
+        void initFSM(const std::vector<sxyz<T1>>& Tx,
+                     const std::vector<T1>& t0,
+                     NodeFlags& frozen,
+                     const int npts,
+                     const size_t threadNo) const;
+        
     private:
         Grid3Drnfs() {}
         Grid3Drnfs(const Grid3Drnfs<T1,T2>& g) {}
@@ -104,6 +144,63 @@ namespace ttcr {
         
     };
     
+    template<typename T1, typename T2>
+    void Grid3Drnfs<T1,T2>::initFSM(const std::vector<sxyz<T1>>& Tx,
+                                    const std::vector<T1>& t0,
+                                    NodeFlags& frozen,
+                                    const int npts,
+                                    const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
+        
+        if ( source_refinement == 0 ) {
+            Grid3Drn<T1,T2,Node3Dn<T1,T2>>::initFSM(Tx, t0, frozen, npts, threadNo);
+            return;
+        }
+        
+        // Traveltimes at the nodes within the source region of each Tx are
+        // computed on a grid with cells source_refinement times smaller (see
+        // SourceRegion.h), and these nodes are not updated by the sweeps.
+        // The region has radius source_radius, or 2 dx if source_radius is 0.
+        const T1 radius = source_radius > 0.0 ? source_radius : 2*this->dx;
+        const sxyz<T1> pmin(this->xmin, this->ymin, this->zmin);
+        const sxyz<T1> pmax(this->xmax, this->ymax, this->zmax);
+        auto slowness = [&](const sxyz<T1>& pt) { return this->computeSlowness(pt); };
+        
+        std::vector<sxyz<T1>> pts;
+        std::vector<T2> nodeNo;
+        std::vector<T1> tt;
+        for ( size_t n=0; n<Tx.size(); ++n ) {
+            pts.clear();
+            nodeNo.clear();
+            long long i0 = std::max(0LL, static_cast<long long>((Tx[n].x-radius-this->xmin)/this->dx));
+            long long j0 = std::max(0LL, static_cast<long long>((Tx[n].y-radius-this->ymin)/this->dy));
+            long long k0 = std::max(0LL, static_cast<long long>((Tx[n].z-radius-this->zmin)/this->dz));
+            long long i1 = std::min(static_cast<long long>(this->ncx), static_cast<long long>((Tx[n].x+radius-this->xmin)/this->dx)+1);
+            long long j1 = std::min(static_cast<long long>(this->ncy), static_cast<long long>((Tx[n].y+radius-this->ymin)/this->dy)+1);
+            long long k1 = std::min(static_cast<long long>(this->ncz), static_cast<long long>((Tx[n].z+radius-this->zmin)/this->dz)+1);
+            for ( long long k=k0; k<=k1; ++k ) {
+                for ( long long j=j0; j<=j1; ++j ) {
+                    for ( long long i=i0; i<=i1; ++i ) {
+                        T2 nn = static_cast<T2>((k*(this->ncy+1)+j)*(this->ncx+1)+i);
+                        if ( this->nodes[nn].getDistance( Tx[n] ) <= radius ) {
+                            pts.push_back( sxyz<T1>(this->nodes[nn]) );
+                            nodeNo.push_back( nn );
+                        }
+                    }
+                }
+            }
+            sourceRegionTraveltimes<Grid3Drnfs<T1,T2>>(Tx[n], t0[n], radius,
+                                                       this->dx/source_refinement,
+                                                       pmin, pmax, slowness, pts, tt);
+            for ( size_t nn=0; nn<nodeNo.size(); ++nn ) {
+                if ( tt[nn] < this->nodes[ nodeNo[nn] ].getTT(threadNo) ) {
+                    this->nodes[ nodeNo[nn] ].setTT( tt[nn], threadNo );
+                }
+                frozen[ nodeNo[nn] ] = true;
+            }
+        }
+    }
+    
     template<typename T1, typename T2>
     void Grid3Drnfs<T1,T2>::buildGridNodes() {
         
@@ -231,22 +328,19 @@ namespace ttcr {
                                      std::vector<T1>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
         // Set Tx pts
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         int npts = 1;
         if ( weno3 == true) npts = 2;
         this->initFSM(Tx, t0, frozen, npts, threadNo);
         
-        std::vector<T1> times( this->nodes.size() );
-        for ( size_t n=0; n<this->nodes.size(); ++n )
-            times[n] = this->nodes[n].getTT( threadNo );
+        this->itLog[threadNo].clear();
         
         T1 change = std::numeric_limits<T1>::max();
         if ( weno3 == true ) {
@@ -256,40 +350,24 @@ namespace ttcr {
                 throw std::logic_error("Error: WENO stencil needs dx equal to dz");
             }
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
             change = std::numeric_limits<T1>::max();
             while ( change >= epsilon && niterw<nitermax ) {
-                this->sweep_weno3(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep_weno3(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niterw++;
             }
         } else {
             niter=0;
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
         }
@@ -310,27 +388,24 @@ namespace ttcr {
                                      std::vector<std::vector<T1>*>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
         if ( traveltimes.size() != Rx.size() ) {
             traveltimes.resize( Rx.size() );
         }
         
         // Set Tx pts
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         int npts = 1;
         if ( weno3 == true) npts = 2;
         this->initFSM(Tx, t0, frozen, npts, threadNo);
         
-        std::vector<T1> times( this->nodes.size() );
-        for ( size_t n=0; n<this->nodes.size(); ++n )
-            times[n] = this->nodes[n].getTT( threadNo );
+        this->itLog[threadNo].clear();
         
         T1 change = std::numeric_limits<T1>::max();
         if ( weno3 == true ) {
@@ -340,40 +415,24 @@ namespace ttcr {
                 throw std::logic_error("Error: WENO stencil needs dx equal to dz");
             }
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
             change = std::numeric_limits<T1>::max();
             while ( change >= epsilon && niterw<nitermax ) {
-                this->sweep_weno3(frozen, threadNo);
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep_weno3(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niterw++;
             }
         } else {
             niter=0;
             while ( change >= epsilon && niter<nitermax ) {
-                this->sweep(frozen, threadNo);
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
-                }
+                this->itLog[threadNo].start();
+                change = this->sweep(frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
                 niter++;
             }
         }
@@ -524,7 +583,9 @@ namespace ttcr {
         }
         
         siv<T1> cell;
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             this->getRaypath(Tx, Rx[n], r_data[n], threadNo);
             
             for (size_t ns=0; ns<r_data[n].size()-1; ++ns) {
@@ -532,15 +593,10 @@ namespace ttcr {
                 cell.i = this->getCellNo( m );
                 cell.v = r_data[n][ns].getDistance( r_data[n][ns+1] );
                 
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
             }
@@ -548,6 +604,155 @@ namespace ttcr {
             sort(l_data[n].begin(), l_data[n].end(), CompareSiv_i<T1>());
         }
     }
+    
+    template<typename T1, typename T2>
+    void Grid3Drnfs<T1,T2>::raytrace(const std::vector<const std::vector<sxyz<T1>>*>& Tx,
+                                     const std::vector<const std::vector<T1>*>& t0,
+                                     const std::vector<sxyz<T1>>& Rx,
+                                     std::vector<std::vector<T1>*>& traveltimes,
+                                     const size_t threadNo) const {
+        
+        if ( weno3 == true ) {
+            // 3rd order sweeps are done shot by shot
+            Grid3D<T1,T2>::raytrace(Tx, t0, Rx, traveltimes, threadNo);
+            return;
+        }
+        
+        this->checkPts(Rx, threadNo);
+        
+        const size_t nNodes = this->nodes.size();
+        std::vector<T1> tt(nNodes*nLanes);
+        std::vector<char> frozen(nNodes*nLanes);
+        NodeFlags& fz = this->workspace[threadNo].frozen;
+        
+        for ( size_t n0=0; n0<Tx.size(); n0+=nLanes ) {
+            
+            // each shot is initialized as when traced alone, and copied to its lane
+            for ( size_t l=0; l<nLanes; ++l ) {
+                if ( n0+l < Tx.size() ) {
+                    this->checkPts(*Tx[n0+l], threadNo);
+                    this->reinitNodes( threadNo );
+                    fz.reset( nNodes );
+                    this->initFSM(*Tx[n0+l], *t0[n0+l], fz, 1, threadNo);
+                    for ( size_t n=0; n<nNodes; ++n ) {
+                        tt[n*nLanes+l] = this->nodes[n].getTT(threadNo);
+                        frozen[n*nLanes+l] = fz[n];
+                    }
+                } else {
+                    // unused lane
+                    for ( size_t n=0; n<nNodes; ++n ) {
+                        tt[n*nLanes+l] = 0.0;
+                        frozen[n*nLanes+l] = 1;
+                    }
+                }
+            }
+            
+            this->itLog[threadNo].clear();
+            
+            T1 change = std::numeric_limits<T1>::max();
+            niter=0;
+            while ( change >= epsilon && niter<nitermax ) {
+                this->itLog[threadNo].start();
+                change = sweep_lanes(tt, frozen, threadNo);
+                this->itLog[threadNo].push_back(change);
+                niter++;
+            }
+            
+            for ( size_t l=0; l<nLanes && n0+l<Tx.size(); ++l ) {
+                for ( size_t n=0; n<nNodes; ++n ) {
+                    this->nodes[n].setTT( tt[n*nLanes+l], threadNo );
+                }
+                std::vector<T1>& ttRx = *traveltimes[n0+l];
+                if ( ttRx.size() != Rx.size() ) {
+                    ttRx.resize( Rx.size() );
+                }
+                for (size_t n=0; n<Rx.size(); ++n) {
+                    ttRx[n] = this->getTraveltime(Rx[n], threadNo);
+                }
+            }
+        }
+    }
+    
+    template<typename T1, typename T2>
+    T1 Grid3Drnfs<T1,T2>::sweep_lanes(std::vector<T1>& tt,
+                                      const std::vector<char>& frozen,
+                                      const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
+        if ( Instrumentation::enabled() ) {
+            const size_t n = std::count(frozen.begin(), frozen.end(), 0);
+            this->instrumentation.count(threadNo, LOCAL_UPDATE, 8*n);
+        }
+        
+        T1 change = 0.0;
+        // same eight orderings as Grid3Drn::sweep; bits 0, 1 & 2 of d reverse
+        // the loops along x, y & z
+        for ( int d=0; d<8; ++d ) {
+            for ( size_t kk=0; kk<=this->ncz; ++kk ) {
+                const size_t k = (d & 4) ? this->ncz-kk : kk;
+                for ( size_t jj=0; jj<=this->ncy; ++jj ) {
+                    const size_t j = (d & 2) ? this->ncy-jj : jj;
+                    for ( size_t ii=0; ii<=this->ncx; ++ii ) {
+                        const size_t i = (d & 1) ? this->ncx-ii : ii;
+                        change += update_node_lanes(i, j, k, tt.data(), frozen.data());
+                    }
+                }
+            }
+        }
+        return change;
+    }
+    
+    template<typename T1, typename T2>
+    T1 Grid3Drnfs<T1,T2>::update_node_lanes(const size_t i, const size_t j, const size_t k,
+                                            T1 *tt, const char *frozen) const {
+        
+        // Same update as Grid3Drn::update_node, written without branches
+        // within the loop over the lanes so that it is vectorized
+        const size_t nnx = this->ncx+1;
+        const size_t nnxy = nnx*(this->ncy+1);
+        const size_t n = (k*(this->ncy+1)+j)*nnx+i;
+        
+        const T1 *z1 = tt + nLanes*( k>0 ? n-nnxy : n+nnxy );
+        const T1 *z2 = tt + nLanes*( k<this->ncz ? n+nnxy : n-nnxy );
+        const T1 *y1 = tt + nLanes*( j>0 ? n-nnx : n+nnx );
+        const T1 *y2 = tt + nLanes*( j<this->ncy ? n+nnx : n-nnx );
+        const T1 *x1 = tt + nLanes*( i>0 ? n-1 : n+1 );
+        const T1 *x2 = tt + nLanes*( i<this->ncx ? n+1 : n-1 );
+        T1 *t0 = tt + nLanes*n;
+        const char *fz = frozen + nLanes*n;
+        
+        const T1 fh = this->nodes[n].getNodeSlowness() * this->dx;
+        
+        T1 change = 0.0;
+        for ( size_t l=0; l<nLanes; ++l ) {
+            T1 a1 = std::min(z1[l], z2[l]);
+            T1 a2 = std::min(y1[l], y2[l]);
+            T1 a3 = std::min(x1[l], x2[l]);
+            
+            // sort, a1 <= a2 <= a3
+            const T1 lo = std::min(a1, a2);
+            const T1 hi = std::max(a1, a2);
+            const T1 mid = std::max(lo, a3);
+            a1 = std::min(lo, a3);
+            a2 = std::min(mid, hi);
+            a3 = std::max(mid, hi);
+            
+            // discriminants are negative only for solutions that are not kept
+            const T1 t1 = a1 + fh;
+            const T1 t2 = 0.5*(a1+a2+std::sqrt(std::max(0.0,
+                                                        2.*fh*fh - (a1-a2)*(a1-a2))));
+            const T1 t3 = 1./3. * ((a1 + a2 + a3) +
+                                   std::sqrt(std::max(0.0,
+                                                      -2.*a1*a1 + 2.*a1*a2 - 2.*a2*a2 +
+                                                      2.*a1*a3 + 2.*a2*a3 -
+                                                      2.*a3*a3 + 3.*fh*fh)));
+            T1 t = t1 > a2 ? ( t2 > a3 ? t3 : t2 ) : t1;
+            
+            t = ( fz[l]==0 && t<t0[l] ) ? t : t0[l];
+            change += t0[l] - t;
+            t0[l] = t;
+        }
+        return change;
+    }
 }
 
 #endif /* Grid3Drnfs_h */
@@ -19,13 +19,16 @@
 
 #include "Grid3Drn.h"
 #include "Node3Dnsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 #include "utils.h"
 
 #include "Interpolator.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2>
+    template<typename T1, typename T2,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid3Drnsp : public Grid3Drn<T1,T2,Node3Dnsp<T1,T2>> {
     public:
         Grid3Drnsp(const T2 nx, const T2 ny, const T2 nz,
@@ -87,6 +90,37 @@ namespace ttcr {
         const T2 getNsny() const { return nsny; }
         const T2 getNsnz() const { return nsnz; }
         
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(this->nodes.size());
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // queue holding all nodes at worst
+            return Grid3Drn<T1,T2,Node3Dnsp<T1,T2>>::estimateThreadMemorySize(nNodes) +
+            nNodes*QUEUE<Node3Dnsp<T1,T2>,T1>::getNodeSize();
+        }
+        
+        // number of nodes of a grid of nx*ny*nz cells with nnx, nny & nnz
+        // secondary nodes, and memory it needs (see Grid3D::getMemorySize)
+        static size_t countNodes(const size_t nx, const size_t ny, const size_t nz,
+                                 const size_t nnx, const size_t nny, const size_t nnz) {
+            return // secondary nodes on the edges
+            nx*nnx*((ny+1)*(nz+1)) + ny*nny*((nx+1)*(nz+1)) + nz*nnz*((nx+1)*(ny+1)) +
+            // secondary nodes on the faces
+            (nnx*nny)*(nx*ny*(nz+1)) + (nnx*nnz)*(nx*nz*(ny+1)) + (nny*nnz)*(ny*nz*(nx+1)) +
+            // primary nodes
+            (nx+1) * (ny+1) * (nz+1);
+        }
+        static void estimateMemorySize(const size_t nx, const size_t ny, const size_t nz,
+                                       const size_t nnx, const size_t nny, const size_t nnz,
+                                       size_t& shared, size_t& thread) {
+            const size_t nNodes = countNodes(nx, ny, nz, nnx, nny, nnz);
+            // corners, and secondary nodes on the 12 edges & 6 faces
+            const size_t nNodesCell = 8 + 4*(nnx+nny+nnz) + 2*(nnx*nny+nnx*nnz+nny*nnz);
+            shared = sizeof(Grid3Drnsp) +
+            Grid3Drn<T1,T2,Node3Dnsp<T1,T2>>::estimateSharedMemorySize(nNodes, nx*ny*nz, nNodesCell);
+            thread = estimateThreadMemorySize(nNodes);
+        }
+        
     private:
         T2 nsnx;                 // number of secondary nodes in x
         T2 nsny;                 // number of secondary nodes in y
@@ -98,44 +132,31 @@ namespace ttcr {
 
         void initQueue(const std::vector<sxyz<T1>>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<Node3Dnsp<T1,T2>*,
-                       std::vector<Node3Dnsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
                        std::vector<Node3Dnsp<T1,T2>>& txNodes,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        const size_t threadNo) const;
         
-        void propagate(std::priority_queue<Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+        void propagate(QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        size_t threadNo) const;
         
         void prepropagate(const Node3Dnsp<T1,T2>& node,
-                          std::priority_queue<Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-                          CompareNodePtr<T1>>& queue,
-                          std::vector<bool>& inQueue,
-                          std::vector<bool>& frozen,
+                          QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                          NodeFlags& inQueue,
+                          NodeFlags& frozen,
                           size_t threadNo) const;
         
     };
     
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::buildGridNodes() {
-        
-        this->nodes.resize(// secondary nodes on the edges
-                           this->ncx*nsnx*((this->ncy+1)*(this->ncz+1)) +
-                           this->ncy*nsny*((this->ncx+1)*(this->ncz+1)) +
-                           this->ncz*nsnz*((this->ncx+1)*(this->ncy+1)) +
-                           // secondary nodes on the faces
-                           (nsnx*nsny)*(this->ncx*this->ncy*(this->ncz+1))+
-                           (nsnx*nsnz)*(this->ncx*this->ncz*(this->ncy+1))+
-                           (nsny*nsnz)*(this->ncy*this->ncz*(this->ncx+1))+
-                           // primary nodes
-                           (this->ncx+1) * (this->ncy+1) * (this->ncz+1),
-                           Node3Dnsp<T1,T2>(this->nThreads));
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::buildGridNodes() {
+        
+        this->nodes.resize(countNodes(this->ncx, this->ncy, this->ncz, nsnx, nsny, nsnz),
+                           Node3Dnsp<T1,T2>(this->nThreads, sharedStorage_t()));
         
         // Create the grid, assign a number for each node, determine the type of the node and find the owners
         // Nodes and cells are first indexed in z, then y, and x.
@@ -451,8 +472,8 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::setSlowness(const std::vector<T1>& s) {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::setSlowness(const std::vector<T1>& s) {
         
         if ( ((this->ncx+1)*(this->ncy+1)*(this->ncz+1)) != s.size() ) {
             throw std::length_error("Error: slowness vector of incompatible size.");
@@ -476,8 +497,8 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::linearInterpolation() const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::linearInterpolation() const {
         
         std::vector<size_t> list;
         list.reserve(8);
@@ -636,8 +657,8 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::invDistInterpolation() const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::invDistInterpolation() const {
         
         std::vector<size_t>::iterator it;
         std::vector<size_t> list;
@@ -676,31 +697,29 @@ namespace ttcr {
     
     
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           const size_t threadNo) const {
         
         // Primary function
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue(cmp);
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         // txNodes: Extra nodes if the sources points are not on an existing node
         std::vector<Node3Dnsp<T1,T2>> txNodes;
         // inQueue lists the nodes waiting in the queue
-        std::vector<bool> inQueue( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
         // Tx sources nodes are "frozen" and their traveltime can't be modified
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -715,28 +734,26 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -753,32 +770,30 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           const size_t threadNo) const {
         
         // Primary function
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue(cmp);
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         // txNodes: Extra nodes if the sources points are not on an existing node
         std::vector<Node3Dnsp<T1,T2>> txNodes;
         // inQueue lists the nodes waiting in the queue
-        std::vector<bool> inQueue( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
         // Tx sources nodes are "frozen" and their traveltime can't be modified
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -799,6 +814,7 @@ namespace ttcr {
         for (size_t n=0; n<Rx.size(); ++n) {
             traveltimes[n] = this->getTraveltime(Rx[n], nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node3Dnsp<T1,T2>> *node_p;
@@ -853,29 +869,27 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
 
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -904,6 +918,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = this->getTraveltime((*Rx[nr])[n],
                                                             nodeParentRx, cellParentRx,
                                                             threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
                 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -965,33 +980,31 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     std::vector<std::vector<siv<T1>>>& l_data,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           std::vector<std::vector<siv<T1>>>& l_data,
+                                           const size_t threadNo) const {
         
         // Primary function
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue(cmp);
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         // txNodes: Extra nodes if the sources points are not on an existing node
         std::vector<Node3Dnsp<T1,T2>> txNodes;
         // inQueue lists the nodes waiting in the queue
-        std::vector<bool> inQueue( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
         // Tx sources nodes are "frozen" and their traveltime can't be modified
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -1016,9 +1029,12 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             traveltimes[n] = this->getTraveltime(Rx[n], nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             // Rx are in nodes (not txNodes)
             std::vector<Node3Dnsp<T1,T2>> *node_p;
@@ -1039,15 +1055,10 @@ namespace ttcr {
                 r_tmp.push_back( child );
                 
                 cell.v = (*node_p)[iParent].getDistance( child );
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -1073,15 +1084,10 @@ namespace ttcr {
             r_tmp.push_back( child );
             
             cell.v = (*node_p)[iParent].getDistance( child );
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -1105,16 +1111,15 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::initQueue(const std::vector<sxyz<T1>>& Tx,
-                                      const std::vector<T1>& t0,
-                                      std::priority_queue<Node3Dnsp<T1,T2>*,
-                                      std::vector<Node3Dnsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<Node3Dnsp<T1,T2>>& txNodes,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::initQueue(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                                            std::vector<Node3Dnsp<T1,T2>>& txNodes,
+                                            NodeFlags& inQueue,
+                                            NodeFlags& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         //Find the starting nodes of the transmitters Tx and start the queue list
         for(size_t n=0; n<Tx.size(); ++n){
@@ -1152,17 +1157,17 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::propagate(std::priority_queue<Node3Dnsp<T1,T2>*,
-                                      std::vector<Node3Dnsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::propagate(QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                                            NodeFlags& inQueue,
+                                            NodeFlags& frozen,
+                                            size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !queue.empty() ) {
             const Node3Dnsp<T1,T2>* source = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;
             
@@ -1178,6 +1183,7 @@ namespace ttcr {
                     if (ttsource < this->nodes[neibNo].getTT(threadNo)){
                         // Compute dt
                         T1 dt = this->computeDt(*source, this->nodes[neibNo]);
+                        this->instrumentation.count(threadNo, LOCAL_UPDATE);
                         
                         if ( ttsource +dt < this->nodes[neibNo].getTT( threadNo ) ) {
                             this->nodes[neibNo].setTT( ttsource +dt, threadNo );
@@ -1187,7 +1193,11 @@ namespace ttcr {
                             
                             if ( !inQueue[neibNo] ) {
                                 queue.push( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_PUSH);
                                 inQueue[neibNo] = true;
+                            } else {
+                                queue.update( &(this->nodes[neibNo]) );
+                                this->instrumentation.count(threadNo, QUEUE_UPDATE);
                             }
                         }
                     }
@@ -1196,14 +1206,12 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::prepropagate(const Node3Dnsp<T1,T2>& node,
-                                         std::priority_queue<Node3Dnsp<T1,T2>*,
-                                         std::vector<Node3Dnsp<T1,T2>*>,
-                                         CompareNodePtr<T1>>& queue,
-                                         std::vector<bool>& inQueue,
-                                         std::vector<bool>& frozen,
-                                         const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::prepropagate(const Node3Dnsp<T1,T2>& node,
+                                               QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                                               NodeFlags& inQueue,
+                                               NodeFlags& frozen,
+                                               const size_t threadNo) const {
         
         // This function can be used to "prepropagate" each Tx nodes one first time
         // during "initQueue", before running "propagate".
@@ -1222,6 +1230,7 @@ namespace ttcr {
                 
                 // compute dt
                 T1 dt = this->computeDt(node, this->nodes[neibNo]);
+                this->instrumentation.count(threadNo, LOCAL_UPDATE);
                 
                 if ( node.getTT( threadNo )+dt < this->nodes[neibNo].getTT( threadNo ) ) {
                     this->nodes[neibNo].setTT( node.getTT( threadNo )+dt, threadNo );
@@ -1230,7 +1239,11 @@ namespace ttcr {
                     
                     if ( !inQueue[neibNo] ) {
                         queue.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inQueue[neibNo] = true;
+                    } else {
+                        queue.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
@@ -1238,9 +1251,9 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Drnsp<T1,T2>::savePrimary(const char filename[], const size_t nt,
-                                        const bool vtkFormat) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Drnsp<T1,T2,QUEUE>::savePrimary(const char filename[], const size_t nt,
+                                              const bool vtkFormat) const {
         
         if ( vtkFormat ) {
             
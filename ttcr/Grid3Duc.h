@@ -31,9 +31,11 @@
 #include <array>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <set>
 #include <sstream>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 #ifdef VTK
@@ -51,8 +53,11 @@
 #include "vtkXMLUnstructuredGridWriter.h"
 #endif
 
+#include "Adjacency.h"
+#include "CellLocator3D.h"
 #include "Grad.h"
 #include "Grid3D.h"
+#include "GridCache.h"
 #include "utils.h"
 
 namespace ttcr {
@@ -63,14 +68,18 @@ namespace ttcr {
         Grid3Duc(const std::vector<sxyz<T1>>& no,
                  const std::vector<tetrahedronElem<T2>>& tet,
                  const size_t nt=1) :
+        Grid3D<T1,T2>(nt),
         nThreads(nt),
         nPrimary(static_cast<T2>(no.size())),
         source_radius(0.0),
         nodes(std::vector<NODE>(no.size(), NODE(nt))),
         slowness(std::vector<T1>(tet.size())),
-        neighbors(std::vector<std::vector<T2>>(tet.size())),
-        tetrahedra(tet)
-        {}
+        neighbors(tet.size()),
+        tetrahedra(tet),
+        locator()
+        {
+            locator.build(no, tet);
+        }
         
         virtual ~Grid3Duc() {}
         
@@ -105,6 +114,7 @@ namespace ttcr {
         }
         
         size_t getNumberOfNodes() const { return nodes.size(); }
+        size_t getNumberOfCells() const { return tetrahedra.size(); }
         
         const T1 getXmin() const {
             T1 xmin = nodes[0].getX();
@@ -169,9 +179,15 @@ namespace ttcr {
                              std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
                              const size_t=0) const {}
         
+        void setInputOrder(const std::vector<T2>& o) { inputOrder = o; }
+        
         void saveTT(const std::string &, const int, const size_t nt=0,
                     const bool vtkFormat=0) const;
         
+        // save nodes, owners & neighbors of the built grid, key identifying
+        // the data the grid was built from (see GridCache.h)
+        void saveGridCache(const std::string &, const uint64_t key) const;
+        
 #ifdef VTK
         void saveModelVTU(const std::string &, const bool saveSlowness=true,
                           const bool savePhysicalEntity=false) const;
@@ -186,14 +202,56 @@ namespace ttcr {
         
         const size_t getNthreads() const { return nThreads; }
         
+        // memory used by the lists of nodes of the cells, in bytes
+        size_t getNeighborsSize() const {
+            return neighbors.getSize();
+        }
+        
+        size_t getSharedMemorySize() const {
+            size_t size = sizeof(*this) + neighbors.getSize() +
+            slowness.capacity()*sizeof(T1) +
+            (nodes.capacity()-nodes.size())*sizeof(NODE) +
+            faceNeighbors.capacity()*sizeof(std::array<T2,4>) +
+            tetrahedra.capacity()*sizeof(tetrahedronElem<T2>) +
+            inputOrder.capacity()*sizeof(T2) + locator.getSize() +
+            tetGeom.capacity()*sizeof(tetrahedronGeometry<T1>);
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                size += nodes[n].getSharedSize();
+            }
+            return size;
+        }
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(nodes.size());
+        }
+        
+        // memory needed by nNodes nodes and nTet tetrahedra holding
+        // nNodesCell nodes each, to estimate the size of a grid before
+        // building it
+        static size_t estimateSharedMemorySize(const size_t nNodes,
+                                               const size_t nTet,
+                                               const size_t nNodesCell) {
+            // nodes & their owners, neighbors, locator and tetrahedra with their slowness
+            return nNodes*NODE::estimateSharedSize() + (nTet+1)*sizeof(size_t) +
+            2*nTet*nNodesCell*sizeof(T2) + CellLocator3D<T1,T2>::estimateSize(nTet) +
+            nTet*(sizeof(std::array<T2,4>) + sizeof(tetrahedronElem<T2>) + sizeof(T1));
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // values of the nodes, and frozen & inQueue flags (std::vector<bool>)
+            return nNodes*NODE::getThreadSize() + (nNodes+3)/4;
+        }
+        
     protected:
         const size_t nThreads;
         T2 nPrimary;
         T1 source_radius;
         mutable std::vector<NODE> nodes;
         std::vector<T1> slowness;
-        std::vector<std::vector<T2>> neighbors;  // nodes common to a cell
+        Adjacency<T2> neighbors;                 // nodes common to a cell
+        std::vector<std::array<T2,4>> faceNeighbors;  // cell across the face opposite to vertex i
         std::vector<tetrahedronElem<T2>> tetrahedra;
+        std::vector<T2> inputOrder;  // grid index of input nodes, empty if not renumbered
+        CellLocator3D<T1,T2> locator;           // bucket grid for point location
+        std::vector<tetrahedronGeometry<T1>> tetGeom;   // empty unless buildTetGeometry is called
         
         T1 computeDt(const NODE& source, const sxyz<T1>& node,
                      const size_t cellNo) const {
@@ -215,18 +273,33 @@ namespace ttcr {
                          T2& cellParentRx,
                          const size_t threadNo) const;
         
-        void checkPts(const std::vector<sxyz<T1>>&) const;
+        void checkPts(const std::vector<sxyz<T1>>&, const size_t threadNo=0) const;
         
         bool insideTetrahedron(const sxyz<T1>&, const T2) const;
         
         T2 getCellNo(const sxyz<T1>& pt) const {
-            for ( T2 n=0; n<tetrahedra.size(); ++n ) {
-                if ( insideTetrahedron(pt, n) ) {
-                    return n;
+            auto range = locator.getCandidates(pt);
+            for ( auto nc=range.first; nc!=range.second; ++nc ) {
+                if ( insideTetrahedron(pt, *nc) ) {
+                    return *nc;
                 }
             }
             return -1;
         }
+        
+        T2 getNodeNo(const sxyz<T1>& pt) const {
+            // lowest index of nodes at pt, looking only in candidate cells
+            T2 nodeNo = std::numeric_limits<T2>::max();
+            auto range = locator.getCandidates(pt);
+            for ( auto nc=range.first; nc!=range.second; ++nc ) {
+                for ( auto nn=neighbors[*nc].begin(); nn!=neighbors[*nc].end(); ++nn ) {
+                    if ( *nn < nodeNo && nodes[*nn] == pt ) {
+                        nodeNo = *nn;
+                    }
+                }
+            }
+            return nodeNo;
+        }
 
         void buildGridNodes(const std::vector<sxyz<T1>>&, const size_t);
         void buildGridNodes(const std::vector<sxyz<T1>>&,
@@ -234,14 +307,105 @@ namespace ttcr {
 
         void buildGridNeighbors() {
             // Index the neighbors nodes of each cell
-            for ( T2 n=0; n<nodes.size(); ++n ) {
-                for ( size_t n2=0; n2<nodes[n].getOwners().size(); ++n2) {
-                    neighbors[ nodes[n].getOwners()[n2] ].push_back(n);
+            neighbors.buildFromOwners(nodes);
+        }
+        
+        // Index the cells sharing a face, faceNeighbors[n][i] is the cell on
+        // the other side of the face of tetrahedron n opposite to vertex
+        // tetrahedra[n].i[i], or max() if the face is on the boundary.  Used
+        // to walk raypaths, to be called once nodes are built
+        void buildFaceNeighbors() {
+            const T2 none = std::numeric_limits<T2>::max();
+            faceNeighbors.assign(tetrahedra.size(), {{none, none, none, none}});
+            for ( size_t n=0; n<tetrahedra.size(); ++n ) {
+                for ( size_t i=0; i<4; ++i ) {
+                    if ( faceNeighbors[n][i] != none ) continue;
+                    std::array<T2,3> face;
+                    for ( size_t j=0, k=0; j<4; ++j ) {
+                        if ( j != i ) face[k++] = tetrahedra[n].i[j];
+                    }
+                    const std::vector<T2>& owners = nodes[face[0]].getOwners();
+                    for ( size_t no=0; no<owners.size(); ++no ) {
+                        if ( owners[no] == n ) continue;
+                        size_t i2 = oppositeVertex(face, owners[no]);
+                        if ( i2 < 4 ) {
+                            faceNeighbors[n][i] = owners[no];
+                            faceNeighbors[owners[no]][i2] = static_cast<T2>(n);
+                            break;
+                        }
+                    }
                 }
             }
         }
         
-        void localUpdate3D(NODE *vertexC, const size_t threadNo) const;
+        // index in tetrahedra[cellNo].i of the vertex not on the face, or 4
+        // if the face is not a face of cellNo
+        size_t oppositeVertex(const std::array<T2,3> &faceNodes, const T2 cellNo) const {
+            size_t i = 4;
+            size_t nFound = 0;
+            for ( size_t j=0; j<4; ++j ) {
+                T2 v = tetrahedra[cellNo].i[j];
+                if ( v == faceNodes[0] || v == faceNodes[1] || v == faceNodes[2] ) {
+                    ++nFound;
+                } else {
+                    i = j;
+                }
+            }
+            return nFound == 3 ? i : 4;
+        }
+        
+        bool isVertex(const T2 nodeNo, const T2 cellNo) const {
+            return tetrahedra[cellNo].i[0] == nodeNo || tetrahedra[cellNo].i[1] == nodeNo ||
+            tetrahedra[cellNo].i[2] == nodeNo || tetrahedra[cellNo].i[3] == nodeNo;
+        }
+        
+        // cells where a raypath reaches a Tx, sorted, with the index of the
+        // first Tx found in the cell (same test as in the raypath loop)
+        void getTxCells(const std::vector<bool>& txOnNode,
+                        const std::vector<T2>& txNode,
+                        const std::vector<T2>& txCell,
+                        const std::vector<std::vector<T2>>& txNeighborCells,
+                        std::vector<std::pair<T2,size_t>>& txCells) const {
+            txCells.clear();
+            for ( size_t nt=0; nt<txOnNode.size(); ++nt ) {
+                if ( txOnNode[nt] ) {
+                    for ( auto nc=nodes[txNode[nt]].getOwners().begin();
+                         nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
+                        txCells.push_back( {*nc, nt} );
+                    }
+                } else {
+                    txCells.push_back( {txCell[nt], nt} );
+                    for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
+                        txCells.push_back( {txNeighborCells[nt][nn], nt} );
+                    }
+                }
+            }
+            std::sort(txCells.begin(), txCells.end());
+            txCells.erase(std::unique(txCells.begin(), txCells.end(),
+                                      [](const std::pair<T2,size_t>& a,
+                                         const std::pair<T2,size_t>& b) { return a.first == b.first; }),
+                          txCells.end());
+        }
+        
+        // precompute the geometry used by localUpdate3D (about 14 values
+        // per tetrahedron), to be called once nodes are built
+        void buildTetGeometry() {
+            tetGeom.clear();
+            tetGeom.reserve(tetrahedra.size());
+            for ( size_t n=0; n<tetrahedra.size(); ++n ) {
+                tetGeom.push_back(tetrahedronGeometry<T1>(sxyz<T1>(nodes[tetrahedra[n].i[0]]),
+                                                          sxyz<T1>(nodes[tetrahedra[n].i[1]]),
+                                                          sxyz<T1>(nodes[tetrahedra[n].i[2]]),
+                                                          sxyz<T1>(nodes[tetrahedra[n].i[3]])));
+            }
+        }
+        
+        // replaces buildGridNodes & buildGridNeighbors, returns false if
+        // the file cannot be used
+        bool loadGridCache(const std::string &, const uint64_t key);
+        
+        // returns the decrease of traveltime at vertexC
+        T1 localUpdate3D(NODE *vertexC, const size_t threadNo) const;
         
         T1 localUpdate2D(const NODE *vertexA,
                          const NODE *vertexB,
@@ -249,6 +413,16 @@ namespace ttcr {
                          const T2 tetraNo,
                          const size_t threadNo) const;
         
+        // iA, iB & iC are the indices of the vertices in the tetrahedron
+        T1 localUpdate2D(const NODE *vertexA,
+                         const NODE *vertexB,
+                         const NODE *vertexC,
+                         const T2 tetraNo,
+                         const T2 iA,
+                         const T2 iB,
+                         const T2 iC,
+                         const size_t threadNo) const;
+        
         void local3Dsolver(NODE *vertexC, const size_t threadNo) const;
         
         T1 local2Dsolver(const NODE *vertexA,
@@ -519,15 +693,83 @@ namespace ttcr {
         nodes.shrink_to_fit();
     }
     
+    template<typename T1, typename T2, typename NODE>
+    void Grid3Duc<T1,T2,NODE>::saveGridCache(const std::string &fname,
+                                             const uint64_t key) const {
+        GridCacheWriter cache(fname, key, sizeof(T1), sizeof(T2),
+                              nodes.size(), tetrahedra.size());
+        std::vector<T1> xyz(3*nodes.size());
+        std::vector<int> primary(nodes.size());
+        for ( size_t n=0; n<nodes.size(); ++n ) {
+            xyz[3*n] = nodes[n].getX();
+            xyz[3*n+1] = nodes[n].getY();
+            xyz[3*n+2] = nodes[n].getZ();
+            primary[n] = nodes[n].isPrimary();
+        }
+        cache.write(xyz);
+        cache.write(primary);
+        cache.template writeLists<T2>(nodes.size(), [this](const size_t n) -> const std::vector<T2>& {
+            return nodes[n].getOwners();
+        });
+        cache.template writeLists<T2>(neighbors.size(), [this](const size_t n) {
+            return neighbors[n];
+        });
+        cache.close();
+    }
+    
+    template<typename T1, typename T2, typename NODE>
+    bool Grid3Duc<T1,T2,NODE>::loadGridCache(const std::string &fname,
+                                             const uint64_t key) {
+        try {
+            GridCacheReader cache(fname);
+            if ( !cache.template matches<T1,T2>(key) ||
+                 cache.getNnodes() < nPrimary || cache.getNcells() != tetrahedra.size() ) {
+                return false;
+            }
+            std::vector<T1> xyz;
+            std::vector<int> primary;
+            cache.read(xyz);
+            cache.read(primary);
+            if ( xyz.size() != 3*cache.getNnodes() || primary.size() != cache.getNnodes() ) {
+                return false;
+            }
+            nodes.clear();
+            nodes.resize(cache.getNnodes(), NODE(nThreads));
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                nodes[n].setXYZindex( xyz[3*n], xyz[3*n+1], xyz[3*n+2], static_cast<T2>(n) );
+                nodes[n].setPrimary( primary[n] != 0 );
+            }
+            cache.template readLists<T2>([this](const size_t n, const T2 *first, const T2 *last) {
+                if ( n >= nodes.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                for ( const T2 *o=first; o!=last; ++o ) nodes[n].pushOwner( *o );
+            });
+            neighbors.clear();
+            cache.template readLists<T2>([this](const size_t n, const T2 *first, const T2 *last) {
+                if ( n != neighbors.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                neighbors.append(first, last);
+            });
+            if ( neighbors.size() != tetrahedra.size() ) {
+                throw std::runtime_error("Error: grid cache corrupted.");
+            }
+        } catch ( std::exception& ) {
+            // back to the state expected by buildGridNodes
+            nodes.clear();
+            nodes.resize(nPrimary, NODE(nThreads));
+            neighbors = Adjacency<T2>(tetrahedra.size());
+            return false;
+        }
+        return true;
+    }
+    
     template<typename T1, typename T2, typename NODE>
     T1 Grid3Duc<T1,T2,NODE>::getTraveltime(const sxyz<T1>& Rx,
                                            const std::vector<NODE>& nodes,
                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
-        for ( size_t nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == Rx ) {
-                return nodes[nn].getTT(threadNo);
-            }
+        T2 nodeNo = getNodeNo( Rx );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            return nodes[nodeNo].getTT(threadNo);
         }
         
         T2 cellNo = getCellNo( Rx );
@@ -551,13 +793,13 @@ namespace ttcr {
                                            const std::vector<NODE>& nodes,
                                            T2& nodeParentRx, T2& cellParentRx,
                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
-        for ( size_t nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == Rx ) {
-                nodeParentRx = nodes[nn].getNodeParent(threadNo);
-                cellParentRx = nodes[nn].getCellParent(threadNo);
-                return nodes[nn].getTT(threadNo);
-            }
+        T2 nodeNo = getNodeNo( Rx );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            nodeParentRx = nodes[nodeNo].getNodeParent(threadNo);
+            cellParentRx = nodes[nodeNo].getCellParent(threadNo);
+            return nodes[nodeNo].getTT(threadNo);
         }
         
         T2 cellNo = getCellNo( Rx );
@@ -581,24 +823,20 @@ namespace ttcr {
     
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Duc<T1,T2,NODE>::checkPts(const std::vector<sxyz<T1>>& pts) const {
+    void Grid3Duc<T1,T2,NODE>::checkPts(const std::vector<sxyz<T1>>& pts,
+                                        const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, CHECK_PTS);
         
         for (size_t n=0; n<pts.size(); ++n) {
             bool found = false;
             // check first if point is on a node
-            for ( T2 nt=0; nt<nodes.size(); ++nt ) {
-                if ( nodes[nt] == pts[n]) {
-                    found = true;
-                    break;
-                }
+            if ( getNodeNo(pts[n]) != std::numeric_limits<T2>::max() ) {
+                found = true;
             }
             if ( found == false ) {
                 // check if inside tetrahedra
-                for ( T2 nt=0; nt<tetrahedra.size(); ++nt ) {
-                    if ( insideTetrahedron(pts[n], nt) ) {
-                        found = true;
-                        break;
-                    }
+                if ( getCellNo(pts[n]) != std::numeric_limits<T2>::max() ) {
+                    found = true;
                 }
             }
             if ( found == false ) {
@@ -717,10 +955,12 @@ namespace ttcr {
                 nMax = static_cast<T2>(nodes.size());
             }
             for ( T2 n=0; n<nMax; ++n ) {
-                fout << nodes[n].getX() << '\t'
-                << nodes[n].getY() << '\t'
-                << nodes[n].getZ() << '\t'
-                << nodes[n].getTT(nt) << '\n';
+                // primary nodes are written in the order of the input file
+                T2 nn = n<inputOrder.size() ? inputOrder[n] : n;
+                fout << nodes[nn].getX() << '\t'
+                << nodes[nn].getY() << '\t'
+                << nodes[nn].getZ() << '\t'
+                << nodes[nn].getTT(nt) << '\n';
             }
             fout.close();
         }
@@ -857,11 +1097,9 @@ namespace ttcr {
                 pt.y = 0.5*(x[2]+x[3]);
                 pt.z = 0.5*(x[4]+x[5]);
                 
-                for ( T2 nt=0; nt<tetrahedra.size(); ++nt ) {
-                    if ( insideTetrahedron(pt, nt) ) {
-                        data->InsertNextValue( slowness[nt] );
-                        break;
-                    }
+                T2 nt = getCellNo( pt );
+                if ( nt != std::numeric_limits<T2>::max() ) {
+                    data->InsertNextValue( slowness[nt] );
                 }
             }
         } else {
@@ -876,11 +1114,9 @@ namespace ttcr {
                 pt.y = 0.5*(x[2]+x[3]);
                 pt.z = 0.5*(x[4]+x[5]);
                 
-                for ( T2 nt=0; nt<tetrahedra.size(); ++nt ) {
-                    if ( insideTetrahedron(pt, nt) ) {
-                        data->InsertNextValue( 1./slowness[nt] );
-                        break;
-                    }
+                T2 nt = getCellNo( pt );
+                if ( nt != std::numeric_limits<T2>::max() ) {
+                    data->InsertNextValue( 1./slowness[nt] );
                 }
             }
         }
@@ -948,11 +1184,9 @@ namespace ttcr {
                         std::cout.flush();
                     }
                     
-                    for ( T2 nt=0; nt<tetrahedra.size(); ++nt ) {
-                        if ( insideTetrahedron(pt, nt) ) {
-                            data[nd++] = 1./slowness[nt];
-                            break;
-                        }
+                    T2 nt = getCellNo( pt );
+                    if ( nt != std::numeric_limits<T2>::max() ) {
+                        data[nd++] = 1./slowness[nt];
                     }
                 }
             }
@@ -991,11 +1225,13 @@ namespace ttcr {
     
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Duc<T1,T2,NODE>::localUpdate3D(NODE *vertexD,
-                                             const size_t threadNo) const {
+    T1 Grid3Duc<T1,T2,NODE>::localUpdate3D(NODE *vertexD,
+                                           const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         // méthode of Lelievre et al. 2011
         
+        const T1 t0 = vertexD->getTT(threadNo);
         T2 iA, iB, iC, iD;
         NODE *vertexA, *vertexB, *vertexC;
         
@@ -1036,43 +1272,43 @@ namespace ttcr {
                 T1 u = vertexB->getTT(threadNo) - vertexA->getTT(threadNo);
                 T1 v = vertexC->getTT(threadNo) - vertexA->getTT(threadNo);
                 
-                sxyz<T1> v_b = { vertexC->getX() - vertexA->getX(),
-                    vertexC->getY() - vertexA->getY(),
-                    vertexC->getZ() - vertexA->getZ() };
-                sxyz<T1> v_c = { vertexB->getX() - vertexA->getX(),
-                    vertexB->getY() - vertexA->getY(),
-                    vertexB->getZ() - vertexA->getZ() };
+                T1 b, c, d2, phi, rho0, xi0, zeta0;
                 
-                T1 b = norm( v_b );
-                T1 c = norm( v_c );
-                T1 d2 = dot(v_b, v_c);  // eq 15
+                if ( tetGeom.empty() ) {
+                    sxyz<T1> v_b = { vertexC->getX() - vertexA->getX(),
+                        vertexC->getY() - vertexA->getY(),
+                        vertexC->getZ() - vertexA->getZ() };
+                    sxyz<T1> v_c = { vertexB->getX() - vertexA->getX(),
+                        vertexB->getY() - vertexA->getY(),
+                        vertexB->getZ() - vertexA->getZ() };
                 
-                T1 alpha = acos( d2 / (b*c) );
+                    b = norm( v_b );
+                    c = norm( v_c );
+                    d2 = dot(v_b, v_c);  // eq 15
                 
-                T1 phi = c*b*sin(alpha);  // eq 23a
+                    T1 alpha = acos( d2 / (b*c) );
                 
-                T1 w_tilde = sqrt( slowness[tetNo]*slowness[tetNo]*phi*phi -
-                                  u*u*b*b - v*v*c*c + 2.*u*v*d2 );  // eq 23b
+                    phi = c*b*sin(alpha);  // eq 23a
                 
-                // project D on plane
+                    // project D on plane
                 
-                sxyz<T1> v_n = cross(v_b, v_c);
+                    sxyz<T1> v_n = cross(v_b, v_c);
                 
-                T1 d_tmp = -vertexA->getX()*v_n.x - vertexA->getY()*v_n.y - vertexA->getZ()*v_n.z;
+                    T1 d_tmp = -vertexA->getX()*v_n.x - vertexA->getY()*v_n.y - vertexA->getZ()*v_n.z;
                 
-                T1 k = -(d_tmp + v_n.x*vertexD->getX() + v_n.y*vertexD->getY() + v_n.z*vertexD->getZ())/
-                norm2(v_n);
+                    T1 k = -(d_tmp + v_n.x*vertexD->getX() + v_n.y*vertexD->getY() + v_n.z*vertexD->getZ())/
+                    norm2(v_n);
                 
-                sxyz<T1> pt;
-                pt.x = vertexD->getX() + k*v_n.x;
-                pt.y = vertexD->getY() + k*v_n.y;
-                pt.z = vertexD->getZ() + k*v_n.z;
+                    sxyz<T1> pt;
+                    pt.x = vertexD->getX() + k*v_n.x;
+                    pt.y = vertexD->getY() + k*v_n.y;
+                    pt.z = vertexD->getZ() + k*v_n.z;
                 
-                T1 rho0 = vertexD->getDistance( pt );
+                    rho0 = vertexD->getDistance( pt );
                 
-                sxyz<T1> v_pt = {pt.x-vertexA->getX(), pt.y-vertexA->getY(), pt.z-vertexA->getZ()};
+                    sxyz<T1> v_pt = {pt.x-vertexA->getX(), pt.y-vertexA->getY(), pt.z-vertexA->getZ()};
                 
-                // project point on AB
+                    // project point on AB
                 
 //                k = dot(v_pt,v_c)/dot(v_c,v_c);
 //                pt.x = vertexA->getX() + k*v_c.x;
@@ -1080,9 +1316,9 @@ namespace ttcr {
 //                pt.z = vertexA->getZ() + k*v_c.z;
 //                
 //                T1 xi0 = vertexA->getDistance( pt )/c;
-                T1 xi0 = dot(v_pt,v_c)/dot(v_c,v_c);
+                    xi0 = dot(v_pt,v_c)/dot(v_c,v_c);
                 
-                // project point on AC
+                    // project point on AC
                 
 //                k = dot(v_pt,v_b)/dot(v_b,v_b);
 //                pt.x = vertexA->getX() + k*v_b.x;
@@ -1090,8 +1326,26 @@ namespace ttcr {
 //                pt.z = vertexA->getZ() + k*v_b.z;
 //                
 //                T1 zeta0 = vertexA->getDistance( pt )/b;
-                T1 zeta0 = dot(v_pt,v_b)/dot(v_b,v_b);
+                    zeta0 = dot(v_pt,v_b)/dot(v_b,v_b);
+                } else {
+                    // same quantities, with dot products of edges from
+                    // the law of cosines
+                    const tetrahedronGeometry<T1>& g = tetGeom[tetNo];
+                    b = g.l[tetEdge(iA,iC)];
+                    c = g.l[tetEdge(iA,iB)];
+                    T1 a = g.l[tetEdge(iB,iC)];
+                    d2 = 0.5*(b*b + c*c - a*a);  // eq 15
+                    phi = g.phi[iD];  // eq 23a
+                    rho0 = g.rho[iD];
+                    T1 ad = g.l[tetEdge(iA,iD)];
+                    T1 bd = g.l[tetEdge(iB,iD)];
+                    T1 cd = g.l[tetEdge(iC,iD)];
+                    xi0 = 0.5*(ad*ad + c*c - bd*bd)/(c*c);
+                    zeta0 = 0.5*(ad*ad + b*b - cd*cd)/(b*b);
+                }
                 
+                T1 w_tilde = sqrt( slowness[tetNo]*slowness[tetNo]*phi*phi -
+                                  u*u*b*b - v*v*c*c + 2.*u*v*d2 );  // eq 23b
                 
                 T1 beta = u*b*b - v*d2;    // from eq 19
                 T1 gamma = v*c*c - u*d2;
@@ -1108,24 +1362,42 @@ namespace ttcr {
                 }
             }
             
-            T1 t = vertexA->getTT(threadNo) + slowness[tetNo] * vertexD->getDistance( *vertexA );
-            if ( t < tABC ) tABC = t;
-            t = vertexB->getTT(threadNo) + slowness[tetNo] * vertexD->getDistance( *vertexB );
-            if ( t < tABC ) tABC = t;
-            t = vertexC->getTT(threadNo) + slowness[tetNo] * vertexD->getDistance( *vertexC );
-            if ( t < tABC ) tABC = t;
-            
-            t = localUpdate2D(vertexA, vertexB, vertexD, tetNo, threadNo);
-            if ( t < tABC ) tABC = t;
-            t = localUpdate2D(vertexA, vertexC, vertexD, tetNo, threadNo);
-            if ( t < tABC ) tABC = t;
-            t = localUpdate2D(vertexB, vertexC, vertexD, tetNo, threadNo);
-            if ( t < tABC ) tABC = t;
+            if ( tetGeom.empty() ) {
+                T1 t = vertexA->getTT(threadNo) + slowness[tetNo] * vertexD->getDistance( *vertexA );
+                if ( t < tABC ) tABC = t;
+                t = vertexB->getTT(threadNo) + slowness[tetNo] * vertexD->getDistance( *vertexB );
+                if ( t < tABC ) tABC = t;
+                t = vertexC->getTT(threadNo) + slowness[tetNo] * vertexD->getDistance( *vertexC );
+                if ( t < tABC ) tABC = t;
+                
+                t = localUpdate2D(vertexA, vertexB, vertexD, tetNo, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexA, vertexC, vertexD, tetNo, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexB, vertexC, vertexD, tetNo, threadNo);
+                if ( t < tABC ) tABC = t;
+            } else {
+                const tetrahedronGeometry<T1>& g = tetGeom[tetNo];
+                T1 t = vertexA->getTT(threadNo) + slowness[tetNo] * g.l[tetEdge(iA,iD)];
+                if ( t < tABC ) tABC = t;
+                t = vertexB->getTT(threadNo) + slowness[tetNo] * g.l[tetEdge(iB,iD)];
+                if ( t < tABC ) tABC = t;
+                t = vertexC->getTT(threadNo) + slowness[tetNo] * g.l[tetEdge(iC,iD)];
+                if ( t < tABC ) tABC = t;
+                
+                t = localUpdate2D(vertexA, vertexB, vertexD, tetNo, iA, iB, iD, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexA, vertexC, vertexD, tetNo, iA, iC, iD, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexB, vertexC, vertexD, tetNo, iB, iC, iD, threadNo);
+                if ( t < tABC ) tABC = t;
+            }
             
             if ( tABC<vertexD->getTT(threadNo) )
                 vertexD->setTT(tABC, threadNo);
             
         }
+        return t0 - vertexD->getTT(threadNo);
     }
     
     
@@ -1181,9 +1453,54 @@ namespace ttcr {
         return t;
     }
     
+    template<typename T1, typename T2, typename NODE>
+    T1 Grid3Duc<T1,T2,NODE>::localUpdate2D(const NODE *vertexA,
+                                           const NODE *vertexB,
+                                           const NODE *vertexC,
+                                           const T2 tetNo,
+                                           const T2 iA,
+                                           const T2 iB,
+                                           const T2 iC,
+                                           const size_t threadNo) const {
+        
+        // same as above, with the geometry of the tetrahedron precomputed
+        
+        const tetrahedronGeometry<T1>& g = tetGeom[tetNo];
+        
+        if ( vertexB->getTT(threadNo)==std::numeric_limits<T1>::max() &&
+            vertexA->getTT(threadNo)==std::numeric_limits<T1>::max() ) {
+            return std::numeric_limits<T1>::max();
+        }
+        
+        T1 u = vertexB->getTT(threadNo) - vertexA->getTT(threadNo);
+        
+        T1 c = g.l[tetEdge(iA,iB)];
+        
+        T1 w2 = slowness[tetNo]*slowness[tetNo]*c*c - u*u;
+        if ( w2 < 0.0 ) {
+            return std::numeric_limits<T1>::max();
+        }
+        
+        T1 w = sqrt( w2 );
+        
+        T1 ac = g.l[tetEdge(iA,iC)];
+        T1 bc = g.l[tetEdge(iB,iC)];
+        T1 xi0 = 0.5*(ac*ac + c*c - bc*bc)/(c*c);
+        T1 rho0 = g.phi[6-iA-iB-iC]/c;  // height of triangle ABC
+        
+        T1 xi = xi0 - u*rho0/(w*c);
+        
+        if ( 0.<xi && xi<1. ) {
+            return vertexA->getTT(threadNo) + u*xi0 + w*rho0/c;
+        } else {
+            return std::numeric_limits<T1>::max();
+        }
+    }
+    
     template<typename T1, typename T2, typename NODE>
     void Grid3Duc<T1,T2,NODE>::local3Dsolver(NODE *vertexD,
                                              const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         // Méthode de Qian et al. 2007
         
@@ -1219,8 +1536,13 @@ namespace ttcr {
                 continue;
             }
             
-            AB = vertexA->getDistance( *vertexB );
-            AC = vertexA->getDistance( *vertexC );
+            if ( tetGeom.empty() ) {
+                AB = vertexA->getDistance( *vertexB );
+                AC = vertexA->getDistance( *vertexC );
+            } else {
+                AB = tetGeom[tetNo].l[tetEdge(iA,iB)];
+                AC = tetGeom[tetNo].l[tetEdge(iA,iC)];
+            }
             
             bool apply2Dsolvers = true;
             
@@ -1518,6 +1840,7 @@ namespace ttcr {
                                           const sxyz<T1> &Rx,
                                           std::vector<sxyz<T1>> &r_data,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         T1 minDist = small;
         r_data.emplace_back( Rx );
@@ -1533,12 +1856,10 @@ namespace ttcr {
         std::vector<T2> txCell( Tx.size() );
         std::vector<std::vector<T2>> txNeighborCells( Tx.size() );
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-            for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-                if ( nodes[nn] == Tx[nt] ) {
-                    txOnNode[nt] = true;
-                    txNode[nt] = nn;
-                    break;
-                }
+            T2 nn = getNodeNo( Tx[nt] );
+            if ( nn != std::numeric_limits<T2>::max() ) {
+                txOnNode[nt] = true;
+                txNode[nt] = nn;
             }
         }
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
@@ -1556,13 +1877,16 @@ namespace ttcr {
                 
                 for ( size_t nedge=0; nedge<6; ++nedge ) {
                     for ( auto nc0=nodes[ind[nedge][0]].getOwners().begin(); nc0!=nodes[ind[nedge][0]].getOwners().end(); ++nc0 ) {
-                        if ( std::find(nodes[ind[nedge][1]].getOwners().begin(), nodes[ind[nedge][1]].getOwners().end(), *nc0)!=nodes[ind[nedge][1]].getOwners().end() )
+                        if ( isVertex(ind[nedge][1], *nc0) )
                             txNeighborCells[nt].push_back( *nc0 );
                     }
                 }
             }
         }
         
+        std::vector<std::pair<T2,size_t>> txCells;
+        getTxCells(txOnNode, txNode, txCell, txNeighborCells, txCells);
+        
         T2 cellNo, nodeNo;
         sxyz<T1> curr_pt( Rx );
         
@@ -1574,12 +1898,9 @@ namespace ttcr {
         Grad3D<T1,NODE> grad3d;
         bool reachedTx = false;
         
-        for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn].getDistance( curr_pt ) < small ) {
-                nodeNo = nn;
-                onNode = true;
-                break;
-            }
+        nodeNo = getNodeNo( curr_pt );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            onNode = true;
         }
         if ( !onNode ) {
             cellNo = getCellNo( curr_pt );
@@ -1716,7 +2037,7 @@ namespace ttcr {
                 // find cells common to edge
                 std::vector<T2> cells;
                 for ( auto nc0=nodes[edgeNodes[0]].getOwners().begin(); nc0!=nodes[edgeNodes[0]].getOwners().end(); ++nc0 ) {
-                    if ( std::find(nodes[edgeNodes[1]].getOwners().begin(), nodes[edgeNodes[1]].getOwners().end(), *nc0)!=nodes[edgeNodes[1]].getOwners().end() )
+                    if ( isVertex(edgeNodes[1], *nc0) )
                         cells.push_back( *nc0 );
                 }
                 
@@ -2075,31 +2396,11 @@ namespace ttcr {
                     }
                 }
             } else {
-                for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-                    if ( txOnNode[nt] ) {
-                        for ( auto nc=nodes[txNode[nt]].getOwners().begin();
-                             nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
-                            if ( cellNo == *nc ) {
-                                r_data.push_back( Tx[nt] );
-                                reachedTx = true;
-                                break;
-                            }
-                        }
-                    } else {
-                        if ( cellNo == txCell[nt] ) {
-                            r_data.push_back( Tx[nt] );
-                            reachedTx = true;
-                        } else {
-                            for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
-                                if ( cellNo == txNeighborCells[nt][nn] ) {
-                                    r_data.push_back( Tx[nt] );
-                                    reachedTx = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if ( reachedTx ) break;
+                auto it = std::lower_bound(txCells.begin(), txCells.end(),
+                                           std::pair<T2,size_t>(cellNo, 0));
+                if ( it != txCells.end() && it->first == cellNo ) {
+                    r_data.push_back( Tx[it->second] );
+                    reachedTx = true;
                 }
             }
         }
@@ -2111,6 +2412,7 @@ namespace ttcr {
                                              const sxyz<T1> &Rx,
                                              std::vector<sxyz<T1>> &r_data,
                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         T1 minDist = small;
         r_data.emplace_back( Rx );
@@ -2126,12 +2428,10 @@ namespace ttcr {
         std::vector<T2> txCell( Tx.size() );
         std::vector<std::vector<T2>> txNeighborCells( Tx.size() );
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-            for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-                if ( nodes[nn] == Tx[nt] ) {
-                    txOnNode[nt] = true;
-                    txNode[nt] = nn;
-                    break;
-                }
+            T2 nn = getNodeNo( Tx[nt] );
+            if ( nn != std::numeric_limits<T2>::max() ) {
+                txOnNode[nt] = true;
+                txNode[nt] = nn;
             }
         }
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
@@ -2149,13 +2449,16 @@ namespace ttcr {
                 
                 for ( size_t nedge=0; nedge<6; ++nedge ) {
                     for ( auto nc0=nodes[ind[nedge][0]].getOwners().begin(); nc0!=nodes[ind[nedge][0]].getOwners().end(); ++nc0 ) {
-                        if ( std::find(nodes[ind[nedge][1]].getOwners().begin(), nodes[ind[nedge][1]].getOwners().end(), *nc0)!=nodes[ind[nedge][1]].getOwners().end() )
+                        if ( isVertex(ind[nedge][1], *nc0) )
                             txNeighborCells[nt].push_back( *nc0 );
                     }
                 }
             }
         }
         
+        std::vector<std::pair<T2,size_t>> txCells;
+        getTxCells(txOnNode, txNode, txCell, txNeighborCells, txCells);
+        
         T2 cellNo, nodeNo;
         sxyz<T1> curr_pt( Rx );
         
@@ -2167,12 +2470,9 @@ namespace ttcr {
         Grad3D_ho<T1,NODE> grad3d;
         bool reachedTx = false;
         
-        for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn].getDistance( curr_pt ) < small ) {
-                nodeNo = nn;
-                onNode = true;
-                break;
-            }
+        nodeNo = getNodeNo( curr_pt );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            onNode = true;
         }
         if ( !onNode ) {
             cellNo = getCellNo( curr_pt );
@@ -2306,7 +2606,7 @@ namespace ttcr {
                 std::vector<T2> cells;
                 std::set<NODE*> nnodes;
                 for ( auto nc0=nodes[edgeNodes[0]].getOwners().begin(); nc0!=nodes[edgeNodes[0]].getOwners().end(); ++nc0 ) {
-                    if ( std::find(nodes[edgeNodes[1]].getOwners().begin(), nodes[edgeNodes[1]].getOwners().end(), *nc0)!=nodes[edgeNodes[1]].getOwners().end() ) {
+                    if ( isVertex(edgeNodes[1], *nc0) ) {
                         cells.push_back( *nc0 );
                         getNeighborNodes(*nc0, nnodes);
                     }
@@ -2582,31 +2882,11 @@ namespace ttcr {
                     }
                 }
             } else {
-                for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-                    if ( txOnNode[nt] ) {
-                        for ( auto nc=nodes[txNode[nt]].getOwners().begin();
-                             nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
-                            if ( cellNo == *nc ) {
-                                r_data.push_back( Tx[nt] );
-                                reachedTx = true;
-                                break;
-                            }
-                        }
-                    } else {
-                        if ( cellNo == txCell[nt] ) {
-                            r_data.push_back( Tx[nt] );
-                            reachedTx = true;
-                        } else {
-                            for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
-                                if ( cellNo == txNeighborCells[nt][nn] ) {
-                                    r_data.push_back( Tx[nt] );
-                                    reachedTx = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if ( reachedTx ) break;
+                auto it = std::lower_bound(txCells.begin(), txCells.end(),
+                                           std::pair<T2,size_t>(cellNo, 0));
+                if ( it != txCells.end() && it->first == cellNo ) {
+                    r_data.push_back( Tx[it->second] );
+                    reachedTx = true;
                 }
             }
         }
@@ -2719,20 +2999,28 @@ namespace ttcr {
     T2 Grid3Duc<T1,T2,NODE>::findAdjacentCell1(const std::array<T2,3> &faceNodes,
                                                const T2 nodeNo) const {
         
-        std::vector<T2> cells;
+        // first cell owning the face, the other one is in the face table
+        T2 cell0 = std::numeric_limits<T2>::max();
+        size_t i = 4;
         for ( auto nc0=nodes[faceNodes[0]].getOwners().begin(); nc0!=nodes[faceNodes[0]].getOwners().end(); ++nc0 ) {
-            if ( std::find(nodes[faceNodes[1]].getOwners().begin(), nodes[faceNodes[1]].getOwners().end(), *nc0)!=nodes[faceNodes[1]].getOwners().end() &&
-                std::find(nodes[faceNodes[2]].getOwners().begin(), nodes[faceNodes[2]].getOwners().end(), *nc0)!=nodes[faceNodes[2]].getOwners().end() )
-                cells.push_back( *nc0 );
+            i = oppositeVertex(faceNodes, *nc0);
+            if ( i < 4 ) {
+                cell0 = *nc0;
+                break;
+            }
+        }
+        if ( cell0 == std::numeric_limits<T2>::max() ) {
+            return cell0;
         }
-        if ( cells.size() == 1 ) {
-            return cells[0];
+        T2 cell1 = faceNeighbors[cell0][i];
+        if ( cell1 == std::numeric_limits<T2>::max() ) {
+            return cell0;
         }
         for ( auto nc0=nodes[nodeNo].getOwners().begin(); nc0!=nodes[nodeNo].getOwners().end(); ++nc0 ) {
-            if ( *nc0 == cells[0] ) {
-                return cells[1];
-            } else if ( *nc0 == cells[1] ) {
-                return cells[0];
+            if ( *nc0 == cell0 ) {
+                return cell1;
+            } else if ( *nc0 == cell1 ) {
+                return cell0;
             }
         }
         return std::numeric_limits<T2>::max();
@@ -2742,19 +3030,17 @@ namespace ttcr {
     T2 Grid3Duc<T1,T2,NODE>::findAdjacentCell2(const std::array<T2,3> &faceNodes,
                                                const T2 cellNo) const {
         
-        std::vector<T2> cells;
-        for ( auto nc0=nodes[faceNodes[0]].getOwners().begin(); nc0!=nodes[faceNodes[0]].getOwners().end(); ++nc0 ) {
-            if ( std::find(nodes[faceNodes[1]].getOwners().begin(), nodes[faceNodes[1]].getOwners().end(), *nc0)!=nodes[faceNodes[1]].getOwners().end() &&
-                std::find(nodes[faceNodes[2]].getOwners().begin(), nodes[faceNodes[2]].getOwners().end(), *nc0)!=nodes[faceNodes[2]].getOwners().end() )
-                cells.push_back( *nc0 );
-        }
-        if ( cells.size() == 1 ) {
-            return cells[0];
+        size_t i = oppositeVertex(faceNodes, cellNo);
+        if ( i < 4 ) {
+            T2 cell = faceNeighbors[cellNo][i];
+            return cell == std::numeric_limits<T2>::max() ? cellNo : cell;
         }
-        if ( cellNo == cells[0] ) {
-            return cells[1];
-        } else if ( cellNo == cells[1] ) {
-            return cells[0];
+        // face not in cellNo, valid only if on the boundary
+        for ( auto nc0=nodes[faceNodes[0]].getOwners().begin(); nc0!=nodes[faceNodes[0]].getOwners().end(); ++nc0 ) {
+            i = oppositeVertex(faceNodes, *nc0);
+            if ( i < 4 ) {
+                return faceNeighbors[*nc0][i] == std::numeric_limits<T2>::max() ? *nc0 : std::numeric_limits<T2>::max();
+            }
         }
         return std::numeric_limits<T2>::max();
     }
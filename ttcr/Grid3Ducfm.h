@@ -52,19 +52,23 @@
 
 #include "Grid3Duc.h"
 #include "Node3Dc.h"
+#include "PriorityQueue.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2>
+    template<typename T1, typename T2,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid3Ducfm : public Grid3Duc<T1,T2,Node3Dc<T1,T2>> {
     public:
         Grid3Ducfm(const std::vector<sxyz<T1>>& no,
                    const std::vector<tetrahedronElem<T2>>& tet,
-                   const bool rp=false, const size_t nt=1) :
+                   const bool rp=false, const size_t nt=1, const bool tg=false) :
         Grid3Duc<T1,T2,Node3Dc<T1,T2>>(no, tet, nt), rp_ho(rp)
         {
             this->buildGridNodes(no, nt);
             this->buildGridNeighbors();
+            this->buildFaceNeighbors();
+            if ( tg ) this->buildTetGeometry();
         }
         
         ~Grid3Ducfm() {
@@ -96,44 +100,56 @@ namespace ttcr {
                      std::vector<std::vector<std::vector<sxyz<T1>>>*>&,
                      const size_t=0) const;
         
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(this->nodes.size());
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // narrow band holding all nodes at worst
+            return Grid3Duc<T1,T2,Node3Dc<T1,T2>>::estimateThreadMemorySize(nNodes) +
+            nNodes*QUEUE<Node3Dc<T1,T2>,T1>::getNodeSize();
+        }
+        
+        // memory needed by a grid of nPrimary nodes and nTet tetrahedra
+        // (see Grid3D::getMemorySize)
+        static void estimateMemorySize(const size_t nPrimary, const size_t nTet,
+                                       size_t& shared, size_t& thread) {
+            shared = sizeof(Grid3Ducfm) +
+            Grid3Duc<T1,T2,Node3Dc<T1,T2>>::estimateSharedMemorySize(nPrimary, nTet, 4);
+            thread = estimateThreadMemorySize(nPrimary);
+        }
+        
     private:
         bool rp_ho;
         
         void initBand(const std::vector<sxyz<T1>>& Tx,
                       const std::vector<T1>& t0,
-                      std::priority_queue<Node3Dc<T1,T2>*,
-                      std::vector<Node3Dc<T1,T2>*>,
-                      CompareNodePtr<T1>>&,
+                      QUEUE<Node3Dc<T1,T2>,T1>&,
                       std::vector<bool>&,
                       std::vector<bool>&,
                       const size_t) const;
         
-        void propagate(std::priority_queue<Node3Dc<T1,T2>*,
-                       std::vector<Node3Dc<T1,T2>*>,
-                       CompareNodePtr<T1>>&,
+        void propagate(QUEUE<Node3Dc<T1,T2>,T1>&,
                        std::vector<bool>&,
                        std::vector<bool>&,
                        const size_t) const;
         
     };
     
-    template<typename T1, typename T2>
-    void Grid3Ducfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dc<T1,T2>*, std::vector<Node3Dc<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<Node3Dc<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<bool> inQueue( this->nodes.size(), false );
         std::vector<bool> frozen( this->nodes.size(), false );
@@ -151,24 +167,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dc<T1,T2>*, std::vector<Node3Dc<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<Node3Dc<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<bool> inBand( this->nodes.size(), false );
         std::vector<bool> frozen( this->nodes.size(), false );
@@ -188,24 +202,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dc<T1,T2>*, std::vector<Node3Dc<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<Node3Dc<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<bool> inQueue( this->nodes.size(), false );
         std::vector<bool> frozen( this->nodes.size(), false );
@@ -238,25 +250,23 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Ducfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dc<T1,T2>*, std::vector<Node3Dc<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<Node3Dc<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
         
         std::vector<bool> inBand( this->nodes.size(), false );
         std::vector<bool> frozen( this->nodes.size(), false );
@@ -293,15 +303,14 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducfm<T1,T2>::initBand(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     std::priority_queue<Node3Dc<T1,T2>*,
-                                     std::vector<Node3Dc<T1,T2>*>,
-                                     CompareNodePtr<T1>>& narrow_band,
-                                     std::vector<bool>& inBand,
-                                     std::vector<bool>& frozen,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducfm<T1,T2,QUEUE>::initBand(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           QUEUE<Node3Dc<T1,T2>,T1>& narrow_band,
+                                           std::vector<bool>& inBand,
+                                           std::vector<bool>& frozen,
+                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -310,6 +319,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     narrow_band.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inBand[nn] = true;
                     frozen[nn] = true;
                     
@@ -323,14 +333,19 @@ namespace ttcr {
                                     T2 neibNo = this->neighbors[cellNo][k];
                                     if ( neibNo == nn ) continue;
                                     T1 dt = this->computeDt(this->nodes[nn], this->nodes[neibNo], cellNo);
+                                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                                     
                                     if ( t0[n]+dt < this->nodes[neibNo].getTT(threadNo) ) {
                                         this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
                                         
                                         if ( !inBand[neibNo] ) {
                                             narrow_band.push( &(this->nodes[neibNo]) );
+                                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                                             inBand[neibNo] = true;
                                             frozen[neibNo] = true;
+                                        } else {
+                                            narrow_band.update( &(this->nodes[neibNo]) );
+                                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                         }
                                     }
                                 }
@@ -359,9 +374,13 @@ namespace ttcr {
                                         
                                         if ( !inBand[no] ) {
                                             narrow_band.push( &(this->nodes[no]) );
+                                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                                             inBand[no] = true;
                                             frozen[no] = true;
                                             nodes_added++;
+                                        } else {
+                                            narrow_band.update( &(this->nodes[no]) );
+                                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                         }
                                     }
                                 }
@@ -389,9 +408,11 @@ namespace ttcr {
                         
                         // compute dt
                         T1 dt = this->computeDt(this->nodes[neibNo], Tx[n], cellNo);
+                        this->instrumentation.count(threadNo, LOCAL_UPDATE);
                         
                         this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
                         narrow_band.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inBand[neibNo] = true;
                         frozen[neibNo] = true;
                     }
@@ -411,9 +432,13 @@ namespace ttcr {
                                 
                                 if ( !inBand[no] ) {
                                     narrow_band.push( &(this->nodes[no]) );
+                                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                                     inBand[no] = true;
                                     frozen[no] = true;
                                     nodes_added++;
+                                } else {
+                                    narrow_band.update( &(this->nodes[no]) );
+                                    this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                 }
                             }
                         }
@@ -429,18 +454,18 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducfm<T1,T2>::propagate(std::priority_queue<Node3Dc<T1,T2>*,
-                                      std::vector<Node3Dc<T1,T2>*>,
-                                      CompareNodePtr<T1>>& narrow_band,
-                                      std::vector<bool>& inNarrowBand,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducfm<T1,T2,QUEUE>::propagate(QUEUE<Node3Dc<T1,T2>,T1>& narrow_band,
+                                            std::vector<bool>& inNarrowBand,
+                                            std::vector<bool>& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !narrow_band.empty() ) {
             
             const Node3Dc<T1,T2>* source = narrow_band.top();
             narrow_band.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inNarrowBand[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;   // marked as known
             
@@ -459,7 +484,11 @@ namespace ttcr {
                     
                     if ( !inNarrowBand[neibNo] ) {
                         narrow_band.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inNarrowBand[neibNo] = true;
+                    } else {
+                        narrow_band.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
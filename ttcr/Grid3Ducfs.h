@@ -28,6 +28,8 @@
 #include <cmath>
 #include <fstream>
 #include <queue>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "Grid3Duc.h"
@@ -42,18 +44,30 @@ namespace ttcr {
         Grid3Ducfs(const std::vector<sxyz<T1>>& no,
                    const std::vector<tetrahedronElem<T2>>& tet,
                    const T1 eps, const int maxit, const bool rp=false,
-                   const size_t nt=1) :
+                   const size_t nt=1, const bool tg=false) :
         Grid3Duc<T1,T2,Node3Dc<T1,T2>>(no, tet, nt),
-        rp_ho(rp), epsilon(eps), nitermax(maxit), S()
+        rp_ho(rp), epsilon(eps), nitermax(maxit), S(), itLog(nt)
         {
             this->buildGridNodes(no, nt);
             this->buildGridNeighbors();
+            this->buildFaceNeighbors();
+            if ( tg ) this->buildTetGeometry();
         }
         
         ~Grid3Ducfs() {
         }
         
-        void initOrdering(const std::vector<sxyz<T1>>& refPts, const int order);
+        // sweeping ordering, read from cacheFile if it was computed for the
+        // same nodes and reference points, otherwise computed and saved in it
+        void initOrdering(const std::vector<sxyz<T1>>& refPts, const int order,
+                          const std::string& cacheFile="");
+        
+        const std::vector<T1> get_change(const size_t threadNo=0) const {
+            return itLog[threadNo].change;
+        }
+        const std::vector<double> get_iteration_time(const size_t threadNo=0) const {
+            return itLog[threadNo].time;
+        }
         
         void raytrace(const std::vector<sxyz<T1>>& Tx,
                      const std::vector<T1>& t0,
@@ -81,11 +95,34 @@ namespace ttcr {
                      std::vector<std::vector<std::vector<sxyz<T1>>>*>&,
                      const size_t=0) const;
         
+        size_t getSharedMemorySize() const {
+            size_t size = Grid3Duc<T1,T2,Node3Dc<T1,T2>>::getSharedMemorySize() +
+            S.capacity()*sizeof(std::vector<Node3Dc<T1,T2>*>);
+            for ( size_t n=0; n<S.size(); ++n ) {
+                size += S[n].capacity()*sizeof(Node3Dc<T1,T2>*);
+            }
+            return size;
+        }
+        
+        // memory needed by a grid of nPrimary nodes and nTet tetrahedra,
+        // swept in nRef orderings (see Grid3D::getMemorySize)
+        static void estimateMemorySize(const size_t nPrimary, const size_t nTet,
+                                       const size_t nRef,
+                                       size_t& shared, size_t& thread) {
+            shared = sizeof(Grid3Ducfs) +
+            Grid3Duc<T1,T2,Node3Dc<T1,T2>>::estimateSharedMemorySize(nPrimary, nTet, 4) +
+            nRef*(sizeof(std::vector<Node3Dc<T1,T2>*>) + nPrimary*sizeof(Node3Dc<T1,T2>*));
+            thread = Grid3Duc<T1,T2,Node3Dc<T1,T2>>::estimateThreadMemorySize(nPrimary);
+        }
+        
     private:
         bool rp_ho;
         T1 epsilon;
         int nitermax;
         std::vector<std::vector<Node3Dc<T1,T2>*>> S;
+        mutable std::vector<iterationLog<T1>> itLog;  // convergence, for each thread
+        
+        bool loadOrdering(const std::string&, const uint64_t, const size_t);
         
         void initTx(const std::vector<sxyz<T1>>& Tx, const std::vector<T1>& t0,
                     std::vector<bool>& frozen, const size_t threadNo) const;
@@ -111,7 +148,22 @@ namespace ttcr {
     
     template<typename T1, typename T2>
     void Grid3Ducfs<T1,T2>::initOrdering(const std::vector<sxyz<T1>>& refPts,
-                                         const int order) {
+                                         const int order,
+                                         const std::string& cacheFile) {
+        GridCacheKey key;
+        if ( !cacheFile.empty() ) {
+            key.add("Grid3Ducfs ordering");
+            key.add(this->nodes.size());
+            for ( size_t n=0; n<this->nodes.size(); ++n ) {
+                key.add(this->nodes[n].getX());
+                key.add(this->nodes[n].getY());
+                key.add(this->nodes[n].getZ());
+            }
+            key.add(refPts);
+            key.add(order);
+            if ( loadOrdering(cacheFile, key.value(), refPts.size()) ) return;
+        }
+        
         S.resize( refPts.size() );
         
         Metric<T1> *m;
@@ -124,6 +176,7 @@ namespace ttcr {
         
         for ( size_t np=0; np<refPts.size(); ++np ) {
             
+            S[np].reserve( this->nodes.size() );
             for ( size_t n=0; n<this->nodes.size(); ++n ) {
                 queue.push( {n, m->l(this->nodes[n], refPts[np])} );
             }
@@ -136,6 +189,42 @@ namespace ttcr {
         }
         
         delete m;
+        
+        if ( !cacheFile.empty() ) {
+            GridCacheWriter cache(cacheFile, key.value(), sizeof(T1), sizeof(T2),
+                                  this->nodes.size(), this->tetrahedra.size());
+            std::vector<T2> ind;
+            cache.template writeLists<T2>(S.size(), [this,&ind](const size_t np) -> const std::vector<T2>& {
+                ind.resize( S[np].size() );
+                for ( size_t n=0; n<S[np].size(); ++n ) ind[n] = S[np][n]->getGridIndex();
+                return ind;
+            });
+            cache.close();
+        }
+    }
+    
+    template<typename T1, typename T2>
+    bool Grid3Ducfs<T1,T2>::loadOrdering(const std::string& cacheFile,
+                                         const uint64_t key, const size_t nRef) {
+        std::vector<std::vector<Node3Dc<T1,T2>*>> tmp(nRef);
+        try {
+            GridCacheReader cache(cacheFile);
+            if ( !cache.template matches<T1,T2>(key) || cache.getNnodes() != this->nodes.size() ) {
+                return false;
+            }
+            cache.template readLists<T2>([this,&tmp](const size_t np, const T2 *first, const T2 *last) {
+                if ( np >= tmp.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                tmp[np].reserve( last-first );
+                for ( const T2 *n=first; n!=last; ++n ) {
+                    if ( *n >= this->nodes.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                    tmp[np].push_back( &(this->nodes[*n]) );
+                }
+            });
+        } catch ( std::exception& ) {
+            return false;
+        }
+        S.swap( tmp );
+        return true;
     }
     
     template<typename T1, typename T2>
@@ -145,8 +234,8 @@ namespace ttcr {
                                      std::vector<T1>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
@@ -155,9 +244,7 @@ namespace ttcr {
         std::vector<bool> frozen( this->nodes.size(), false );
         initTx(Tx, t0, frozen, threadNo);
         
-        std::vector<T1> times( this->nodes.size() );
-        for ( size_t n=0; n<this->nodes.size(); ++n )
-            times[n] = this->nodes[n].getTT( threadNo );
+        itLog[threadNo].clear();
         
         int niter=0;
         T1 change = std::numeric_limits<T1>::max();
@@ -166,37 +253,27 @@ namespace ttcr {
             for ( size_t i=0; i<S.size(); ++i ) {
                 
                 // ascending
+                itLog[threadNo].start();
+                change = 0.0;
                 for ( auto vertexC=S[i].begin(); vertexC!=S[i].end(); ++vertexC ) {
                     if ( !frozen[(*vertexC)->getGridIndex()] )
                         //                    this->local3Dsolver(*vertexC, threadNo);
-                        this->localUpdate3D(*vertexC, threadNo);
-                }
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
+                        change += this->localUpdate3D(*vertexC, threadNo);
                 }
+                itLog[threadNo].push_back(change);
                 if ( change < epsilon ) {
                     break;
                 }
                 
                 // descending
+                itLog[threadNo].start();
+                change = 0.0;
                 for ( auto vertexC=S[i].rbegin(); vertexC!=S[i].rend(); ++vertexC ) {
                     if ( !frozen[(*vertexC)->getGridIndex()] )
                         //                    this->local3Dsolver(*vertexC, threadNo);
-                        this->localUpdate3D(*vertexC, threadNo);
-                }
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
+                        change += this->localUpdate3D(*vertexC, threadNo);
                 }
+                itLog[threadNo].push_back(change);
                 if ( change < epsilon ) {
                     break;
                 }
@@ -221,9 +298,9 @@ namespace ttcr {
                                      std::vector<std::vector<T1>*>& traveltimes,
                                      const size_t threadNo) const {
         
-        this->checkPts(Tx);
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
@@ -232,9 +309,7 @@ namespace ttcr {
         std::vector<bool> frozen( this->nodes.size(), false );
         initTx(Tx, t0, frozen, threadNo);
         
-        std::vector<T1> times( this->nodes.size() );
-        for ( size_t n=0; n<this->nodes.size(); ++n )
-            times[n] = this->nodes[n].getTT( threadNo );
+        itLog[threadNo].clear();
         
         int niter=0;
         T1 change = std::numeric_limits<T1>::max();
@@ -243,37 +318,27 @@ namespace ttcr {
             for ( size_t i=0; i<S.size(); ++i ) {
                 
                 // ascending
+                itLog[threadNo].start();
+                change = 0.0;
                 for ( auto vertexC=S[i].begin(); vertexC!=S[i].end(); ++vertexC ) {
                     if ( !frozen[(*vertexC)->getGridIndex()] )
                         //                    this->local3Dsolver(*vertexC, threadNo);
-                        this->localUpdate3D(*vertexC, threadNo);
-                }
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
+                        change += this->localUpdate3D(*vertexC, threadNo);
                 }
+                itLog[threadNo].push_back(change);
                 if ( change < epsilon ) {
                     break;
                 }
                 
                 // descending
+                itLog[threadNo].start();
+                change = 0.0;
                 for ( auto vertexC=S[i].rbegin(); vertexC!=S[i].rend(); ++vertexC ) {
                     if ( !frozen[(*vertexC)->getGridIndex()] )
                         //                    this->local3Dsolver(*vertexC, threadNo);
-                        this->localUpdate3D(*vertexC, threadNo);
-                }
-                
-                change = 0.0;
-                for ( size_t n=0; n<this->nodes.size(); ++n ) {
-                    T1 dt = fabs( times[n] - this->nodes[n].getTT(threadNo) );
-                    
-                    change += dt;
-                    times[n] = this->nodes[n].getTT(threadNo);
+                        change += this->localUpdate3D(*vertexC, threadNo);
                 }
+                itLog[threadNo].push_back(change);
                 if ( change < epsilon ) {
                     break;
                 }
@@ -360,6 +425,7 @@ namespace ttcr {
                                    const std::vector<T1>& t0,
                                    std::vector<bool>& frozen,
                                    const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
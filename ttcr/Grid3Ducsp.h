@@ -31,24 +31,40 @@
 #include <iostream>
 #include <map>
 #include <queue>
+#include <string>
 #include <vector>
 
 #include "Grid3Duc.h"
 #include "Node3Dcsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 #include "utils.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2>
+    template<typename T1, typename T2,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid3Ducsp : public Grid3Duc<T1,T2,Node3Dcsp<T1,T2>> {
     public:
         Grid3Ducsp(const std::vector<sxyz<T1>>& no,
                    const std::vector<tetrahedronElem<T2>>& tet,
-                   const int ns, const size_t nt=1, const int verbose=0) :
+                   const int ns, const size_t nt=1, const int verbose=0,
+                   const std::string& cacheFile="") :
         Grid3Duc<T1,T2,Node3Dcsp<T1,T2>>(no, tet, nt)
         {
+            // nodes & neighbors are read from cacheFile if it was built
+            // from the same mesh, otherwise they are built and saved in it
+            GridCacheKey key;
+            if ( !cacheFile.empty() ) {
+                key.add("Grid3Ducsp");
+                key.add(no);
+                key.add(tet);
+                key.add(ns);
+                if ( this->loadGridCache(cacheFile, key.value()) ) return;
+            }
             this->buildGridNodes(no, ns, nt, verbose);
             this->buildGridNeighbors();
+            if ( !cacheFile.empty() ) this->saveGridCache(cacheFile, key.value());
         }
         
         ~Grid3Ducsp() {
@@ -88,29 +104,49 @@ namespace ttcr {
                      std::vector<std::vector<siv<T1>>>&,
                      const size_t=0) const;
         
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(this->nodes.size());
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // queue holding all nodes at worst
+            return Grid3Duc<T1,T2,Node3Dcsp<T1,T2>>::estimateThreadMemorySize(nNodes) +
+            nNodes*QUEUE<Node3Dcsp<T1,T2>,T1>::getNodeSize();
+        }
+        
+        // memory needed by a grid of nPrimary nodes and nTet tetrahedra with
+        // nsecondary nodes per edge (see Grid3D::getMemorySize).  The mesh is
+        // assumed to have about nPrimary+nTet edges and 2*nTet faces, as
+        // given by Euler's formula when the boundary is neglected.
+        static void estimateMemorySize(const size_t nPrimary, const size_t nTet,
+                                       const size_t nsecondary,
+                                       size_t& shared, size_t& thread) {
+            const size_t nFaceNodes = nsecondary*(nsecondary-1)/2;
+            const size_t nNodes = nPrimary + (nPrimary+nTet)*nsecondary +
+            2*nTet*nFaceNodes;
+            const size_t nNodesCell = 4 + 6*nsecondary + 4*nFaceNodes;
+            shared = sizeof(Grid3Ducsp) +
+            Grid3Duc<T1,T2,Node3Dcsp<T1,T2>>::estimateSharedMemorySize(nNodes, nTet, nNodesCell);
+            thread = estimateThreadMemorySize(nNodes);
+        }
+        
         
     private:
         
         void initQueue(const std::vector<sxyz<T1>>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<Node3Dcsp<T1,T2>*,
-                       std::vector<Node3Dcsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                        std::vector<Node3Dcsp<T1,T2>>& txNodes,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
                        const size_t threadNo) const;
         
         void prepropagate(const Node3Dcsp<T1,T2>& node,
-                          std::priority_queue<Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-                          CompareNodePtr<T1>>& queue,
+                          QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                           std::vector<bool>& inQueue,
                           std::vector<bool>& frozen,
                           size_t threadNo) const;
         
-        void propagate(std::priority_queue<Node3Dcsp<T1,T2>*,
-                       std::vector<Node3Dcsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+        void propagate(QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
                        std::vector<bool>& inQueue,
                        std::vector<bool>& frozen,
                        const size_t threadNo) const;
@@ -119,23 +155,21 @@ namespace ttcr {
     
     
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -154,24 +188,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -192,24 +224,22 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -235,6 +265,7 @@ namespace ttcr {
             
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -295,25 +326,23 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -346,6 +375,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = this->getTraveltime((*Rx[nr])[n], this->nodes,
                                                             nodeParentRx, cellParentRx,
                                                             threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
                 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -407,25 +437,23 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     std::vector<std::vector<siv<T1>>>& l_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           std::vector<std::vector<siv<T1>>>& l_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
         for ( size_t n=0; n<this->nodes.size(); ++n ) {
             this->nodes[n].reinit( threadNo );
         }
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dcsp<T1,T2>*, std::vector<Node3Dcsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dcsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dcsp<T1,T2>> txNodes;
         std::vector<bool> inQueue( this->nodes.size(), false );
@@ -453,10 +481,13 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                            threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++n ) {
@@ -490,15 +521,10 @@ namespace ttcr {
                 r_tmp.push_back( child );
                 
                 cell.v = (*node_p)[iParent].getDistance( child );
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -522,15 +548,10 @@ namespace ttcr {
             r_tmp.push_back( child );
             
             cell.v = (*node_p)[iParent].getDistance( child );
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -550,16 +571,15 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::initQueue(const std::vector<sxyz<T1>>& Tx,
-                                      const std::vector<T1>& t0,
-                                      std::priority_queue<Node3Dcsp<T1,T2>*,
-                                      std::vector<Node3Dcsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<Node3Dcsp<T1,T2>>& txNodes,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::initQueue(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                            std::vector<Node3Dcsp<T1,T2>>& txNodes,
+                                            std::vector<bool>& inQueue,
+                                            std::vector<bool>& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -568,6 +588,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     queue.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inQueue[nn] = true;
                     frozen[nn] = true;
                     break;
@@ -592,14 +613,12 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::prepropagate(const Node3Dcsp<T1,T2>& node,
-                                         std::priority_queue<Node3Dcsp<T1,T2>*,
-                                         std::vector<Node3Dcsp<T1,T2>*>,
-                                         CompareNodePtr<T1>>& queue,
-                                         std::vector<bool>& inQueue,
-                                         std::vector<bool>& frozen,
-                                         size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::prepropagate(const Node3Dcsp<T1,T2>& node,
+                                               QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                               std::vector<bool>& inQueue,
+                                               std::vector<bool>& frozen,
+                                               size_t threadNo) const {
         
         // This function can be used to "prepropagate" each Tx nodes one first time
         // during "initQueue", before running "propagate".
@@ -618,6 +637,7 @@ namespace ttcr {
                 
                 // compute dt
                 T1 dt = this->computeDt(node, this->nodes[neibNo], cellNo);
+                this->instrumentation.count(threadNo, LOCAL_UPDATE);
                 
                 if ( node.getTT( threadNo )+dt < this->nodes[neibNo].getTT( threadNo ) ) {
                     this->nodes[neibNo].setTT( node.getTT( threadNo )+dt, threadNo );
@@ -626,7 +646,11 @@ namespace ttcr {
                     
                     if ( !inQueue[neibNo] ) {
                         queue.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inQueue[neibNo] = true;
+                    } else {
+                        queue.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
@@ -634,17 +658,17 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Ducsp<T1,T2>::propagate(std::priority_queue<Node3Dcsp<T1,T2>*,
-                                      std::vector<Node3Dcsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Ducsp<T1,T2,QUEUE>::propagate(QUEUE<Node3Dcsp<T1,T2>,T1>& queue,
+                                            std::vector<bool>& inQueue,
+                                            std::vector<bool>& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !queue.empty() ) {
             const Node3Dcsp<T1,T2>* src = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ src->getGridIndex() ] = false;
             frozen[ src->getGridIndex() ] = true;
             
@@ -660,6 +684,7 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->computeDt(*src, this->nodes[neibNo], cellNo);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     if (src->getTT(threadNo)+dt < this->nodes[neibNo].getTT(threadNo)) {
                         this->nodes[neibNo].setTT( src->getTT(threadNo)+dt, threadNo );
@@ -668,7 +693,11 @@ namespace ttcr {
                         
                         if ( !inQueue[neibNo] ) {
                             queue.push( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                             inQueue[neibNo] = true;
+                        } else {
+                            queue.update( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                         }
                     }
                 }
@@ -31,9 +31,11 @@
 #include <array>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <set>
 #include <sstream>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 #ifdef VTK
@@ -52,9 +54,16 @@
 #endif
 
 
+#include "Adjacency.h"
+#include "CellLocator3D.h"
 #include "Grad.h"
 #include "Grid3D.h"
+#include "GridCache.h"
 #include "Interpolator.h"
+#include "Node.h"
+#include "Node3Dnsp.h"
+#include "RowIndex.h"
+#include "SourceRegion.h"
 #include "utils.h"
 
 namespace ttcr {
@@ -65,13 +74,20 @@ namespace ttcr {
         Grid3Dun(const std::vector<sxyz<T1>>& no,
                  const std::vector<tetrahedronElem<T2>>& tet,
                  const size_t nt=1) :
+        Grid3D<T1,T2>(nt),
         nThreads(nt),
         nPrimary(static_cast<T2>(no.size())),
         source_radius(0.0),
-        nodes(std::vector<NODE>(no.size(), NODE(nt))),
-        neighbors(std::vector<std::vector<T2>>(tet.size())),
-        tetrahedra(tet)
-        {}
+        source_refinement(0),
+        nodes(std::vector<NODE>(no.size(), NODE(nt, sharedStorage_t()))),
+        neighbors(tet.size()),
+        tetrahedra(tet),
+        locator(),
+        storage(),
+        workspace(nt)
+        {
+            locator.build(no, tet);
+        }
         
         virtual ~Grid3Dun() {}
         
@@ -100,12 +116,14 @@ namespace ttcr {
         }
         
         void setSourceRadius(const double r) { source_radius = r; }
+        void setSourceRefinement(const int r) { source_refinement = r; }
         
         void setTT(const T1 tt, const size_t nn, const size_t nt=0) {
             nodes[nn].setTT(tt, nt);
         }
         
         size_t getNumberOfNodes() const { return nodes.size(); }
+        size_t getNumberOfCells() const { return tetrahedra.size(); }
         
         const T1 getXmin() const {
             T1 xmin = nodes[0].getX();
@@ -170,9 +188,15 @@ namespace ttcr {
                              std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
                              const size_t=0) const {}
         
+        void setInputOrder(const std::vector<T2>& o) { inputOrder = o; }
+        
         void saveTT(const std::string &, const int, const size_t nt=0,
                     const bool vtkFormat=0) const;
         
+        // save nodes, owners & neighbors of the built grid, key identifying
+        // the data the grid was built from (see GridCache.h)
+        void saveGridCache(const std::string &, const uint64_t key) const;
+        
 #ifdef VTK
         void saveModelVTU(const std::string &, const bool saveSlowness=true,
                           const bool savePhysicalEntity=false) const;
@@ -180,13 +204,62 @@ namespace ttcr {
         
         const size_t getNthreads() const { return nThreads; }
         
+        // memory used by the lists of nodes of the cells, in bytes
+        size_t getNeighborsSize() const {
+            return neighbors.getSize();
+        }
+        
+        size_t getSharedMemorySize() const {
+            size_t size = sizeof(*this) + neighbors.getSize() +
+            (nodes.capacity()-nodes.size())*sizeof(NODE) +
+            faceNeighbors.capacity()*sizeof(std::array<T2,4>) +
+            tetrahedra.capacity()*sizeof(tetrahedronElem<T2>) +
+            inputOrder.capacity()*sizeof(T2) + locator.getSize() +
+            tetGeom.capacity()*sizeof(tetrahedronGeometry<T1>);
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                size += nodes[n].getSharedSize();
+            }
+            return size;
+        }
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(nodes.size());
+        }
+        
+        // memory needed by nNodes nodes and nTet tetrahedra holding
+        // nNodesCell nodes each, to estimate the size of a grid before
+        // building it
+        static size_t estimateSharedMemorySize(const size_t nNodes,
+                                               const size_t nTet,
+                                               const size_t nNodesCell) {
+            // nodes & their owners, neighbors, locator and tetrahedra
+            return nNodes*NODE::estimateSharedSize() + (nTet+1)*sizeof(size_t) +
+            2*nTet*nNodesCell*sizeof(T2) + CellLocator3D<T1,T2>::estimateSize(nTet) +
+            nTet*(sizeof(std::array<T2,4>) + sizeof(tetrahedronElem<T2>));
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // values of the nodes in storage, and frozen & inQueue flags
+            return nNodes*(NODE::getThreadSize() + 2*sizeof(uint32_t));
+        }
+        
+        // reinitialize traveltimes & parents of all nodes for thread threadNo
+        void reinitNodes(const size_t threadNo) const {
+            storage.reinit(threadNo, nodes.size());
+        }
+        
     protected:
         const size_t nThreads;
         T2 nPrimary;
         T1 source_radius;
+        int source_refinement;   // ratio of cell sizes of the coarse & source region grids
         mutable std::vector<NODE> nodes;
-        std::vector<std::vector<T2>> neighbors;  // nodes common to a cell
+        Adjacency<T2> neighbors;                 // nodes common to a cell
+        std::vector<std::array<T2,4>> faceNeighbors;  // cell across the face opposite to vertex i
         std::vector<tetrahedronElem<T2>> tetrahedra;
+        std::vector<T2> inputOrder;  // grid index of input nodes, empty if not renumbered
+        CellLocator3D<T1,T2> locator;           // bucket grid for point location
+        mutable threadStorage<T1,T2> storage;   // traveltimes & parents of nodes
+        mutable std::vector<threadWorkspace> workspace;  // flags of nodes, for each thread
+        std::vector<tetrahedronGeometry<T1>> tetGeom;   // empty unless buildTetGeometry is called
         
         T1 computeDt(const NODE& source, const NODE& node) const {
             return (node.getNodeSlowness()+source.getNodeSlowness())/2 * source.getDistance( node );
@@ -200,38 +273,224 @@ namespace ttcr {
                          const std::vector<NODE>& nodes,
                          const size_t threadNo) const;
         
-        void checkPts(const std::vector<sxyz<T1>>&) const;
+        void checkPts(const std::vector<sxyz<T1>>&, const size_t threadNo=0) const;
+        
+        // slowness at pt, interpolated linearly in tetrahedron cellNo
+        T1 interpSlowness(const sxyz<T1>& pt, const T2 cellNo) const {
+            sxyz<T1> v[4];
+            for ( size_t i=0; i<4; ++i ) v[i] = nodes[ tetrahedra[cellNo].i[i] ];
+            T1 D0 = det4(v[0], v[1], v[2], v[3]);
+            T1 w[4] = { det4(pt, v[1], v[2], v[3]), det4(v[0], pt, v[2], v[3]),
+                det4(v[0], v[1], pt, v[3]), det4(v[0], v[1], v[2], pt) };
+            T1 s = 0.0;
+            for ( size_t i=0; i<4; ++i )
+                s += w[i]/D0 * nodes[ tetrahedra[cellNo].i[i] ].getNodeSlowness();
+            return s;
+        }
+        
+        // Traveltimes at the nodes within the source region of Tx, computed
+        // on a fine rectilinear grid (see SourceRegion.h) with cells
+        // source_refinement times smaller than the mean edge length of the
+        // cell of Tx.  The region has radius source_radius, or twice the
+        // longest edge of the cell of Tx if source_radius is 0.
+        template<typename SUBGRID>
+        void getSourceRegionTT(const sxyz<T1>& Tx, const T1 t0,
+                               std::vector<T2>& nodeNo,
+                               std::vector<T1>& tt) const {
+            T2 cellNo = getCellNo( Tx );
+            T1 lmean = 0.0;
+            T1 lmax = 0.0;
+            for ( size_t i=0; i<3; ++i ) {
+                for ( size_t j=i+1; j<4; ++j ) {
+                    T1 l = nodes[ tetrahedra[cellNo].i[i] ].getDistance( nodes[ tetrahedra[cellNo].i[j] ] );
+                    lmean += l/6;
+                    lmax = l > lmax ? l : lmax;
+                }
+            }
+            const T1 radius = source_radius > 0.0 ? source_radius : 2*lmax;
+            
+            sxyz<T1> pmin = nodes[0];
+            sxyz<T1> pmax = nodes[0];
+            std::vector<sxyz<T1>> pts;
+            nodeNo.clear();
+            for ( T2 n=0; n<nPrimary; ++n ) {
+                pmin.x = pmin.x < nodes[n].getX() ? pmin.x : nodes[n].getX();
+                pmin.y = pmin.y < nodes[n].getY() ? pmin.y : nodes[n].getY();
+                pmin.z = pmin.z < nodes[n].getZ() ? pmin.z : nodes[n].getZ();
+                pmax.x = pmax.x > nodes[n].getX() ? pmax.x : nodes[n].getX();
+                pmax.y = pmax.y > nodes[n].getY() ? pmax.y : nodes[n].getY();
+                pmax.z = pmax.z > nodes[n].getZ() ? pmax.z : nodes[n].getZ();
+                if ( nodes[n].getDistance( Tx ) <= radius ) {
+                    pts.push_back( sxyz<T1>(nodes[n]) );
+                    nodeNo.push_back( n );
+                }
+            }
+            
+            // points of the fine grid outside the mesh take the slowness at Tx
+            const T1 sTx = interpSlowness(Tx, cellNo);
+            auto slowness = [&](const sxyz<T1>& pt) {
+                T2 c = getCellNo( pt );
+                return c == std::numeric_limits<T2>::max() ? sTx : interpSlowness(pt, c);
+            };
+            sourceRegionTraveltimes<SUBGRID>(Tx, t0, radius, lmean/source_refinement,
+                                             pmin, pmax, slowness, pts, tt);
+        }
         
         bool insideTetrahedron(const sxyz<T1>&, const T2) const;
         
         T2 getCellNo(const sxyz<T1>& pt) const {
-            for ( T2 n=0; n<tetrahedra.size(); ++n ) {
-                if ( insideTetrahedron(pt, n) ) {
-                    return n;
+            auto range = locator.getCandidates(pt);
+            for ( auto nc=range.first; nc!=range.second; ++nc ) {
+                if ( insideTetrahedron(pt, *nc) ) {
+                    return *nc;
                 }
             }
             return -1;
         }
         
+        T2 getNodeNo(const sxyz<T1>& pt) const {
+            // lowest index of nodes at pt, looking only in candidate cells
+            T2 nodeNo = std::numeric_limits<T2>::max();
+            auto range = locator.getCandidates(pt);
+            for ( auto nc=range.first; nc!=range.second; ++nc ) {
+                for ( auto nn=neighbors[*nc].begin(); nn!=neighbors[*nc].end(); ++nn ) {
+                    if ( *nn < nodeNo && nodes[*nn] == pt ) {
+                        nodeNo = *nn;
+                    }
+                }
+            }
+            return nodeNo;
+        }
+        
         void buildGridNodes(const std::vector<sxyz<T1>>&, const size_t);
         void buildGridNodes(const std::vector<sxyz<T1>>&,
                             const int, const size_t, const int);
         
         void buildGridNeighbors() {
             // Index the neighbors nodes of each cell
-            for ( T2 n=0; n<nodes.size(); ++n ) {
-                for ( size_t n2=0; n2<nodes[n].getOwners().size(); ++n2) {
-                    neighbors[ nodes[n].getOwners()[n2] ].push_back(n);
+            neighbors.buildFromOwners(nodes);
+            attachStorage();
+        }
+        
+        // Index the cells sharing a face, faceNeighbors[n][i] is the cell on
+        // the other side of the face of tetrahedron n opposite to vertex
+        // tetrahedra[n].i[i], or max() if the face is on the boundary.  Used
+        // to walk raypaths, to be called once nodes are built
+        void buildFaceNeighbors() {
+            const T2 none = std::numeric_limits<T2>::max();
+            faceNeighbors.assign(tetrahedra.size(), {{none, none, none, none}});
+            for ( size_t n=0; n<tetrahedra.size(); ++n ) {
+                for ( size_t i=0; i<4; ++i ) {
+                    if ( faceNeighbors[n][i] != none ) continue;
+                    std::array<T2,3> face;
+                    for ( size_t j=0, k=0; j<4; ++j ) {
+                        if ( j != i ) face[k++] = tetrahedra[n].i[j];
+                    }
+                    const std::vector<T2>& owners = nodes[face[0]].getOwners();
+                    for ( size_t no=0; no<owners.size(); ++no ) {
+                        if ( owners[no] == n ) continue;
+                        size_t i2 = oppositeVertex(face, owners[no]);
+                        if ( i2 < 4 ) {
+                            faceNeighbors[n][i] = owners[no];
+                            faceNeighbors[owners[no]][i2] = static_cast<T2>(n);
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        
+        // index in tetrahedra[cellNo].i of the vertex not on the face, or 4
+        // if the face is not a face of cellNo
+        size_t oppositeVertex(const std::array<T2,3> &faceNodes, const T2 cellNo) const {
+            size_t i = 4;
+            size_t nFound = 0;
+            for ( size_t j=0; j<4; ++j ) {
+                T2 v = tetrahedra[cellNo].i[j];
+                if ( v == faceNodes[0] || v == faceNodes[1] || v == faceNodes[2] ) {
+                    ++nFound;
+                } else {
+                    i = j;
+                }
+            }
+            return nFound == 3 ? i : 4;
+        }
+        
+        bool isVertex(const T2 nodeNo, const T2 cellNo) const {
+            return tetrahedra[cellNo].i[0] == nodeNo || tetrahedra[cellNo].i[1] == nodeNo ||
+            tetrahedra[cellNo].i[2] == nodeNo || tetrahedra[cellNo].i[3] == nodeNo;
+        }
+        
+        // cells where a raypath reaches a Tx, sorted, with the index of the
+        // first Tx found in the cell (same test as in the raypath loop)
+        void getTxCells(const std::vector<bool>& txOnNode,
+                        const std::vector<T2>& txNode,
+                        const std::vector<T2>& txCell,
+                        const std::vector<std::vector<T2>>& txNeighborCells,
+                        std::vector<std::pair<T2,size_t>>& txCells) const {
+            txCells.clear();
+            for ( size_t nt=0; nt<txOnNode.size(); ++nt ) {
+                if ( txOnNode[nt] ) {
+                    for ( auto nc=nodes[txNode[nt]].getOwners().begin();
+                         nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
+                        txCells.push_back( {*nc, nt} );
+                    }
+                } else {
+                    txCells.push_back( {txCell[nt], nt} );
+                    for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
+                        txCells.push_back( {txNeighborCells[nt][nn], nt} );
+                    }
                 }
             }
+            std::sort(txCells.begin(), txCells.end());
+            txCells.erase(std::unique(txCells.begin(), txCells.end(),
+                                      [](const std::pair<T2,size_t>& a,
+                                         const std::pair<T2,size_t>& b) { return a.first == b.first; }),
+                          txCells.end());
+        }
+        
+        // precompute the geometry used by localUpdate3D (about 14 values
+        // per tetrahedron), to be called once nodes are built
+        void buildTetGeometry() {
+            tetGeom.clear();
+            tetGeom.reserve(tetrahedra.size());
+            for ( size_t n=0; n<tetrahedra.size(); ++n ) {
+                tetGeom.push_back(tetrahedronGeometry<T1>(sxyz<T1>(nodes[tetrahedra[n].i[0]]),
+                                                          sxyz<T1>(nodes[tetrahedra[n].i[1]]),
+                                                          sxyz<T1>(nodes[tetrahedra[n].i[2]]),
+                                                          sxyz<T1>(nodes[tetrahedra[n].i[3]])));
+            }
         }
         
-        void localUpdate3D(NODE *vertexC, const size_t threadNo) const;
+        // replaces buildGridNodes & buildGridNeighbors, returns false if
+        // the file cannot be used
+        bool loadGridCache(const std::string &, const uint64_t key);
+        
+        // per-thread values of the nodes are held in storage, thread by thread
+        void attachStorage() {
+            NODE::allocateStorage(storage, nodes.size(), nThreads);
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                nodes[n].setStorage(storage, n, nodes.size());
+            }
+        }
+        
+        // returns the decrease of traveltime at vertexC
+        T1 localUpdate3D(NODE *vertexC, const size_t threadNo) const;
+        
+        T1 localUpdate2D(const NODE *vertexA,
+                         const NODE *vertexB,
+                         const NODE *vertexC,
+                         const T2 tetraNo,
+                         const size_t threadNo) const;
         
+        // iA, iB & iC are the indices of the vertices in the tetrahedron
         T1 localUpdate2D(const NODE *vertexA,
                          const NODE *vertexB,
                          const NODE *vertexC,
                          const T2 tetraNo,
+                         const T2 iA,
+                         const T2 iB,
+                         const T2 iC,
                          const size_t threadNo) const;
         
         void local3Dsolver(NODE *vertexC, const size_t threadNo) const;
@@ -267,7 +526,8 @@ namespace ttcr {
                            const std::set<T2>& allNodes,
                            const sxyz<T1>& mid_pt,
                            const T1 s,
-                           const T1 ds) const ;
+                           const T1 ds,
+                           const size_t threadNo) const ;
         
         void getRaypath(const std::vector<sxyz<T1>>& Tx,
                         const sxyz<T1> &Rx,
@@ -406,7 +666,7 @@ namespace ttcr {
         }
         
         // edge nodes
-        Node3Dnsp<T1,T2> tmpNode(nt);
+        Node3Dnsp<T1,T2> tmpNode(nt, sharedStorage_t());
         for ( T2 ntet=0; ntet<tetrahedra.size(); ++ntet ) {
             
             if ( verbose>1 && nsecondary > 0 ) {
@@ -529,15 +789,84 @@ namespace ttcr {
         nodes.shrink_to_fit();
     }
     
+    template<typename T1, typename T2, typename NODE>
+    void Grid3Dun<T1,T2,NODE>::saveGridCache(const std::string &fname,
+                                             const uint64_t key) const {
+        GridCacheWriter cache(fname, key, sizeof(T1), sizeof(T2),
+                              nodes.size(), tetrahedra.size());
+        std::vector<T1> xyz(3*nodes.size());
+        std::vector<int> primary(nodes.size());
+        for ( size_t n=0; n<nodes.size(); ++n ) {
+            xyz[3*n] = nodes[n].getX();
+            xyz[3*n+1] = nodes[n].getY();
+            xyz[3*n+2] = nodes[n].getZ();
+            primary[n] = nodes[n].getPrimary();
+        }
+        cache.write(xyz);
+        cache.write(primary);
+        cache.template writeLists<T2>(nodes.size(), [this](const size_t n) -> const std::vector<T2>& {
+            return nodes[n].getOwners();
+        });
+        cache.template writeLists<T2>(neighbors.size(), [this](const size_t n) {
+            return neighbors[n];
+        });
+        cache.close();
+    }
+    
+    template<typename T1, typename T2, typename NODE>
+    bool Grid3Dun<T1,T2,NODE>::loadGridCache(const std::string &fname,
+                                             const uint64_t key) {
+        try {
+            GridCacheReader cache(fname);
+            if ( !cache.template matches<T1,T2>(key) ||
+                 cache.getNnodes() < nPrimary || cache.getNcells() != tetrahedra.size() ) {
+                return false;
+            }
+            std::vector<T1> xyz;
+            std::vector<int> primary;
+            cache.read(xyz);
+            cache.read(primary);
+            if ( xyz.size() != 3*cache.getNnodes() || primary.size() != cache.getNnodes() ) {
+                return false;
+            }
+            nodes.clear();
+            nodes.resize(cache.getNnodes(), NODE(nThreads, sharedStorage_t()));
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                nodes[n].setXYZindex( xyz[3*n], xyz[3*n+1], xyz[3*n+2], static_cast<T2>(n) );
+                nodes[n].setPrimary( primary[n] );
+            }
+            cache.template readLists<T2>([this](const size_t n, const T2 *first, const T2 *last) {
+                if ( n >= nodes.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                for ( const T2 *o=first; o!=last; ++o ) nodes[n].pushOwner( *o );
+            });
+            neighbors.clear();
+            cache.template readLists<T2>([this](const size_t n, const T2 *first, const T2 *last) {
+                if ( n != neighbors.size() ) throw std::runtime_error("Error: grid cache corrupted.");
+                neighbors.append(first, last);
+            });
+            if ( neighbors.size() != tetrahedra.size() ) {
+                throw std::runtime_error("Error: grid cache corrupted.");
+            }
+        } catch ( std::exception& ) {
+            // back to the state expected by buildGridNodes
+            nodes.clear();
+            nodes.resize(nPrimary, NODE(nThreads, sharedStorage_t()));
+            neighbors = Adjacency<T2>(tetrahedra.size());
+            return false;
+        }
+        attachStorage();
+        return true;
+    }
+    
     template<typename T1, typename T2, typename NODE>
     T1 Grid3Dun<T1,T2,NODE>::getTraveltime(const sxyz<T1>& Rx,
                                            const std::vector<NODE>& nodes,
                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
         
-        for ( size_t nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == Rx ) {
-                return nodes[nn].getTT(threadNo);
-            }
+        T2 nodeNo = getNodeNo( Rx );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            return nodes[nodeNo].getTT(threadNo);
         }
         //If Rx is not on a node:
         T1 slo = computeSlowness( Rx );
@@ -561,24 +890,20 @@ namespace ttcr {
     
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Dun<T1,T2,NODE>::checkPts(const std::vector<sxyz<T1>>& pts) const {
+    void Grid3Dun<T1,T2,NODE>::checkPts(const std::vector<sxyz<T1>>& pts,
+                                        const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, CHECK_PTS);
         
         for (size_t n=0; n<pts.size(); ++n) {
             bool found = false;
             // check first if point is on a node
-            for ( T2 nt=0; nt<nodes.size(); ++nt ) {
-                if ( nodes[nt] == pts[n]) {
-                    found = true;
-                    break;
-                }
+            if ( getNodeNo(pts[n]) != std::numeric_limits<T2>::max() ) {
+                found = true;
             }
             if ( found == false ) {
                 // check if inside tetrahedra
-                for ( T2 nt=0; nt<tetrahedra.size(); ++nt ) {
-                    if ( insideTetrahedron(pts[n], nt) ) {
-                        found = true;
-                        break;
-                    }
+                if ( getCellNo(pts[n]) != std::numeric_limits<T2>::max() ) {
+                    found = true;
                 }
             }
             if ( found == false ) {
@@ -730,10 +1055,12 @@ namespace ttcr {
                 nMax = static_cast<T2>(nodes.size());
             }
             for ( T2 n=0; n<nMax; ++n ) {
-                fout << nodes[n].getX() << '\t'
-                << nodes[n].getY() << '\t'
-                << nodes[n].getZ() << '\t'
-                << nodes[n].getTT(nt) << '\n';
+                // primary nodes are written in the order of the input file
+                T2 nn = n<inputOrder.size() ? inputOrder[n] : n;
+                fout << nodes[nn].getX() << '\t'
+                << nodes[nn].getY() << '\t'
+                << nodes[nn].getZ() << '\t'
+                << nodes[nn].getTT(nt) << '\n';
             }
             fout.close();
         }
@@ -816,11 +1143,13 @@ namespace ttcr {
     
     
     template<typename T1, typename T2, typename NODE>
-    void Grid3Dun<T1,T2,NODE>::localUpdate3D(NODE *vertexD,
-                                             const size_t threadNo) const {
+    T1 Grid3Dun<T1,T2,NODE>::localUpdate3D(NODE *vertexD,
+                                           const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         // méthode of Lelievre et al. 2011
         
+        const T1 t0 = vertexD->getTT(threadNo);
         T2 iA, iB, iC, iD;
         NODE *vertexA, *vertexB, *vertexC;
         
@@ -864,23 +1193,35 @@ namespace ttcr {
                 T1 u = vertexB->getTT(threadNo) - vertexA->getTT(threadNo);
                 T1 v = vertexC->getTT(threadNo) - vertexA->getTT(threadNo);
                 
-                sxyz<T1> v_b = { vertexC->getX() - vertexA->getX(),
-                    vertexC->getY() - vertexA->getY(),
-                    vertexC->getZ() - vertexA->getZ() };
-                sxyz<T1> v_c = { vertexB->getX() - vertexA->getX(),
-                    vertexB->getY() - vertexA->getY(),
-                    vertexB->getZ() - vertexA->getZ() };
-                
-                // vector normal to plane
-                sxyz<T1> v_n = cross(v_b, v_c);
-                
-                T1 b = norm( v_b );
-                T1 c = norm( v_c );
-                T1 d2 = dot(v_b, v_c);
+                sxyz<T1> v_b, v_c, v_n;
+                T1 b, c, d2, phi;
                 
-                T1 alpha = acos( d2 / (b*c) );
-                
-                T1 phi = c*b*sin(alpha);
+                if ( tetGeom.empty() ) {
+                    v_b = { vertexC->getX() - vertexA->getX(),
+                        vertexC->getY() - vertexA->getY(),
+                        vertexC->getZ() - vertexA->getZ() };
+                    v_c = { vertexB->getX() - vertexA->getX(),
+                        vertexB->getY() - vertexA->getY(),
+                        vertexB->getZ() - vertexA->getZ() };
+                    
+                    // vector normal to plane
+                    v_n = cross(v_b, v_c);
+                    
+                    b = norm( v_b );
+                    c = norm( v_c );
+                    d2 = dot(v_b, v_c);
+                    
+                    T1 alpha = acos( d2 / (b*c) );
+                    
+                    phi = c*b*sin(alpha);
+                } else {
+                    const tetrahedronGeometry<T1>& g = tetGeom[tetNo];
+                    b = g.l[tetEdge(iA,iC)];
+                    c = g.l[tetEdge(iA,iB)];
+                    T1 a = g.l[tetEdge(iB,iC)];
+                    d2 = 0.5*(b*b + c*c - a*a);
+                    phi = g.phi[iD];
+                }
                 
                 // check for negative value
                 T1 w_tilde = vertexD->getNodeSlowness()*vertexD->getNodeSlowness()*phi*phi -
@@ -890,25 +1231,47 @@ namespace ttcr {
                     w_tilde = sqrt( w_tilde );
                     
                     // Point (ξ_0 , ζ_0 ) is the normalized projection of node D onto face ABC
-                    // project D on plane
-                    
-                    T1 d_tmp = -vertexA->getX()*v_n.x - vertexA->getY()*v_n.y - vertexA->getZ()*v_n.z;
-                    
-                    T1 k = -(d_tmp + v_n.x*vertexD->getX() + v_n.y*vertexD->getY() + v_n.z*vertexD->getZ())/
-                    norm2(v_n);
-                    
-                    sxyz<T1> pt;   // -> Point (ξ_0 , ζ_0 )
-                    pt.x = vertexD->getX() + k*v_n.x;
-                    pt.y = vertexD->getY() + k*v_n.y;
-                    pt.z = vertexD->getZ() + k*v_n.z;
-                    
-                    T1 rho0 = vertexD->getDistance( pt );
-                    
-                    sxyz<T1> v_pt = {pt.x-vertexA->getX(), pt.y-vertexA->getY(), pt.z-vertexA->getZ()};
                     
+                    T1 rho0;
                     T1 xi0;
                     T1 zeta0;
-                    projNorm(v_b/b, v_c/c, v_pt, xi0, zeta0);
+                    if ( tetGeom.empty() ) {
+                        // project D on plane
+                        
+                        T1 d_tmp = -vertexA->getX()*v_n.x - vertexA->getY()*v_n.y - vertexA->getZ()*v_n.z;
+                        
+                        T1 k = -(d_tmp + v_n.x*vertexD->getX() + v_n.y*vertexD->getY() + v_n.z*vertexD->getZ())/
+                        norm2(v_n);
+                        
+                        sxyz<T1> pt;   // -> Point (ξ_0 , ζ_0 )
+                        pt.x = vertexD->getX() + k*v_n.x;
+                        pt.y = vertexD->getY() + k*v_n.y;
+                        pt.z = vertexD->getZ() + k*v_n.z;
+                        
+                        rho0 = vertexD->getDistance( pt );
+                        
+                        sxyz<T1> v_pt = {pt.x-vertexA->getX(), pt.y-vertexA->getY(), pt.z-vertexA->getZ()};
+                        
+                        projNorm(v_b/b, v_c/c, v_pt, xi0, zeta0);
+                    } else {
+                        // same system as in projNorm, with AD.AB & AD.AC
+                        // from the length of edges
+                        const tetrahedronGeometry<T1>& g = tetGeom[tetNo];
+                        rho0 = g.rho[iD];
+                        T1 ad = g.l[tetEdge(iA,iD)];
+                        T1 bd = g.l[tetEdge(iB,iD)];
+                        T1 cd = g.l[tetEdge(iC,iD)];
+                        T1 pc = 0.5*(ad*ad + c*c - bd*bd)/c;
+                        T1 pb = 0.5*(ad*ad + b*b - cd*cd)/b;
+                        T1 cosa = d2/(b*c);
+                        T1 det = 1.0 - cosa*cosa;
+                        if ( phi == 0.0 ) {
+                            xi0 = zeta0 = -1.0;
+                        } else {
+                            xi0 = (pc - cosa*pb)/det;
+                            zeta0 = (pb - cosa*pc)/det;
+                        }
+                    }
                     if ( xi0 < 0.0 || zeta0 < 0.0 ) {
                         // this should not happen unless we have incorrect triangle
                         continue;
@@ -929,24 +1292,42 @@ namespace ttcr {
                 }
             }
             
-            T1 t = vertexA->getTT(threadNo) + vertexD->getNodeSlowness() * vertexD->getDistance( *vertexA );
-            if ( t < tABC ) tABC = t;
-            t = vertexB->getTT(threadNo) + vertexD->getNodeSlowness() * vertexD->getDistance( *vertexB );
-            if ( t < tABC ) tABC = t;
-            t = vertexC->getTT(threadNo) + vertexD->getNodeSlowness() * vertexD->getDistance( *vertexC );
-            if ( t < tABC ) tABC = t;
-            
-            t = localUpdate2D(vertexA, vertexB, vertexD, tetNo, threadNo);
-            if ( t < tABC ) tABC = t;
-            t = localUpdate2D(vertexA, vertexC, vertexD, tetNo, threadNo);
-            if ( t < tABC ) tABC = t;
-            t = localUpdate2D(vertexB, vertexC, vertexD, tetNo, threadNo);
-            if ( t < tABC ) tABC = t;
+            if ( tetGeom.empty() ) {
+                T1 t = vertexA->getTT(threadNo) + vertexD->getNodeSlowness() * vertexD->getDistance( *vertexA );
+                if ( t < tABC ) tABC = t;
+                t = vertexB->getTT(threadNo) + vertexD->getNodeSlowness() * vertexD->getDistance( *vertexB );
+                if ( t < tABC ) tABC = t;
+                t = vertexC->getTT(threadNo) + vertexD->getNodeSlowness() * vertexD->getDistance( *vertexC );
+                if ( t < tABC ) tABC = t;
+                
+                t = localUpdate2D(vertexA, vertexB, vertexD, tetNo, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexA, vertexC, vertexD, tetNo, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexB, vertexC, vertexD, tetNo, threadNo);
+                if ( t < tABC ) tABC = t;
+            } else {
+                const tetrahedronGeometry<T1>& g = tetGeom[tetNo];
+                T1 t = vertexA->getTT(threadNo) + vertexD->getNodeSlowness() * g.l[tetEdge(iA,iD)];
+                if ( t < tABC ) tABC = t;
+                t = vertexB->getTT(threadNo) + vertexD->getNodeSlowness() * g.l[tetEdge(iB,iD)];
+                if ( t < tABC ) tABC = t;
+                t = vertexC->getTT(threadNo) + vertexD->getNodeSlowness() * g.l[tetEdge(iC,iD)];
+                if ( t < tABC ) tABC = t;
+                
+                t = localUpdate2D(vertexA, vertexB, vertexD, tetNo, iA, iB, iD, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexA, vertexC, vertexD, tetNo, iA, iC, iD, threadNo);
+                if ( t < tABC ) tABC = t;
+                t = localUpdate2D(vertexB, vertexC, vertexD, tetNo, iB, iC, iD, threadNo);
+                if ( t < tABC ) tABC = t;
+            }
             
             if ( tABC<vertexD->getTT(threadNo) )
                 vertexD->setTT(tABC, threadNo);
             
         }
+        return t0 - vertexD->getTT(threadNo);
     }
     
     
@@ -1000,9 +1381,52 @@ namespace ttcr {
         return t;
     }
     
+    template<typename T1, typename T2, typename NODE>
+    T1 Grid3Dun<T1,T2,NODE>::localUpdate2D(const NODE *vertexA,
+                                           const NODE *vertexB,
+                                           const NODE *vertexC,
+                                           const T2 tetNo,
+                                           const T2 iA,
+                                           const T2 iB,
+                                           const T2 iC,
+                                           const size_t threadNo) const {
+        
+        // same as above, with the geometry of the tetrahedron precomputed
+        
+        const tetrahedronGeometry<T1>& g = tetGeom[tetNo];
+        
+        if ( vertexB->getTT(threadNo)==std::numeric_limits<T1>::max() &&
+            vertexA->getTT(threadNo)==std::numeric_limits<T1>::max() ) {
+            return std::numeric_limits<T1>::max();
+        }
+        
+        T1 u = vertexB->getTT(threadNo) - vertexA->getTT(threadNo);
+        
+        T1 c = g.l[tetEdge(iA,iB)];
+        
+        T1 w2 = vertexC->getNodeSlowness()*vertexC->getNodeSlowness()*c*c - u*u;
+        if ( w2 < 0.0 ) return std::numeric_limits<T1>::max();
+        
+        T1 w = sqrt( w2 );
+        
+        T1 ac = g.l[tetEdge(iA,iC)];
+        T1 bc = g.l[tetEdge(iB,iC)];
+        T1 xi0 = 0.5*(ac*ac + c*c - bc*bc)/(c*c);
+        T1 rho0 = g.phi[6-iA-iB-iC]/c;  // height of triangle ABC
+        
+        T1 xi = xi0 - u*rho0/(w*c);
+        
+        if ( 0.<xi && xi<1. ) {
+            return vertexA->getTT(threadNo) + u*xi0 + w*rho0/c;
+        } else {
+            return std::numeric_limits<T1>::max();
+        }
+    }
+    
     template<typename T1, typename T2, typename NODE>
     void Grid3Dun<T1,T2,NODE>::local3Dsolver(NODE *vertexD,
                                              const size_t threadNo) const {
+        this->instrumentation.count(threadNo, LOCAL_UPDATE);
         
         // Méthode de Qian et al. 2007
         
@@ -1038,8 +1462,13 @@ namespace ttcr {
                 continue;
             }
             
-            AB = vertexA->getDistance( *vertexB );
-            AC = vertexA->getDistance( *vertexC );
+            if ( tetGeom.empty() ) {
+                AB = vertexA->getDistance( *vertexB );
+                AC = vertexA->getDistance( *vertexC );
+            } else {
+                AB = tetGeom[tetNo].l[tetEdge(iA,iB)];
+                AC = tetGeom[tetNo].l[tetEdge(iA,iC)];
+            }
             
             bool apply2Dsolvers = true;
             
@@ -1286,6 +1715,7 @@ namespace ttcr {
                                           const sxyz<T1> &Rx,
                                           std::vector<sxyz<T1>> &r_data,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         T1 minDist = small;
         std::vector<sxyz<T1>> r_tmp;
@@ -1302,12 +1732,10 @@ namespace ttcr {
         std::vector<T2> txCell( Tx.size() );
         std::vector<std::vector<T2>> txNeighborCells( Tx.size() );
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-            for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-                if ( nodes[nn] == Tx[nt] ) {
-                    txOnNode[nt] = true;
-                    txNode[nt] = nn;
-                    break;
-                }
+            T2 nn = getNodeNo( Tx[nt] );
+            if ( nn != std::numeric_limits<T2>::max() ) {
+                txOnNode[nt] = true;
+                txNode[nt] = nn;
             }
         }
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
@@ -1325,13 +1753,16 @@ namespace ttcr {
                 
                 for ( size_t nedge=0; nedge<6; ++nedge ) {
                     for ( auto nc0=nodes[ind[nedge][0]].getOwners().begin(); nc0!=nodes[ind[nedge][0]].getOwners().end(); ++nc0 ) {
-                        if ( std::find(nodes[ind[nedge][1]].getOwners().begin(), nodes[ind[nedge][1]].getOwners().end(), *nc0)!=nodes[ind[nedge][1]].getOwners().end() )
+                        if ( isVertex(ind[nedge][1], *nc0) )
                             txNeighborCells[nt].push_back( *nc0 );
                     }
                 }
             }
         }
         
+        std::vector<std::pair<T2,size_t>> txCells;
+        getTxCells(txOnNode, txNode, txCell, txNeighborCells, txCells);
+        
         T2 cellNo, nodeNo;
         sxyz<T1> curr_pt( Rx );
         
@@ -1343,12 +1774,9 @@ namespace ttcr {
         Grad3D<T1,NODE> grad3d;
         bool reachedTx = false;
         
-        for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == curr_pt ) {
-                nodeNo = nn;
-                onNode = true;
-                break;
-            }
+        nodeNo = getNodeNo( curr_pt );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            onNode = true;
         }
         if ( !onNode ) {
             cellNo = getCellNo( curr_pt );
@@ -1488,7 +1916,7 @@ namespace ttcr {
                 // find cells common to edge
                 std::vector<T2> cells;
                 for ( auto nc0=nodes[edgeNodes[0]].getOwners().begin(); nc0!=nodes[edgeNodes[0]].getOwners().end(); ++nc0 ) {
-                    if ( std::find(nodes[edgeNodes[1]].getOwners().begin(), nodes[edgeNodes[1]].getOwners().end(), *nc0)!=nodes[edgeNodes[1]].getOwners().end() )
+                    if ( isVertex(edgeNodes[1], *nc0) )
                         cells.push_back( *nc0 );
                 }
                 // compute gradient with nodes from all common cells
@@ -1772,31 +2200,11 @@ namespace ttcr {
                     }
                 }
             } else {
-                for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-                    if ( txOnNode[nt] ) {
-                        for ( auto nc=nodes[txNode[nt]].getOwners().begin();
-                             nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
-                            if ( cellNo == *nc ) {
-                                r_tmp.push_back( Tx[nt] );
-                                reachedTx = true;
-                                break;
-                            }
-                        }
-                    } else {
-                        if ( cellNo == txCell[nt] ) {
-                            r_tmp.push_back( Tx[nt] );
-                            reachedTx = true;
-                        } else {
-                            for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
-                                if ( cellNo == txNeighborCells[nt][nn] ) {
-                                    r_tmp.push_back( Tx[nt] );
-                                    reachedTx = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if ( reachedTx ) break;
+                auto it = std::lower_bound(txCells.begin(), txCells.end(),
+                                           std::pair<T2,size_t>(cellNo, 0));
+                if ( it != txCells.end() && it->first == cellNo ) {
+                    r_tmp.push_back( Tx[it->second] );
+                    reachedTx = true;
                 }
             }
         }
@@ -1813,6 +2221,7 @@ namespace ttcr {
                                              const sxyz<T1> &Rx,
                                              std::vector<sxyz<T1>> &r_data,
                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
         
         T1 minDist = small;
         std::vector<sxyz<T1>> r_tmp;
@@ -1829,12 +2238,10 @@ namespace ttcr {
         std::vector<T2> txCell( Tx.size() );
         std::vector<std::vector<T2>> txNeighborCells( Tx.size() );
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-            for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-                if ( nodes[nn] == Tx[nt] ) {
-                    txOnNode[nt] = true;
-                    txNode[nt] = nn;
-                    break;
-                }
+            T2 nn = getNodeNo( Tx[nt] );
+            if ( nn != std::numeric_limits<T2>::max() ) {
+                txOnNode[nt] = true;
+                txNode[nt] = nn;
             }
         }
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
@@ -1852,13 +2259,16 @@ namespace ttcr {
                 
                 for ( size_t nedge=0; nedge<6; ++nedge ) {
                     for ( auto nc0=nodes[ind[nedge][0]].getOwners().begin(); nc0!=nodes[ind[nedge][0]].getOwners().end(); ++nc0 ) {
-                        if ( std::find(nodes[ind[nedge][1]].getOwners().begin(), nodes[ind[nedge][1]].getOwners().end(), *nc0)!=nodes[ind[nedge][1]].getOwners().end() )
+                        if ( isVertex(ind[nedge][1], *nc0) )
                             txNeighborCells[nt].push_back( *nc0 );
                     }
                 }
             }
         }
         
+        std::vector<std::pair<T2,size_t>> txCells;
+        getTxCells(txOnNode, txNode, txCell, txNeighborCells, txCells);
+        
         T2 cellNo, nodeNo;
         sxyz<T1> curr_pt( Rx );
         
@@ -1870,12 +2280,9 @@ namespace ttcr {
         Grad3D_ho<T1,NODE> grad3d;
         bool reachedTx = false;
         
-        for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == curr_pt ) {
-                nodeNo = nn;
-                onNode = true;
-                break;
-            }
+        nodeNo = getNodeNo( curr_pt );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            onNode = true;
         }
         if ( !onNode ) {
             cellNo = getCellNo( curr_pt );
@@ -2010,7 +2417,7 @@ namespace ttcr {
                 std::vector<T2> cells;
                 std::set<NODE*> nnodes;
                 for ( auto nc0=nodes[edgeNodes[0]].getOwners().begin(); nc0!=nodes[edgeNodes[0]].getOwners().end(); ++nc0 ) {
-                    if ( std::find(nodes[edgeNodes[1]].getOwners().begin(), nodes[edgeNodes[1]].getOwners().end(), *nc0)!=nodes[edgeNodes[1]].getOwners().end() ) {
+                    if ( isVertex(edgeNodes[1], *nc0) ) {
                         cells.push_back( *nc0 );
                         getNeighborNodes(*nc0, nnodes);
                     }
@@ -2287,31 +2694,11 @@ namespace ttcr {
                     }
                 }
             } else {
-                for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-                    if ( txOnNode[nt] ) {
-                        for ( auto nc=nodes[txNode[nt]].getOwners().begin();
-                             nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
-                            if ( cellNo == *nc ) {
-                                r_tmp.push_back( Tx[nt] );
-                                reachedTx = true;
-                                break;
-                            }
-                        }
-                    } else {
-                        if ( cellNo == txCell[nt] ) {
-                            r_tmp.push_back( Tx[nt] );
-                            reachedTx = true;
-                        } else {
-                            for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
-                                if ( cellNo == txNeighborCells[nt][nn] ) {
-                                    r_tmp.push_back( Tx[nt] );
-                                    reachedTx = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if ( reachedTx ) break;
+                auto it = std::lower_bound(txCells.begin(), txCells.end(),
+                                           std::pair<T2,size_t>(cellNo, 0));
+                if ( it != txCells.end() && it->first == cellNo ) {
+                    r_tmp.push_back( Tx[it->second] );
+                    reachedTx = true;
                 }
             }
         }
@@ -2329,7 +2716,9 @@ namespace ttcr {
                                              const std::set<T2>& allNodes,
                                              const sxyz<T1>& mid_pt,
                                              const T1 s,
-                                             const T1 ds) const {
+                                             const T1 ds,
+                                             const size_t threadNo) const {
+        RowIndex& rowIndex = workspace[threadNo].row;
         std::vector<T1> w;
         T1 sum_w = 0.0;
         for ( auto it=allNodes.begin(); it!=allNodes.end(); ++it ) {
@@ -2340,15 +2729,10 @@ namespace ttcr {
         for ( auto it=allNodes.begin(); it!=allNodes.end(); ++it ) {
             m.j = *it;
             m.v = -s * ds * w[nn++]/sum_w;
-            bool found = false;
-            for ( size_t nm=0; nm<m_data.size(); ++nm ) {
-                if ( m_data[nm].j == m.j ) {
-                    m_data[nm].v += m.v;
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nm = rowIndex.insert(m.j, m_data.size());
+            if ( nm < m_data.size() ) {
+                m_data[nm].v += m.v;
+            } else {
                 m_data.push_back(m);
             }
         }
@@ -2362,6 +2746,13 @@ namespace ttcr {
                                           std::vector<sijv<T1>>& m_data,
                                           const size_t RxNo,
                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
+        
+        // m_data may already hold terms
+        workspace[threadNo].row.clear();
+        for ( size_t nm=0; nm<m_data.size(); ++nm ) {
+            workspace[threadNo].row.insert(m_data[nm].j, nm);
+        }
         
         T1 minDist = small;
         std::vector<sxyz<T1>> r_tmp;
@@ -2378,12 +2769,10 @@ namespace ttcr {
         std::vector<T2> txCell( Tx.size() );
         std::vector<std::vector<T2>> txNeighborCells( Tx.size() );
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-            for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-                if ( nodes[nn] == Tx[nt] ) {
-                    txOnNode[nt] = true;
-                    txNode[nt] = nn;
-                    break;
-                }
+            T2 nn = getNodeNo( Tx[nt] );
+            if ( nn != std::numeric_limits<T2>::max() ) {
+                txOnNode[nt] = true;
+                txNode[nt] = nn;
             }
         }
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
@@ -2401,13 +2790,16 @@ namespace ttcr {
                 
                 for ( size_t nedge=0; nedge<6; ++nedge ) {
                     for ( auto nc0=nodes[ind[nedge][0]].getOwners().begin(); nc0!=nodes[ind[nedge][0]].getOwners().end(); ++nc0 ) {
-                        if ( std::find(nodes[ind[nedge][1]].getOwners().begin(), nodes[ind[nedge][1]].getOwners().end(), *nc0)!=nodes[ind[nedge][1]].getOwners().end() )
+                        if ( isVertex(ind[nedge][1], *nc0) )
                             txNeighborCells[nt].push_back( *nc0 );
                     }
                 }
             }
         }
         
+        std::vector<std::pair<T2,size_t>> txCells;
+        getTxCells(txOnNode, txNode, txCell, txNeighborCells, txCells);
+        
         T2 cellNo, nodeNo, nodeNoPrev;
         sxyz<T1> curr_pt( Rx ), mid_pt, prev_pt( Rx );
         sijv<T1> m;
@@ -2424,12 +2816,9 @@ namespace ttcr {
         Grad3D<T1,NODE> grad3d;
         bool reachedTx = false;
         
-        for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == curr_pt ) {
-                nodeNo = nn;
-                onNode = true;
-                break;
-            }
+        nodeNo = getNodeNo( curr_pt );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            onNode = true;
         }
         if ( !onNode ) {
             cellNo = getCellNo( curr_pt );
@@ -2539,7 +2928,7 @@ namespace ttcr {
 								allNodes.insert(nodeNoPrev);
 								allNodes.insert(nodeNo);
 								
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 							}
 
 							break_flag = true;
@@ -2567,7 +2956,7 @@ namespace ttcr {
                                 allNodes.insert( edgeNodes[0] );
                                 allNodes.insert( edgeNodes[1] );
 																
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 							}
 
                             break_flag = true;
@@ -2592,7 +2981,7 @@ namespace ttcr {
                         allNodes.insert( faceNodes[1] );
                         allNodes.insert( faceNodes[2] );
 						
-                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 					}
 
                     // find next cell
@@ -2620,7 +3009,7 @@ namespace ttcr {
                 // find cells common to edge
                 std::vector<T2> cells;
                 for ( auto nc0=nodes[edgeNodes[0]].getOwners().begin(); nc0!=nodes[edgeNodes[0]].getOwners().end(); ++nc0 ) {
-                    if ( std::find(nodes[edgeNodes[1]].getOwners().begin(), nodes[edgeNodes[1]].getOwners().end(), *nc0)!=nodes[edgeNodes[1]].getOwners().end() )
+                    if ( isVertex(edgeNodes[1], *nc0) )
                         cells.push_back( *nc0 );
                 }
                 // compute gradient with nodes from all common cells
@@ -2696,7 +3085,7 @@ namespace ttcr {
                                 allNodes.insert( edgeNodesPrev[0] );
                                 allNodes.insert( edgeNodesPrev[1] );
 								
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 							}
 							
                             break_flag = true;
@@ -2722,7 +3111,7 @@ namespace ttcr {
                             allNodes.insert( edgeNodes[0] );
                             allNodes.insert( edgeNodes[1] );
 							
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 						}
 						
 						break_flag = true;
@@ -2744,7 +3133,7 @@ namespace ttcr {
                             allNodes.insert( edgeNodes[0] );
                             allNodes.insert( edgeNodes[1] );
 							
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 						}
 						
 						break_flag = true;
@@ -2766,7 +3155,7 @@ namespace ttcr {
                             allNodes.insert( edgeNodes[0] );
                             allNodes.insert( edgeNodes[1] );
 							
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 						}
 						
 						break_flag = true;
@@ -2794,7 +3183,7 @@ namespace ttcr {
                         allNodes.insert( faceNodes[1] );
                         allNodes.insert( faceNodes[2] );
 						
-                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 					}
 					
                     // find next cell
@@ -2880,7 +3269,7 @@ namespace ttcr {
                                 allNodes.insert( faceNodesPrev[1] );
                                 allNodes.insert( faceNodesPrev[2] );
 								
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 							}
 
 							break_flag = true;
@@ -2910,7 +3299,7 @@ namespace ttcr {
                                 allNodes.insert( faceNodesPrev[1] );
                                 allNodes.insert( faceNodesPrev[2] );
 								
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 							}
 
 							break_flag = true;
@@ -2936,7 +3325,7 @@ namespace ttcr {
                         allNodes.insert( faceNodes[1] );
                         allNodes.insert( faceNodes[2] );
 						
-                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 					}
 
                     // find next cell
@@ -3007,7 +3396,7 @@ namespace ttcr {
                                     allNodes.insert( faceNodesPrev[1] );
                                     allNodes.insert( faceNodesPrev[2] );
                                 	
-                                    update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                    update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 								}
 								
 								break_flag = true;
@@ -3037,7 +3426,7 @@ namespace ttcr {
                                     allNodes.insert( faceNodesPrev[1] );
                                     allNodes.insert( faceNodesPrev[2] );
 									
-									update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+									update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 								}
 								
 								break_flag = true;
@@ -3063,7 +3452,7 @@ namespace ttcr {
                             allNodes.insert( faceNodes[1] );
                             allNodes.insert( faceNodes[2] );
 							
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
 						}
 						
                         // find next cell
@@ -3095,31 +3484,11 @@ namespace ttcr {
                     }
                 }
             } else {
-                for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-                    if ( txOnNode[nt] ) {
-                        for ( auto nc=nodes[txNode[nt]].getOwners().begin();
-                             nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
-                            if ( cellNo == *nc ) {
-                                r_tmp.push_back( Tx[nt] );
-                                reachedTx = true;
-                                break;
-                            }
-                        }
-                    } else {
-                        if ( cellNo == txCell[nt] ) {
-                            r_tmp.push_back( Tx[nt] );
-                            reachedTx = true;
-                        } else {
-                            for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
-                                if ( cellNo == txNeighborCells[nt][nn] ) {
-                                    r_tmp.push_back( Tx[nt] );
-                                    reachedTx = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if ( reachedTx ) break;
+                auto it = std::lower_bound(txCells.begin(), txCells.end(),
+                                           std::pair<T2,size_t>(cellNo, 0));
+                if ( it != txCells.end() && it->first == cellNo ) {
+                    r_tmp.push_back( Tx[it->second] );
+                    reachedTx = true;
                 }
             }
         }
@@ -3138,6 +3507,13 @@ namespace ttcr {
                                              std::vector<sijv<T1>>& m_data,
                                              const size_t RxNo,
                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
+        
+        // m_data may already hold terms
+        workspace[threadNo].row.clear();
+        for ( size_t nm=0; nm<m_data.size(); ++nm ) {
+            workspace[threadNo].row.insert(m_data[nm].j, nm);
+        }
         
         T1 minDist = small;
         std::vector<sxyz<T1>> r_tmp;
@@ -3154,12 +3530,10 @@ namespace ttcr {
         std::vector<T2> txCell( Tx.size() );
         std::vector<std::vector<T2>> txNeighborCells( Tx.size() );
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-            for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-                if ( nodes[nn] == Tx[nt] ) {
-                    txOnNode[nt] = true;
-                    txNode[nt] = nn;
-                    break;
-                }
+            T2 nn = getNodeNo( Tx[nt] );
+            if ( nn != std::numeric_limits<T2>::max() ) {
+                txOnNode[nt] = true;
+                txNode[nt] = nn;
             }
         }
         for ( size_t nt=0; nt<Tx.size(); ++nt ) {
@@ -3177,13 +3551,16 @@ namespace ttcr {
                 
                 for ( size_t nedge=0; nedge<6; ++nedge ) {
                     for ( auto nc0=nodes[ind[nedge][0]].getOwners().begin(); nc0!=nodes[ind[nedge][0]].getOwners().end(); ++nc0 ) {
-                        if ( std::find(nodes[ind[nedge][1]].getOwners().begin(), nodes[ind[nedge][1]].getOwners().end(), *nc0)!=nodes[ind[nedge][1]].getOwners().end() )
+                        if ( isVertex(ind[nedge][1], *nc0) )
                             txNeighborCells[nt].push_back( *nc0 );
                     }
                 }
             }
         }
         
+        std::vector<std::pair<T2,size_t>> txCells;
+        getTxCells(txOnNode, txNode, txCell, txNeighborCells, txCells);
+        
         T2 cellNo, nodeNo, nodeNoPrev;
         sxyz<T1> curr_pt( Rx ), mid_pt, prev_pt( Rx );
         sijv<T1> m;
@@ -3200,12 +3577,9 @@ namespace ttcr {
         Grad3D_ho<T1,NODE> grad3d;
         bool reachedTx = false;
         
-        for ( T2 nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == curr_pt ) {
-                nodeNo = nn;
-                onNode = true;
-                break;
-            }
+        nodeNo = getNodeNo( curr_pt );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            onNode = true;
         }
         if ( !onNode ) {
             cellNo = getCellNo( curr_pt );
@@ -3310,7 +3684,7 @@ namespace ttcr {
                                 allNodes.insert(nodeNoPrev);
                                 allNodes.insert(nodeNo);
                                 
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                             }
                             
                             break_flag = true;
@@ -3338,7 +3712,7 @@ namespace ttcr {
                                 allNodes.insert( edgeNodes[0] );
                                 allNodes.insert( edgeNodes[1] );
                                 
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                             }
 
                             break_flag = true;
@@ -3363,7 +3737,7 @@ namespace ttcr {
                         allNodes.insert( faceNodes[1] );
                         allNodes.insert( faceNodes[2] );
                         
-                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                     }
                     
                     // find next cell
@@ -3392,7 +3766,7 @@ namespace ttcr {
                 std::vector<T2> cells;
                 std::set<NODE*> nnodes;
                 for ( auto nc0=nodes[edgeNodes[0]].getOwners().begin(); nc0!=nodes[edgeNodes[0]].getOwners().end(); ++nc0 ) {
-                    if ( std::find(nodes[edgeNodes[1]].getOwners().begin(), nodes[edgeNodes[1]].getOwners().end(), *nc0)!=nodes[edgeNodes[1]].getOwners().end() ) {
+                    if ( isVertex(edgeNodes[1], *nc0) ) {
                         cells.push_back( *nc0 );
                         getNeighborNodes(*nc0, nnodes);
                     }
@@ -3463,7 +3837,7 @@ namespace ttcr {
                                 allNodes.insert( edgeNodesPrev[0] );
                                 allNodes.insert( edgeNodesPrev[1] );
                                 
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                             }
                             
                             break_flag = true;
@@ -3489,7 +3863,7 @@ namespace ttcr {
                             allNodes.insert( edgeNodes[0] );
                             allNodes.insert( edgeNodes[1] );
                             
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                         }
                         
                         break_flag = true;
@@ -3511,7 +3885,7 @@ namespace ttcr {
                             allNodes.insert( edgeNodes[0] );
                             allNodes.insert( edgeNodes[1] );
                             
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                         }
                         
                         break_flag = true;
@@ -3533,7 +3907,7 @@ namespace ttcr {
                             allNodes.insert( edgeNodes[0] );
                             allNodes.insert( edgeNodes[1] );
 
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                         }
                         
                         break_flag = true;
@@ -3561,7 +3935,7 @@ namespace ttcr {
                         allNodes.insert( faceNodes[1] );
                         allNodes.insert( faceNodes[2] );
                         
-                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                     }
                     
                     // find next cell
@@ -3646,7 +4020,7 @@ namespace ttcr {
                                 allNodes.insert( faceNodesPrev[1] );
                                 allNodes.insert( faceNodesPrev[2] );
                                 
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                             }
                             
                             break_flag = true;
@@ -3676,7 +4050,7 @@ namespace ttcr {
                                 allNodes.insert( faceNodesPrev[1] );
                                 allNodes.insert( faceNodesPrev[2] );
                                 
-                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                             }
                             
                             break_flag = true;
@@ -3702,7 +4076,7 @@ namespace ttcr {
                         allNodes.insert( faceNodes[1] );
                         allNodes.insert( faceNodes[2] );
                         
-                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                        update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                     }
                     
                     // find next cell
@@ -3773,7 +4147,7 @@ namespace ttcr {
                                     allNodes.insert( faceNodesPrev[1] );
                                     allNodes.insert( faceNodesPrev[2] );
                                     
-                                    update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                    update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                                 }
                                 
                                 break_flag = true;
@@ -3803,7 +4177,7 @@ namespace ttcr {
                                     allNodes.insert( faceNodesPrev[1] );
                                     allNodes.insert( faceNodesPrev[2] );
                                     
-                                    update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                                    update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                                 }
                                 
                                 break_flag = true;
@@ -3829,7 +4203,7 @@ namespace ttcr {
                             allNodes.insert( faceNodes[1] );
                             allNodes.insert( faceNodes[2] );
                             
-                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds);
+                            update_m_data(m_data, m, allNodes, mid_pt, s,  ds, threadNo);
                         }
                         
                         // find next cell
@@ -3861,31 +4235,11 @@ namespace ttcr {
                     }
                 }
             } else {
-                for ( size_t nt=0; nt<Tx.size(); ++nt ) {
-                    if ( txOnNode[nt] ) {
-                        for ( auto nc=nodes[txNode[nt]].getOwners().begin();
-                             nc!=nodes[txNode[nt]].getOwners().end(); ++nc ) {
-                            if ( cellNo == *nc ) {
-                                r_tmp.push_back( Tx[nt] );
-                                reachedTx = true;
-                                break;
-                            }
-                        }
-                    } else {
-                        if ( cellNo == txCell[nt] ) {
-                            r_tmp.push_back( Tx[nt] );
-                            reachedTx = true;
-                        } else {
-                            for ( size_t nn=0; nn<txNeighborCells[nt].size(); ++nn ) {
-                                if ( cellNo == txNeighborCells[nt][nn] ) {
-                                    r_tmp.push_back( Tx[nt] );
-                                    reachedTx = true;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    if ( reachedTx ) break;
+                auto it = std::lower_bound(txCells.begin(), txCells.end(),
+                                           std::pair<T2,size_t>(cellNo, 0));
+                if ( it != txCells.end() && it->first == cellNo ) {
+                    r_tmp.push_back( Tx[it->second] );
+                    reachedTx = true;
                 }
             }
         }
@@ -4004,20 +4358,28 @@ namespace ttcr {
     T2 Grid3Dun<T1,T2,NODE>::findAdjacentCell1(const std::array<T2,3> &faceNodes,
                                                const T2 nodeNo) const {
         
-        std::vector<T2> cells;
+        // first cell owning the face, the other one is in the face table
+        T2 cell0 = std::numeric_limits<T2>::max();
+        size_t i = 4;
         for ( auto nc0=nodes[faceNodes[0]].getOwners().begin(); nc0!=nodes[faceNodes[0]].getOwners().end(); ++nc0 ) {
-            if ( std::find(nodes[faceNodes[1]].getOwners().begin(), nodes[faceNodes[1]].getOwners().end(), *nc0)!=nodes[faceNodes[1]].getOwners().end() &&
-                std::find(nodes[faceNodes[2]].getOwners().begin(), nodes[faceNodes[2]].getOwners().end(), *nc0)!=nodes[faceNodes[2]].getOwners().end() )
-                cells.push_back( *nc0 );
+            i = oppositeVertex(faceNodes, *nc0);
+            if ( i < 4 ) {
+                cell0 = *nc0;
+                break;
+            }
         }
-        if ( cells.size() == 1 ) {
-            return cells[0];
+        if ( cell0 == std::numeric_limits<T2>::max() ) {
+            return cell0;
+        }
+        T2 cell1 = faceNeighbors[cell0][i];
+        if ( cell1 == std::numeric_limits<T2>::max() ) {
+            return cell0;
         }
         for ( auto nc0=nodes[nodeNo].getOwners().begin(); nc0!=nodes[nodeNo].getOwners().end(); ++nc0 ) {
-            if ( *nc0 == cells[0] ) {
-                return cells[1];
-            } else if ( *nc0 == cells[1] ) {
-                return cells[0];
+            if ( *nc0 == cell0 ) {
+                return cell1;
+            } else if ( *nc0 == cell1 ) {
+                return cell0;
             }
         }
         return std::numeric_limits<T2>::max();
@@ -4027,19 +4389,17 @@ namespace ttcr {
     T2 Grid3Dun<T1,T2,NODE>::findAdjacentCell2(const std::array<T2,3> &faceNodes,
                                                const T2 cellNo) const {
         
-        std::vector<T2> cells;
-        for ( auto nc0=nodes[faceNodes[0]].getOwners().begin(); nc0!=nodes[faceNodes[0]].getOwners().end(); ++nc0 ) {
-            if ( std::find(nodes[faceNodes[1]].getOwners().begin(), nodes[faceNodes[1]].getOwners().end(), *nc0)!=nodes[faceNodes[1]].getOwners().end() &&
-                std::find(nodes[faceNodes[2]].getOwners().begin(), nodes[faceNodes[2]].getOwners().end(), *nc0)!=nodes[faceNodes[2]].getOwners().end() )
-                cells.push_back( *nc0 );
+        size_t i = oppositeVertex(faceNodes, cellNo);
+        if ( i < 4 ) {
+            T2 cell = faceNeighbors[cellNo][i];
+            return cell == std::numeric_limits<T2>::max() ? cellNo : cell;
         }
-        if ( cells.size() == 1 ) {
-            return cells[0];
-        }
-        if ( cellNo == cells[0] ) {
-            return cells[1];
-        } else if ( cellNo == cells[1] ) {
-            return cells[0];
+        // face not in cellNo, valid only if on the boundary
+        for ( auto nc0=nodes[faceNodes[0]].getOwners().begin(); nc0!=nodes[faceNodes[0]].getOwners().end(); ++nc0 ) {
+            i = oppositeVertex(faceNodes, *nc0);
+            if ( i < 4 ) {
+                return faceNeighbors[*nc0][i] == std::numeric_limits<T2>::max() ? *nc0 : std::numeric_limits<T2>::max();
+            }
         }
         return std::numeric_limits<T2>::max();
     }
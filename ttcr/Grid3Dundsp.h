@@ -6,32 +6,668 @@
 //  Copyright © 2018 Bernard Giroux. All rights reserved.
 //
 
-#ifndef Grid3Dundsp_h
-#define Grid3Dundsp_h
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
 
-#include "Grid3Dun.h"
+#ifndef ttcr_Grid3Dundsp_h
+#define ttcr_Grid3Dundsp_h
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Grid3Dunsp.h"
+#include "Interpolator.h"
+#include "Node3Dnsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 
 namespace ttcr {
-    
-    template<typename T1, typename T2>
-    class Grid3Dundsp : public Grid3Dun<T1,T2,Node3Dn<T1,T2>> {
+
+    /*
+     Shortest path method with dynamic nodes.  The grid holds nsecondary
+     static nodes per edge, as Grid3Dunsp.  For each raytrace, ndynamic
+     tertiary nodes are added between successive nodes of the edges (and on
+     the faces, with the same spacing) of the cells around the sources,
+     where the curvature of the wavefront is high and the error of the
+     method is largest.  These cells are those touching a vertex within
+     distance radius of a source, and those touching a vertex of the cell
+     of the source.  Tertiary nodes are discarded once the raytrace is done.
+     */
+    template<typename T1, typename T2,
+             template<typename,typename> class QUEUE=DefaultQueue>
+    class Grid3Dundsp : public Grid3Dunsp<T1,T2,QUEUE> {
     public:
         Grid3Dundsp(const std::vector<sxyz<T1>>& no,
-                   const std::vector<tetrahedronElem<T2>>& tet,
-                   const int ns, const int nd, const size_t nt=1,
-                    const int verbose=0) :
-        Grid3Dun<T1,T2,Node3Dn<T1,T2>>(no, tet, nt), nsecondary(ns), ndynamic(nd)
+                    const std::vector<tetrahedronElem<T2>>& tet,
+                    const int ns, const int nd, const T1 rad,
+                    const size_t nt=1, const int verbose=0,
+                    const std::string& cacheFile="") :
+        Grid3Dunsp<T1,T2,QUEUE>(no, tet, ns, nt, verbose, cacheFile),
+        ndynamic(nd), radius(rad)
         {
-            this->buildGridNodes(no, ns, nt, verbose);
-            this->buildGridNeighbors();
         }
-        
+
         ~Grid3Dundsp() {
         }
-        
+
+        void raytrace(const std::vector<sxyz<T1>>&,
+                      const std::vector<T1>&,
+                      const std::vector<sxyz<T1>>&,
+                      std::vector<T1>&,
+                      const size_t=0) const;
+
+        void raytrace(const std::vector<sxyz<T1>>&,
+                      const std::vector<T1>&,
+                      const std::vector<const std::vector<sxyz<T1>>*>&,
+                      std::vector<std::vector<T1>*>&,
+                      const size_t=0) const;
+
+        void raytrace(const std::vector<sxyz<T1>>&,
+                      const std::vector<T1>& ,
+                      const std::vector<sxyz<T1>>&,
+                      std::vector<T1>&,
+                      std::vector<std::vector<sxyz<T1>>>&,
+                      const size_t=0) const;
+
+        void raytrace(const std::vector<sxyz<T1>>&,
+                      const std::vector<T1>&,
+                      const std::vector<const std::vector<sxyz<T1>>*>&,
+                      std::vector<std::vector<T1>*>&,
+                      std::vector<std::vector<std::vector<sxyz<T1>>>*>&,
+                      const size_t=0) const;
+
+        void raytrace(const std::vector<sxyz<T1>>&,
+                      const std::vector<T1>& ,
+                      const std::vector<sxyz<T1>>&,
+                      std::vector<T1>&,
+                      std::vector<std::vector<sxyz<T1>>>&,
+                      std::vector<std::vector<siv<T1>>>&,
+                      const size_t=0) const;
+
     private:
-        T2 ndynamic;
-        
+        T2 ndynamic;     // number of tertiary nodes between static nodes
+        T1 radius;       // radius of the region refined around sources
+
+        // Nodes added for one raytrace: tertiary nodes, then sources that
+        // are not on a grid node.  nodes[k] has grid index
+        // this->nodes.size()+k.
+        struct dynamicNodes {
+            std::vector<Node3Dnsp<T1,T2>> nodes;
+            threadStorage<T1,T2> storage;
+            std::map<T2,std::vector<T2>> cellNodes;  // grid indices of added nodes of cells
+        };
+
+        Node3Dnsp<T1,T2>& getNode(const T2 nodeNo, dynamicNodes& dyn) const {
+            return nodeNo < this->nodes.size() ? this->nodes[nodeNo] :
+            dyn.nodes[nodeNo-this->nodes.size()];
+        }
+
+        void addNode(const sxyz<T1>& pt, const T1 s,
+                     const std::vector<T2>& owners,
+                     dynamicNodes& dyn) const;
+
+        void buildDynamicNodes(const std::vector<sxyz<T1>>& Tx,
+                               dynamicNodes& dyn) const;
+
+        void solve(const std::vector<sxyz<T1>>& Tx,
+                   const std::vector<T1>& t0,
+                   dynamicNodes& dyn,
+                   const size_t threadNo) const;
+
+        void propagate(QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                       dynamicNodes& dyn,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
+                       const size_t threadNo) const;
+
+        T1 getTraveltime(const sxyz<T1>& Rx,
+                         dynamicNodes& dyn,
+                         T2& nodeParentRx,
+                         T2& cellParentRx,
+                         const size_t threadNo) const;
+
+        void getRaypath(const std::vector<sxyz<T1>>& Tx,
+                        const sxyz<T1>& Rx,
+                        const T2 nodeParentRx,
+                        const T2 cellParentRx,
+                        dynamicNodes& dyn,
+                        std::vector<sxyz<T1>>& r_data,
+                        std::vector<siv<T1>> *l_data,
+                        RowIndex& rowIndex,
+                        const size_t threadNo) const;
     };
+
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::addNode(const sxyz<T1>& pt, const T1 s,
+                                           const std::vector<T2>& owners,
+                                           dynamicNodes& dyn) const {
+        T2 nodeNo = static_cast<T2>(this->nodes.size()+dyn.nodes.size());
+        dyn.nodes.push_back( Node3Dnsp<T1,T2>(this->nThreads, sharedStorage_t()) );
+        dyn.nodes.back().setXYZindex( pt, nodeNo );
+        dyn.nodes.back().setNodeSlowness( s );
+        for ( size_t no=0; no<owners.size(); ++no ) {
+            dyn.nodes.back().pushOwner( owners[no] );
+            dyn.cellNodes[ owners[no] ].push_back( nodeNo );
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::buildDynamicNodes(const std::vector<sxyz<T1>>& Tx,
+                                                     dynamicNodes& dyn) const {
+
+        // cells touching a vertex close to a source
+        std::set<T2> cells;
+        for ( size_t n=0; n<Tx.size(); ++n ) {
+            T2 cellNo = this->getCellNo( Tx[n] );
+            std::set<T2> vertices;
+            std::vector<T2> front;
+            for ( size_t i=0; i<4; ++i ) {
+                vertices.insert( this->tetrahedra[cellNo].i[i] );
+                front.push_back( this->tetrahedra[cellNo].i[i] );
+            }
+            while ( !front.empty() ) {
+                T2 v = front.back();
+                front.pop_back();
+                const std::vector<T2>& owners = this->nodes[v].getOwners();
+                for ( size_t no=0; no<owners.size(); ++no ) {
+                    if ( !cells.insert(owners[no]).second ) continue;
+                    for ( size_t i=0; i<4; ++i ) {
+                        T2 w = this->tetrahedra[owners[no]].i[i];
+                        if ( vertices.find(w) == vertices.end() &&
+                            this->nodes[w].getDistance(Tx[n]) <= radius ) {
+                            vertices.insert( w );
+                            front.push_back( w );
+                        }
+                    }
+                }
+            }
+        }
+
+        // Static nodes divide the edges in nsecondary+1 segments, each
+        // divided again in ndynamic+1 segments; the lattice of the faces
+        // follows the same spacing.  Positions of static nodes are skipped.
+        const T2 nd = ndynamic+1;
+        const T2 nseg = (this->nsecondary+1)*nd;
+
+        std::set<std::array<T2,2>> edges;
+        std::set<std::array<T2,3>> faces;
+        std::vector<T2> owners;
+
+        for ( auto c=cells.begin(); c!=cells.end(); ++c ) {
+            const tetrahedronElem<T2>& tet = this->tetrahedra[*c];
+
+            for ( size_t i=0; i<3; ++i ) {
+                for ( size_t j=i+1; j<4; ++j ) {
+                    std::array<T2,2> edge = {{tet.i[i], tet.i[j]}};
+                    std::sort(edge.begin(), edge.end());
+                    if ( !edges.insert(edge).second ) continue;
+
+                    const Node3Dnsp<T1,T2>& n0 = this->nodes[edge[0]];
+                    const Node3Dnsp<T1,T2>& n1 = this->nodes[edge[1]];
+
+                    owners.clear();
+                    for ( size_t no=0; no<n0.getOwners().size(); ++no ) {
+                        if ( this->isVertex(edge[1], n0.getOwners()[no]) )
+                            owners.push_back( n0.getOwners()[no] );
+                    }
+
+                    for ( T2 k=1; k<nseg; ++k ) {
+                        if ( k%nd == 0 ) continue;
+                        T1 w = static_cast<T1>(k)/nseg;
+                        sxyz<T1> pt;
+                        pt.x = (1-w)*n0.getX() + w*n1.getX();
+                        pt.y = (1-w)*n0.getY() + w*n1.getY();
+                        pt.z = (1-w)*n0.getZ() + w*n1.getZ();
+                        T1 s = (1-w)*n0.getNodeSlowness() + w*n1.getNodeSlowness();
+                        addNode(pt, s, owners, dyn);
+                    }
+                }
+            }
+
+            for ( size_t ntri=0; ntri<4; ++ntri ) {
+                std::array<T2,3> face = {{tet.i[ iNodes[ntri][0] ],
+                    tet.i[ iNodes[ntri][1] ], tet.i[ iNodes[ntri][2] ]}};
+                std::sort(face.begin(), face.end());
+                if ( !faces.insert(face).second ) continue;
+
+                std::vector<Node3Dnsp<T1,T2>*> inodes;
+                inodes.push_back( &(this->nodes[face[0]]) );
+                inodes.push_back( &(this->nodes[face[1]]) );
+                inodes.push_back( &(this->nodes[face[2]]) );
+
+                owners.clear();
+                const std::vector<T2>& o0 = inodes[0]->getOwners();
+                for ( size_t no=0; no<o0.size(); ++no ) {
+                    if ( this->isVertex(face[1], o0[no]) && this->isVertex(face[2], o0[no]) )
+                        owners.push_back( o0[no] );
+                }
+
+                // interior points of the lattice, with barycentric
+                // coordinates (nseg-k1-k2, k1, k2)/nseg
+                for ( T2 k1=1; k1+1<nseg; ++k1 ) {
+                    for ( T2 k2=1; k1+k2<nseg; ++k2 ) {
+                        if ( k1%nd == 0 && k2%nd == 0 ) continue;
+                        T1 w1 = static_cast<T1>(k1)/nseg;
+                        T1 w2 = static_cast<T1>(k2)/nseg;
+                        T1 w0 = 1 - w1 - w2;
+                        sxyz<T1> pt;
+                        pt.x = w0*inodes[0]->getX() + w1*inodes[1]->getX() + w2*inodes[2]->getX();
+                        pt.y = w0*inodes[0]->getY() + w1*inodes[1]->getY() + w2*inodes[2]->getY();
+                        pt.z = w0*inodes[0]->getZ() + w1*inodes[1]->getZ() + w2*inodes[2]->getZ();
+                        T1 s = Interpolator<T1>::inverseDistance(pt, inodes);
+                        addNode(pt, s, owners, dyn);
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::solve(const std::vector<sxyz<T1>>& Tx,
+                                         const std::vector<T1>& t0,
+                                         dynamicNodes& dyn,
+                                         const size_t threadNo) const {
+
+        this->reinitNodes( threadNo );
+
+        if ( ndynamic > 0 ) buildDynamicNodes(Tx, dyn);
+
+        // sources that are not on a node are added after the tertiary nodes
+        std::vector<T2> txNodeNo( Tx.size() );
+        for ( size_t n=0; n<Tx.size(); ++n ) {
+            txNodeNo[n] = this->getNodeNo( Tx[n] );
+            if ( txNodeNo[n] == std::numeric_limits<T2>::max() ) {
+                txNodeNo[n] = static_cast<T2>(this->nodes.size()+dyn.nodes.size());
+                std::vector<T2> owners(1, this->getCellNo(Tx[n]));
+                addNode(Tx[n], this->computeSlowness(Tx[n]), owners, dyn);
+            }
+        }
+
+        Node3Dnsp<T1,T2>::allocateStorage(dyn.storage, dyn.nodes.size(), this->nThreads);
+        for ( size_t n=0; n<dyn.nodes.size(); ++n ) {
+            dyn.nodes[n].setStorage(dyn.storage, n, dyn.nodes.size());
+        }
+
+        const size_t nNodes = this->nodes.size() + dyn.nodes.size();
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, nNodes);
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( nNodes );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( nNodes );
+
+        for ( size_t n=0; n<Tx.size(); ++n ) {
+            Node3Dnsp<T1,T2>& node = getNode(txNodeNo[n], dyn);
+            node.setTT( t0[n], threadNo );
+            if ( !inQueue[ txNodeNo[n] ] ) {
+                queue.push( &node );
+                this->instrumentation.count(threadNo, QUEUE_PUSH);
+                inQueue[ txNodeNo[n] ] = true;
+            }
+            frozen[ txNodeNo[n] ] = true;
+        }
+
+        propagate(queue, dyn, inQueue, frozen, threadNo);
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::propagate(QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                                             dynamicNodes& dyn,
+                                             NodeFlags& inQueue,
+                                             NodeFlags& frozen,
+                                             const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
+
+        // relax node neibNo from src, through cell cellNo
+        auto relax = [&](const Node3Dnsp<T1,T2>* src, const T2 neibNo, const T2 cellNo) {
+            if ( neibNo == src->getGridIndex() || frozen[neibNo] ) {
+                return;
+            }
+            Node3Dnsp<T1,T2>& node = getNode(neibNo, dyn);
+
+            // compute dt
+            T1 dt = this->computeDt(*src, node);
+
+            if (src->getTT(threadNo)+dt < node.getTT(threadNo)) {
+                node.setTT( src->getTT(threadNo)+dt, threadNo );
+                node.setnodeParent(src->getGridIndex(),threadNo);
+                node.setCellParent(cellNo, threadNo );
+
+                if ( !inQueue[neibNo] ) {
+                    queue.push( &node );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
+                    inQueue[neibNo] = true;
+                } else {
+                    queue.update( &node );
+                    this->instrumentation.count(threadNo, QUEUE_UPDATE);
+                }
+            }
+        };
+
+        while ( !queue.empty() ) {
+            const Node3Dnsp<T1,T2>* src = queue.top();
+            queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
+            inQueue[ src->getGridIndex() ] = false;
+            frozen[ src->getGridIndex() ] = true;
+
+            for ( size_t no=0; no<src->getOwners().size(); ++no ) {
+
+                T2 cellNo = src->getOwners()[no];
+
+                for ( size_t k=0; k< this->neighbors[cellNo].size(); ++k ) {
+                    relax(src, this->neighbors[cellNo][k], cellNo);
+                }
+
+                auto it = dyn.cellNodes.find( cellNo );
+                if ( it != dyn.cellNodes.end() ) {
+                    for ( size_t k=0; k<it->second.size(); ++k ) {
+                        relax(src, it->second[k], cellNo);
+                    }
+                }
+            }
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    T1 Grid3Dundsp<T1,T2,QUEUE>::getTraveltime(const sxyz<T1>& Rx,
+                                               dynamicNodes& dyn,
+                                               T2& nodeParentRx, T2& cellParentRx,
+                                               const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
+
+        T2 nodeNo = this->getNodeNo( Rx );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            nodeParentRx = this->nodes[nodeNo].getNodeParent(threadNo);
+            cellParentRx = this->nodes[nodeNo].getCellParent(threadNo);
+            return this->nodes[nodeNo].getTT(threadNo);
+        }
+        //If Rx is not on a node:
+        T1 slo = this->computeSlowness( Rx );
+
+        T2 cellNo = this->getCellNo( Rx );
+        T1 traveltime = std::numeric_limits<T1>::max();
+        cellParentRx = cellNo;
+
+        for ( size_t k=0; k< this->neighbors[cellNo].size(); ++k ) {
+            T2 neibNo = this->neighbors[cellNo][k];
+            T1 dt = this->computeDt(this->nodes[neibNo], Rx, slo);
+            if ( traveltime > this->nodes[neibNo].getTT(threadNo)+dt ) {
+                traveltime = this->nodes[neibNo].getTT(threadNo)+dt;
+                nodeParentRx = neibNo;
+            }
+        }
+        auto it = dyn.cellNodes.find( cellNo );
+        if ( it != dyn.cellNodes.end() ) {
+            for ( size_t k=0; k<it->second.size(); ++k ) {
+                const Node3Dnsp<T1,T2>& node = getNode(it->second[k], dyn);
+                T1 dt = this->computeDt(node, Rx, slo);
+                this->instrumentation.count(threadNo, LOCAL_UPDATE);
+                if ( traveltime > node.getTT(threadNo)+dt ) {
+                    traveltime = node.getTT(threadNo)+dt;
+                    nodeParentRx = it->second[k];
+                }
+            }
+        }
+        return traveltime;
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::getRaypath(const std::vector<sxyz<T1>>& Tx,
+                                              const sxyz<T1>& Rx,
+                                              const T2 nodeParentRx,
+                                              const T2 cellParentRx,
+                                              dynamicNodes& dyn,
+                                              std::vector<sxyz<T1>>& r_data,
+                                              std::vector<siv<T1>> *l_data,
+                                              RowIndex& rowIndex,
+                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
+
+        r_data.resize( 0 );
+        if ( l_data != nullptr ) {
+            l_data->resize( 0 );
+            rowIndex.clear();
+        }
+
+        for ( size_t ns=0; ns<Tx.size(); ++ns ) {
+            if ( Rx == Tx[ns] ) {
+                r_data.resize( 1 );
+                r_data[0] = Rx;
+                // no need to update l_data: ray length is zero
+                return;
+            }
+        }
+
+        // add length of segment in cell
+        auto addLength = [&](const siv<T1>& cell) {
+            size_t nc = rowIndex.insert(cell.i, l_data->size());
+            if ( nc < l_data->size() ) {
+                (*l_data)[nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
+                l_data->push_back( cell );
+            }
+        };
+
+        std::vector<sxyz<T1>> r_tmp;
+        const Node3Dnsp<T1,T2> *parent = &getNode(nodeParentRx, dyn);
+        sxyz<T1> child;
+        siv<T1> cell;
+
+        // store the son's coord
+        child = Rx;
+        cell.i = cellParentRx;
+        while ( parent->getNodeParent(threadNo) != std::numeric_limits<T2>::max() ) {
+
+            r_tmp.push_back( child );
+
+            if ( l_data != nullptr ) {
+                cell.v = parent->getDistance( child );
+                addLength( cell );
+            }
+
+            // we now go up in time - parent becomes the child of grand'pa
+            child = *parent;
+            cell.i = parent->getCellParent(threadNo);
+
+            // grand'pa is now papa
+            parent = &getNode(parent->getNodeParent(threadNo), dyn);
+        }
+
+        // parent is now at Tx
+        r_tmp.push_back( child );
+
+        if ( l_data != nullptr ) {
+            cell.v = parent->getDistance( child );
+            addLength( cell );
+            //  must be sorted to build matrix L
+            std::sort(l_data->begin(), l_data->end(), CompareSiv_i<T1>());
+        }
+
+        // finally, store Tx position
+        child = *parent;
+        r_tmp.push_back( child );
+
+        // the order should be from Tx to Rx, so we reorder...
+        r_data.resize( r_tmp.size() );
+        for ( size_t nn=0; nn<r_data.size(); ++nn ) {
+            r_data[nn] = r_tmp[ r_tmp.size()-1-nn ];
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            const std::vector<sxyz<T1>>& Rx,
+                                            std::vector<T1>& traveltimes,
+                                            const size_t threadNo) const {
+
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+
+        dynamicNodes dyn;
+        solve(Tx, t0, dyn, threadNo);
+
+        if ( traveltimes.size() != Rx.size() ) {
+            traveltimes.resize( Rx.size() );
+        }
+
+        T2 nodeParentRx;
+        T2 cellParentRx;
+        for (size_t n=0; n<Rx.size(); ++n) {
+            traveltimes[n] = getTraveltime(Rx[n], dyn, nodeParentRx, cellParentRx, threadNo);
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                            std::vector<std::vector<T1>*>& traveltimes,
+                                            const size_t threadNo) const {
+
+        this->checkPts(Tx, threadNo);
+        for ( size_t n=0; n<Rx.size(); ++n )
+            this->checkPts(*Rx[n], threadNo);
+
+        dynamicNodes dyn;
+        solve(Tx, t0, dyn, threadNo);
+
+        if ( traveltimes.size() != Rx.size() ) {
+            traveltimes.resize( Rx.size() );
+        }
+
+        T2 nodeParentRx;
+        T2 cellParentRx;
+        for (size_t nr=0; nr<Rx.size(); ++nr) {
+            traveltimes[nr]->resize( Rx[nr]->size() );
+            for (size_t n=0; n<Rx[nr]->size(); ++n)
+                (*traveltimes[nr])[n] = getTraveltime((*Rx[nr])[n], dyn, nodeParentRx,
+                                                      cellParentRx, threadNo);
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            const std::vector<sxyz<T1>>& Rx,
+                                            std::vector<T1>& traveltimes,
+                                            std::vector<std::vector<sxyz<T1>>>& r_data,
+                                            const size_t threadNo) const {
+
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+
+        dynamicNodes dyn;
+        solve(Tx, t0, dyn, threadNo);
+
+        if ( traveltimes.size() != Rx.size() ) {
+            traveltimes.resize( Rx.size() );
+        }
+        if ( r_data.size() != Rx.size() ) {
+            r_data.resize( Rx.size() );
+        }
+
+        T2 nodeParentRx;
+        T2 cellParentRx;
+        RowIndex rowIndex;
+        for (size_t n=0; n<Rx.size(); ++n) {
+            traveltimes[n] = getTraveltime(Rx[n], dyn, nodeParentRx, cellParentRx, threadNo);
+            getRaypath(Tx, Rx[n], nodeParentRx, cellParentRx, dyn, r_data[n],
+                       nullptr, rowIndex, threadNo);
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                            std::vector<std::vector<T1>*>& traveltimes,
+                                            std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
+                                            const size_t threadNo) const {
+
+        this->checkPts(Tx, threadNo);
+        for ( size_t n=0; n<Rx.size(); ++n )
+            this->checkPts(*Rx[n], threadNo);
+
+        dynamicNodes dyn;
+        solve(Tx, t0, dyn, threadNo);
+
+        if ( traveltimes.size() != Rx.size() ) {
+            traveltimes.resize( Rx.size() );
+        }
+        if ( r_data.size() != Rx.size() ) {
+            r_data.resize( Rx.size() );
+        }
+
+        T2 nodeParentRx;
+        T2 cellParentRx;
+        RowIndex rowIndex;
+        for (size_t nr=0; nr<Rx.size(); ++nr) {
+            traveltimes[nr]->resize( Rx[nr]->size() );
+            r_data[nr]->resize( Rx[nr]->size() );
+            for (size_t n=0; n<Rx[nr]->size(); ++n) {
+                (*traveltimes[nr])[n] = getTraveltime((*Rx[nr])[n], dyn, nodeParentRx,
+                                                      cellParentRx, threadNo);
+                getRaypath(Tx, (*Rx[nr])[n], nodeParentRx, cellParentRx, dyn,
+                           (*r_data[nr])[n], nullptr, rowIndex, threadNo);
+            }
+        }
+    }
+
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dundsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            const std::vector<sxyz<T1>>& Rx,
+                                            std::vector<T1>& traveltimes,
+                                            std::vector<std::vector<sxyz<T1>>>& r_data,
+                                            std::vector<std::vector<siv<T1>>>& l_data,
+                                            const size_t threadNo) const {
+
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+
+        dynamicNodes dyn;
+        solve(Tx, t0, dyn, threadNo);
+
+        if ( traveltimes.size() != Rx.size() ) {
+            traveltimes.resize( Rx.size() );
+        }
+        if ( r_data.size() != Rx.size() ) {
+            r_data.resize( Rx.size() );
+        }
+        if ( l_data.size() != Rx.size() ) {
+            l_data.resize( Rx.size() );
+        }
+
+        T2 nodeParentRx;
+        T2 cellParentRx;
+        RowIndex rowIndex;
+        for (size_t n=0; n<Rx.size(); ++n) {
+            traveltimes[n] = getTraveltime(Rx[n], dyn, nodeParentRx, cellParentRx, threadNo);
+            getRaypath(Tx, Rx[n], nodeParentRx, cellParentRx, dyn, r_data[n],
+                       &(l_data[n]), rowIndex, threadNo);
+        }
+    }
+
 }
-#endif /* Grid3Dundsp_h */
+
+#endif
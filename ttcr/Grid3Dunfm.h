@@ -30,21 +30,26 @@
 #include <queue>
 #include <vector>
 
+#include "Grid3Drnfs.h"
 #include "Grid3Dun.h"
 #include "Node3Dn.h"
+#include "PriorityQueue.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2>
+    template<typename T1, typename T2,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid3Dunfm : public Grid3Dun<T1,T2,Node3Dn<T1,T2>> {
     public:
         Grid3Dunfm(const std::vector<sxyz<T1>>& no,
                    const std::vector<tetrahedronElem<T2>>& tet,
-                   const bool rp=false, const size_t nt=1) :
+                   const bool rp=false, const size_t nt=1, const bool tg=false) :
         Grid3Dun<T1,T2,Node3Dn<T1,T2>>(no, tet, nt), rp_ho(rp)
         {
             this->buildGridNodes(no, nt);
             this->buildGridNeighbors();
+            this->buildFaceNeighbors();
+            if ( tg ) this->buildTetGeometry();
         }
         
         ~Grid3Dunfm() {
@@ -76,47 +81,59 @@ namespace ttcr {
                      std::vector<std::vector<std::vector<sxyz<T1>>>*>&,
                      const size_t=0) const;
         
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(this->nodes.size());
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // narrow band holding all nodes at worst
+            return Grid3Dun<T1,T2,Node3Dn<T1,T2>>::estimateThreadMemorySize(nNodes) +
+            nNodes*QUEUE<Node3Dn<T1,T2>,T1>::getNodeSize();
+        }
+        
+        // memory needed by a grid of nPrimary nodes and nTet tetrahedra
+        // (see Grid3D::getMemorySize)
+        static void estimateMemorySize(const size_t nPrimary, const size_t nTet,
+                                       size_t& shared, size_t& thread) {
+            shared = sizeof(Grid3Dunfm) +
+            Grid3Dun<T1,T2,Node3Dn<T1,T2>>::estimateSharedMemorySize(nPrimary, nTet, 4);
+            thread = estimateThreadMemorySize(nPrimary);
+        }
+        
     private:
         bool rp_ho;
         
         void initBand(const std::vector<sxyz<T1>>& Tx,
                       const std::vector<T1>& t0,
-                      std::priority_queue<Node3Dn<T1,T2>*,
-                      std::vector<Node3Dn<T1,T2>*>,
-                      CompareNodePtr<T1>>&,
-                      std::vector<bool>&,
-                      std::vector<bool>&,
+                      QUEUE<Node3Dn<T1,T2>,T1>&,
+                      NodeFlags&,
+                      NodeFlags&,
                       const size_t) const;
         
-        void propagate(std::priority_queue<Node3Dn<T1,T2>*,
-                       std::vector<Node3Dn<T1,T2>*>,
-                       CompareNodePtr<T1>>&,
-                       std::vector<bool>&,
-                       std::vector<bool>&,
+        void propagate(QUEUE<Node3Dn<T1,T2>,T1>&,
+                       NodeFlags&,
+                       NodeFlags&,
                        const size_t) const;
         
     };
     
-    template<typename T1, typename T2>
-    void Grid3Dunfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
+        
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dn<T1,T2>*, std::vector<Node3Dn<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<Node3Dn<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
         
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initBand(Tx, t0, narrow_band, inQueue, frozen, threadNo);
         
@@ -131,27 +148,25 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dn<T1,T2>*, std::vector<Node3Dn<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<Node3Dn<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
         
-        std::vector<bool> inBand( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inBand = this->workspace[threadNo].inQueue;
+        inBand.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initBand(Tx, t0, narrow_band, inBand, frozen, threadNo);
         
@@ -168,27 +183,25 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
-        this->checkPts(Rx);
-        
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           const size_t threadNo) const {
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dn<T1,T2>*, std::vector<Node3Dn<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        this->reinitNodes( threadNo );
+        
+        QUEUE<Node3Dn<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
+        
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initBand(Tx, t0, narrow_band, inQueue, frozen, threadNo);
         
@@ -217,28 +230,26 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunfm<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunfm<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dn<T1,T2>*, std::vector<Node3Dn<T1,T2>*>,
-        CompareNodePtr<T1>> narrow_band( cmp );
+        QUEUE<Node3Dn<T1,T2>,T1> narrow_band(threadNo, this->nodes.size());
         
-        std::vector<bool> inBand( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inBand = this->workspace[threadNo].inQueue;
+        inBand.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initBand(Tx, t0, narrow_band, inBand, frozen, threadNo);
         
@@ -272,15 +283,38 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunfm<T1,T2>::initBand(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     std::priority_queue<Node3Dn<T1,T2>*,
-                                     std::vector<Node3Dn<T1,T2>*>,
-                                     CompareNodePtr<T1>>& narrow_band,
-                                     std::vector<bool>& inBand,
-                                     std::vector<bool>& frozen,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunfm<T1,T2,QUEUE>::initBand(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           QUEUE<Node3Dn<T1,T2>,T1>& narrow_band,
+                                           NodeFlags& inBand,
+                                           NodeFlags& frozen,
+                                           const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
+        
+        if ( this->source_refinement > 0 ) {
+            // nodes of the source regions form the initial narrow band
+            std::vector<T2> nodeNo;
+            std::vector<T1> tt;
+            for (size_t n=0; n<Tx.size(); ++n) {
+                this->template getSourceRegionTT<Grid3Drnfs<T1,T2>>(Tx[n], t0[n], nodeNo, tt);
+                for ( size_t nn=0; nn<nodeNo.size(); ++nn ) {
+                    if ( tt[nn] < this->nodes[ nodeNo[nn] ].getTT(threadNo) ) {
+                        this->nodes[ nodeNo[nn] ].setTT( tt[nn], threadNo );
+                        if ( !inBand[ nodeNo[nn] ] ) {
+                            narrow_band.push( &(this->nodes[ nodeNo[nn] ]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
+                            inBand[ nodeNo[nn] ] = true;
+                            frozen[ nodeNo[nn] ] = true;
+                        } else {
+                            narrow_band.update( &(this->nodes[ nodeNo[nn] ]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
+                        }
+                    }
+                }
+            }
+            return;
+        }
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -289,6 +323,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     narrow_band.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inBand[nn] = true;
                     frozen[nn] = true;
                     
@@ -302,14 +337,19 @@ namespace ttcr {
                                     T2 neibNo = this->neighbors[cellNo][k];
                                     if ( neibNo == nn ) continue;
                                     T1 dt = this->computeDt(this->nodes[nn], this->nodes[neibNo]);
+                                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                                     
                                     if ( t0[n]+dt < this->nodes[neibNo].getTT(threadNo) ) {
                                         this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
                                         
                                         if ( !inBand[neibNo] ) {
                                             narrow_band.push( &(this->nodes[neibNo]) );
+                                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                                             inBand[neibNo] = true;
                                             frozen[neibNo] = true;
+                                        } else {
+                                            narrow_band.update( &(this->nodes[neibNo]) );
+                                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                         }
                                     }
                                 }
@@ -326,15 +366,20 @@ namespace ttcr {
                                 if ( d <= Grid3Dun<T1,T2,Node3Dn<T1,T2>>::source_radius ) {
                                     
                                     T1 dt = this->computeDt(this->nodes[nn], this->nodes[no] );
+                                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                                     
                                     if ( t0[n]+dt < this->nodes[no].getTT(threadNo) ) {
                                         this->nodes[no].setTT( t0[n]+dt, threadNo );
                                         
                                         if ( !inBand[no] ) {
                                             narrow_band.push( &(this->nodes[no]) );
+                                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                                             inBand[no] = true;
                                             frozen[no] = true;
                                             nodes_added++;
+                                        } else {
+                                            narrow_band.update( &(this->nodes[no]) );
+                                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                         }
                                     }
                                 }
@@ -364,6 +409,7 @@ namespace ttcr {
                         
                         this->nodes[neibNo].setTT( t0[n]+dt, threadNo );
                         narrow_band.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inBand[neibNo] = true;
                         frozen[neibNo] = true;
                         
@@ -384,9 +430,13 @@ namespace ttcr {
                                 
                                 if ( !inBand[no] ) {
                                     narrow_band.push( &(this->nodes[no]) );
+                                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                                     inBand[no] = true;
                                     frozen[no] = true;
                                     nodes_added++;
+                                } else {
+                                    narrow_band.update( &(this->nodes[no]) );
+                                    this->instrumentation.count(threadNo, QUEUE_UPDATE);
                                 }
                             }
                         }
@@ -402,18 +452,18 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunfm<T1,T2>::propagate(std::priority_queue<Node3Dn<T1,T2>*,
-                                      std::vector<Node3Dn<T1,T2>*>,
-                                      CompareNodePtr<T1>>& narrow_band,
-                                      std::vector<bool>& inNarrowBand,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunfm<T1,T2,QUEUE>::propagate(QUEUE<Node3Dn<T1,T2>,T1>& narrow_band,
+                                            NodeFlags& inNarrowBand,
+                                            NodeFlags& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !narrow_band.empty() ) {
             
             const Node3Dn<T1,T2>* source = narrow_band.top();
             narrow_band.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inNarrowBand[ source->getGridIndex() ] = false;
             frozen[ source->getGridIndex() ] = true;   // marked as known
             
@@ -432,7 +482,11 @@ namespace ttcr {
                     
                     if ( !inNarrowBand[neibNo] ) {
                         narrow_band.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inNarrowBand[neibNo] = true;
+                    } else {
+                        narrow_band.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
@@ -32,25 +32,41 @@
 #include <map>
 #include <queue>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "Grid3Dun.h"
 #include "Interpolator.h"
 #include "Node3Dnsp.h"
+#include "PriorityQueue.h"
+#include "RowIndex.h"
 #include "utils.h"
 
 namespace ttcr {
     
-    template<typename T1, typename T2>
+    template<typename T1, typename T2,
+             template<typename,typename> class QUEUE=DefaultQueue>
     class Grid3Dunsp : public Grid3Dun<T1,T2,Node3Dnsp<T1,T2>> {
     public:
         Grid3Dunsp(const std::vector<sxyz<T1>>& no,
                    const std::vector<tetrahedronElem<T2>>& tet,
-                   const int ns, const size_t nt=1, const int verbose=0) :
+                   const int ns, const size_t nt=1, const int verbose=0,
+                   const std::string& cacheFile="") :
         Grid3Dun<T1,T2,Node3Dnsp<T1,T2>>(no, tet, nt), nsecondary(ns)
         {
+            // nodes & neighbors are read from cacheFile if it was built
+            // from the same mesh, otherwise they are built and saved in it
+            GridCacheKey key;
+            if ( !cacheFile.empty() ) {
+                key.add("Grid3Dunsp");
+                key.add(no);
+                key.add(tet);
+                key.add(ns);
+                if ( this->loadGridCache(cacheFile, key.value()) ) return;
+            }
             this->buildGridNodes(no, ns, nt, verbose);
             this->buildGridNeighbors();
+            if ( !cacheFile.empty() ) this->saveGridCache(cacheFile, key.value());
         }
         
         ~Grid3Dunsp() {
@@ -113,34 +129,55 @@ namespace ttcr {
                      std::vector<std::vector<siv<T1>>>&,
                      const size_t=0) const;
         
+        size_t getThreadMemorySize() const {
+            return estimateThreadMemorySize(this->nodes.size());
+        }
+        static size_t estimateThreadMemorySize(const size_t nNodes) {
+            // queue holding all nodes at worst
+            return Grid3Dun<T1,T2,Node3Dnsp<T1,T2>>::estimateThreadMemorySize(nNodes) +
+            nNodes*QUEUE<Node3Dnsp<T1,T2>,T1>::getNodeSize();
+        }
         
-    private:
+        // memory needed by a grid of nPrimary nodes and nTet tetrahedra with
+        // nsecondary nodes per edge (see Grid3D::getMemorySize).  The mesh is
+        // assumed to have about nPrimary+nTet edges and 2*nTet faces, as
+        // given by Euler's formula when the boundary is neglected.
+        static void estimateMemorySize(const size_t nPrimary, const size_t nTet,
+                                       const size_t nsecondary,
+                                       size_t& shared, size_t& thread) {
+            const size_t nFaceNodes = nsecondary*(nsecondary-1)/2;
+            const size_t nNodes = nPrimary + (nPrimary+nTet)*nsecondary +
+            2*nTet*nFaceNodes;
+            const size_t nNodesCell = 4 + 6*nsecondary + 4*nFaceNodes;
+            shared = sizeof(Grid3Dunsp) +
+            Grid3Dun<T1,T2,Node3Dnsp<T1,T2>>::estimateSharedMemorySize(nNodes, nTet, nNodesCell);
+            thread = estimateThreadMemorySize(nNodes);
+        }
+        
+        
+    protected:
         T2 nsecondary;
         
+    private:
         void interpSlownessSecondary();
         
         void initQueue(const std::vector<sxyz<T1>>& Tx,
                        const std::vector<T1>& t0,
-                       std::priority_queue<Node3Dnsp<T1,T2>*,
-                       std::vector<Node3Dnsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
+                       QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
                        std::vector<Node3Dnsp<T1,T2>>& txNodes,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        const size_t threadNo) const;
         
         void prepropagate(const Node3Dnsp<T1,T2>& node,
-                          std::priority_queue<Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-                          CompareNodePtr<T1>>& queue,
-                          std::vector<bool>& inQueue,
-                          std::vector<bool>& frozen,
+                          QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                          NodeFlags& inQueue,
+                          NodeFlags& frozen,
                           size_t threadNo) const;
         
-        void propagate(std::priority_queue<Node3Dnsp<T1,T2>*,
-                       std::vector<Node3Dnsp<T1,T2>*>,
-                       CompareNodePtr<T1>>& queue,
-                       std::vector<bool>& inQueue,
-                       std::vector<bool>& frozen,
+        void propagate(QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                       NodeFlags& inQueue,
+                       NodeFlags& frozen,
                        const size_t threadNo) const;
         
         T1 getTraveltime(const sxyz<T1>& Rx,
@@ -155,8 +192,8 @@ namespace ttcr {
     };
     
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::interpSlownessSecondary() {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::interpSlownessSecondary() {
         
         T2 nNodes = this->nPrimary;
         
@@ -251,27 +288,25 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -286,28 +321,26 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -325,28 +358,26 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -368,6 +399,7 @@ namespace ttcr {
             
             traveltimes[n] = this->getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                                  threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
             for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -428,29 +460,27 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<const std::vector<sxyz<T1>>*>& Rx,
-                                     std::vector<std::vector<T1>*>& traveltimes,
-                                     std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
-                                     const size_t threadNo) const {
-        
-        this->checkPts(Tx);
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<const std::vector<sxyz<T1>>*>& Rx,
+                                           std::vector<std::vector<T1>*>& traveltimes,
+                                           std::vector<std::vector<std::vector<sxyz<T1>>>*>& r_data,
+                                           const size_t threadNo) const {
+        
+        this->checkPts(Tx, threadNo);
         for ( size_t n=0; n<Rx.size(); ++n )
-            this->checkPts(*Rx[n]);
+            this->checkPts(*Rx[n], threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -479,6 +509,7 @@ namespace ttcr {
                 (*traveltimes[nr])[n] = this->getTraveltime((*Rx[nr])[n], this->nodes,
                                                             nodeParentRx, cellParentRx,
                                                             threadNo);
+                PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
                 
                 bool flag=false;
                 for ( size_t ns=0; ns<Tx.size(); ++ns ) {
@@ -540,29 +571,27 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::raytrace(const std::vector<sxyz<T1>>& Tx,
-                                     const std::vector<T1>& t0,
-                                     const std::vector<sxyz<T1>>& Rx,
-                                     std::vector<T1>& traveltimes,
-                                     std::vector<std::vector<sxyz<T1>>>& r_data,
-                                     std::vector<std::vector<siv<T1>>>& l_data,
-                                     const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::raytrace(const std::vector<sxyz<T1>>& Tx,
+                                           const std::vector<T1>& t0,
+                                           const std::vector<sxyz<T1>>& Rx,
+                                           std::vector<T1>& traveltimes,
+                                           std::vector<std::vector<sxyz<T1>>>& r_data,
+                                           std::vector<std::vector<siv<T1>>>& l_data,
+                                           const size_t threadNo) const {
         
-        this->checkPts(Tx);
-        this->checkPts(Rx);
+        this->checkPts(Tx, threadNo);
+        this->checkPts(Rx, threadNo);
         
-        for ( size_t n=0; n<this->nodes.size(); ++n ) {
-            this->nodes[n].reinit( threadNo );
-        }
+        this->reinitNodes( threadNo );
         
-        CompareNodePtr<T1> cmp(threadNo);
-        std::priority_queue< Node3Dnsp<T1,T2>*, std::vector<Node3Dnsp<T1,T2>*>,
-        CompareNodePtr<T1>> queue( cmp );
+        QUEUE<Node3Dnsp<T1,T2>,T1> queue(threadNo, this->nodes.size());
         
         std::vector<Node3Dnsp<T1,T2>> txNodes;
-        std::vector<bool> inQueue( this->nodes.size(), false );
-        std::vector<bool> frozen( this->nodes.size(), false );
+        NodeFlags& inQueue = this->workspace[threadNo].inQueue;
+        inQueue.reset( this->nodes.size() );
+        NodeFlags& frozen = this->workspace[threadNo].frozen;
+        frozen.reset( this->nodes.size() );
         
         initQueue(Tx, t0, queue, txNodes, inQueue, frozen, threadNo);
         
@@ -586,13 +615,16 @@ namespace ttcr {
         T2 nodeParentRx;
         T2 cellParentRx;
         
+        RowIndex rowIndex;
         for (size_t n=0; n<Rx.size(); ++n) {
+            rowIndex.clear();
             
             traveltimes[n] = getTraveltime(Rx[n], this->nodes, nodeParentRx, cellParentRx,
                                            threadNo);
+            PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_RAYPATH);
             
             bool flag=false;
-            for ( size_t ns=0; ns<Tx.size(); ++n ) {
+            for ( size_t ns=0; ns<Tx.size(); ++ns ) {
                 if ( Rx[n] == Tx[ns] ) {
                     
                     r_data[n].resize( 1 );
@@ -601,6 +633,7 @@ namespace ttcr {
                     // no need to update l_data: ray length is zero
                     
                     flag = true;
+                    break;
                 }
             }
             if ( flag ) continue;
@@ -623,15 +656,10 @@ namespace ttcr {
                 r_tmp.push_back( child );
                 
                 cell.v = (*node_p)[iParent].getDistance( child );
-                bool found=false;
-                for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                    if ( l_data[n][nc].i == cell.i ) {
-                        l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                        found = true;
-                        break;
-                    }
-                }
-                if ( found == false ) {
+                size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+                if ( nc < l_data[n].size() ) {
+                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+                } else {
                     l_data[n].push_back( cell );
                 }
                 
@@ -655,15 +683,10 @@ namespace ttcr {
             r_tmp.push_back( child );
             
             cell.v = (*node_p)[iParent].getDistance( child );
-            bool found=false;
-            for (size_t nc=0; nc<l_data[n].size(); ++nc) {
-                if ( l_data[n][nc].i == cell.i ) {
-                    l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
-                    found = true;
-                    break;
-                }
-            }
-            if ( found == false ) {
+            size_t nc = rowIndex.insert(cell.i, l_data[n].size());
+            if ( nc < l_data[n].size() ) {
+                l_data[n][nc].v += cell.v;  // must add in case we pass through secondary nodes along edge
+            } else {
                 l_data[n].push_back( cell );
             }
             
@@ -683,16 +706,15 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::initQueue(const std::vector<sxyz<T1>>& Tx,
-                                      const std::vector<T1>& t0,
-                                      std::priority_queue<Node3Dnsp<T1,T2>*,
-                                      std::vector<Node3Dnsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<Node3Dnsp<T1,T2>>& txNodes,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::initQueue(const std::vector<sxyz<T1>>& Tx,
+                                            const std::vector<T1>& t0,
+                                            QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                                            std::vector<Node3Dnsp<T1,T2>>& txNodes,
+                                            NodeFlags& inQueue,
+                                            NodeFlags& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, INIT_TX);
         
         for (size_t n=0; n<Tx.size(); ++n) {
             bool found = false;
@@ -701,6 +723,7 @@ namespace ttcr {
                     found = true;
                     this->nodes[nn].setTT( t0[n], threadNo );
                     queue.push( &(this->nodes[nn]) );
+                    this->instrumentation.count(threadNo, QUEUE_PUSH);
                     inQueue[nn] = true;
                     frozen[nn] = true;
                     break;
@@ -711,6 +734,7 @@ namespace ttcr {
                 txNodes.push_back( Node3Dnsp<T1,T2>(t0[n], Tx[n].x, Tx[n].y, Tx[n].z,
                                                     this->nThreads, threadNo));
                 txNodes.back().pushOwner( this->getCellNo(Tx[n]) );
+                txNodes.back().setNodeSlowness( this->computeSlowness(Tx[n]) );
                 txNodes.back().setGridIndex( static_cast<T2>(this->nodes.size()+
                                                              txNodes.size()-1) );
                 frozen.push_back( true );
@@ -725,14 +749,12 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::prepropagate(const Node3Dnsp<T1,T2>& node,
-                                         std::priority_queue<Node3Dnsp<T1,T2>*,
-                                         std::vector<Node3Dnsp<T1,T2>*>,
-                                         CompareNodePtr<T1>>& queue,
-                                         std::vector<bool>& inQueue,
-                                         std::vector<bool>& frozen,
-                                         size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::prepropagate(const Node3Dnsp<T1,T2>& node,
+                                               QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                                               NodeFlags& inQueue,
+                                               NodeFlags& frozen,
+                                               size_t threadNo) const {
         
         // This function can be used to "prepropagate" each Tx nodes one first time
         // during "initQueue", before running "propagate".
@@ -751,6 +773,7 @@ namespace ttcr {
                 
                 // compute dt
                 T1 dt = this->computeDt(node, this->nodes[neibNo]);
+                this->instrumentation.count(threadNo, LOCAL_UPDATE);
                 
                 if ( node.getTT( threadNo )+dt < this->nodes[neibNo].getTT( threadNo ) ) {
                     this->nodes[neibNo].setTT( node.getTT( threadNo )+dt, threadNo );
@@ -759,7 +782,11 @@ namespace ttcr {
                     
                     if ( !inQueue[neibNo] ) {
                         queue.push( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_PUSH);
                         inQueue[neibNo] = true;
+                    } else {
+                        queue.update( &(this->nodes[neibNo]) );
+                        this->instrumentation.count(threadNo, QUEUE_UPDATE);
                     }
                 }
             }
@@ -767,17 +794,17 @@ namespace ttcr {
     }
     
     
-    template<typename T1, typename T2>
-    void Grid3Dunsp<T1,T2>::propagate(std::priority_queue<Node3Dnsp<T1,T2>*,
-                                      std::vector<Node3Dnsp<T1,T2>*>,
-                                      CompareNodePtr<T1>>& queue,
-                                      std::vector<bool>& inQueue,
-                                      std::vector<bool>& frozen,
-                                      const size_t threadNo) const {
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    void Grid3Dunsp<T1,T2,QUEUE>::propagate(QUEUE<Node3Dnsp<T1,T2>,T1>& queue,
+                                            NodeFlags& inQueue,
+                                            NodeFlags& frozen,
+                                            const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, PROPAGATE);
         
         while ( !queue.empty() ) {
             const Node3Dnsp<T1,T2>* src = queue.top();
             queue.pop();
+            this->instrumentation.count(threadNo, QUEUE_POP);
             inQueue[ src->getGridIndex() ] = false;
             frozen[ src->getGridIndex() ] = true;
             
@@ -793,6 +820,7 @@ namespace ttcr {
                     
                     // compute dt
                     T1 dt = this->computeDt(*src, this->nodes[neibNo]);
+                    this->instrumentation.count(threadNo, LOCAL_UPDATE);
                     
                     if (src->getTT(threadNo)+dt < this->nodes[neibNo].getTT(threadNo)) {
                         this->nodes[neibNo].setTT( src->getTT(threadNo)+dt, threadNo );
@@ -801,7 +829,11 @@ namespace ttcr {
                         
                         if ( !inQueue[neibNo] ) {
                             queue.push( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_PUSH);
                             inQueue[neibNo] = true;
+                        } else {
+                            queue.update( &(this->nodes[neibNo]) );
+                            this->instrumentation.count(threadNo, QUEUE_UPDATE);
                         }
                     }
                 }
@@ -809,15 +841,15 @@ namespace ttcr {
         }
     }
     
-    template<typename T1, typename T2>
-    T1 Grid3Dunsp<T1,T2>::getTraveltime(const sxyz<T1>& Rx,
-                                        const std::vector<Node3Dnsp<T1,T2>>& nodes,
-                                        const size_t threadNo) const {
-        
-        for ( size_t nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == Rx ) {
-                return nodes[nn].getTT(threadNo);
-            }
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    T1 Grid3Dunsp<T1,T2,QUEUE>::getTraveltime(const sxyz<T1>& Rx,
+                                              const std::vector<Node3Dnsp<T1,T2>>& nodes,
+                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
+        
+        T2 nodeNo = this->getNodeNo( Rx );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            return nodes[nodeNo].getTT(threadNo);
         }
         //If Rx is not on a node:
         T1 slo = this->computeSlowness( Rx );
@@ -837,18 +869,18 @@ namespace ttcr {
         return traveltime;
     }
     
-    template<typename T1, typename T2>
-    T1 Grid3Dunsp<T1,T2>::getTraveltime(const sxyz<T1>& Rx,
-                                        const std::vector<Node3Dnsp<T1,T2>>& nodes,
-                                        T2& nodeParentRx, T2& cellParentRx,
-                                        const size_t threadNo) const {
-        
-        for ( size_t nn=0; nn<nodes.size(); ++nn ) {
-            if ( nodes[nn] == Rx ) {
-                nodeParentRx = nodes[nn].getNodeParent(threadNo);
-                cellParentRx = nodes[nn].getCellParent(threadNo);
-                return nodes[nn].getTT(threadNo);
-            }
+    template<typename T1, typename T2, template<typename,typename> class QUEUE>
+    T1 Grid3Dunsp<T1,T2,QUEUE>::getTraveltime(const sxyz<T1>& Rx,
+                                              const std::vector<Node3Dnsp<T1,T2>>& nodes,
+                                              T2& nodeParentRx, T2& cellParentRx,
+                                              const size_t threadNo) const {
+        PhaseTimer phaseTimer(this->instrumentation, threadNo, GET_TT);
+        
+        T2 nodeNo = this->getNodeNo( Rx );
+        if ( nodeNo != std::numeric_limits<T2>::max() ) {
+            nodeParentRx = nodes[nodeNo].getNodeParent(threadNo);
+            cellParentRx = nodes[nodeNo].getCellParent(threadNo);
+            return nodes[nodeNo].getTT(threadNo);
         }
         //If Rx is not on a node:
         T1 slo = this->computeSlowness( Rx );
@@ -0,0 +1,287 @@
+//
+//  GridCache.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_GridCache_h
+#define ttcr_GridCache_h
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ttcr_t.h"
+
+namespace ttcr {
+
+    /*
+     Binary file holding the state of a built grid (nodes, owners,
+     neighbors, sweeping ordering), so that grids that are long to build
+     can be reused from one run to the next.
+
+     The file starts with a 64 byte header (native byte order):
+
+     char[8]  magic        "ttcrGRD\0"
+     uint32   version      1
+     uint16   valueSize    sizeof(T1) of the grid
+     uint16   indexSize    sizeof(T2) of the grid
+     uint64   key          hash of the data the grid was built from
+     uint64   nNodes       number of nodes
+     uint64   nCells       number of cells
+     uint64   reserved[3]
+
+     It is followed by sections whose content depends on the grid.  A
+     section holding an array starts with the uint64 number of values; a
+     section holding lists starts with the uint64 number of lists followed
+     by the uint64 offsets of the lists in the values (one more than the
+     number of lists).  Sections are padded to multiples of 8 bytes.
+     */
+
+    struct GridCacheHeader {
+        char magic[8];
+        uint32_t version;
+        uint16_t valueSize;
+        uint16_t indexSize;
+        uint64_t key;
+        uint64_t nNodes;
+        uint64_t nCells;
+        uint64_t reserved[3];
+    };
+    static_assert(sizeof(GridCacheHeader) == 64, "GridCacheHeader should be 64 bytes");
+
+    static const char GridCacheMagic[8] = { 't','t','c','r','G','R','D','\0' };
+
+    // 64-bit FNV-1a hash of the input of a grid, to tell if a cache file
+    // was built from the same model and parameters.
+    class GridCacheKey {
+    public:
+        GridCacheKey() : h(14695981039346656037ULL) {}
+
+        void add(const void *p, const size_t n) {
+            const unsigned char *c = static_cast<const unsigned char*>(p);
+            for ( size_t i=0; i<n; ++i ) {
+                h ^= c[i];
+                h *= 1099511628211ULL;
+            }
+        }
+
+        void add(const char *s) { add(s, std::strlen(s)); }
+
+        template<typename T>
+        void add(const T v) {
+            uint64_t w = 0;
+            static_assert(sizeof(T) <= sizeof(w), "GridCacheKey: scalar too large");
+            std::memcpy(&w, &v, sizeof(T));
+            mix(w);
+        }
+
+        template<typename T>
+        void add(const std::vector<sxyz<T>>& pts) {
+            add(pts.size());
+            for ( size_t n=0; n<pts.size(); ++n ) {
+                add(pts[n].x);
+                add(pts[n].y);
+                add(pts[n].z);
+            }
+        }
+
+        template<typename T>
+        void add(const std::vector<tetrahedronElem<T>>& tet) {
+            add(tet.size());
+            for ( size_t n=0; n<tet.size(); ++n ) {
+                for ( size_t i=0; i<4; ++i ) add(tet[n].i[i]);
+            }
+        }
+
+        uint64_t value() const { return h; }
+
+    private:
+        uint64_t h;
+
+        // whole words at a time, large meshes are hashed at each run
+        void mix(const uint64_t w) {
+            h ^= w;
+            h *= 1099511628211ULL;
+        }
+    };
+
+    class GridCacheWriter {
+    public:
+        GridCacheWriter(const std::string& filename, const uint64_t key,
+                        const size_t valueSize, const size_t indexSize,
+                        const size_t nNodes, const size_t nCells) :
+        fout(filename, std::ios::out | std::ios::binary), hdr()
+        {
+            if ( !fout ) {
+                throw std::runtime_error("Cannot open file " + filename + " for writing.");
+            }
+            std::memcpy(hdr.magic, GridCacheMagic, 8);
+            hdr.version = 1;
+            hdr.valueSize = static_cast<uint16_t>(valueSize);
+            hdr.indexSize = static_cast<uint16_t>(indexSize);
+            hdr.key = key;
+            hdr.nNodes = nNodes;
+            hdr.nCells = nCells;
+            fout.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        }
+
+        template<typename T>
+        void write(const std::vector<T>& v) {
+            writeWord(v.size());
+            writeValues(v.data(), v.size());
+        }
+
+        // n lists, list(i) returning list i (a std::vector<T> or an
+        // Adjacency<T>::range)
+        template<typename T, typename F>
+        void writeLists(const size_t n, F list) {
+            writeWord(n);
+            uint64_t offset = 0;
+            writeWord(offset);
+            for ( size_t i=0; i<n; ++i ) {
+                offset += list(i).size();
+                writeWord(offset);
+            }
+            for ( size_t i=0; i<n; ++i ) {
+                const auto& l = list(i);
+                fout.write(reinterpret_cast<const char*>(l.data()), l.size()*sizeof(T));
+            }
+            pad(offset*sizeof(T));
+        }
+
+        void close() {
+            fout.close();
+            if ( fout.fail() ) {
+                throw std::runtime_error("Error: grid cache could not be written.");
+            }
+        }
+
+    private:
+        std::ofstream fout;
+        GridCacheHeader hdr;
+
+        void writeWord(const uint64_t w) {
+            fout.write(reinterpret_cast<const char*>(&w), sizeof(w));
+        }
+
+        template<typename T>
+        void writeValues(const T *v, const size_t n) {
+            fout.write(reinterpret_cast<const char*>(v), n*sizeof(T));
+            pad(n*sizeof(T));
+        }
+
+        void pad(const size_t nBytes) {
+            static const char zeros[8] = {};
+            if ( nBytes%8 != 0 ) fout.write(zeros, 8-nBytes%8);
+        }
+    };
+
+    // Sections are read in the order they were written.  Throws if the
+    // file is not a grid cache or is truncated.
+    class GridCacheReader {
+    public:
+        GridCacheReader(const std::string& filename) : file(filename), hdr(),
+        p(file.data()), end(file.data()+file.size())
+        {
+            if ( file.size() < sizeof(GridCacheHeader) ) {
+                throw std::runtime_error("Error: " + filename + " is not a grid cache.");
+            }
+            std::memcpy(&hdr, p, sizeof(hdr));
+            if ( std::memcmp(hdr.magic, GridCacheMagic, 8) != 0 || hdr.version != 1 ) {
+                throw std::runtime_error("Error: " + filename + " is not a grid cache.");
+            }
+            p += sizeof(hdr);
+        }
+
+        // true if the file holds a grid of types T1 & T2 built from key
+        template<typename T1, typename T2>
+        bool matches(const uint64_t key) const {
+            return hdr.key == key && hdr.valueSize == sizeof(T1) && hdr.indexSize == sizeof(T2);
+        }
+
+        size_t getNnodes() const { return hdr.nNodes; }
+        size_t getNcells() const { return hdr.nCells; }
+
+        template<typename T>
+        void read(std::vector<T>& v) {
+            size_t n = readWord();
+            const T *data = values<T>(n);
+            v.assign(data, data+n);
+        }
+
+        // calls set(i, first, last) with the values of each list i
+        template<typename T, typename F>
+        void readLists(F set) {
+            size_t n = readWord();
+            const char *off = p;
+            skip((n+1)*sizeof(uint64_t));
+            uint64_t first, last;
+            std::memcpy(&last, off+n*sizeof(uint64_t), sizeof(uint64_t));
+            const T *data = values<T>(last);
+            for ( size_t i=0; i<n; ++i ) {
+                std::memcpy(&first, off+i*sizeof(uint64_t), sizeof(uint64_t));
+                std::memcpy(&last, off+(i+1)*sizeof(uint64_t), sizeof(uint64_t));
+                if ( first > last ) {
+                    throw std::runtime_error("Error: grid cache corrupted.");
+                }
+                set(i, data+first, data+last);
+            }
+        }
+
+    private:
+        MappedFile file;
+        GridCacheHeader hdr;
+        const char *p;
+        const char *end;
+
+        void skip(const size_t nBytes) {
+            if ( nBytes > static_cast<size_t>(end-p) ) {
+                throw std::runtime_error("Error: grid cache truncated.");
+            }
+            p += nBytes;
+        }
+
+        uint64_t readWord() {
+            uint64_t w;
+            const char *q = p;
+            skip(sizeof(w));
+            std::memcpy(&w, q, sizeof(w));
+            return w;
+        }
+
+        // sections are 8-byte aligned in a page-aligned mapping
+        template<typename T>
+        const T* values(const size_t n) {
+            if ( n > static_cast<size_t>(end-p)/sizeof(T) ) {
+                throw std::runtime_error("Error: grid cache truncated.");
+            }
+            const T *v = reinterpret_cast<const T*>(p);
+            size_t nBytes = n*sizeof(T);
+            skip(nBytes%8 == 0 ? nBytes : nBytes + 8-nBytes%8);
+            return v;
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,187 @@
+//
+//  Instrumentation.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_Instrumentation_h
+#define ttcr_Instrumentation_h
+
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+namespace ttcr {
+
+    // Phases of a raytracing call, timed separately.  Phases may be nested
+    // (e.g. traveltimes computed while tracing raypaths), in which case the
+    // time of the inner phase is also included in the outer one.
+    enum InstrumentedPhase {
+        CHECK_PTS,      // checking that Tx and Rx are in the grid
+        INIT_TX,        // initial queue, narrow band or FSM source region
+        PROPAGATE,      // SPM/FMM propagation and FSM sweeps
+        GET_TT,         // traveltime at receivers
+        GET_RAYPATH,    // raypaths
+        N_PHASES
+    };
+
+    enum InstrumentedCount {
+        QUEUE_PUSH,     // nodes inserted in the queue or narrow band
+        QUEUE_POP,      // nodes removed from the queue or narrow band
+        QUEUE_UPDATE,   // decrease-key of nodes already in the queue
+        LOCAL_UPDATE,   // edge relaxations (SPM) and local solver calls (FMM, FSM)
+        N_COUNTS
+    };
+
+    // Per-thread timings and operation counters of a grid, collected only
+    // when compiled with TTCR_INSTRUMENT defined.  Otherwise, PhaseTimer and
+    // count() do nothing and are optimized away, and all values read zero.
+    // Each thread only writes in its own slot, given by threadNo.
+    class Instrumentation {
+    public:
+        Instrumentation(const size_t nt=1) : stats(nt>0 ? nt : 1) {}
+
+        static constexpr bool enabled() {
+#ifdef TTCR_INSTRUMENT
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        size_t getNthreads() const { return stats.size(); }
+
+        void count(const size_t threadNo, const InstrumentedCount c,
+                   const size_t n=1) {
+#ifdef TTCR_INSTRUMENT
+            stats[threadNo].counts[c] += n;
+#endif
+        }
+
+        void reset() {
+            for ( size_t n=0; n<stats.size(); ++n ) stats[n] = Stats();
+        }
+
+        // time spent in phase p, in s, and number of operations of type c,
+        // by thread threadNo or summed over all threads
+        double getTime(const InstrumentedPhase p, const size_t threadNo) const {
+            return stats[threadNo].time[p];
+        }
+        double getTime(const InstrumentedPhase p) const {
+            double t = 0.0;
+            for ( size_t n=0; n<stats.size(); ++n ) t += stats[n].time[p];
+            return t;
+        }
+        size_t getCount(const InstrumentedCount c, const size_t threadNo) const {
+            return stats[threadNo].counts[c];
+        }
+        size_t getCount(const InstrumentedCount c) const {
+            size_t nc = 0;
+            for ( size_t n=0; n<stats.size(); ++n ) nc += stats[n].counts[c];
+            return nc;
+        }
+
+        static const char* phaseName(const InstrumentedPhase p) {
+            static const char* names[N_PHASES] = {"checkPts", "initTx",
+                "propagate", "getTraveltime", "getRaypath"};
+            return names[p];
+        }
+        static const char* countName(const InstrumentedCount c) {
+            static const char* names[N_COUNTS] = {"queue pushes", "queue pops",
+                "queue updates", "local updates"};
+            return names[c];
+        }
+
+        void report(std::ostream& os) const {
+            if ( !enabled() ) {
+                os << "Instrumentation not available (compiled without TTCR_INSTRUMENT)\n";
+                return;
+            }
+            const std::ios::fmtflags flags = os.flags();
+            os << "Time per phase (s), over " << stats.size() << " thread(s):\n";
+            for ( int p=0; p<N_PHASES; ++p ) {
+                os << "  " << std::left << std::setw(16) << phaseName(static_cast<InstrumentedPhase>(p))
+                << std::right << std::setw(12) << std::fixed << std::setprecision(6)
+                << getTime(static_cast<InstrumentedPhase>(p));
+                if ( stats.size() > 1 ) {
+                    os << "   (";
+                    for ( size_t n=0; n<stats.size(); ++n ) {
+                        os << (n>0 ? " " : "") << stats[n].time[p];
+                    }
+                    os << ')';
+                }
+                os << '\n';
+            }
+            os << "Operations:\n";
+            for ( int c=0; c<N_COUNTS; ++c ) {
+                os << "  " << std::left << std::setw(16) << countName(static_cast<InstrumentedCount>(c))
+                << std::right << std::setw(12) << getCount(static_cast<InstrumentedCount>(c)) << '\n';
+            }
+            os.flags(flags);
+        }
+
+    private:
+        friend class PhaseTimer;
+
+        // padded to a cache line so that threads do not share lines
+        struct Stats {
+            double time[N_PHASES];
+            size_t counts[N_COUNTS];
+            int depth[N_PHASES];
+            char pad[64];
+            Stats() : time(), counts(), depth(), pad() {}
+        };
+        std::vector<Stats> stats;
+    };
+
+    // Adds the time spent in its scope to phase p of thread threadNo.  Only
+    // the outermost timer counts when a phase is entered recursively, e.g.
+    // by a derived grid calling the base class function.
+    class PhaseTimer {
+    public:
+#ifdef TTCR_INSTRUMENT
+        PhaseTimer(Instrumentation& i, const size_t threadNo,
+                   const InstrumentedPhase p) :
+        stats(i.stats[threadNo]), phase(p), outer(stats.depth[p]++ == 0),
+        start(outer ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point()) {}
+
+        ~PhaseTimer() {
+            --stats.depth[phase];
+            if ( outer ) {
+                stats.time[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+#else
+        PhaseTimer(Instrumentation&, const size_t, const InstrumentedPhase) {}
+#endif
+        PhaseTimer(const PhaseTimer&) = delete;
+        PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+#ifdef TTCR_INSTRUMENT
+    private:
+        Instrumentation::Stats& stats;
+        const InstrumentedPhase phase;
+        const bool outer;
+        const std::chrono::steady_clock::time_point start;
+#endif
+    };
+
+}
+
+#endif
@@ -25,28 +25,45 @@
 #ifndef _MSHReader_h
 #define _MSHReader_h
 
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <fstream>
-#include <string>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 
+#include "MappedFile.h"
 #include "ttcr_t.h"
 
 namespace ttcr {
-    
-    // A class to read Gmsh's native "MSH" ASCII format
+
+    // A class to read Gmsh's native "MSH" format, versions 2.2 and 4.1, ASCII
+    // or binary.
+    //
+    // The file is memory-mapped and read in a single pass the first time
+    // data is requested; nodes, lines, triangles, tetrahedra and physical
+    // names are then kept by the reader.  Large ASCII node and element
+    // blocks are split in chunks of lines parsed by different threads.
     class MSHReader {
     public:
         MSHReader(const char *fname) : filename(fname), valid(false),
         physicalNames(std::vector<std::vector<std::string>>(4)),
-        physicalIndices(std::vector<std::vector<int>>(4)){
+        physicalIndices(std::vector<std::vector<int>>(4)),
+        nThreads(std::thread::hardware_concurrency()), loaded(false),
+        version(0.0), binary(false), nElements(0), nodes(), lines(), triangles(),
+        tetrahedra(), tagIndex(), entityPhysical() {
+            if ( nThreads == 0 ) nThreads = 1;
             valid = check_format();
         }
-        
+
         bool isValid() const { return valid; }
-        
+
         void setFilename(const char *fname) {  // we reset the reader
             filename = fname;
             valid = check_format();
@@ -54,11 +71,20 @@ namespace ttcr {
                 it->clear();
             for ( auto it = physicalIndices.begin(); it!=physicalIndices.end(); ++it )
                 it->clear();
+            loaded = false;
+            nElements = 0;
+            nodes.clear();
+            lines.clear();
+            triangles.clear();
+            tetrahedra.clear();
+            tagIndex.clear();
         }
-        
+
+        // number of threads used to parse ASCII files
+        void setNthreads(const size_t nt) { nThreads = nt>0 ? nt : 1; }
+
         bool is2D() const {
-            std::vector<sxyz<double>> nodes;
-            readNodes3D(nodes);
+            load();
             double ymin=0.0;
             double ymax=0.0;
             double zmin=0.0;
@@ -78,10 +104,9 @@ namespace ttcr {
             }
             return ymin == ymax || zmin == zmax;
         }
-        
+
         int get2Ddim() const {
-            std::vector<sxyz<double>> nodes;
-            readNodes3D(nodes);
+            load();
             double xmin=0.0;
             double xmax=0.0;
             double ymin=0.0;
@@ -112,332 +137,658 @@ namespace ttcr {
             }
             return 0;
         }
-        
-        size_t getNumberOfElements() {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t nElements=0;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Elements") != std::string::npos ) {
-                    fin >> nElements;
-                    break;
-                }
-            }
-            fin.close();
+
+        size_t getNumberOfElements() const {
+            load();
             return nElements;
         }
-        
+
         size_t getNumberOfNodes() const {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t nNodes=0;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Nodes") != std::string::npos ) {
-                    fin >> nNodes;
-                    break;
-                }
-            }
-            fin.close();
-            return nNodes;
+            load();
+            return nodes.size();
         }
-        
+
         //
         // Return names of physical entities and their corresponding indices
         //  Note: indices start at 0, not 1 like in MSH file
         //
         const std::vector<std::string>& getPhysicalNames(size_t i=3) const {
-            if ( physicalNames[i].empty() ) {
-                readPhysicalNames(i);
-            }
+            load();
             return physicalNames[i];
         }
-        
+
         const std::vector<int>& getPhysicalIndices(size_t i=3) const {
-            if ( physicalIndices[i].empty() ) {
-                readPhysicalNames(i);
-            }
+            load();
             return physicalIndices[i];
         }
-        
+
         size_t getNumberOfLines() const {
-            return getNumberOfElements(1);
+            load();
+            return lines.size();
         }
         size_t getNumberOfTriangles() const {
-            return getNumberOfElements(2);
+            load();
+            return triangles.size();
         }
         size_t getNumberOfTetra() const {
-            return getNumberOfElements(4);
+            load();
+            return tetrahedra.size();
         }
-        
-        
-        
+
+
+
         template<typename T>
-        void readNodes2D(std::vector<sxz<T>>& nodes, const int d) const {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t nNodes;
-            T x[3];
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Nodes") != std::string::npos ) {
-                    fin >> nNodes;
-                    if ( nodes.size() != nNodes ) {
-                        nodes.resize( nNodes );
-                    }
-                    size_t index;
-                    for ( size_t n=0; n<nNodes; ++n ) {
-                        fin >> index >> nodes[n].x >> x[1] >> x[2];
-                        nodes[n].z = x[d];
-                    }
-                    break;
-                }
+        void readNodes2D(std::vector<sxz<T>>& nodes2D, const int d) const {
+            load();
+            nodes2D.resize( nodes.size() );
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                nodes2D[n].x = nodes[n].x;
+                nodes2D[n].z = d==1 ? nodes[n].y : nodes[n].z;
             }
-            fin.close();
         }
-        
+
         template<typename T>
-        void readNodes3D(std::vector<sxyz<T>>& nodes) const {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t nNodes;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Nodes") != std::string::npos ) {
-                    fin >> nNodes;
-                    if ( nodes.size() != nNodes ) {
-                        nodes.resize( nNodes );
-                    }
-                    size_t index;
-                    for ( size_t n=0; n<nNodes; ++n ) {
-                        fin >> index >> nodes[n].x >> nodes[n].y >> nodes[n].z;
-                    }
-                    break;
-                }
+        void readNodes3D(std::vector<sxyz<T>>& nodes3D) const {
+            load();
+            nodes3D.resize( nodes.size() );
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                nodes3D[n].x = nodes[n].x;
+                nodes3D[n].y = nodes[n].y;
+                nodes3D[n].z = nodes[n].z;
             }
-            fin.close();
         }
-        
+
         template<typename T>
         void readLineElements(std::vector<lineElem<T>>& lineElem) const {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t nElements;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Elements") != std::string::npos ) {
-                    fin >> nElements;
-                    if ( lineElem.size() != nElements ) {
-                        lineElem.resize( nElements );
-                    }
-                    size_t index;
-                    int elm_type, nTags;
-                    std::vector<T> tags(10);
-                    size_t nLines=0;
-                    T ind;
-                    for ( size_t n=0; n<nElements; ++n ) {
-                        fin >> index >> elm_type >> nTags;
-                        if ( tags.size() < nTags ) { tags.resize( nTags ); }
-                        if ( elm_type == 1 ) {
-                            for ( size_t n=0; n<nTags; ++n ) {
-                                fin >> tags[n];
-                            }
-                            fin >> ind;
-                            lineElem[nLines].i[0] = ind-1;
-                            fin >> ind;
-                            lineElem[nLines].i[1] = ind-1;
-                            lineElem[nLines++].physical_entity = tags[0]-1;
-                        } else {
-                            getline( fin, line );
-                        }
-                    }
-                    lineElem.resize( nLines );
-                    break;
-                }
+            load();
+            lineElem.resize( lines.size() );
+            for ( size_t n=0; n<lines.size(); ++n ) {
+                lineElem[n].i[0] = lines[n].i[0];
+                lineElem[n].i[1] = lines[n].i[1];
+                lineElem[n].physical_entity = lines[n].physical_entity;
             }
-            fin.close();
         }
-        
+
         template<typename T>
         void readTriangleElements(std::vector<triangleElem<T>>& tri) const {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t nElements;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Elements") != std::string::npos ) {
-                    fin >> nElements;
-                    if ( tri.size() != nElements ) {
-                        tri.resize( nElements );
-                    }
-                    size_t index;
-                    int elm_type, nTags;
-                    std::vector<T> tags(10);
-                    size_t nTriangles=0;
-                    T ind;
-                    for ( size_t n=0; n<nElements; ++n ) {
-                        fin >> index >> elm_type >> nTags;
-                        if ( tags.size() < nTags ) { tags.resize( nTags ); }
-                        if ( elm_type == 2 ) {
-                            for ( size_t n=0; n<nTags; ++n ) {
-                                fin >> tags[n];
-                            }
-                            fin >> ind;
-                            tri[nTriangles].i[0] = ind-1;
-                            fin >> ind;
-                            tri[nTriangles].i[1] = ind-1;
-                            fin >> ind;
-                            tri[nTriangles].i[2] = ind-1;
-                            tri[nTriangles++].physical_entity = tags[0]-1;
-                        } else {
-                            getline( fin, line );
-                        }
-                    }
-                    tri.resize( nTriangles );
-                    break;
-                }
+            load();
+            tri.resize( triangles.size() );
+            for ( size_t n=0; n<triangles.size(); ++n ) {
+                for ( size_t i=0; i<3; ++i ) tri[n].i[i] = triangles[n].i[i];
+                tri[n].physical_entity = triangles[n].physical_entity;
             }
-            fin.close();
         }
-        
+
         template<typename T>
         void readTetrahedronElements(std::vector<tetrahedronElem<T>>& tet) const {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t nElements;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Elements") != std::string::npos ) {
-                    fin >> nElements;
-                    if ( tet.size() != nElements ) {
-                        tet.resize( nElements );
-                    }
-                    size_t index;
-                    int elm_type, nTags;
-                    std::vector<T> tags(10);
-                    size_t nTetrahedron=0;
-                    T ind;
-                    for ( size_t n=0; n<nElements; ++n ) {
-                        fin >> index >> elm_type >> nTags;
-                        if ( tags.size() < nTags ) { tags.resize( nTags ); }
-                        if ( elm_type == 4 ) {
-                            for ( size_t n=0; n<nTags; ++n ) {
-                                fin >> tags[n];
-                            }
-                            fin >> ind;
-                            tet[nTetrahedron].i[0] = ind-1;
-                            fin >> ind;
-                            tet[nTetrahedron].i[1] = ind-1;
-                            fin >> ind;
-                            tet[nTetrahedron].i[2] = ind-1;
-                            fin >> ind;
-                            tet[nTetrahedron].i[3] = ind-1;
-                            tet[nTetrahedron++].physical_entity = tags[0]-1;
-                        } else {
-                            getline( fin, line );
-                        }
-                    }
-                    tet.resize( nTetrahedron );
-                    break;
-                }
+            load();
+            tet.resize( tetrahedra.size() );
+            for ( size_t n=0; n<tetrahedra.size(); ++n ) {
+                for ( size_t i=0; i<4; ++i ) tet[n].i[i] = tetrahedra[n].i[i];
+                tet[n].physical_entity = tetrahedra[n].physical_entity;
             }
-            fin.close();
         }
-        
+
     private:
+        // elements of one chunk of lines
+        struct elementBuffer {
+            std::vector<lineElem<uint32_t>> lin;
+            std::vector<triangleElem<uint32_t>> tri;
+            std::vector<tetrahedronElem<uint32_t>> tet;
+        };
+
         std::string filename;
         bool valid;
         mutable std::vector<std::vector<std::string>> physicalNames;
         mutable std::vector<std::vector<int>> physicalIndices;
-        
+        size_t nThreads;
+
+        mutable bool loaded;
+        mutable double version;
+        mutable bool binary;
+        mutable size_t nElements;
+        mutable std::vector<sxyz<double>> nodes;
+        mutable std::vector<lineElem<uint32_t>> lines;
+        mutable std::vector<triangleElem<uint32_t>> triangles;
+        mutable std::vector<tetrahedronElem<uint32_t>> tetrahedra;
+        mutable std::vector<uint32_t> tagIndex;          // node index from node tag, empty if tag == index+1
+        mutable std::vector<std::map<int,int>> entityPhysical;  // first physical tag of entities (MSH 4)
+
+        static const size_t minChunk = 1<<20;  // min bytes parsed by a thread
+
         bool check_format() const {
             std::ifstream fin(filename.c_str());
             bool format_ok = false;
             std::string line;
-//            size_t tmp;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$MeshFormat") != std::string::npos ) {
-                    double version;
-                    int file_type;
-                    fin >> version >> file_type;
-                    if ( version == 2.2 && file_type == 0 ) {
-                        format_ok = true;
-                    }
+            getline( fin, line );
+            if ( line.find("$MeshFormat") != std::string::npos ) {
+                double v;
+                int file_type, data_size;
+                fin >> v >> file_type >> data_size;
+                if ( (v == 2.2 || v == 4.1) && (file_type == 0 || file_type == 1) &&
+                     data_size == sizeof(double) ) {
+                    format_ok = true;
                 }
-//                if ( line.find("$Elements") != std::string::npos ) {
-//                    fin >> tmp;
-//                    size_t index;
-//                    int elm_type, nTags;
-//                    for ( size_t n=0; n<tmp; ++n ) {
-//                        fin >> index >> elm_type >> nTags;
-//                        if ( nTags == 0 ) {
-//                            format_ok = false;
-//                            fin.close();
-//                            return format_ok;
-//                        }
-//                    }
-//                }
             }
             fin.close();
             return format_ok;
         }
-        
-        void readPhysicalNames(const size_t dim) const {
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$PhysicalNames") != std::string::npos ) {
-                    std::string name;
-                    size_t np, dimension;
-                    int index;
-                    fin >> np;
-                    for ( size_t n=0; n<np; ++n ) {
-                        fin >> dimension >> index;
-                        getline( fin, name );
-                        if ( dimension==dim ) {
-                            size_t p1 = name.find("\"")+1;
-                            size_t p2 = name.rfind("\"");
-                            physicalNames[dimension].push_back( name.substr(p1, p2-p1) );
-                            physicalIndices[dimension].push_back(index-1);
+
+        void load() const {
+            if ( loaded ) return;
+            if ( !valid ) {
+                throw std::runtime_error("Error: " + filename + " is not a valid MSH file");
+            }
+            MappedFile file(filename);
+            const char *p = file.data();
+            const char *end = p + file.size();
+            entityPhysical.assign(4, std::map<int,int>());
+
+            while ( (p = findSection(p, end)) < end ) {
+                const char *eol = lineEnd(p, end);
+                std::string name(p+1, eol);
+                if ( !name.empty() && name.back() == '\r' ) name.pop_back();
+                p = nextLine(p, end);
+
+                if ( name == "MeshFormat" ) {
+                    version = toDouble(p, end);
+                    binary = toInt(p, end) == 1;
+                    toInt(p, end);
+                    p = nextLine(p, end);
+                    if ( binary ) {
+                        if ( get<int>(p, end) != 1 ) {
+                            throw std::runtime_error("Error: byte order of binary MSH file not supported");
                         }
                     }
-                    break;
+                } else if ( name == "PhysicalNames" ) {
+                    readPhysicalNames(p, end);
+                } else if ( name == "Entities" && version >= 4 ) {
+                    if ( binary ) readEntitiesBinary(p, end);
+                    else readEntitiesASCII(p, end);
+                } else if ( name == "Nodes" ) {
+                    if ( version >= 4 ) {
+                        if ( binary ) readNodes4Binary(p, end);
+                        else readNodes4ASCII(p, end);
+                    } else {
+                        if ( binary ) readNodes2Binary(p, end);
+                        else readNodes2ASCII(p, end);
+                    }
+                    buildTagIndex();
+                } else if ( name == "Elements" ) {
+                    if ( version >= 4 ) {
+                        if ( binary ) readElements4Binary(p, end);
+                        else readElements4ASCII(p, end);
+                    } else {
+                        if ( binary ) readElements2Binary(p, end);
+                        else readElements2ASCII(p, end);
+                    }
                 }
+                p = skipSection(p, end, name);
             }
-            fin.close();
+            tagIndex.clear();
+            entityPhysical.clear();
+            loaded = true;
         }
-                
-        size_t getNumberOfElements(const int type) const {
-            
-            std::ifstream fin(filename.c_str());
-            std::string line;
-            size_t tmp;
-            size_t nElem=0;
-            while ( fin ) {
-                getline( fin, line );
-                if ( line.find("$Elements") != std::string::npos ) {
-                    fin >> tmp;
-                    size_t index;
-                    int elm_type;
-                    for ( size_t n=0; n<tmp; ++n ) {
-                        fin >> index >> elm_type;
-                        if ( elm_type == type ) {
-                            nElem++;
+
+        // ASCII helpers
+
+        static const char* lineEnd(const char *p, const char *end) {
+            const char *eol = static_cast<const char*>( std::memchr(p, '\n', end-p) );
+            return eol == nullptr ? end : eol;
+        }
+        static const char* nextLine(const char *p, const char *end) {
+            p = lineEnd(p, end);
+            return p < end ? p+1 : end;
+        }
+        static const char* skipLines(const char *p, const char *end, size_t n) {
+            for ( ; n>0 && p<end; --n ) p = nextLine(p, end);
+            return p;
+        }
+        static size_t countLines(const char *p, const char *end) {
+            size_t n = 0;
+            while ( (p = static_cast<const char*>( std::memchr(p, '\n', end-p) )) != nullptr ) {
+                ++n;
+                ++p;
+            }
+            return n;
+        }
+        static const char* findSection(const char *p, const char *end) {
+            while ( p < end && *p != '$' ) p = nextLine(p, end);
+            return p;
+        }
+        static const char* skipSection(const char *p, const char *end, const std::string& name) {
+            const std::string tag = "$End" + name;
+            while ( p < end ) {
+                p = static_cast<const char*>( std::memchr(p, '$', end-p) );
+                if ( p == nullptr ) return end;
+                if ( static_cast<size_t>(end-p) >= tag.size() &&
+                     std::memcmp(p, tag.c_str(), tag.size()) == 0 ) {
+                    return nextLine(p, end);
+                }
+                ++p;
+            }
+            return end;
+        }
+        // numbers are followed by white space or by the next section, so that
+        // strtod & co never read past the end of the mapping
+        static long long toInt(const char *&p, const char *end) {
+            char *q;
+            long long v = std::strtoll(p, &q, 10);
+            if ( q == p || q > end ) {
+                throw std::runtime_error("Error: MSH file corrupted");
+            }
+            p = q;
+            return v;
+        }
+        static double toDouble(const char *&p, const char *end) {
+            char *q;
+            double v = std::strtod(p, &q);
+            if ( q == p || q > end ) {
+                throw std::runtime_error("Error: MSH file corrupted");
+            }
+            p = q;
+            return v;
+        }
+
+        // binary helper
+        template<typename T>
+        static T get(const char *&p, const char *end) {
+            if ( static_cast<size_t>(end-p) < sizeof(T) ) {
+                throw std::runtime_error("Error: MSH file truncated");
+            }
+            T v;
+            std::memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+            return v;
+        }
+
+        static int nodesPerElement(const int type) {
+            static const int n[] = { 0, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18, 14, 1, 8, 20, 15, 13 };
+            return type>0 && type<20 ? n[type] : -1;
+        }
+
+        // Call parse(line, lineNo, chunkNo) for each of the nLines lines in
+        // [begin, end), the lines being split in contiguous chunks parsed
+        // by different threads.
+        template<typename F>
+        void parseLines(const char *begin, const char *end, const size_t nLines, F parse) const {
+            size_t len = end - begin;
+            size_t nt = 1 + len/minChunk;
+            if ( nt > nThreads ) nt = nThreads;
+
+            std::vector<const char*> chunk(nt+1, end);
+            chunk[0] = begin;
+            for ( size_t i=1; i<nt; ++i ) {
+                const char *p = begin + i*len/nt;
+                p = p < chunk[i-1] ? chunk[i-1] : nextLine(p, end);
+                chunk[i] = p;
+            }
+            std::vector<size_t> first(nt+1, 0);
+            runThreads(nt, [&chunk,&first](const size_t i) {
+                first[i+1] = countLines(chunk[i], chunk[i+1]);
+            });
+            for ( size_t i=0; i<nt; ++i ) first[i+1] += first[i];
+            if ( chunk[nt] > chunk[nt-1] && *(chunk[nt]-1) != '\n' ) first[nt]++;  // last line without eol
+            if ( first[nt] != nLines ) {
+                throw std::runtime_error("Error: unexpected number of lines in MSH file");
+            }
+            runThreads(nt, [&chunk,&first,&parse](const size_t i) {
+                size_t l = first[i];
+                for ( const char *p=chunk[i]; p<chunk[i+1]; p=nextLine(p, chunk[i+1]) ) {
+                    parse(p, l++, i);
+                }
+            });
+        }
+
+        // run f(i) for i=0, ..., nt-1, in parallel
+        template<typename F>
+        static void runThreads(const size_t nt, F f) {
+            if ( nt == 1 ) {
+                f(0);
+                return;
+            }
+            std::vector<std::thread> threads(nt-1);
+            std::vector<std::exception_ptr> errors(nt);
+            for ( size_t i=1; i<nt; ++i ) {
+                threads[i-1] = std::thread( [&f,&errors,i]{
+                    try { f(i); } catch (...) { errors[i] = std::current_exception(); }
+                });
+            }
+            try { f(0); } catch (...) { errors[0] = std::current_exception(); }
+            for ( size_t i=0; i<threads.size(); ++i ) {
+                threads[i].join();
+            }
+            for ( size_t i=0; i<nt; ++i ) {
+                if ( errors[i] ) std::rethrow_exception( errors[i] );
+            }
+        }
+
+        uint32_t nodeIndex(const long long tag) const {
+            if ( tagIndex.empty() ) {
+                if ( tag < 1 || static_cast<size_t>(tag) > nodes.size() ) {
+                    throw std::runtime_error("Error: invalid node tag in MSH file");
+                }
+                return static_cast<uint32_t>(tag-1);
+            }
+            if ( tag < 0 || static_cast<size_t>(tag) >= tagIndex.size() ||
+                 tagIndex[tag] == std::numeric_limits<uint32_t>::max() ) {
+                throw std::runtime_error("Error: invalid node tag in MSH file");
+            }
+            return tagIndex[tag];
+        }
+
+        // node tags are stored in tagIndex while reading the nodes, and
+        // replaced by the reverse map if they are not 1, 2, ..., nNodes
+        void buildTagIndex() const {
+            std::vector<uint32_t> tags;
+            tags.swap( tagIndex );
+            bool ordered = true;
+            uint32_t maxTag = 0;
+            for ( size_t n=0; n<tags.size(); ++n ) {
+                if ( tags[n] != n+1 ) ordered = false;
+                maxTag = maxTag > tags[n] ? maxTag : tags[n];
+            }
+            if ( ordered ) return;
+            tagIndex.assign( static_cast<size_t>(maxTag)+1, std::numeric_limits<uint32_t>::max() );
+            for ( size_t n=0; n<tags.size(); ++n ) {
+                tagIndex[ tags[n] ] = static_cast<uint32_t>(n);
+            }
+        }
+
+        void addElement(elementBuffer& buffer, const int type, const int physical,
+                        const uint32_t *ind) const {
+            if ( type == 1 ) {
+                lineElem<uint32_t> l;
+                l.i[0] = ind[0];
+                l.i[1] = ind[1];
+                l.physical_entity = physical-1;
+                buffer.lin.push_back( l );
+            } else if ( type == 2 ) {
+                buffer.tri.push_back( triangleElem<uint32_t>(ind[0], ind[1], ind[2], physical-1) );
+            } else if ( type == 4 ) {
+                buffer.tet.push_back( tetrahedronElem<uint32_t>(ind[0], ind[1], ind[2], ind[3], physical-1) );
+            }
+        }
+
+        void appendElements(std::vector<elementBuffer>& buffers) const {
+            for ( size_t i=0; i<buffers.size(); ++i ) {
+                lines.insert( lines.end(), buffers[i].lin.begin(), buffers[i].lin.end() );
+                triangles.insert( triangles.end(), buffers[i].tri.begin(), buffers[i].tri.end() );
+                tetrahedra.insert( tetrahedra.end(), buffers[i].tet.begin(), buffers[i].tet.end() );
+                buffers[i] = elementBuffer();
+            }
+        }
+
+        void readPhysicalNames(const char *p, const char *end) const {
+            size_t np = toInt(p, end);
+            p = nextLine(p, end);
+            for ( size_t n=0; n<np; ++n ) {
+                const char *eol = lineEnd(p, end);
+                size_t dimension = toInt(p, eol);
+                int index = static_cast<int>( toInt(p, eol) );
+                std::string name(p, eol);
+                if ( dimension < physicalNames.size() ) {
+                    size_t p1 = name.find("\"")+1;
+                    size_t p2 = name.rfind("\"");
+                    physicalNames[dimension].push_back( name.substr(p1, p2-p1) );
+                    physicalIndices[dimension].push_back(index-1);
+                }
+                p = nextLine(p, end);
+            }
+        }
+
+        // MSH 2.2
+
+        void readNodes2ASCII(const char *p, const char *end) const {
+            size_t nNodes = toInt(p, end);
+            p = nextLine(p, end);
+            const char *last = skipLines(p, end, nNodes);
+            nodes.resize( nNodes );
+            tagIndex.resize( nNodes );
+            parseLines(p, last, nNodes, [this,last](const char *q, const size_t n, const size_t) {
+                tagIndex[n] = static_cast<uint32_t>( toInt(q, last) );
+                nodes[n].x = toDouble(q, last);
+                nodes[n].y = toDouble(q, last);
+                nodes[n].z = toDouble(q, last);
+            });
+        }
+
+        void readNodes2Binary(const char *p, const char *end) const {
+            size_t nNodes = toInt(p, end);
+            p = nextLine(p, end);
+            nodes.resize( nNodes );
+            tagIndex.resize( nNodes );
+            for ( size_t n=0; n<nNodes; ++n ) {
+                tagIndex[n] = static_cast<uint32_t>( get<int>(p, end) );
+                nodes[n].x = get<double>(p, end);
+                nodes[n].y = get<double>(p, end);
+                nodes[n].z = get<double>(p, end);
+            }
+        }
+
+        void readElements2ASCII(const char *p, const char *end) const {
+            nElements = toInt(p, end);
+            p = nextLine(p, end);
+            const char *last = skipLines(p, end, nElements);
+            std::vector<elementBuffer> buffers(nThreads);
+            parseLines(p, last, nElements, [this,last,&buffers](const char *q, const size_t, const size_t nc) {
+                toInt(q, last);
+                int type = static_cast<int>( toInt(q, last) );
+                int nTags = static_cast<int>( toInt(q, last) );
+                if ( type != 1 && type != 2 && type != 4 ) return;
+                int physical = 0;
+                for ( int n=0; n<nTags; ++n ) {
+                    int tag = static_cast<int>( toInt(q, last) );
+                    if ( n == 0 ) physical = tag;
+                }
+                uint32_t ind[4];
+                for ( int n=0; n<nodesPerElement(type); ++n ) {
+                    ind[n] = nodeIndex( toInt(q, last) );
+                }
+                addElement(buffers[nc], type, physical, ind);
+            });
+            appendElements(buffers);
+        }
+
+        void readElements2Binary(const char *p, const char *end) const {
+            nElements = toInt(p, end);
+            p = nextLine(p, end);
+            std::vector<elementBuffer> buffers(1);
+            std::vector<int> data;
+            for ( size_t n=0; n<nElements; ) {
+                int type = get<int>(p, end);
+                int nFollow = get<int>(p, end);
+                int nTags = get<int>(p, end);
+                int nNodes = nodesPerElement(type);
+                if ( nNodes < 0 || nFollow < 0 || nTags < 0 ) {
+                    throw std::runtime_error("Error: element type not supported in binary MSH file");
+                }
+                data.resize( 1+nTags+nNodes );
+                for ( int ne=0; ne<nFollow; ++ne ) {
+                    for ( size_t i=0; i<data.size(); ++i ) data[i] = get<int>(p, end);
+                    if ( type == 1 || type == 2 || type == 4 ) {
+                        uint32_t ind[4];
+                        for ( int i=0; i<nNodes; ++i ) ind[i] = nodeIndex( data[1+nTags+i] );
+                        addElement(buffers[0], type, nTags>0 ? data[1] : 0, ind);
+                    }
+                }
+                n += nFollow;
+            }
+            appendElements(buffers);
+        }
+
+        // MSH 4.1
+
+        void readEntitiesASCII(const char *p, const char *end) const {
+            size_t nEnt[4];
+            for ( size_t d=0; d<4; ++d ) nEnt[d] = toInt(p, end);
+            for ( size_t d=0; d<4; ++d ) {
+                for ( size_t n=0; n<nEnt[d]; ++n ) {
+                    int tag = static_cast<int>( toInt(p, end) );
+                    for ( size_t i=0; i<(d==0 ? 3 : 6); ++i ) toDouble(p, end);
+                    size_t nPhys = toInt(p, end);
+                    for ( size_t i=0; i<nPhys; ++i ) {
+                        int phys = static_cast<int>( toInt(p, end) );
+                        if ( i == 0 ) entityPhysical[d][tag] = phys;
+                    }
+                    if ( d > 0 ) {
+                        size_t nBound = toInt(p, end);
+                        for ( size_t i=0; i<nBound; ++i ) toInt(p, end);
+                    }
+                }
+            }
+        }
+
+        void readEntitiesBinary(const char *p, const char *end) const {
+            size_t nEnt[4];
+            for ( size_t d=0; d<4; ++d ) nEnt[d] = get<uint64_t>(p, end);
+            for ( size_t d=0; d<4; ++d ) {
+                for ( size_t n=0; n<nEnt[d]; ++n ) {
+                    int tag = get<int>(p, end);
+                    for ( size_t i=0; i<(d==0 ? 3 : 6); ++i ) get<double>(p, end);
+                    size_t nPhys = get<uint64_t>(p, end);
+                    for ( size_t i=0; i<nPhys; ++i ) {
+                        int phys = get<int>(p, end);
+                        if ( i == 0 ) entityPhysical[d][tag] = phys;
+                    }
+                    if ( d > 0 ) {
+                        size_t nBound = get<uint64_t>(p, end);
+                        for ( size_t i=0; i<nBound; ++i ) get<int>(p, end);
+                    }
+                }
+            }
+        }
+
+        int getEntityPhysical(const int dim, const int tag) const {
+            if ( dim < 0 || dim > 3 ) return 0;
+            auto it = entityPhysical[dim].find(tag);
+            return it == entityPhysical[dim].end() ? 0 : it->second;
+        }
+
+        void readNodes4ASCII(const char *p, const char *end) const {
+            size_t nBlocks = toInt(p, end);
+            size_t nNodes = toInt(p, end);
+            p = nextLine(p, end);
+            nodes.resize( nNodes );
+            tagIndex.resize( nNodes );
+            size_t offset = 0;
+            for ( size_t nb=0; nb<nBlocks; ++nb ) {
+                toInt(p, end);
+                toInt(p, end);
+                toInt(p, end);
+                size_t nInBlock = toInt(p, end);
+                p = nextLine(p, end);
+                if ( offset+nInBlock > nNodes ) {
+                    throw std::runtime_error("Error: MSH file corrupted");
+                }
+                const char *coord = skipLines(p, end, nInBlock);
+                const char *last = skipLines(coord, end, nInBlock);
+                parseLines(p, coord, nInBlock, [this,coord,offset](const char *q, const size_t n, const size_t) {
+                    tagIndex[offset+n] = static_cast<uint32_t>( toInt(q, coord) );
+                });
+                parseLines(coord, last, nInBlock, [this,last,offset](const char *q, const size_t n, const size_t) {
+                    nodes[offset+n].x = toDouble(q, last);
+                    nodes[offset+n].y = toDouble(q, last);
+                    nodes[offset+n].z = toDouble(q, last);
+                });
+                offset += nInBlock;
+                p = last;
+            }
+        }
+
+        void readNodes4Binary(const char *p, const char *end) const {
+            size_t nBlocks = get<uint64_t>(p, end);
+            size_t nNodes = get<uint64_t>(p, end);
+            get<uint64_t>(p, end);
+            get<uint64_t>(p, end);
+            nodes.resize( nNodes );
+            tagIndex.resize( nNodes );
+            size_t offset = 0;
+            for ( size_t nb=0; nb<nBlocks; ++nb ) {
+                int dim = get<int>(p, end);
+                get<int>(p, end);
+                int parametric = get<int>(p, end);
+                size_t nInBlock = get<uint64_t>(p, end);
+                if ( offset+nInBlock > nNodes ) {
+                    throw std::runtime_error("Error: MSH file corrupted");
+                }
+                for ( size_t n=0; n<nInBlock; ++n ) {
+                    tagIndex[offset+n] = static_cast<uint32_t>( get<uint64_t>(p, end) );
+                }
+                size_t nParam = parametric ? (dim<2 ? dim : 2) : 0;
+                for ( size_t n=0; n<nInBlock; ++n ) {
+                    nodes[offset+n].x = get<double>(p, end);
+                    nodes[offset+n].y = get<double>(p, end);
+                    nodes[offset+n].z = get<double>(p, end);
+                    for ( size_t i=0; i<nParam; ++i ) get<double>(p, end);
+                }
+                offset += nInBlock;
+            }
+        }
+
+        void readElements4ASCII(const char *p, const char *end) const {
+            size_t nBlocks = toInt(p, end);
+            nElements = toInt(p, end);
+            p = nextLine(p, end);
+            std::vector<elementBuffer> buffers(nThreads);
+            for ( size_t nb=0; nb<nBlocks; ++nb ) {
+                int dim = static_cast<int>( toInt(p, end) );
+                int tag = static_cast<int>( toInt(p, end) );
+                int type = static_cast<int>( toInt(p, end) );
+                size_t nInBlock = toInt(p, end);
+                p = nextLine(p, end);
+                const char *last = skipLines(p, end, nInBlock);
+                if ( type == 1 || type == 2 || type == 4 ) {
+                    int physical = getEntityPhysical(dim, tag);
+                    parseLines(p, last, nInBlock, [this,last,type,physical,&buffers](const char *q, const size_t, const size_t nc) {
+                        toInt(q, last);
+                        uint32_t ind[4];
+                        for ( int n=0; n<nodesPerElement(type); ++n ) {
+                            ind[n] = nodeIndex( toInt(q, last) );
                         }
-                        getline( fin, line );
+                        addElement(buffers[nc], type, physical, ind);
+                    });
+                    appendElements(buffers);
+                }
+                p = last;
+            }
+        }
+
+        void readElements4Binary(const char *p, const char *end) const {
+            size_t nBlocks = get<uint64_t>(p, end);
+            nElements = get<uint64_t>(p, end);
+            get<uint64_t>(p, end);
+            get<uint64_t>(p, end);
+            std::vector<elementBuffer> buffers(1);
+            for ( size_t nb=0; nb<nBlocks; ++nb ) {
+                int dim = get<int>(p, end);
+                int tag = get<int>(p, end);
+                int type = get<int>(p, end);
+                size_t nInBlock = get<uint64_t>(p, end);
+                int nNodes = nodesPerElement(type);
+                if ( nNodes < 0 ) {
+                    throw std::runtime_error("Error: element type not supported in binary MSH file");
+                }
+                if ( type == 1 || type == 2 || type == 4 ) {
+                    int physical = getEntityPhysical(dim, tag);
+                    uint32_t ind[4];
+                    for ( size_t n=0; n<nInBlock; ++n ) {
+                        get<uint64_t>(p, end);
+                        for ( int i=0; i<nNodes; ++i ) ind[i] = nodeIndex( get<uint64_t>(p, end) );
+                        addElement(buffers[0], type, physical, ind);
+                    }
+                } else {
+                    size_t nBytes = nInBlock*(1+nNodes)*sizeof(uint64_t);
+                    if ( static_cast<size_t>(end-p) < nBytes ) {
+                        throw std::runtime_error("Error: MSH file truncated");
                     }
-                    break;
+                    p += nBytes;
                 }
             }
-            fin.close();
-            return nElem;
+            appendElements(buffers);
         }
     };
-    
+
 }
 
 #endif
@@ -0,0 +1,77 @@
+//
+//  MappedFile.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_MappedFile_h
+#define ttcr_MappedFile_h
+
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ttcr {
+
+    // Read-only memory mapping of a whole file.
+    class MappedFile {
+    public:
+        MappedFile(const std::string& filename) : base(nullptr), length(0) {
+            int fd = open(filename.c_str(), O_RDONLY);
+            if ( fd == -1 ) {
+                throw std::runtime_error("Cannot open file " + filename + " for reading.");
+            }
+            struct stat sb;
+            if ( fstat(fd, &sb) == -1 ) {
+                ::close(fd);
+                throw std::runtime_error("Error: cannot get size of " + filename);
+            }
+            length = sb.st_size;
+            if ( length > 0 ) {
+                void *p = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+                if ( p == MAP_FAILED ) {
+                    ::close(fd);
+                    throw std::runtime_error("Error: cannot map " + filename + " in memory.");
+                }
+                base = static_cast<const char*>(p);
+            }
+            ::close(fd);
+        }
+
+        ~MappedFile() {
+            if ( base != nullptr ) munmap(const_cast<char*>(base), length);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return base; }
+        size_t size() const { return length; }
+
+    private:
+        const char *base;
+        size_t length;
+    };
+
+}
+
+#endif
@@ -25,8 +25,103 @@
 #ifndef __NODE_H__
 #define __NODE_H__
 
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "RowIndex.h"
+
 namespace ttcr {
     
+    // Bookkeeping of the allocator for each block on the heap (about two
+    // words with glibc's malloc), added to the memory used by the nodes
+    const size_t heapOverhead = 2*sizeof(void*);
+    
+    // Per-thread values (traveltime and ray parents) of all the nodes of a
+    // grid.  Values of thread n are stored contiguously in [n*nNodes,
+    // (n+1)*nNodes), so that threads do not write to the same cache lines.
+    template<typename T1, typename T2>
+    struct threadStorage {
+        std::vector<T1> tt;
+        std::vector<T2> nodeParent;
+        std::vector<T2> cellParent;
+        
+        size_t getSize() const {
+            return tt.size()*sizeof(T1) +
+            (nodeParent.size()+cellParent.size())*sizeof(T2);
+        }
+        
+        // same as calling reinit(n) for all nodes
+        void reinit(const size_t n, const size_t nNodes) {
+            std::fill(tt.begin()+n*nNodes, tt.begin()+(n+1)*nNodes,
+                      std::numeric_limits<T1>::max());
+            if ( !nodeParent.empty() ) {
+                std::fill(nodeParent.begin()+n*nNodes, nodeParent.begin()+(n+1)*nNodes,
+                          std::numeric_limits<T2>::max());
+                std::fill(cellParent.begin()+n*nNodes, cellParent.begin()+(n+1)*nNodes,
+                          std::numeric_limits<T2>::max());
+            }
+        }
+    };
+    
+    // Boolean flags of the nodes of a grid, cleared in O(1) when a new
+    // raytrace starts: flag i is true if stamp[i] equals the current epoch.
+    class NodeFlags {
+    public:
+        class reference {
+        public:
+            reference(NodeFlags& f, const size_t i) : flags(f), index(i) {}
+            operator bool() const { return flags.stamp[index] == flags.epoch; }
+            reference& operator=(const bool v) {
+                flags.stamp[index] = v ? flags.epoch : 0;
+                return *this;
+            }
+        private:
+            NodeFlags& flags;
+            size_t index;
+        };
+        
+        NodeFlags() : stamp(), epoch(0), nFlags(0) {}
+        
+        // n flags, all false
+        void reset(const size_t n) {
+            if ( ++epoch == 0 ) {
+                // wrapped around, old stamps could match again
+                std::fill(stamp.begin(), stamp.end(), 0);
+                epoch = 1;
+            }
+            if ( stamp.size() < n ) stamp.resize(n, 0);
+            nFlags = n;
+        }
+        
+        size_t size() const { return nFlags; }
+        bool operator[](const size_t i) const { return stamp[i] == epoch; }
+        reference operator[](const size_t i) { return reference(*this, i); }
+        
+        void push_back(const bool v) {
+            if ( stamp.size() == nFlags ) stamp.push_back(0);
+            stamp[nFlags++] = v ? epoch : 0;
+        }
+        
+    private:
+        std::vector<uint32_t> stamp;
+        uint32_t epoch;
+        size_t nFlags;
+    };
+    
+    // flags used by the propagators, reused from one raytrace to the next
+    struct threadWorkspace {
+        NodeFlags frozen;
+        NodeFlags inQueue;
+        RowIndex row;       // columns of the row of m_data being built
+    };
+    
+    // tag for nodes whose per-thread values are held in a threadStorage
+    // (attached later with setStorage)
+    struct sharedStorage_t {};
+    
+
     template<typename T>
     class Node {
     public:
@@ -40,7 +40,9 @@ namespace ttcr {
         tt(0),
         x(0.0), z(0.0), slowness(0.0),
         gridIndex(std::numeric_limits<T2>::max()),
-        owners(0)
+        stride(1),
+        owners(0),
+        shared(false)
         {
             tt = new T1[nt];
             
@@ -49,12 +51,24 @@ namespace ttcr {
             }
         }
         
+        Node2Dn(const size_t nt, sharedStorage_t) :
+        nThreads(nt),
+        tt(nullptr),
+        x(0.0), z(0.0), slowness(0.0),
+        gridIndex(std::numeric_limits<T2>::max()),
+        stride(0),
+        owners(0),
+        shared(true)
+        {}
+        
         Node2Dn(const T1 t, const sxz<T1>& s, const size_t nt, const size_t i) :
         nThreads(nt),
         tt(0),
         x(s.x), z(s.z), slowness(0.0),
         gridIndex(std::numeric_limits<T2>::max()),
-        owners(std::vector<T2>(0))
+        stride(1),
+        owners(std::vector<T2>(0)),
+        shared(false)
         {
             tt = new T1[nt];
             
@@ -66,29 +80,46 @@ namespace ttcr {
         
         Node2Dn(const Node2Dn<T1,T2>& node) :
         nThreads(node.nThreads),
-        tt(0),
+        tt(node.tt),
         x(node.x), z(node.z), slowness(node.slowness),
         gridIndex(node.gridIndex),
-        owners(node.owners)
+        stride(node.stride),
+        owners(node.owners),
+        shared(node.shared)
         {
-            tt = new T1[nThreads];
-            
-            for ( size_t n=0; n<nThreads; ++n ) {
-                tt[n] = node.tt[n];
+            if ( !shared ) {
+                tt = new T1[nThreads];
+                for ( size_t n=0; n<nThreads; ++n ) {
+                    tt[n] = node.tt[n];
+                }
             }
         }
         
         
-        Node2Dn() {
-            delete [] tt;
+        ~Node2Dn() {
+            if ( !shared ) delete [] tt;
+        }
+        
+        static void allocateStorage(threadStorage<T1,T2>& ts, const size_t nNodes,
+                                    const size_t nt) {
+            ts.tt.assign(nNodes*nt, std::numeric_limits<T1>::max());
+        }
+        
+        // use values of node no. index in ts instead of own arrays
+        void setStorage(threadStorage<T1,T2>& ts, const size_t index,
+                        const size_t nNodes) {
+            if ( !shared ) delete [] tt;
+            shared = true;
+            stride = static_cast<T2>(nNodes);
+            tt = ts.tt.data() + index;
         }
         
         void reinit(const size_t thread_no) { //=0) {
-            tt[thread_no] = std::numeric_limits<T1>::max();
+            tt[thread_no*stride] = std::numeric_limits<T1>::max();
         }
         
-        T1 getTT(const size_t i) const { return tt[i]; }
-        void setTT(const T1 t, const size_t i) { tt[i] = t; }
+        T1 getTT(const size_t i) const { return tt[i*stride]; }
+        void setTT(const T1 t, const size_t i) { tt[i*stride] = t; }
         
         void setXZindex(const T1 xx, const T1 zz, const T2 index) {
             x=xx; z=zz; gridIndex = index;  }
@@ -148,7 +179,9 @@ namespace ttcr {
         T1 z;                          // z coordinate
         T1 slowness;
         T2 gridIndex;                  // index of this node in the list of the grid
+        T2 stride;                     // distance between values of successive threads
         std::vector<T2> owners;        // indices of cells touching the node
+        bool shared;                   // tt points into a threadStorage
     };
     
 	
@@ -40,10 +40,12 @@ namespace ttcr {
         tt(0),
         x(0.0), z(0.0), slowness(0.0),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         nodeParent(0),
         cellParent(0),
         owners(0),
-        primary(0)
+        primary(0),
+        shared(false)
         {
             tt = new T1[nt];
             nodeParent = new T2[nt];
@@ -57,15 +59,30 @@ namespace ttcr {
         }
         
         
+        Node2Dnsp(const size_t nt, sharedStorage_t) :
+        nThreads(nt),
+        tt(nullptr),
+        x(0.0), z(0.0), slowness(0.0),
+        gridIndex(std::numeric_limits<T2>::max()),
+        stride(0),
+        nodeParent(nullptr),
+        cellParent(nullptr),
+        owners(0),
+        primary(0),
+        shared(true)
+        {}
+        
         Node2Dnsp(const T1 t, const sxz<T1>& s, const size_t nt, const size_t i) :
         nThreads(nt),
         tt(0),
         x(s.x), z(s.z), slowness(0.0),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         nodeParent(0),
         cellParent(0),
         owners(std::vector<T2>(0)),
-        primary(0)
+        primary(0),
+        shared(false)
         {
             tt = new T1[nt];
             nodeParent = new T2[nt];
@@ -81,40 +98,68 @@ namespace ttcr {
         
         Node2Dnsp(const Node2Dnsp<T1,T2>& node) :
         nThreads(node.nThreads),
-        tt(0),
+        tt(node.tt),
         x(node.x), z(node.z), slowness(node.slowness),
         gridIndex(node.gridIndex),
-        nodeParent(0),
-        cellParent(0),
+        stride(node.stride),
+        nodeParent(node.nodeParent),
+        cellParent(node.cellParent),
         owners(node.owners),
-        primary(node.primary)
+        primary(node.primary),
+        shared(node.shared)
         {
-            tt = new T1[nThreads];
-            nodeParent = new T2[nThreads];
-            cellParent = new T2[nThreads];
-            
-            for ( size_t n=0; n<nThreads; ++n ) {
-                tt[n] = node.tt[n];
-                nodeParent[n] = node.nodeParent[n];
-                cellParent[n] = node.cellParent[n];
+            if ( !shared ) {
+                tt = new T1[nThreads];
+                nodeParent = new T2[nThreads];
+                cellParent = new T2[nThreads];
+                
+                for ( size_t n=0; n<nThreads; ++n ) {
+                    tt[n] = node.tt[n];
+                    nodeParent[n] = node.nodeParent[n];
+                    cellParent[n] = node.cellParent[n];
+                }
             }
         }
         
         
-        Node2Dnsp() {
-            delete [] tt;
-            delete [] nodeParent;
-            delete [] cellParent;
+        ~Node2Dnsp() {
+            if ( !shared ) {
+                delete [] tt;
+                delete [] nodeParent;
+                delete [] cellParent;
+            }
+        }
+        
+        static void allocateStorage(threadStorage<T1,T2>& ts, const size_t nNodes,
+                                    const size_t nt) {
+            ts.tt.assign(nNodes*nt, std::numeric_limits<T1>::max());
+            ts.nodeParent.assign(nNodes*nt, std::numeric_limits<T2>::max());
+            ts.cellParent.assign(nNodes*nt, std::numeric_limits<T2>::max());
+        }
+        
+        // use values of node no. index in ts instead of own arrays
+        void setStorage(threadStorage<T1,T2>& ts, const size_t index,
+                        const size_t nNodes) {
+            if ( !shared ) {
+                delete [] tt;
+                delete [] nodeParent;
+                delete [] cellParent;
+            }
+            shared = true;
+            stride = static_cast<T2>(nNodes);
+            tt = ts.tt.data() + index;
+            nodeParent = ts.nodeParent.data() + index;
+            cellParent = ts.cellParent.data() + index;
         }
         
         void reinit(const size_t thread_no) { //=0) {
-            tt[thread_no] = std::numeric_limits<T1>::max();
-            nodeParent[thread_no] = std::numeric_limits<T2>::max();
-            cellParent[thread_no] = std::numeric_limits<T2>::max();
+            tt[thread_no*stride] = std::numeric_limits<T1>::max();
+            nodeParent[thread_no*stride] = std::numeric_limits<T2>::max();
+            cellParent[thread_no*stride] = std::numeric_limits<T2>::max();
         }
         
-        T1 getTT(const size_t i) const { return tt[i]; }
-        void setTT(const T1 t, const size_t i) { tt[i] = t; }
+        T1 getTT(const size_t i) const { return tt[i*stride]; }
+        void setTT(const T1 t, const size_t i) { tt[i*stride] = t; }
         
         void setXZindex(const T1 xx, const T1 zz, const T2 index) {
             x=xx; z=zz; gridIndex = index;  }
@@ -139,11 +184,11 @@ namespace ttcr {
         T2 getGridIndex() const { return gridIndex; }
         void setGridIndex(const T2 index) { gridIndex = index; }
         
-        T2 getNodeParent(const size_t i) const { return nodeParent[i]; }
-        void setnodeParent(const T2 index, const size_t i) { nodeParent[i] = index; }
+        T2 getNodeParent(const size_t i) const { return nodeParent[i*stride]; }
+        void setnodeParent(const T2 index, const size_t i) { nodeParent[i*stride] = index; }
         
-        T2 getCellParent(const size_t i) const { return cellParent[i]; }
-        void setCellParent(const T2 index, const size_t i) { cellParent[i] = index; }
+        T2 getCellParent(const size_t i) const { return cellParent[i*stride]; }
+        void setCellParent(const T2 index, const size_t i) { cellParent[i*stride] = index; }
         
         int getPrimary() const { return primary; };
         void setPrimary( const int o ) { primary = o; }
@@ -183,10 +228,12 @@ namespace ttcr {
         T1 z;                          // z coordinate
         T1 slowness;
         T2 gridIndex;                  // index of this node in the list of the grid
+        T2 stride;                     // distance between values of successive threads
         T2 *nodeParent;                // index of parent node of the ray
         T2 *cellParent;                // index of cell traversed by the ray
         std::vector<T2> owners;        // indices of cells touching the node
         int primary;				   // indicate the order of the node: 5= primary,
+        bool shared;                   // tt & parents point into a threadStorage
         
     };
     
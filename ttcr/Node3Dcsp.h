@@ -202,9 +202,21 @@ namespace ttcr {
             return fabs(x-node.x)<small && fabs(y-node.y)<small && fabs(z-node.z)<small;
         }
         
+        // memory of the node, without its values for the threads, with the
+        // heap blocks of owners and of values
+        size_t getSharedSize() const {
+            return sizeof(*this) + owners.capacity() * sizeof(T2) +
+            ((owners.capacity()>0) + 3)*heapOverhead;
+        }
+        // same, without owner entries, for a node of a grid
+        static size_t estimateSharedSize() {
+            return sizeof(Node3Dcsp) + 4*heapOverhead;
+        }
+        // memory of the values of one thread (traveltime & parents)
+        static size_t getThreadSize() { return sizeof(T1) + 2*sizeof(T2); }
+        
         size_t getSize() const {
-            return sizeof(size_t) + nThreads*sizeof(T1) + 3*sizeof(T1) +
-            (1+2*nThreads)*sizeof(T2) + owners.size() * sizeof(T2);
+            return getSharedSize() + nThreads*getThreadSize();
         }
         
         int getDimension() const { return 3; }
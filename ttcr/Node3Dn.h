@@ -41,22 +41,37 @@ namespace ttcr {
         tt(new T1[nt]),
         x(0.0f), y(0.0f), z(0.0f),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         owners(std::vector<T2>(0)),
-        slowness(0)
+        slowness(0),
+        shared(false)
         {
             for ( size_t n=0; n<nt; ++n ) {
                 tt[n] = std::numeric_limits<T1>::max();
             }
         }
         
+        Node3Dn(const size_t nt, sharedStorage_t) :
+        nThreads(nt),
+        tt(nullptr),
+        x(0.0f), y(0.0f), z(0.0f),
+        gridIndex(std::numeric_limits<T2>::max()),
+        stride(0),
+        owners(std::vector<T2>(0)),
+        slowness(0),
+        shared(true)
+        {}
+        
         Node3Dn(const T1 t, const T1 xx, const T1 yy, const T1 zz, const size_t nt,
                 const size_t i) :
         nThreads(nt),
         tt(new T1[nt]),
         x(xx), y(yy), z(zz),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         owners(std::vector<T2>(0)),
-        slowness(0)
+        slowness(0),
+        shared(false)
         {
             for ( size_t n=0; n<nt; ++n ) {
                 tt[n] = std::numeric_limits<T1>::max();
@@ -70,8 +85,10 @@ namespace ttcr {
         tt(new T1[nt]),
         x(s.x), y(s.y), z(s.z),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         owners(std::vector<T2>(0)),
-        slowness(0)
+        slowness(0),
+        shared(false)
         {
             for ( size_t n=0; n<nt; ++n ) {
                 tt[n] = std::numeric_limits<T1>::max();
@@ -81,30 +98,47 @@ namespace ttcr {
         
         Node3Dn(const Node3Dn<T1,T2>& node) :
         nThreads(node.nThreads),
-        tt(0),
+        tt(node.tt),
         x(node.x), y(node.y), z(node.z),
         gridIndex(node.gridIndex),
+        stride(node.stride),
         owners(node.owners),
-        slowness(node.slowness)
+        slowness(node.slowness),
+        shared(node.shared)
         {
-            tt = new T1[nThreads];
-            
-            for ( size_t n=0; n<nThreads; ++n ) {
-                tt[n] = node.tt[n];
+            if ( !shared ) {
+                tt = new T1[nThreads];
+                for ( size_t n=0; n<nThreads; ++n ) {
+                    tt[n] = node.tt[n];
+                }
             }
         }
         
         ~Node3Dn() {
-            delete [] tt;
+            if ( !shared ) delete [] tt;
+        }
+        
+        static void allocateStorage(threadStorage<T1,T2>& ts, const size_t nNodes,
+                                    const size_t nt) {
+            ts.tt.assign(nNodes*nt, std::numeric_limits<T1>::max());
+        }
+        
+        // use values of node no. index in ts instead of own arrays
+        void setStorage(threadStorage<T1,T2>& ts, const size_t index,
+                        const size_t nNodes) {
+            if ( !shared ) delete [] tt;
+            shared = true;
+            stride = static_cast<T2>(nNodes);
+            tt = ts.tt.data() + index;
         }
         
         // Sets the vectors to the right size of threads and initialize it
         void reinit(const size_t n) {
-            tt[n] = std::numeric_limits<T1>::max();
+            tt[n*stride] = std::numeric_limits<T1>::max();
         }
         
-        T1 getTT(const size_t n) const { return tt[n]; }
-        void setTT(const T1 t, const size_t n ) { tt[n] = t; }
+        T1 getTT(const size_t n) const { return tt[n*stride]; }
+        void setTT(const T1 t, const size_t n ) { tt[n*stride] = t; }
         
         void setXYZindex(const T1 xx, const T1 yy, const T1 zz, const T2 index) {
             x=xx; y=yy; z=zz; gridIndex = index;  }
@@ -144,9 +178,22 @@ namespace ttcr {
             return fabs(x-node.x)<small && fabs(y-node.y)<small && fabs(z-node.z)<small;
         }
         
+        // memory of the node, without its values for the threads, with the
+        // heap blocks of owners and of values not in a threadStorage
+        size_t getSharedSize() const {
+            return sizeof(*this) + owners.capacity() * sizeof(T2) +
+            ((owners.capacity()>0) + (shared ? 0 : 1))*heapOverhead;
+        }
+        // same, without owner entries, for a node of a grid (values in
+        // its threadStorage)
+        static size_t estimateSharedSize() {
+            return sizeof(Node3Dn) + heapOverhead;
+        }
+        // memory of the values of one thread
+        static size_t getThreadSize() { return sizeof(T1); }
+        
         size_t getSize() const {
-            return 2*sizeof(size_t) + nThreads*sizeof(T1) + 4*sizeof(T1) +
-            (1+2*nThreads)*sizeof(T2) + owners.size() * sizeof(T2);
+            return getSharedSize() + (shared ? 0 : nThreads*getThreadSize());
         }
         
         int getDimension() const { return 3; }
@@ -160,8 +207,10 @@ namespace ttcr {
         T1 y;							// y coordinate [km]
         T1 z;                           // z coordinate [km]
         T2 gridIndex;                   // index of this node in the list of the grid
+        T2 stride;                      // distance between values of successive threads
         std::vector<T2> owners;         // indices of cells touching the node
         T1 slowness;					// slowness at the node [s/km], only used by Grid3Dinterp    
+        bool shared;                    // tt points into a threadStorage
     };
     
 }
@@ -41,11 +41,13 @@ namespace ttcr {
         tt(new T1[nt]),
         x(0.0f), y(0.0f), z(0.0f),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         nodeParent(new T2[nt]),
         cellParent(new T2[nt]),
         owners(std::vector<T2>(0)),
         slowness(0),
-        primary(0)
+        primary(0),
+        shared(false)
         {
             for ( size_t n=0; n<nt; ++n ) {
                 tt[n] = std::numeric_limits<T1>::max();
@@ -54,17 +56,33 @@ namespace ttcr {
             }
         }
         
+        Node3Dnsp(const size_t nt, sharedStorage_t) :
+        nThreads(nt),
+        tt(nullptr),
+        x(0.0f), y(0.0f), z(0.0f),
+        gridIndex(std::numeric_limits<T2>::max()),
+        stride(0),
+        nodeParent(nullptr),
+        cellParent(nullptr),
+        owners(std::vector<T2>(0)),
+        slowness(0),
+        primary(0),
+        shared(true)
+        {}
+        
         Node3Dnsp(const T1 t, const T1 xx, const T1 yy, const T1 zz, const size_t nt,
                   const size_t i) :
         nThreads(nt),
         tt(new T1[nt]),
         x(xx), y(yy), z(zz),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         nodeParent(new T2[nt]),
         cellParent(new T2[nt]),
         owners(std::vector<T2>(0)),
         slowness(0),
-        primary(0)
+        primary(0),
+        shared(false)
         {
             for ( size_t n=0; n<nt; ++n ) {
                 tt[n] = std::numeric_limits<T1>::max();
@@ -80,11 +98,13 @@ namespace ttcr {
         tt(new T1[nt]),
         x(s.x), y(s.y), z(s.z),
         gridIndex(std::numeric_limits<T2>::max()),
+        stride(1),
         nodeParent(new T2[nt]),
         cellParent(new T2[nt]),
         owners(std::vector<T2>(0)),
         slowness(0),
-        primary(0)
+        primary(0),
+        shared(false)
         {
             for ( size_t n=0; n<nt; ++n ) {
                 tt[n] = std::numeric_limits<T1>::max();
@@ -96,41 +116,69 @@ namespace ttcr {
         
         Node3Dnsp(const Node3Dnsp<T1,T2>& node) :
         nThreads(node.nThreads),
-        tt(0),
+        tt(node.tt),
         x(node.x), y(node.y), z(node.z),
         gridIndex(node.gridIndex),
-        nodeParent(0),
-        cellParent(0),
+        stride(node.stride),
+        nodeParent(node.nodeParent),
+        cellParent(node.cellParent),
         owners(node.owners),
         slowness(node.slowness),
-        primary(node.primary)
+        primary(node.primary),
+        shared(node.shared)
         {
-            tt = new T1[nThreads];
-            nodeParent = new T2[nThreads];
-            cellParent = new T2[nThreads];
-            
-            for ( size_t n=0; n<nThreads; ++n ) {
-                tt[n] = node.tt[n];
-                nodeParent[n] = node.nodeParent[n];
-                cellParent[n] = node.cellParent[n];
+            if ( !shared ) {
+                tt = new T1[nThreads];
+                nodeParent = new T2[nThreads];
+                cellParent = new T2[nThreads];
+                
+                for ( size_t n=0; n<nThreads; ++n ) {
+                    tt[n] = node.tt[n];
+                    nodeParent[n] = node.nodeParent[n];
+                    cellParent[n] = node.cellParent[n];
+                }
             }
         }
         
         ~Node3Dnsp() {
-            delete [] tt;
-            delete [] nodeParent;
-            delete [] cellParent;
+            if ( !shared ) {
+                delete [] tt;
+                delete [] nodeParent;
+                delete [] cellParent;
+            }
+        }
+        
+        static void allocateStorage(threadStorage<T1,T2>& ts, const size_t nNodes,
+                                    const size_t nt) {
+            ts.tt.assign(nNodes*nt, std::numeric_limits<T1>::max());
+            ts.nodeParent.assign(nNodes*nt, std::numeric_limits<T2>::max());
+            ts.cellParent.assign(nNodes*nt, std::numeric_limits<T2>::max());
+        }
+        
+        // use values of node no. index in ts instead of own arrays
+        void setStorage(threadStorage<T1,T2>& ts, const size_t index,
+                        const size_t nNodes) {
+            if ( !shared ) {
+                delete [] tt;
+                delete [] nodeParent;
+                delete [] cellParent;
+            }
+            shared = true;
+            stride = static_cast<T2>(nNodes);
+            tt = ts.tt.data() + index;
+            nodeParent = ts.nodeParent.data() + index;
+            cellParent = ts.cellParent.data() + index;
         }
         
         // Sets the vectors to the right size of threads and initialize it
         void reinit(const size_t n) {
-            tt[n] = std::numeric_limits<T1>::max();
-            nodeParent[n] = std::numeric_limits<T2>::max();
-            cellParent[n] = std::numeric_limits<T2>::max();
+            tt[n*stride] = std::numeric_limits<T1>::max();
+            nodeParent[n*stride] = std::numeric_limits<T2>::max();
+            cellParent[n*stride] = std::numeric_limits<T2>::max();
         }
         
-        T1 getTT(const size_t n) const { return tt[n]; }
-        void setTT(const T1 t, const size_t n ) { tt[n] = t; }
+        T1 getTT(const size_t n) const { return tt[n*stride]; }
+        void setTT(const T1 t, const size_t n ) { tt[n*stride] = t; }
         
         void setXYZindex(const T1 xx, const T1 yy, const T1 zz, const T2 index) {
             x=xx; y=yy; z=zz; gridIndex = index;  }
@@ -149,11 +197,11 @@ namespace ttcr {
         T2 getGridIndex() const { return gridIndex; }
         void setGridIndex(const T2 index) { gridIndex = index; }
         
-        T2 getNodeParent(const size_t n) const { return nodeParent[n]; }
-        void setnodeParent(const T2 index, const size_t n) { nodeParent[n] = index; }
+        T2 getNodeParent(const size_t n) const { return nodeParent[n*stride]; }
+        void setnodeParent(const T2 index, const size_t n) { nodeParent[n*stride] = index; }
         
-        T2 getCellParent(const size_t n) const { return cellParent[n]; }
-        void setCellParent(const T2 index, const size_t n) { cellParent[n] = index; }
+        T2 getCellParent(const size_t n) const { return cellParent[n*stride]; }
+        void setCellParent(const T2 index, const size_t n) { cellParent[n*stride] = index; }
         
         int getPrimary() const { return primary; }
         void setPrimary( const int o ) { primary = o; }
@@ -177,9 +225,22 @@ namespace ttcr {
             return fabs(x-node.x)<small && fabs(y-node.y)<small && fabs(z-node.z)<small;
         }
         
+        // memory of the node, without its values for the threads, with the
+        // heap blocks of owners and of values not in a threadStorage
+        size_t getSharedSize() const {
+            return sizeof(*this) + owners.capacity() * sizeof(T2) +
+            ((owners.capacity()>0) + (shared ? 0 : 3))*heapOverhead;
+        }
+        // same, without owner entries, for a node of a grid (values in
+        // its threadStorage)
+        static size_t estimateSharedSize() {
+            return sizeof(Node3Dnsp) + heapOverhead;
+        }
+        // memory of the values of one thread (traveltime & parents)
+        static size_t getThreadSize() { return sizeof(T1) + 2*sizeof(T2); }
+        
         size_t getSize() const {
-            return 2*sizeof(size_t) + nThreads*sizeof(T1) + 4*sizeof(T1) +
-            (1+2*nThreads)*sizeof(T2) + owners.size() * sizeof(T2);
+            return getSharedSize() + (shared ? 0 : nThreads*getThreadSize());
         }
         
         int getDimension() const { return 3; }
@@ -193,6 +254,7 @@ namespace ttcr {
         T1 y;							// y coordinate [km]
         T1 z;                           // z coordinate [km]
         T2 gridIndex;                   // index of this node in the list of the grid
+        T2 stride;                      // distance between values of successive threads
         T2 *nodeParent;                 // index of parent node of the ray for each thread
         T2 *cellParent;                 // index of cell traversed by the ray for each thread
         std::vector<T2> owners;         // indices of cells touching the node
@@ -200,6 +262,7 @@ namespace ttcr {
         int primary;					// indicate the order of the node: 5= primary,
         //  (25:48)= secondary on edges,
         //  (50:71)= secondary on faces, only used by Grid3Dinterp
+        bool shared;                    // tt & parents point into a threadStorage
         
     };
     
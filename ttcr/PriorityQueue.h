@@ -0,0 +1,177 @@
+//
+//  PriorityQueue.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_PriorityQueue_h
+#define ttcr_PriorityQueue_h
+
+#include <limits>
+#include <queue>
+#include <vector>
+
+#include "Node.h"
+
+namespace ttcr {
+
+    /*
+     Queues of node pointers used by the shortest-path and fast marching
+     propagators, returning the node of minimum traveltime for thread threadNo.
+     The queue is a template parameter of the grids, both classes have the
+     same interface:
+
+     push(node)   : insert node
+     update(node) : node already in the queue had its traveltime modified
+     top(), pop(), empty(), size()
+     getNodeSize(): memory used per node of the grid when all are queued
+     */
+
+    // std::priority_queue, traveltimes are read at each comparison and
+    // update() does nothing: a node whose traveltime decreases while in the
+    // queue keeps its position in the heap.
+    template<typename NODE, typename T1>
+    class BinaryHeap : public std::priority_queue<NODE*, std::vector<NODE*>, CompareNodePtr<T1>> {
+    public:
+        BinaryHeap(const size_t threadNo, const size_t nNodes=0) :
+        std::priority_queue<NODE*, std::vector<NODE*>, CompareNodePtr<T1>>(CompareNodePtr<T1>(threadNo))
+        {}
+
+        void update(NODE*) {}
+
+        static size_t getNodeSize() { return sizeof(NODE*); }
+    };
+
+    // Indexed 4-ary heap with decrease-key.  Traveltimes are copied in the
+    // heap entries when nodes are pushed or updated, and the position of each
+    // node in the heap is indexed by its grid index, so that a node is never
+    // found more than once in the queue.
+    template<typename NODE, typename T1>
+    class IndexedHeap {
+    public:
+        IndexedHeap(const size_t nt, const size_t nNodes=0) :
+        threadNo(nt), heap(), pos(nNodes, npos)
+        {}
+
+        bool empty() const { return heap.empty(); }
+        size_t size() const { return heap.size(); }
+        NODE* top() const { return heap.front().node; }
+
+        static size_t getNodeSize() { return sizeof(entry) + sizeof(size_t); }
+
+        // insert node, or move it if it is already in the queue
+        void push(NODE* node) {
+            size_t i = node->getGridIndex();
+            if ( i >= pos.size() ) pos.resize(i+1, npos);
+            if ( pos[i] == npos ) {
+                heap.push_back( {node->getTT(threadNo), node} );
+                pos[i] = heap.size()-1;
+                siftUp( heap.size()-1 );
+            } else {
+                rekey( pos[i] );
+            }
+        }
+
+        void update(NODE* node) {
+            size_t i = node->getGridIndex();
+            if ( i < pos.size() && pos[i] != npos ) rekey( pos[i] );
+        }
+
+        void pop() {
+            pos[ heap.front().node->getGridIndex() ] = npos;
+            if ( heap.size() > 1 ) {
+                heap.front() = heap.back();
+                pos[ heap.front().node->getGridIndex() ] = 0;
+                heap.pop_back();
+                siftDown( 0 );
+            } else {
+                heap.pop_back();
+            }
+        }
+
+    private:
+        struct entry {
+            T1 tt;
+            NODE *node;
+        };
+        static const size_t npos = std::numeric_limits<size_t>::max();
+
+        size_t threadNo;
+        std::vector<entry> heap;
+        std::vector<size_t> pos;    // position in heap, indexed by grid index
+
+        void rekey(const size_t n) {
+            T1 tt = heap[n].node->getTT(threadNo);
+            if ( tt < heap[n].tt ) {
+                heap[n].tt = tt;
+                siftUp( n );
+            } else if ( tt > heap[n].tt ) {
+                heap[n].tt = tt;
+                siftDown( n );
+            }
+        }
+
+        void siftUp(size_t n) {
+            entry e = heap[n];
+            while ( n > 0 ) {
+                size_t p = (n-1)/4;
+                if ( !(e.tt < heap[p].tt) ) break;
+                heap[n] = heap[p];
+                pos[ heap[n].node->getGridIndex() ] = n;
+                n = p;
+            }
+            heap[n] = e;
+            pos[ e.node->getGridIndex() ] = n;
+        }
+
+        void siftDown(size_t n) {
+            entry e = heap[n];
+            const size_t nh = heap.size();
+            for ( ;; ) {
+                size_t c = 4*n+1;
+                if ( c >= nh ) break;
+                size_t cmax = c+4 < nh ? c+4 : nh;
+                size_t cmin = c;
+                for ( ++c; c<cmax; ++c ) {
+                    if ( heap[c].tt < heap[cmin].tt ) cmin = c;
+                }
+                if ( !(heap[cmin].tt < e.tt) ) break;
+                heap[n] = heap[cmin];
+                pos[ heap[n].node->getGridIndex() ] = n;
+                n = cmin;
+            }
+            heap[n] = e;
+            pos[ e.node->getGridIndex() ] = n;
+        }
+    };
+
+    template<typename NODE, typename T1>
+    const size_t IndexedHeap<NODE,T1>::npos;
+
+    // queue used when the grid template parameter is not given
+#ifdef TTCR_INDEXED_HEAP
+    template<typename NODE, typename T1>
+    using DefaultQueue = IndexedHeap<NODE,T1>;
+#else
+    template<typename NODE, typename T1>
+    using DefaultQueue = BinaryHeap<NODE,T1>;
+#endif
+
+}
+
+#endif
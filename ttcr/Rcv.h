@@ -31,6 +31,7 @@
 #include <string>
 #include <vector>
 
+#include "TTtable.h"
 #include "ttcr_t.h"
 
 namespace ttcr {
@@ -47,6 +48,7 @@ namespace ttcr {
         std::vector<T>& get_tt(const size_t n, const size_t nr=0) { return tt[n][nr]; }
         
         void save_tt( const std::string &, const size_t) const;
+        void save_tt_bin( const std::string &, const bool single=false) const;
         
         void add_coord(const sxyz<T> &c) { coord.push_back(c); }
         void init_tt(const size_t nsrc) {
@@ -159,6 +161,16 @@ namespace ttcr {
         fout.close();
     }
     
+    template<typename T>
+    void Rcv<T>::save_tt_bin( const std::string &filename, const bool single) const {
+        try {
+            saveTTtable(filename, tt, single);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << '\n';
+            exit(1);
+        }
+    }
+    
     template<typename T>
     void Rcv<T>::save_rcvfile() const {
         
@@ -0,0 +1,215 @@
+//
+//  Renumbering.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_Renumbering_h
+#define ttcr_Renumbering_h
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ttcr_t.h"
+
+namespace ttcr {
+
+    // Renumbering of the nodes and cells of a mesh along a Hilbert curve,
+    // so that nodes and cells close in space are also close in memory.
+    // Nodes are sorted according to their position on the curve, and cells
+    // according to the position of their centroid.  The permutations are
+    // kept to bring results back to the numbering of the input file.
+    template<typename T2>
+    class Renumbering {
+    public:
+        Renumbering() : nodeOld(), nodeNew(), cellOld() {}
+
+        bool empty() const { return nodeOld.empty(); }
+
+        // renumber nodes & cells, vertex indices of cells are updated
+        template<typename P, typename E>
+        void apply(std::vector<P>& nodes, std::vector<E>& cells) {
+            if ( nodes.empty() ) return;
+
+            P pmin = nodes[0];
+            P pmax = nodes[0];
+            for ( size_t n=1; n<nodes.size(); ++n ) {
+                bounds(nodes[n], pmin, pmax);
+            }
+
+            std::vector<std::pair<uint64_t,T2>> keys(nodes.size());
+            for ( size_t n=0; n<nodes.size(); ++n ) {
+                keys[n] = { key(nodes[n], pmin, pmax), static_cast<T2>(n) };
+            }
+            std::sort(keys.begin(), keys.end());
+            nodeOld.resize(nodes.size());
+            nodeNew.resize(nodes.size());
+            for ( size_t n=0; n<keys.size(); ++n ) {
+                nodeOld[n] = keys[n].second;
+                nodeNew[ keys[n].second ] = static_cast<T2>(n);
+            }
+            permute(nodes, nodeOld);
+
+            const size_t nv = sizeof(cells[0].i)/sizeof(cells[0].i[0]);
+            keys.resize(cells.size());
+            for ( size_t n=0; n<cells.size(); ++n ) {
+                for ( size_t i=0; i<nv; ++i ) {
+                    cells[n].i[i] = nodeNew[ cells[n].i[i] ];
+                }
+                P c = centroid(nodes, cells[n]);
+                keys[n] = { key(c, pmin, pmax), static_cast<T2>(n) };
+            }
+            std::sort(keys.begin(), keys.end());
+            cellOld.resize(cells.size());
+            for ( size_t n=0; n<keys.size(); ++n ) {
+                cellOld[n] = keys[n].second;
+            }
+            permute(cells, cellOld);
+        }
+
+        // values given in the order of the input file (e.g. slowness)
+        template<typename V>
+        void permuteNodeValues(std::vector<V>& v) const { permute(v, nodeOld); }
+        template<typename V>
+        void permuteCellValues(std::vector<V>& v) const { permute(v, cellOld); }
+
+        // index in the grid of the nodes of the input file
+        const std::vector<T2>& getNodeIndices() const { return nodeNew; }
+
+        T2 originalNode(const T2 n) const { return nodeOld[n]; }
+        T2 originalCell(const T2 n) const { return cellOld[n]; }
+
+        // bring back node indices of the columns of matrix M to the input
+        // numbering (secondary nodes are not renumbered)
+        template<typename T>
+        void restore(std::vector<std::vector<sijv<T>>>& m_data) const {
+            for ( size_t n=0; n<m_data.size(); ++n ) {
+                for ( size_t nm=0; nm<m_data[n].size(); ++nm ) {
+                    if ( m_data[n][nm].j < nodeOld.size() )
+                        m_data[n][nm].j = nodeOld[ m_data[n][nm].j ];
+                }
+            }
+        }
+
+    private:
+        std::vector<T2> nodeOld;   // input index of grid node n
+        std::vector<T2> nodeNew;   // grid index of input node n
+        std::vector<T2> cellOld;   // input index of grid cell n
+
+        static const int bits = 21;  // per coordinate, 63 bits in 3D
+
+        template<typename V>
+        static void permute(std::vector<V>& v, const std::vector<T2>& old) {
+            if ( old.empty() || v.size() != old.size() ) return;
+            std::vector<V> tmp;
+            tmp.reserve(v.size());
+            for ( size_t n=0; n<old.size(); ++n ) {
+                tmp.push_back( v[ old[n] ] );
+            }
+            v.swap(tmp);
+        }
+
+        template<typename T>
+        static void bounds(const sxyz<T>& p, sxyz<T>& pmin, sxyz<T>& pmax) {
+            pmin.x = pmin.x < p.x ? pmin.x : p.x;
+            pmin.y = pmin.y < p.y ? pmin.y : p.y;
+            pmin.z = pmin.z < p.z ? pmin.z : p.z;
+            pmax.x = pmax.x > p.x ? pmax.x : p.x;
+            pmax.y = pmax.y > p.y ? pmax.y : p.y;
+            pmax.z = pmax.z > p.z ? pmax.z : p.z;
+        }
+        template<typename T>
+        static void bounds(const sxz<T>& p, sxz<T>& pmin, sxz<T>& pmax) {
+            pmin.x = pmin.x < p.x ? pmin.x : p.x;
+            pmin.z = pmin.z < p.z ? pmin.z : p.z;
+            pmax.x = pmax.x > p.x ? pmax.x : p.x;
+            pmax.z = pmax.z > p.z ? pmax.z : p.z;
+        }
+
+        template<typename P, typename E>
+        static P centroid(const std::vector<P>& nodes, const E& cell) {
+            const size_t nv = sizeof(cell.i)/sizeof(cell.i[0]);
+            P c = nodes[ cell.i[0] ];
+            for ( size_t i=1; i<nv; ++i ) {
+                c += nodes[ cell.i[i] ];
+            }
+            c /= nv;
+            return c;
+        }
+
+        template<typename T>
+        static uint32_t scale(const T x, const T xmin, const T xmax) {
+            const uint32_t nmax = (1u << bits) - 1;
+            if ( xmax <= xmin ) return 0;
+            T s = (x-xmin) / (xmax-xmin) * nmax;
+            if ( s < 0 ) return 0;
+            if ( s > nmax ) return nmax;
+            return static_cast<uint32_t>(s);
+        }
+
+        template<typename T>
+        static uint64_t key(const sxyz<T>& p, const sxyz<T>& pmin, const sxyz<T>& pmax) {
+            uint32_t X[3] = { scale(p.x, pmin.x, pmax.x),
+                scale(p.y, pmin.y, pmax.y), scale(p.z, pmin.z, pmax.z) };
+            return hilbert(X, 3);
+        }
+        template<typename T>
+        static uint64_t key(const sxz<T>& p, const sxz<T>& pmin, const sxz<T>& pmax) {
+            uint32_t X[2] = { scale(p.x, pmin.x, pmax.x), scale(p.z, pmin.z, pmax.z) };
+            return hilbert(X, 2);
+        }
+
+        // J. Skilling, 2004, Programming the Hilbert curve, AIP Conf. Proc.
+        // 707, 381-387: coordinates are transformed in place to the
+        // "transposed" Hilbert index, whose bits are then interleaved
+        static uint64_t hilbert(uint32_t *X, const int n) {
+            const uint32_t M = 1u << (bits-1);
+            for ( uint32_t Q=M; Q>1; Q>>=1 ) {
+                uint32_t P = Q - 1;
+                for ( int i=0; i<n; ++i ) {
+                    if ( X[i] & Q ) {
+                        X[0] ^= P;
+                    } else {
+                        uint32_t t = (X[0]^X[i]) & P;
+                        X[0] ^= t;
+                        X[i] ^= t;
+                    }
+                }
+            }
+            for ( int i=1; i<n; ++i ) X[i] ^= X[i-1];
+            uint32_t t = 0;
+            for ( uint32_t Q=M; Q>1; Q>>=1 ) {
+                if ( X[n-1] & Q ) t ^= Q-1;
+            }
+            for ( int i=0; i<n; ++i ) X[i] ^= t;
+
+            uint64_t h = 0;
+            for ( int b=bits-1; b>=0; --b ) {
+                for ( int i=0; i<n; ++i ) {
+                    h = (h << 1) | ((X[i] >> b) & 1u);
+                }
+            }
+            return h;
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,93 @@
+//
+//  RowIndex.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_RowIndex_h
+#define ttcr_RowIndex_h
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace ttcr {
+
+    // Position of the columns in a row of a sparse matrix built one term at
+    // a time (l_data or m_data along a raypath), so that a term can be added
+    // to an existing one without scanning the row.  Open addressing hash
+    // table whose size follows the length of the row, not the size of the
+    // grid; clear() is called before each new row.
+    class RowIndex {
+    public:
+        RowIndex() : keys(16, none()), pos(16), used() {}
+
+        void clear() {
+            for ( size_t n=0; n<used.size(); ++n ) {
+                keys[ used[n] ] = none();
+            }
+            used.clear();
+        }
+
+        // position of column col in the row; if col is not in the row yet,
+        // n (where it will be appended) is recorded and returned
+        size_t insert(const size_t col, const size_t n) {
+            if ( 2*(used.size()+1) > keys.size() ) grow();
+            size_t s = slot(col);
+            if ( keys[s] == col ) return pos[s];
+            keys[s] = col;
+            pos[s] = n;
+            used.push_back(s);
+            return n;
+        }
+
+    private:
+        std::vector<size_t> keys;   // column, none() if slot is free
+        std::vector<size_t> pos;    // position of column in row
+        std::vector<size_t> used;   // slots in use
+
+        static size_t none() { return std::numeric_limits<size_t>::max(); }
+
+        size_t slot(const size_t col) const {
+            const size_t mask = keys.size()-1;
+            uint64_t h = static_cast<uint64_t>(col) * 0x9E3779B97F4A7C15ull;
+            size_t s = static_cast<size_t>(h ^ (h >> 32)) & mask;
+            while ( keys[s] != none() && keys[s] != col ) {
+                s = (s+1) & mask;
+            }
+            return s;
+        }
+
+        void grow() {
+            std::vector<size_t> k(keys.size()*2, none());
+            std::vector<size_t> p(keys.size()*2);
+            k.swap(keys);
+            p.swap(pos);
+            for ( size_t n=0; n<used.size(); ++n ) {
+                size_t s = slot( k[used[n]] );
+                keys[s] = k[used[n]];
+                pos[s] = p[used[n]];
+                used[n] = s;
+            }
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+//
+//  ShotScheduler.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_ShotScheduler_h
+#define ttcr_ShotScheduler_h
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ttcr {
+
+    // Dynamic distribution of shots to threads: each thread takes the next
+    // shot from a shared counter as soon as it is done with the previous
+    // one, so that shots of very different cost keep all threads busy.
+    class ShotScheduler {
+    public:
+        ShotScheduler(const size_t ns, const size_t nt) :
+        nShots(ns), nThreads(nt>0 ? nt : 1), next(0),
+        busy(nThreads, 0.0), count(nThreads, 0), error()
+        {}
+
+        // Call job(n, threadNo) for shots n=0, ..., nShots-1.  The calling
+        // thread is thread 0.  If a job throws, remaining shots are skipped
+        // and the first exception is rethrown once all threads are done.
+        template<typename F>
+        void run(F job) {
+            next = 0;
+            error = nullptr;
+            std::fill(busy.begin(), busy.end(), 0.0);
+            std::fill(count.begin(), count.end(), 0);
+            std::vector<std::thread> threads(nThreads-1);
+            for ( size_t i=0; i<nThreads-1; ++i ) {
+                threads[i] = std::thread( [this,&job,i]{ work(job, i+1); } );
+            }
+            work(job, 0);
+            for ( size_t i=0; i<threads.size(); ++i ) {
+                threads[i].join();
+            }
+            if ( error ) std::rethrow_exception( error );
+        }
+
+        size_t getNthreads() const { return nThreads; }
+        // cumulated time spent in jobs by thread threadNo, in s
+        double getBusyTime(const size_t threadNo) const { return busy[threadNo]; }
+        // number of shots computed by thread threadNo
+        size_t getNshots(const size_t threadNo) const { return count[threadNo]; }
+
+    private:
+        const size_t nShots;
+        const size_t nThreads;
+        std::atomic<size_t> next;
+        std::vector<double> busy;
+        std::vector<size_t> count;
+        std::exception_ptr error;
+        std::mutex mtx;
+
+        template<typename F>
+        void work(F& job, const size_t threadNo) {
+            for ( ;; ) {
+                size_t n = next.fetch_add(1);
+                if ( n >= nShots ) break;
+                auto begin = std::chrono::high_resolution_clock::now();
+                try {
+                    job(n, threadNo);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    if ( !error ) error = std::current_exception();
+                    next = nShots;
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+                busy[threadNo] += std::chrono::duration<double>(end-begin).count();
+                count[threadNo]++;
+            }
+        }
+    };
+
+}
+
+#endif
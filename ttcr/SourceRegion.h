@@ -0,0 +1,95 @@
+//
+//  SourceRegion.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_SourceRegion_h
+#define ttcr_SourceRegion_h
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "ttcr_t.h"
+
+namespace ttcr {
+
+    /*
+     Source region refinement for the FMM and FSM.
+
+     The wavefront is strongly curved close to a source, and the first
+     order schemes are least accurate there; the error made in the first
+     cells then spreads to the whole grid.  Traveltimes at the nodes close
+     to the source are instead computed on a fine rectilinear grid of nodes
+     built around the source, and the solve on the coarse grid starts from
+     these nodes.
+
+     The fine grid has cells of size h and covers the cube of half-width
+     radius centered on Tx, clipped to [pmin, pmax].  slowness(pt) returns
+     the slowness of the coarse model at pt.  SUBGRID is a rectilinear grid
+     of nodes solved by fast sweeping (Grid3Drnfs).  pts must lie within
+     radius of Tx.
+     */
+    template<typename SUBGRID, typename T1, typename SLO>
+    void sourceRegionTraveltimes(const sxyz<T1>& Tx, const T1 t0,
+                                 const T1 radius, const T1 h,
+                                 const sxyz<T1>& pmin, const sxyz<T1>& pmax,
+                                 const SLO& slowness,
+                                 const std::vector<sxyz<T1>>& pts,
+                                 std::vector<T1>& tt) {
+        if ( pts.empty() ) {
+            tt.clear();
+            return;
+        }
+
+        sxyz<T1> lo, hi;
+        lo.x = std::max(pmin.x, Tx.x-radius-h);
+        lo.y = std::max(pmin.y, Tx.y-radius-h);
+        lo.z = std::max(pmin.z, Tx.z-radius-h);
+        hi.x = std::min(pmax.x, Tx.x+radius+h);
+        hi.y = std::min(pmax.y, Tx.y+radius+h);
+        hi.z = std::min(pmax.z, Tx.z+radius+h);
+
+        const size_t ncx = std::max(static_cast<size_t>(1), static_cast<size_t>(std::ceil((hi.x-lo.x)/h)));
+        const size_t ncy = std::max(static_cast<size_t>(1), static_cast<size_t>(std::ceil((hi.y-lo.y)/h)));
+        const size_t ncz = std::max(static_cast<size_t>(1), static_cast<size_t>(std::ceil((hi.z-lo.z)/h)));
+
+        SUBGRID grid(ncx, ncy, ncz, h, lo.x, lo.y, lo.z, 1.e-15, 20, false, 1);
+
+        // the last plane of nodes may fall outside the coarse model
+        std::vector<T1> s((ncx+1)*(ncy+1)*(ncz+1));
+        sxyz<T1> pt;
+        for ( size_t k=0; k<=ncz; ++k ) {
+            pt.z = std::min(pmax.z, lo.z + k*h);
+            for ( size_t j=0; j<=ncy; ++j ) {
+                pt.y = std::min(pmax.y, lo.y + j*h);
+                for ( size_t i=0; i<=ncx; ++i ) {
+                    pt.x = std::min(pmax.x, lo.x + i*h);
+                    s[(k*(ncy+1)+j)*(ncx+1)+i] = slowness(pt);
+                }
+            }
+        }
+        grid.setSlowness(s);
+
+        grid.raytrace(std::vector<sxyz<T1>>(1, Tx), std::vector<T1>(1, t0), pts, tt);
+    }
+
+}
+
+#endif
@@ -0,0 +1,253 @@
+//
+//  SparseMatrix.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_SparseMatrix_h
+#define ttcr_SparseMatrix_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ShotScheduler.h"
+#include "ttcr_t.h"
+
+namespace ttcr {
+
+    /*
+     Binary sensitivity matrix in compressed sparse row format.
+
+     The file starts with a 64 byte header (native byte order):
+
+     char[8]  magic        "ttcrCSR\0"
+     uint32   version      1
+     uint32   valueSize    4 (float) or 8 (double)
+     uint64   nRows        number of rows (receivers of all sources)
+     uint64   nCols        number of columns (nodes or cells)
+     uint64   nnz          number of non-zero terms
+     uint64   nShots       number of sources
+     uint64   reserved[2]
+
+     followed by indptr (nRows+1 int64), indices (nnz int64) and values
+     (nnz values), i.e. the arrays of scipy.sparse.csr_matrix.  Rows are
+     those of the receivers of the first source, then of the second, etc.;
+     columns of a row are in increasing order.
+     */
+
+    struct CSRHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t valueSize;
+        uint64_t nRows;
+        uint64_t nCols;
+        uint64_t nnz;
+        uint64_t nShots;
+        uint64_t reserved[2];
+    };
+    static_assert(sizeof(CSRHeader) == 64, "CSRHeader should be 64 bytes");
+
+    static const char CSRMagic[8] = { 't','t','c','r','C','S','R','\0' };
+
+    // Rows of l_data or m_data (one row per receiver), for one or several
+    // sources, to be assembled in CSR arrays.  Only pointers to the rows are
+    // kept.  Terms of siv and siv2 are in column i (siv2 also in column
+    // i+nCols/2 for its second value), terms of sijv are in column j.
+    template<typename S>
+    class CSRRows {
+    public:
+        CSRRows(const std::vector<std::vector<S>>& r) : rows() { add(r); }
+        CSRRows(const std::vector<std::vector<std::vector<S>>>& r) : rows() {
+            for ( size_t ns=0; ns<r.size(); ++ns ) add(r[ns]);
+        }
+
+        size_t size() const { return rows.size(); }
+
+        size_t nnz() const {
+            size_t n = 0;
+            for ( size_t nr=0; nr<rows.size(); ++nr ) n += nTerms(*rows[nr]);
+            return n;
+        }
+
+        // first column not used by the terms
+        size_t nCols() const {
+            size_t nc = 0;
+            for ( size_t nr=0; nr<rows.size(); ++nr ) {
+                for ( size_t n=0; n<rows[nr]->size(); ++n ) {
+                    nc = std::max(nc, column((*rows[nr])[n])+1);
+                }
+            }
+            return nc;
+        }
+
+        // Arrays are allocated by the caller: indptr holds size()+1 values,
+        // indices and values hold nnz() values.  Rows are filled in blocks by
+        // nThreads threads once offsets are known.
+        template<typename I, typename T>
+        void fill(I *indptr, I *indices, T *values, const size_t ncols,
+                  const size_t nThreads=1) const {
+            indptr[0] = 0;
+            for ( size_t nr=0; nr<rows.size(); ++nr ) {
+                indptr[nr+1] = indptr[nr] + static_cast<I>(nTerms(*rows[nr]));
+            }
+
+            const size_t blockSize = 256;
+            const size_t nBlocks = (rows.size()+blockSize-1)/blockSize;
+            std::vector<std::vector<std::pair<size_t,T>>> terms(nThreads>0 ? nThreads : 1);
+            ShotScheduler scheduler(nBlocks, nThreads);
+            scheduler.run( [&](const size_t nb, const size_t threadNo) {
+                std::vector<std::pair<size_t,T>>& row = terms[threadNo];
+                const size_t last = std::min(rows.size(), (nb+1)*blockSize);
+                for ( size_t nr=nb*blockSize; nr<last; ++nr ) {
+                    row.clear();
+                    for ( size_t n=0; n<rows[nr]->size(); ++n ) {
+                        addTerms((*rows[nr])[n], ncols, row);
+                    }
+                    if ( !std::is_sorted(row.begin(), row.end(), lessColumn<T>) ) {
+                        std::sort(row.begin(), row.end(), lessColumn<T>);
+                    }
+                    I k = indptr[nr];
+                    for ( size_t n=0; n<row.size(); ++n, ++k ) {
+                        indices[k] = static_cast<I>(row[n].first);
+                        values[k] = row[n].second;
+                    }
+                }
+            });
+        }
+
+    private:
+        std::vector<const std::vector<S>*> rows;
+
+        void add(const std::vector<std::vector<S>>& r) {
+            for ( size_t nr=0; nr<r.size(); ++nr ) rows.push_back( &(r[nr]) );
+        }
+
+        template<typename T>
+        static bool lessColumn(const std::pair<size_t,T>& a, const std::pair<size_t,T>& b) {
+            return a.first < b.first;
+        }
+
+        template<typename T>
+        static size_t nTerms(const std::vector<siv<T>>& r) { return r.size(); }
+        template<typename T>
+        static size_t nTerms(const std::vector<sijv<T>>& r) { return r.size(); }
+        template<typename T>
+        static size_t nTerms(const std::vector<siv2<T>>& r) { return 2*r.size(); }
+
+        template<typename T>
+        static size_t column(const siv<T>& s) { return s.i; }
+        template<typename T>
+        static size_t column(const sijv<T>& s) { return s.j; }
+        template<typename T>
+        static size_t column(const siv2<T>& s) { return 2*s.i+1; }
+
+        template<typename T, typename T2>
+        static void addTerms(const siv<T>& s, const size_t,
+                             std::vector<std::pair<size_t,T2>>& row) {
+            row.push_back( std::make_pair(s.i, static_cast<T2>(s.v)) );
+        }
+        template<typename T, typename T2>
+        static void addTerms(const sijv<T>& s, const size_t,
+                             std::vector<std::pair<size_t,T2>>& row) {
+            row.push_back( std::make_pair(s.j, static_cast<T2>(s.v)) );
+        }
+        template<typename T, typename T2>
+        static void addTerms(const siv2<T>& s, const size_t ncols,
+                             std::vector<std::pair<size_t,T2>>& row) {
+            row.push_back( std::make_pair(s.i, static_cast<T2>(s.v)) );
+            row.push_back( std::make_pair(s.i+ncols/2, static_cast<T2>(s.v2)) );
+        }
+    };
+
+    // Sensitivity matrix of all sources, rows of receivers of source 0
+    // first.  Holds the CSR arrays.
+    template<typename T1>
+    class CSRMatrix {
+    public:
+        CSRMatrix() : nShots(0), nCols(0), indptr(1, 0), indices(), values() {}
+
+        // rows[ns][nr]: row of receiver nr of source ns, as returned by
+        // raytrace.  The number of columns is at least ncols.
+        template<typename S>
+        void assemble(const std::vector<std::vector<std::vector<S>>>& rows,
+                      const size_t ncols, const size_t nThreads=1) {
+            CSRRows<S> r(rows);
+            nShots = rows.size();
+            nCols = std::max(ncols, r.nCols());
+            indptr.resize(r.size()+1);
+            indices.resize(r.nnz());
+            values.resize(indices.size());
+            r.fill(indptr.data(), indices.data(), values.data(), nCols, nThreads);
+        }
+
+        size_t getNrows() const { return indptr.size()-1; }
+        size_t getNcols() const { return nCols; }
+        size_t getNnz() const { return indices.size(); }
+        const std::vector<int64_t>& getIndptr() const { return indptr; }
+        const std::vector<int64_t>& getIndices() const { return indices; }
+        const std::vector<T1>& getValues() const { return values; }
+
+        void save(const std::string& filename, const bool single) const {
+            std::ofstream fout(filename, std::ios::out | std::ios::binary);
+            if ( !fout ) {
+                throw std::runtime_error("Cannot open file " + filename + " for writing.");
+            }
+            CSRHeader hdr;
+            std::memset(&hdr, 0, sizeof(hdr));
+            std::memcpy(hdr.magic, CSRMagic, 8);
+            hdr.version = 1;
+            hdr.valueSize = single ? sizeof(float) : sizeof(double);
+            hdr.nRows = getNrows();
+            hdr.nCols = nCols;
+            hdr.nnz = getNnz();
+            hdr.nShots = nShots;
+            fout.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+            fout.write(reinterpret_cast<const char*>(indptr.data()), indptr.size()*sizeof(int64_t));
+            fout.write(reinterpret_cast<const char*>(indices.data()), indices.size()*sizeof(int64_t));
+            if ( hdr.valueSize == sizeof(T1) ) {
+                fout.write(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(T1));
+            } else if ( single ) {
+                std::vector<float> buffer(values.begin(), values.end());
+                fout.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()*sizeof(float));
+            } else {
+                std::vector<double> buffer(values.begin(), values.end());
+                fout.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()*sizeof(double));
+            }
+            if ( !fout ) {
+                throw std::runtime_error("Error writing " + filename + ".");
+            }
+            fout.close();
+        }
+
+    private:
+        size_t nShots;
+        size_t nCols;
+        std::vector<int64_t> indptr;
+        std::vector<int64_t> indices;
+        std::vector<T1> values;
+    };
+
+}
+
+#endif
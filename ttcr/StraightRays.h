@@ -0,0 +1,217 @@
+//
+//  StraightRays.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_StraightRays_h
+#define ttcr_StraightRays_h
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "ShotScheduler.h"
+
+namespace ttcr {
+
+    // Matrix of the lengths of straight rays in the cells of a rectilinear
+    // grid, in CSR format.  Node coordinates are given along x and z (2D) or
+    // x, y and z (3D), in increasing order; cells are numbered with z
+    // fastest, i.e. ix*nCz + iz in 2D and (ix*nCy + iy)*nCz + iz in 3D.
+    // Tx and Rx hold the coordinates of one pair per row (C order).
+    //
+    // Cells crossed by a ray are visited in order with the traversal of
+    // Amanatides & Woo (1987), starting from a cell found by binary search,
+    // and the part of the ray outside the grid is ignored.  With aniso, the
+    // lengths projected on each axis are given instead, in columns
+    // cell + k*nCells for axis k, for the axes along which the ray extends.
+    template<typename T>
+    class StraightRays {
+    public:
+        StraightRays(const T* grx, const size_t n_grx,
+                     const T* grz, const size_t n_grz) : ndim(2) {
+            gr[0] = grx; n[0] = n_grx;
+            gr[1] = grz; n[1] = n_grz;
+            gr[2] = nullptr; n[2] = 2;
+        }
+
+        StraightRays(const T* grx, const size_t n_grx,
+                     const T* gry, const size_t n_gry,
+                     const T* grz, const size_t n_grz) : ndim(3) {
+            gr[0] = grx; n[0] = n_grx;
+            gr[1] = gry; n[1] = n_gry;
+            gr[2] = grz; n[2] = n_grz;
+        }
+
+        size_t getNcells() const { return (n[0]-1)*(n[1]-1)*(n[2]-1); }
+        size_t getNcols(const bool aniso) const {
+            return aniso ? ndim*getNcells() : getNcells();
+        }
+
+        // Two passes over the rays, shared by nThreads threads: the number
+        // of terms of each row is counted first, so that the caller can
+        // allocate indices and values exactly, and the rows are then filled.
+        template<typename I>
+        size_t count(const T* Tx, const T* Rx, const size_t nTx,
+                     const bool aniso, I* indptr, const size_t nThreads=1) const {
+            indptr[0] = 0;
+            forBlocks(nTx, nThreads, [&](const size_t nr) {
+                size_t nt = 0;
+                ray(Tx, Rx, nr, aniso, [&nt](const size_t, const T) { ++nt; });
+                indptr[nr+1] = static_cast<I>(nt);
+            });
+            for ( size_t nr=0; nr<nTx; ++nr ) {
+                indptr[nr+1] += indptr[nr];
+            }
+            return static_cast<size_t>(indptr[nTx]);
+        }
+
+        template<typename I, typename V>
+        void fill(const T* Tx, const T* Rx, const size_t nTx, const bool aniso,
+                  const I* indptr, I* indices, V* values,
+                  const size_t nThreads=1) const {
+            forBlocks(nTx, nThreads, [&](const size_t nr) {
+                I k = indptr[nr];
+                ray(Tx, Rx, nr, aniso, [&](const size_t col, const T v) {
+                    indices[k] = static_cast<I>(col);
+                    values[k] = static_cast<V>(v);
+                    ++k;
+                });
+            });
+        }
+
+    private:
+        const size_t ndim;
+        const T* gr[3];
+        size_t n[3];
+
+        template<typename F>
+        static void forBlocks(const size_t nTx, const size_t nThreads, F f) {
+            const size_t blockSize = 1024;
+            const size_t nBlocks = (nTx+blockSize-1)/blockSize;
+            ShotScheduler scheduler(nBlocks, std::min(nThreads, nBlocks));
+            scheduler.run( [&](const size_t nb, const size_t) {
+                const size_t last = std::min(nTx, (nb+1)*blockSize);
+                for ( size_t nr=nb*blockSize; nr<last; ++nr ) f(nr);
+            });
+        }
+
+        // call term(column, value) for the cells crossed by ray nr
+        template<typename F>
+        void ray(const T* Tx, const T* Rx, const size_t nr, const bool aniso,
+                 F term) const {
+            if ( ndim == 2 ) traverse<2>(Tx+2*nr, Rx+2*nr, aniso, term);
+            else traverse<3>(Tx+3*nr, Rx+3*nr, aniso, term);
+        }
+
+        template<size_t ND, typename F>
+        void traverse(const T* Tx, const T* Rx, const bool aniso, F term) const {
+            const T small = 1.e-10;
+            const T inf = std::numeric_limits<T>::infinity();
+
+            T d[ND], len = 0.0;
+            for ( size_t k=0; k<ND; ++k ) {
+                d[k] = Rx[k] - Tx[k];
+                len += d[k]*d[k];
+            }
+            len = std::sqrt(len);
+            if ( len < small ) return;
+
+            // part of the ray within the grid, for t in [t0, t1]
+            T t0 = 0.0, t1 = 1.0;
+            T invd[ND];
+            for ( size_t k=0; k<ND; ++k ) {
+                const T lo = gr[k][0];
+                const T hi = gr[k][n[k]-1];
+                if ( std::abs(d[k]) < small ) {
+                    if ( Tx[k] < lo || Tx[k] > hi ) return;
+                    d[k] = 0.0;
+                    invd[k] = 0.0;
+                    continue;
+                }
+                invd[k] = 1.0/d[k];
+                T ta = (lo - Tx[k])*invd[k];
+                T tb = (hi - Tx[k])*invd[k];
+                if ( ta > tb ) std::swap(ta, tb);
+                t0 = std::max(t0, ta);
+                t1 = std::min(t1, tb);
+            }
+            if ( t1 - t0 <= small/len ) return;
+
+            // starting cell, going to the lower cell on a node moving
+            // backward; the cell index is then updated with strides
+            size_t i[ND];
+            T tMax[ND];
+            size_t stride[ND], cell = 0;
+            stride[ND-1] = 1;
+            for ( size_t k=ND-1; k>0; --k ) stride[k-1] = stride[k]*(n[k]-1);
+            for ( size_t k=0; k<ND; ++k ) {
+                const T p = Tx[k] + t0*d[k];
+                const T* g = d[k] < 0.0 ?
+                std::lower_bound(gr[k], gr[k]+n[k], p) :
+                std::upper_bound(gr[k], gr[k]+n[k], p);
+                i[k] = g == gr[k] ? 0 : static_cast<size_t>(g-gr[k]) - 1;
+                i[k] = std::min(i[k], n[k]-2);
+                cell += i[k]*stride[k];
+                if ( d[k] > 0.0 ) tMax[k] = (gr[k][i[k]+1] - Tx[k])*invd[k];
+                else if ( d[k] < 0.0 ) tMax[k] = (gr[k][i[k]] - Tx[k])*invd[k];
+                else tMax[k] = inf;
+            }
+
+            const size_t nCells = getNcells();
+            T t = t0;
+            while ( t1 - t > small/len ) {
+                T tNext = t1;
+                for ( size_t k=0; k<ND; ++k ) tNext = std::min(tNext, tMax[k]);
+
+                const T dt = tNext - t;
+                if ( dt*len > small ) {
+                    if ( aniso ) {
+                        for ( size_t k=0; k<ND; ++k ) {
+                            if ( d[k] != 0.0 ) term(cell + k*nCells, dt*std::abs(d[k]));
+                        }
+                    } else {
+                        term(cell, dt*len);
+                    }
+                }
+                if ( tNext >= t1 ) break;
+
+                // cross all the faces reached at tNext (edges & corners)
+                for ( size_t k=0; k<ND; ++k ) {
+                    if ( tMax[k] > tNext ) continue;
+                    if ( d[k] > 0.0 ) {
+                        if ( ++i[k] == n[k]-1 ) return;
+                        cell += stride[k];
+                        tMax[k] = (gr[k][i[k]+1] - Tx[k])*invd[k];
+                    } else {
+                        if ( i[k] == 0 ) return;
+                        --i[k];
+                        cell -= stride[k];
+                        tMax[k] = (gr[k][i[k]] - Tx[k])*invd[k];
+                    }
+                }
+                t = tNext;
+            }
+        }
+    };
+
+}
+
+#endif
@@ -0,0 +1,231 @@
+//
+//  TTtable.h
+//  ttcr
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef ttcr_TTtable_h
+#define ttcr_TTtable_h
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+namespace ttcr {
+
+    /*
+     Binary table of traveltimes at receivers, for all sources.
+
+     The file starts with a 64 byte header (native byte order):
+
+     char[8]  magic        "ttcrTT\0\0"
+     uint32   version      1
+     uint32   valueSize    4 (float) or 8 (double)
+     uint64   nShots       number of sources
+     uint64   nComp        number of traveltimes per receiver (direct wave
+                           followed by reflected waves)
+     uint64   nRcv         number of receivers
+     uint64   dataOffset   position of the first shot block
+     uint64   tableOffset  position of the table of shot offsets, 0 if none
+     uint64   reserved
+
+     Each shot is stored in a block of nComp*nRcv values, component by
+     component.  Without table, blocks are contiguous and in shot order;
+     otherwise shot ns starts at byte tableOffset[ns] (uint64 table of
+     nShots entries), which allows shots to be written as they complete.
+     */
+
+    struct TTtableHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t valueSize;
+        uint64_t nShots;
+        uint64_t nComp;
+        uint64_t nRcv;
+        uint64_t dataOffset;
+        uint64_t tableOffset;
+        uint64_t reserved;
+    };
+    static_assert(sizeof(TTtableHeader) == 64, "TTtableHeader should be 64 bytes");
+
+    static const char TTtableMagic[8] = { 't','t','c','r','T','T','\0','\0' };
+
+    // Writes shot blocks in the order write() is called; the table of
+    // offsets is appended at close() only if shots were not written in order.
+    class TTtableWriter {
+    public:
+        TTtableWriter(const std::string& filename, const size_t ns,
+                      const size_t nc, const size_t nr, const bool single) :
+        fout(filename, std::ios::out | std::ios::binary), hdr(),
+        offsets(ns, 0), nWritten(0), inOrder(true)
+        {
+            if ( !fout ) {
+                throw std::runtime_error("Cannot open file " + filename + " for writing.");
+            }
+            std::memcpy(hdr.magic, TTtableMagic, 8);
+            hdr.version = 1;
+            hdr.valueSize = single ? sizeof(float) : sizeof(double);
+            hdr.nShots = ns;
+            hdr.nComp = nc;
+            hdr.nRcv = nr;
+            hdr.dataOffset = sizeof(TTtableHeader);
+            fout.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+        }
+
+        ~TTtableWriter() {
+            if ( fout.is_open() ) {
+                try { close(); } catch (...) {}
+            }
+        }
+
+        // tt[nc][nr]: traveltimes of shot ns
+        template<typename T>
+        void write(const size_t ns, const std::vector<std::vector<T>>& tt) {
+            if ( ns >= hdr.nShots || tt.size() != hdr.nComp ) {
+                throw std::runtime_error("Error: inconsistent shot in traveltime table.");
+            }
+            if ( ns != nWritten ) inOrder = false;
+            offsets[ns] = fout.tellp();
+            for ( size_t nc=0; nc<tt.size(); ++nc ) {
+                if ( tt[nc].size() != hdr.nRcv ) {
+                    throw std::runtime_error("Error: inconsistent number of receivers in traveltime table.");
+                }
+                if ( hdr.valueSize == sizeof(T) ) {
+                    fout.write(reinterpret_cast<const char*>(tt[nc].data()), hdr.nRcv*sizeof(T));
+                } else if ( hdr.valueSize == sizeof(float) ) {
+                    std::vector<float> buffer(tt[nc].begin(), tt[nc].end());
+                    fout.write(reinterpret_cast<const char*>(buffer.data()), hdr.nRcv*sizeof(float));
+                } else {
+                    std::vector<double> buffer(tt[nc].begin(), tt[nc].end());
+                    fout.write(reinterpret_cast<const char*>(buffer.data()), hdr.nRcv*sizeof(double));
+                }
+            }
+            nWritten++;
+        }
+
+        void close() {
+            if ( nWritten != hdr.nShots ) {
+                fout.close();
+                throw std::runtime_error("Error: traveltime table incomplete.");
+            }
+            if ( !inOrder ) {
+                hdr.tableOffset = fout.tellp();
+                fout.write(reinterpret_cast<const char*>(offsets.data()),
+                           offsets.size()*sizeof(uint64_t));
+                fout.seekp(0);
+                fout.write(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+            }
+            fout.close();
+        }
+
+    private:
+        std::ofstream fout;
+        TTtableHeader hdr;
+        std::vector<uint64_t> offsets;
+        size_t nWritten;
+        bool inOrder;
+    };
+
+    // tt[ns][nc][nr], as held by Rcv and Rcv2D
+    template<typename T>
+    void saveTTtable(const std::string& filename,
+                     const std::vector<std::vector<std::vector<T>>>& tt,
+                     const bool single) {
+        size_t nc = tt.empty() ? 0 : tt[0].size();
+        size_t nr = nc == 0 ? 0 : tt[0][0].size();
+        TTtableWriter table(filename, tt.size(), nc, nr, single);
+        for ( size_t ns=0; ns<tt.size(); ++ns ) {
+            table.write(ns, tt[ns]);
+        }
+        table.close();
+    }
+
+    // Read-only access to a traveltime table mapped in memory: the values
+    // are used in place, nothing is read until it is accessed.
+    class TTtableReader {
+    public:
+        TTtableReader(const std::string& filename) : file(filename), hdr(),
+        base(file.data()), length(file.size())
+        {
+            if ( length < sizeof(TTtableHeader) ) {
+                throw std::runtime_error("Error: " + filename + " is not a traveltime table.");
+            }
+            std::memcpy(&hdr, base, sizeof(hdr));
+            if ( std::memcmp(hdr.magic, TTtableMagic, 8) != 0 || hdr.version != 1 ||
+                 (hdr.valueSize != sizeof(float) && hdr.valueSize != sizeof(double)) ||
+                 !inFile(hdr.tableOffset, hdr.tableOffset==0 ? 0 : hdr.nShots*sizeof(uint64_t)) ) {
+                throw std::runtime_error("Error: " + filename + " is not a valid traveltime table.");
+            }
+            for ( size_t ns=0; ns<hdr.nShots; ++ns ) {
+                if ( !inFile(getOffset(ns), hdr.nComp*hdr.nRcv*hdr.valueSize) ) {
+                    throw std::runtime_error("Error: traveltime table " + filename + " is truncated.");
+                }
+            }
+        }
+
+        size_t getNshots() const { return hdr.nShots; }
+        size_t getNcomp() const { return hdr.nComp; }
+        size_t getNrcv() const { return hdr.nRcv; }
+        bool isSinglePrecision() const { return hdr.valueSize == sizeof(float); }
+
+        // pointer to the nRcv traveltimes of component nc of shot ns; T must
+        // match the precision of the file
+        template<typename T>
+        const T* data(const size_t ns, const size_t nc=0) const {
+            if ( sizeof(T) != hdr.valueSize ) {
+                throw std::runtime_error("Error: precision of traveltime table does not match.");
+            }
+            return reinterpret_cast<const T*>(base + getOffset(ns)) + nc*hdr.nRcv;
+        }
+
+        double operator()(const size_t ns, const size_t nr, const size_t nc=0) const {
+            const char *p = base + getOffset(ns);
+            if ( hdr.valueSize == sizeof(float) ) {
+                return reinterpret_cast<const float*>(p)[nc*hdr.nRcv + nr];
+            }
+            return reinterpret_cast<const double*>(p)[nc*hdr.nRcv + nr];
+        }
+
+    private:
+        MappedFile file;
+        TTtableHeader hdr;
+        const char *base;
+        size_t length;
+
+        uint64_t getOffset(const size_t ns) const {
+            if ( hdr.tableOffset == 0 ) {
+                return hdr.dataOffset + ns*hdr.nComp*hdr.nRcv*hdr.valueSize;
+            }
+            uint64_t off;
+            std::memcpy(&off, base + hdr.tableOffset + ns*sizeof(uint64_t), sizeof(off));
+            return off;
+        }
+
+        bool inFile(const uint64_t off, const uint64_t size) const {
+            return off <= length && size <= length - off;
+        }
+    };
+
+}
+
+#endif
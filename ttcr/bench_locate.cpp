@@ -0,0 +1,141 @@
+//
+//  bench_locate.cpp
+//  ttcr
+//
+//  Point location cost on tetrahedral meshes: linear scan over all cells
+//  vs CellLocator3D bucket grid, for meshes of increasing size.
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "CellLocator3D.h"
+
+using namespace std;
+using namespace ttcr;
+
+// structured cube of side 1 with n^3 voxels, each split in 6 tetrahedra
+void buildMesh(const size_t n, vector<sxyz<double>>& nodes,
+               vector<tetrahedronElem<uint32_t>>& tet) {
+    double h = 1.0/n;
+    nodes.clear();
+    tet.clear();
+    for ( size_t k=0; k<=n; ++k )
+        for ( size_t j=0; j<=n; ++j )
+            for ( size_t i=0; i<=n; ++i )
+                nodes.push_back( sxyz<double>(i*h, j*h, k*h) );
+
+    auto ind = [n](size_t i, size_t j, size_t k) {
+        return static_cast<uint32_t>((k*(n+1)+j)*(n+1)+i); };
+    const size_t split[6][4] = { {0,1,2,6}, {0,2,3,6}, {0,3,7,6},
+        {0,7,4,6}, {0,4,5,6}, {0,5,1,6} };
+    for ( size_t k=0; k<n; ++k ) {
+        for ( size_t j=0; j<n; ++j ) {
+            for ( size_t i=0; i<n; ++i ) {
+                uint32_t v[8] = { ind(i,j,k), ind(i+1,j,k), ind(i+1,j+1,k), ind(i,j+1,k),
+                    ind(i,j,k+1), ind(i+1,j,k+1), ind(i+1,j+1,k+1), ind(i,j+1,k+1) };
+                for ( size_t t=0; t<6; ++t )
+                    tet.push_back( tetrahedronElem<uint32_t>(v[split[t][0]], v[split[t][1]],
+                                                             v[split[t][2]], v[split[t][3]]) );
+            }
+        }
+    }
+}
+
+bool inside(const sxyz<double>& p, const vector<sxyz<double>>& nodes,
+            const tetrahedronElem<uint32_t>& t) {
+    double D0 = det4(nodes[t.i[0]], nodes[t.i[1]], nodes[t.i[2]], nodes[t.i[3]]);
+    double D1 = det4(p, nodes[t.i[1]], nodes[t.i[2]], nodes[t.i[3]]);
+    double D2 = det4(nodes[t.i[0]], p, nodes[t.i[2]], nodes[t.i[3]]);
+    double D3 = det4(nodes[t.i[0]], nodes[t.i[1]], p, nodes[t.i[3]]);
+    double D4 = det4(nodes[t.i[0]], nodes[t.i[1]], nodes[t.i[2]], p);
+    return D0*D1 >= 0 && D0*D2 >= 0 && D0*D3 >= 0 && D0*D4 >= 0;
+}
+
+int main(int argc, char * argv[]) {
+
+    size_t nPts = argc>1 ? atoi(argv[1]) : 1000;
+
+    mt19937 gen(1);
+    uniform_real_distribution<double> dis(0.0, 1.0);
+    vector<sxyz<double>> pts(nPts);
+    for ( size_t n=0; n<nPts; ++n )
+        pts[n] = sxyz<double>(dis(gen), dis(gen), dis(gen));
+
+    cout << "# " << nPts << " random points\n"
+    << "# ncells  t_build [s]  t_linear [s/pt]  t_bucket [s/pt]  mem_index [B]\n";
+
+    for ( size_t n=8; n<=64; n*=2 ) {
+        vector<sxyz<double>> nodes;
+        vector<tetrahedronElem<uint32_t>> tet;
+        buildMesh(n, nodes, tet);
+
+        auto t0 = chrono::high_resolution_clock::now();
+        CellLocator3D<double,uint32_t> locator;
+        locator.build(nodes, tet);
+        auto t1 = chrono::high_resolution_clock::now();
+
+        // linear scan is too slow on large meshes, use a subset of points
+        size_t nLin = nPts < 20000/n ? nPts : 20000/n;
+        vector<uint32_t> cLin(nLin);
+        auto t2 = chrono::high_resolution_clock::now();
+        for ( size_t np=0; np<nLin; ++np ) {
+            cLin[np] = numeric_limits<uint32_t>::max();
+            for ( uint32_t nt=0; nt<tet.size(); ++nt ) {
+                if ( inside(pts[np], nodes, tet[nt]) ) {
+                    cLin[np] = nt;
+                    break;
+                }
+            }
+        }
+        auto t3 = chrono::high_resolution_clock::now();
+
+        vector<uint32_t> cBkt(nPts);
+        for ( size_t np=0; np<nPts; ++np ) {
+            cBkt[np] = numeric_limits<uint32_t>::max();
+            auto range = locator.getCandidates(pts[np]);
+            for ( auto nc=range.first; nc!=range.second; ++nc ) {
+                if ( inside(pts[np], nodes, tet[*nc]) ) {
+                    cBkt[np] = *nc;
+                    break;
+                }
+            }
+        }
+        auto t4 = chrono::high_resolution_clock::now();
+
+        for ( size_t np=0; np<nLin; ++np ) {
+            if ( cLin[np] != cBkt[np] ) {
+                cerr << "Error: cell mismatch for point " << np << '\n';
+                return 1;
+            }
+        }
+
+        cout << tet.size() << ' '
+        << chrono::duration<double>(t1-t0).count() << ' '
+        << chrono::duration<double>(t3-t2).count()/nLin << ' '
+        << chrono::duration<double>(t4-t3).count()/nPts << ' '
+        << locator.getSize() << '\n';
+    }
+    return 0;
+}
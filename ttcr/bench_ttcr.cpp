@@ -0,0 +1,548 @@
+//
+//  bench_ttcr.cpp
+//  ttcr
+//
+//  Cost and accuracy of the raytracing methods on synthetic models, for the
+//  node- and cell-based classes on rectilinear grids and on triangular and
+//  tetrahedral meshes.  Traveltimes are compared to analytic solutions and
+//  results are written in CSV format, one line per grid class and model.
+//
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <unistd.h>         // for getopt and sysconf
+#ifdef __GLIBC__
+#include <malloc.h>         // for malloc_trim
+#endif
+}
+
+#include "Cell.h"
+#include "Grid2Drcfs.h"
+#include "Grid2Drcsp.h"
+#include "Grid2Drnfs.h"
+#include "Grid2Drnsp.h"
+#include "Grid2Ducfm.h"
+#include "Grid2Ducfs.h"
+#include "Grid2Ducsp.h"
+#include "Grid2Dunfm.h"
+#include "Grid2Dunfs.h"
+#include "Grid2Dunsp.h"
+#include "Grid3Drcfs.h"
+#include "Grid3Drcsp.h"
+#include "Grid3Drnfs.h"
+#include "Grid3Drnsp.h"
+#include "Grid3Ducfm.h"
+#include "Grid3Ducfs.h"
+#include "Grid3Ducsp.h"
+#include "Grid3Dunfm.h"
+#include "Grid3Dunfs.h"
+#include "Grid3Dunsp.h"
+#include "Node2Dcsp.h"
+#include "Node2Dnsp.h"
+#include "ShotScheduler.h"
+
+using namespace std;
+using namespace ttcr;
+
+typedef chrono::high_resolution_clock Clock;
+
+// Models fill a square or a cube of side L, with z positive downward
+enum Model { CONSTANT, GRADIENT, CHECKERBOARD, LAYER, N_MODELS };
+const char* modelName[N_MODELS] = { "constant", "gradient", "checkerboard", "layer" };
+
+const double L = 10.0;
+const double v0 = 2.0;          // velocity at the top
+const double grad = 0.5;        // vertical velocity gradient
+const double dv = 0.25;         // relative perturbation of the checkerboard
+const double block = 0.2*L;     // side of the checkerboard blocks
+const double zi = 0.5*L;        // depth of the interface of the layer model
+const double v2 = 6.0;          // velocity below the interface
+
+double velocity(const Model m, const double x, const double y, const double z) {
+    switch (m) {
+        case GRADIENT:
+            return v0 + grad*z;
+        case CHECKERBOARD: {
+            long p = lround(floor(x/block) + floor(y/block) + floor(z/block));
+            return p%2 == 0 ? v0*(1.0+dv) : v0*(1.0-dv);
+        }
+        case LAYER:
+            return z < zi ? v0 : v2;
+        default:
+            return v0;
+    }
+}
+
+// First-arrival traveltime from s to r, NaN if no analytic solution exists
+double analytic(const Model m, const sxyz<double>& s, const sxyz<double>& r) {
+    const double D = hypot(r.x-s.x, r.y-s.y);   // horizontal offset
+    const double dist = hypot(D, r.z-s.z);
+    switch (m) {
+        case CONSTANT:
+            return dist/v0;
+        case GRADIENT: {
+            double vs = v0 + grad*s.z;
+            double vr = v0 + grad*r.z;
+            return acosh(1.0 + grad*grad*dist*dist/(2.0*vs*vr))/grad;
+        }
+        case LAYER: {
+            const double hs = abs(zi-s.z);
+            const double hr = abs(zi-r.z);
+            const double ss = 1.0/velocity(m, s.x, s.y, s.z);
+            if ( (s.z < zi) == (r.z < zi) ) {
+                // direct wave, or head wave if the other layer is faster
+                double t = ss*dist;
+                const double so = s.z < zi ? 1.0/v2 : 1.0/v0;
+                if ( so < ss ) {
+                    const double c = sqrt(ss*ss - so*so);
+                    if ( D*c >= (hs+hr)*so ) t = min(t, so*D + (hs+hr)*c);
+                }
+                return t;
+            }
+            // transmitted wave: the crossing point at offset u from the
+            // source satisfies Snell's law, found by bisection
+            const double sr = 1.0/velocity(m, r.x, r.y, r.z);
+            double a = 0.0, b = D;
+            for ( size_t n=0; n<100; ++n ) {
+                double u = 0.5*(a+b);
+                if ( ss*u/hypot(u, hs) > sr*(D-u)/hypot(D-u, hr) ) b = u;
+                else a = u;
+            }
+            const double u = 0.5*(a+b);
+            return ss*hypot(u, hs) + sr*hypot(D-u, hr);
+        }
+        default:
+            return numeric_limits<double>::quiet_NaN();
+    }
+}
+
+sxyz<double> toXYZ(const sxz<double>& p) { return sxyz<double>(p.x, 0.0, p.z); }
+sxyz<double> toXYZ(const sxyz<double>& p) { return p; }
+
+// resident set size in bytes, 0 where /proc is not available; memory freed
+// by the previous grids is first given back to the system where possible
+size_t residentMemory() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    ifstream fin("/proc/self/statm");
+    size_t pages, resident;
+    if ( fin >> pages >> resident ) {
+        return resident*static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+}
+
+// node slowness, and cell slowness at the centre of the cells, on a grid of
+// n cells of side L/n per dimension; nodes & cells are numbered with z
+// fastest in 2D and x fastest in 3D, as in the rectilinear grids
+void buildSlowness2D(const Model m, const size_t n, vector<double>& sn,
+                     vector<double>& sc) {
+    const double d = L/n;
+    sn.clear();
+    sc.clear();
+    for ( size_t i=0; i<=n; ++i )
+        for ( size_t k=0; k<=n; ++k )
+            sn.push_back( 1.0/velocity(m, i*d, 0.0, k*d) );
+    for ( size_t i=0; i<n; ++i )
+        for ( size_t k=0; k<n; ++k )
+            sc.push_back( 1.0/velocity(m, (i+0.5)*d, 0.0, (k+0.5)*d) );
+}
+
+void buildSlowness3D(const Model m, const size_t n, vector<double>& sn,
+                     vector<double>& sc) {
+    const double d = L/n;
+    sn.clear();
+    sc.clear();
+    for ( size_t k=0; k<=n; ++k )
+        for ( size_t j=0; j<=n; ++j )
+            for ( size_t i=0; i<=n; ++i )
+                sn.push_back( 1.0/velocity(m, i*d, j*d, k*d) );
+    for ( size_t k=0; k<n; ++k )
+        for ( size_t j=0; j<n; ++j )
+            for ( size_t i=0; i<n; ++i )
+                sc.push_back( 1.0/velocity(m, (i+0.5)*d, (j+0.5)*d, (k+0.5)*d) );
+}
+
+// the nodes of the rectilinear grid, each square split in 2 triangles
+void buildMesh2D(const size_t n, vector<sxz<double>>& nodes,
+                 vector<triangleElem<uint32_t>>& tri) {
+    const double d = L/n;
+    nodes.clear();
+    tri.clear();
+    for ( size_t i=0; i<=n; ++i )
+        for ( size_t k=0; k<=n; ++k )
+            nodes.push_back( sxz<double>(i*d, k*d) );
+
+    auto ind = [n](size_t i, size_t k) { return static_cast<uint32_t>(i*(n+1)+k); };
+    for ( size_t i=0; i<n; ++i ) {
+        for ( size_t k=0; k<n; ++k ) {
+            tri.push_back( triangleElem<uint32_t>(ind(i,k), ind(i+1,k), ind(i+1,k+1)) );
+            tri.push_back( triangleElem<uint32_t>(ind(i,k), ind(i+1,k+1), ind(i,k+1)) );
+        }
+    }
+}
+
+// the nodes of the rectilinear grid, each cube split in 6 tetrahedra
+void buildMesh3D(const size_t n, vector<sxyz<double>>& nodes,
+                 vector<tetrahedronElem<uint32_t>>& tet) {
+    const double d = L/n;
+    nodes.clear();
+    tet.clear();
+    for ( size_t k=0; k<=n; ++k )
+        for ( size_t j=0; j<=n; ++j )
+            for ( size_t i=0; i<=n; ++i )
+                nodes.push_back( sxyz<double>(i*d, j*d, k*d) );
+
+    auto ind = [n](size_t i, size_t j, size_t k) {
+        return static_cast<uint32_t>((k*(n+1)+j)*(n+1)+i); };
+    const size_t split[6][4] = { {0,1,2,6}, {0,2,3,6}, {0,3,7,6},
+        {0,7,4,6}, {0,4,5,6}, {0,5,1,6} };
+    for ( size_t k=0; k<n; ++k ) {
+        for ( size_t j=0; j<n; ++j ) {
+            for ( size_t i=0; i<n; ++i ) {
+                uint32_t v[8] = { ind(i,j,k), ind(i+1,j,k), ind(i+1,j+1,k), ind(i,j+1,k),
+                    ind(i,j,k+1), ind(i+1,j,k+1), ind(i+1,j+1,k+1), ind(i,j+1,k+1) };
+                for ( size_t t=0; t<6; ++t )
+                    tet.push_back( tetrahedronElem<uint32_t>(v[split[t][0]], v[split[t][1]],
+                                                             v[split[t][2]], v[split[t][3]]) );
+            }
+        }
+    }
+}
+
+// slowness of the cells of a mesh, at their centroid
+template<typename S, typename E>
+vector<double> cellSlowness(const Model m, const vector<S>& nodes,
+                            const vector<E>& elem, const size_t nv) {
+    vector<double> sc(elem.size());
+    for ( size_t n=0; n<elem.size(); ++n ) {
+        sxyz<double> c;
+        for ( size_t v=0; v<nv; ++v ) {
+            sxyz<double> p = toXYZ(nodes[elem[n].i[v]]);
+            c.x += p.x/nv;
+            c.y += p.y/nv;
+            c.z += p.z/nv;
+        }
+        sc[n] = 1.0/velocity(m, c.x, c.y, c.z);
+    }
+    return sc;
+}
+
+struct options {
+    size_t n2d;         // number of cells along each side, in 2D
+    size_t n3d;         //   and in 3D
+    size_t nsec;        // number of secondary nodes (SPM)
+    size_t nRcv;
+    size_t nSrc;
+    size_t nThreads;
+    int dim;            // 2 or 3 for 2D or 3D only, 0 for both
+    double epsilon;     // convergence criterion (FSM)
+    int nitermax;       // max number of sweeping iterations (FSM)
+    options() : n2d(50), n3d(15), nsec(3), nRcv(100), nSrc(4), nThreads(1),
+    dim(0), epsilon(1.e-15), nitermax(20) {}
+};
+
+void print_usage(ostream& stream, char *progname, int exit_code) {
+    stream << "\n *** " << progname << " - Benchmark of the grid classes ***\n\n";
+    stream << "Usage: " << progname << " [options]\n";
+    stream << "  -h       print this message\n"
+    << "  -n N     number of cells along each side of 2D models (50)\n"
+    << "  -m N     number of cells along each side of 3D models (15)\n"
+    << "  -s N     number of secondary nodes for the shortest path method (3)\n"
+    << "  -r N     number of receivers (100)\n"
+    << "  -x N     number of sources (4)\n"
+    << "  -t N     number of threads (1)\n"
+    << "  -d 2|3   run only the 2D or 3D grids\n"
+    << "  -o file  write the report in file instead of the standard output\n"
+    << endl;
+    exit(exit_code);
+}
+
+// A grid class to benchmark: build() returns the grid with its slowness
+// set, and niter tells if the grid keeps its number of sweeping iterations
+template<typename G>
+struct Case {
+    string grid;
+    string method;
+    bool niter;
+    function<G*()> build;
+};
+
+// Builds the grid, computes traveltimes for all sources with the thread
+// pool, and writes one line of the report.
+template<typename G, typename S>
+void run(ostream& os, const int dim, const Case<G>& c, const Model m,
+         const vector<S>& src, const vector<S>& rcv, const size_t nThreads) {
+
+    const size_t mem0 = residentMemory();
+    vector<vector<double>> tt(src.size());
+    unique_ptr<G> g;
+    Clock::time_point t0, t1, t2;
+    try {
+        t0 = Clock::now();
+        g.reset( c.build() );
+        t1 = Clock::now();
+        ShotScheduler scheduler(src.size(), min(nThreads, src.size()));
+        scheduler.run( [&](const size_t ns, const size_t threadNo) {
+            vector<S> Tx(1, src[ns]);
+            vector<double> tTx(1, 0.0);
+            g->raytrace(Tx, tTx, rcv, tt[ns], threadNo);
+        });
+        t2 = Clock::now();
+    } catch (exception& e) {
+        cerr << c.grid << ", " << modelName[m] << ": " << e.what() << '\n';
+        return;
+    }
+    const size_t mem1 = residentMemory();
+
+    double rms = 0.0, maxErr = 0.0;
+    size_t nErr = 0;
+    for ( size_t ns=0; ns<src.size(); ++ns ) {
+        for ( size_t nr=0; nr<rcv.size(); ++nr ) {
+            double ta = analytic(m, toXYZ(src[ns]), toXYZ(rcv[nr]));
+            if ( std::isnan(ta) ) continue;
+            double err = tt[ns][nr] - ta;
+            rms += err*err;
+            maxErr = max(maxErr, abs(err));
+            ++nErr;
+        }
+    }
+    rms = sqrt(rms/nErr);
+    if ( nErr == 0 || std::isnan(rms) ) {
+        rms = maxErr = numeric_limits<double>::quiet_NaN();
+    }
+
+    const Instrumentation& instr = g->getInstrumentation();
+    os << dim << "D," << c.grid << ',' << c.method << ',' << modelName[m] << ','
+    << g->getNumberOfNodes() << ',' << g->getNumberOfCells() << ',' << nThreads << ','
+    << chrono::duration<double>(t1-t0).count() << ','
+    << chrono::duration<double>(t2-t1).count() << ','
+    << (mem1 > mem0 ? mem1-mem0 : 0) << ','
+    << (c.niter ? to_string(g->get_niter()) : "") << ','
+    << instr.getCount(QUEUE_POP) << ',' << instr.getCount(LOCAL_UPDATE) << ','
+    << rms << ',' << maxErr << endl;
+}
+
+void bench2D(ostream& os, const options& opt, const vector<sxz<double>>& src,
+             const vector<sxz<double>>& rcv) {
+    typedef Grid2D<double,uint32_t,sxz<double>> G;
+    typedef Cell<double,Node2Dcsp<double,uint32_t>,sxz<double>> CELL;
+    typedef Grid2Dunsp<double,uint32_t,Node2Dnsp<double,uint32_t>,sxz<double>> Gunsp;
+    typedef Grid2Ducsp<double,uint32_t,Node2Dcsp<double,uint32_t>,sxz<double>> Gucsp;
+    typedef Grid2Dunfm<double,uint32_t,Node2Dnsp<double,uint32_t>,sxz<double>> Gunfm;
+    typedef Grid2Ducfm<double,uint32_t,Node2Dcsp<double,uint32_t>,sxz<double>> Gucfm;
+    typedef Grid2Dunfs<double,uint32_t,Node2Dnsp<double,uint32_t>,sxz<double>> Gunfs;
+    typedef Grid2Ducfs<double,uint32_t,Node2Dcsp<double,uint32_t>,sxz<double>> Gucfs;
+
+    const uint32_t n = static_cast<uint32_t>(opt.n2d);
+    const uint32_t ns = static_cast<uint32_t>(opt.nsec);
+    const double d = L/n;
+    const size_t nt = opt.nThreads;
+
+    vector<sxz<double>> nodes;
+    vector<triangleElem<uint32_t>> tri;
+    buildMesh2D(n, nodes, tri);
+    const vector<sxz<double>> ptsRef = { {0.0, 0.0}, {0.0, L}, {L, 0.0}, {L, L} };
+
+    for ( int im=0; im<N_MODELS; ++im ) {
+        const Model m = static_cast<Model>(im);
+        vector<double> sn, sc;
+        buildSlowness2D(m, n, sn, sc);
+        const vector<double> st = cellSlowness(m, nodes, tri, 3);
+
+        auto set = [](G* g, const vector<double>& s) { g->setSlowness(s); return g; };
+        vector<Case<G>> cases;
+
+        cases.push_back( {"Grid2Drnsp", "SPM", false, [&]() {
+            return set(new Grid2Drnsp<double,uint32_t>(n, n, d, d, 0.0, 0.0, ns, ns, nt), sn); } } );
+        cases.push_back( {"Grid2Drcsp", "SPM", false, [&]() {
+            return set(new Grid2Drcsp<double,uint32_t,CELL>(n, n, d, d, 0.0, 0.0, ns, ns, nt), sc); } } );
+        cases.push_back( {"Grid2Drnfs", "FSM", true, [&]() {
+            return set(new Grid2Drnfs<double,uint32_t>(n, n, d, d, 0.0, 0.0, opt.epsilon, opt.nitermax, false, false, nt), sn); } } );
+        cases.push_back( {"Grid2Drcfs", "FSM", true, [&]() {
+            return set(new Grid2Drcfs<double,uint32_t>(n, n, d, d, 0.0, 0.0, opt.epsilon, opt.nitermax, false, false, nt), sc); } } );
+        cases.push_back( {"Grid2Dunsp", "SPM", false, [&]() {
+            return set(new Gunsp(nodes, tri, ns, nt), sn); } } );
+        cases.push_back( {"Grid2Ducsp", "SPM", false, [&]() {
+            return set(new Gucsp(nodes, tri, ns, nt), st); } } );
+        cases.push_back( {"Grid2Dunfm", "FMM", false, [&]() {
+            return set(new Gunfm(nodes, tri, nt), sn); } } );
+        cases.push_back( {"Grid2Ducfm", "FMM", false, [&]() {
+            return set(new Gucfm(nodes, tri, nt), st); } } );
+        cases.push_back( {"Grid2Dunfs", "FSM", false, [&]() {
+            Gunfs* g = new Gunfs(nodes, tri, opt.epsilon, opt.nitermax, nt);
+            g->initOrdering(ptsRef, 2);
+            return set(g, sn); } } );
+        cases.push_back( {"Grid2Ducfs", "FSM", false, [&]() {
+            Gucfs* g = new Gucfs(nodes, tri, opt.epsilon, opt.nitermax, nt);
+            g->initOrdering(ptsRef, 2);
+            return set(g, st); } } );
+
+        for ( size_t nc=0; nc<cases.size(); ++nc ) {
+            run(os, 2, cases[nc], m, src, rcv, nt);
+        }
+    }
+}
+
+void bench3D(ostream& os, const options& opt, const vector<sxyz<double>>& src,
+             const vector<sxyz<double>>& rcv) {
+    typedef Grid3D<double,uint32_t> G;
+    typedef Cell<double,Node3Dcsp<double,uint32_t>,sxyz<double>> CELL;
+
+    const uint32_t n = static_cast<uint32_t>(opt.n3d);
+    const uint32_t ns = static_cast<uint32_t>(opt.nsec);
+    const double d = L/n;
+    const size_t nt = opt.nThreads;
+
+    vector<sxyz<double>> nodes;
+    vector<tetrahedronElem<uint32_t>> tet;
+    buildMesh3D(n, nodes, tet);
+    vector<sxyz<double>> ptsRef;
+    for ( size_t c=0; c<8; ++c ) {
+        ptsRef.push_back( sxyz<double>((c&4) ? L : 0.0, (c&2) ? L : 0.0, (c&1) ? L : 0.0) );
+    }
+
+    for ( int im=0; im<N_MODELS; ++im ) {
+        const Model m = static_cast<Model>(im);
+        vector<double> sn, sc;
+        buildSlowness3D(m, n, sn, sc);
+        const vector<double> st = cellSlowness(m, nodes, tet, 4);
+
+        auto set = [](G* g, const vector<double>& s) { g->setSlowness(s); return g; };
+        vector<Case<G>> cases;
+
+        cases.push_back( {"Grid3Drnsp", "SPM", false, [&]() {
+            return set(new Grid3Drnsp<double,uint32_t>(n, n, n, d, d, d, 0.0, 0.0, 0.0, ns, ns, ns, nt), sn); } } );
+        cases.push_back( {"Grid3Drcsp", "SPM", false, [&]() {
+            return set(new Grid3Drcsp<double,uint32_t,CELL>(n, n, n, d, d, d, 0.0, 0.0, 0.0, ns, ns, ns, nt), sc); } } );
+        cases.push_back( {"Grid3Drnfs", "FSM", true, [&]() {
+            return set(new Grid3Drnfs<double,uint32_t>(n, n, n, d, 0.0, 0.0, 0.0, opt.epsilon, opt.nitermax, false, nt), sn); } } );
+        cases.push_back( {"Grid3Drcfs", "FSM", true, [&]() {
+            return set(new Grid3Drcfs<double,uint32_t>(n, n, n, d, 0.0, 0.0, 0.0, opt.epsilon, opt.nitermax, false, nt), sc); } } );
+        cases.push_back( {"Grid3Dunsp", "SPM", false, [&]() {
+            return set(new Grid3Dunsp<double,uint32_t>(nodes, tet, ns, nt), sn); } } );
+        cases.push_back( {"Grid3Ducsp", "SPM", false, [&]() {
+            return set(new Grid3Ducsp<double,uint32_t>(nodes, tet, ns, nt), st); } } );
+        cases.push_back( {"Grid3Dunfm", "FMM", false, [&]() {
+            return set(new Grid3Dunfm<double,uint32_t>(nodes, tet, false, nt), sn); } } );
+        cases.push_back( {"Grid3Ducfm", "FMM", false, [&]() {
+            return set(new Grid3Ducfm<double,uint32_t>(nodes, tet, false, nt), st); } } );
+        cases.push_back( {"Grid3Dunfs", "FSM", true, [&]() {
+            Grid3Dunfs<double,uint32_t>* g = new Grid3Dunfs<double,uint32_t>(nodes, tet, opt.epsilon, opt.nitermax, false, nt);
+            g->initOrdering(ptsRef, 2);
+            return set(g, sn); } } );
+        cases.push_back( {"Grid3Ducfs", "FSM", false, [&]() {
+            Grid3Ducfs<double,uint32_t>* g = new Grid3Ducfs<double,uint32_t>(nodes, tet, opt.epsilon, opt.nitermax, false, nt);
+            g->initOrdering(ptsRef, 2);
+            return set(g, st); } } );
+
+        for ( size_t nc=0; nc<cases.size(); ++nc ) {
+            run(os, 3, cases[nc], m, src, rcv, nt);
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+
+    options opt;
+    string outFile;
+    int next_option;
+    const char* const short_options = "hn:m:s:r:x:t:d:o:";
+    do {
+        next_option = getopt(argc, argv, short_options);
+        switch (next_option) {
+            case 'n': opt.n2d = atoi(optarg); break;
+            case 'm': opt.n3d = atoi(optarg); break;
+            case 's': opt.nsec = atoi(optarg); break;
+            case 'r': opt.nRcv = atoi(optarg); break;
+            case 'x': opt.nSrc = atoi(optarg); break;
+            case 't': opt.nThreads = atoi(optarg); break;
+            case 'd': opt.dim = atoi(optarg); break;
+            case 'o': outFile = optarg; break;
+            case -1: break;
+            case 'h':
+                print_usage(cout, argv[0], 0);
+            default:
+                print_usage(cerr, argv[0], 1);
+        }
+    } while ( next_option != -1 );
+    if ( opt.n2d < 2 || opt.n3d < 2 || opt.nRcv < 1 || opt.nSrc < 1 || opt.nThreads < 1 ||
+        (opt.dim != 0 && opt.dim != 2 && opt.dim != 3) ) {
+        print_usage(cerr, argv[0], 1);
+    }
+
+    ofstream fout;
+    if ( !outFile.empty() ) {
+        fout.open(outFile);
+        if ( !fout.is_open() ) {
+            cerr << "Error: cannot open " << outFile << '\n';
+            return 1;
+        }
+    }
+    ostream os(outFile.empty() ? cout.rdbuf() : fout.rdbuf());
+
+    // sources along a line in the upper layer, and receivers at random in
+    // the model, the same from run to run
+    vector<sxz<double>> src2, rcv2;
+    vector<sxyz<double>> src3, rcv3;
+    for ( size_t n=0; n<opt.nSrc; ++n ) {
+        double x = opt.nSrc > 1 ? L*(0.2 + 0.6*n/(opt.nSrc-1)) : 0.5*L;
+        src2.push_back( sxz<double>(x, 0.15*L) );
+        src3.push_back( sxyz<double>(x, 0.5*L, 0.15*L) );
+    }
+    mt19937 gen(1);
+    uniform_real_distribution<double> dis(0.02*L, 0.98*L);
+    for ( size_t n=0; n<opt.nRcv; ++n ) {
+        double x = dis(gen), y = dis(gen), z = dis(gen);
+        rcv2.push_back( sxz<double>(x, z) );
+        rcv3.push_back( sxyz<double>(x, y, z) );
+    }
+
+    os << "# " << opt.nSrc << " sources, " << opt.nRcv << " receivers, "
+    << opt.n2d << " cells per side in 2D, " << opt.n3d << " in 3D, "
+    << opt.nsec << " secondary nodes, " << opt.nThreads << " thread(s)"
+    << (Instrumentation::enabled() ? "" : ", operation counts not available") << '\n'
+    << "# times in s, memory as the increase of the resident set in B, errors in s\n"
+    << "dim,grid,method,model,nodes,cells,threads,t_build,t_raytrace,memory,"
+    << "iterations,queue_pops,local_updates,rms_error,max_error\n";
+    os.precision(6);
+
+    // some grids print messages while raytracing, which would end up in the
+    // report: the standard output is muted during the runs
+    streambuf* coutBuf = cout.rdbuf(nullptr);
+    if ( opt.dim != 3 ) bench2D(os, opt, src2, rcv2);
+    if ( opt.dim != 2 ) bench3D(os, opt, src3, rcv3);
+    cout.rdbuf(coutBuf);
+
+    return 0;
+}
@@ -61,6 +61,7 @@
 #include "Grid3Ducsp.h"
 #include "Grid3Dunfm.h"
 #include "Grid3Dunfs.h"
+#include "Grid3Dundsp.h"
 #include "Grid3Dunsp.h"
 #include "Node2Dcsp.h"
 #include "Node2Dnsp.h"
@@ -71,13 +72,53 @@
 
 #include "Rcv.h"
 #include "Rcv2D.h"
+#include "Renumbering.h"
 
 #include "utils.h"
 
 namespace ttcr {
     
+    // source region refinement, for grids using the FMM or FSM
     template<typename T>
-    Grid3D<T,uint32_t> *recti3D(const input_parameters &par, const size_t nt) {
+    void setSourceRegion(Grid3D<T,uint32_t> *g, const input_parameters &par) {
+        if ( par.source_refinement > 0 ) {
+            if ( par.verbose ) {
+                std::cout << "Refining source regions by a factor of "
+                << par.source_refinement << '\n';
+            }
+            g->setSourceRadius( par.source_radius );
+            g->setSourceRefinement( par.source_refinement );
+        }
+    }
+
+    // Number of threads, at most nt, for which a grid needing shared bytes,
+    // plus thread bytes for each thread, fits in the memory budget of par.
+    // The estimate is printed before the grid is built.
+    inline size_t threadsInBudget(const input_parameters &par, const size_t nt,
+                                  const size_t shared, const size_t thread) {
+        const double MB = 1024.0*1024.0;
+        size_t n = nt;
+        if ( par.memoryBudget > 0.0 ) {
+            const double budget = par.memoryBudget*MB;
+            if ( shared + thread > budget ) {
+                n = 1;
+                std::cerr << "Warning: grid needs about " << (shared+thread)/MB
+                << " MB with one thread, more than the memory budget of "
+                << par.memoryBudget << " MB\n";
+            } else {
+                n = std::min(nt, static_cast<size_t>((budget-shared)/thread));
+            }
+        }
+        if ( par.verbose || par.memoryBudget > 0.0 ) {
+            std::cout << "Estimated memory of grid: " << shared/MB << " MB + "
+            << thread/MB << " MB per thread, " << (shared+n*thread)/MB
+            << " MB with " << n << " thread" << (n>1 ? "s" : "") << '\n';
+        }
+        return n;
+    }
+
+    template<typename T>
+    Grid3D<T,uint32_t> *recti3D(const input_parameters &par, size_t nt) {
         
         Grid3D<T,uint32_t> *g = nullptr;
         
@@ -214,6 +255,16 @@ namespace ttcr {
         switch (par.method) {
             case SHORTEST_PATH:
             {
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Drcsp<T, uint32_t, Cell<T,Node3Dcsp<T,uint32_t>,sxyz<T>>>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                                                        par.nn[0], par.nn[1], par.nn[2],
+                                                                                                        shared, thread);
+                else
+                    Grid3Drnsp<T, uint32_t>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                par.nn[0], par.nn[1], par.nn[2],
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid using " << par.nn[0] << " secondary nodes ... ";
                     std::cout.flush();
@@ -224,7 +275,7 @@ namespace ttcr {
                                                                                            d[0], d[1], d[2],
                                                                                            min[0], min[1], min[0],
                                                                                            par.nn[0], par.nn[1], par.nn[2],
-                                                                                           nt);
+                                                                                           nt, par.gridCache);
                 else
                     g = new Grid3Drnsp<T, uint32_t>(ncells[0], ncells[1], ncells[2],
                                                     d[0], d[1], d[2],
@@ -249,6 +300,14 @@ namespace ttcr {
             }
             case FAST_SWEEPING:
             {
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Drcfs<T, uint32_t>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                shared, thread);
+                else
+                    Grid3Drnfs<T, uint32_t>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid ... ";
                     std::cout.flush();
@@ -258,13 +317,13 @@ namespace ttcr {
                     g = new Grid3Drcfs<T, uint32_t>(ncells[0], ncells[1], ncells[2],
                                                     d[0], min[0], min[1],  min[2],
                                                     par.epsilon, par.nitermax,
-                                                    par.weno3, nt);
+                                                    par.weno3, nt, par.nt_sweep);
                 }
                 else
                     g = new Grid3Drnfs<T, uint32_t>(ncells[0], ncells[1], ncells[2],
                                                     d[0], min[0], min[1],  min[2],
                                                     par.epsilon, par.nitermax,
-                                                    par.weno3, nt);
+                                                    par.weno3, nt, par.nt_sweep);
                 
                 if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                 if ( par.verbose ) {
@@ -282,6 +341,7 @@ namespace ttcr {
             std::cout << "Time to build grid: " << std::chrono::duration<double>(end-begin).count() << '\n';
         }
         std::cout.flush();
+        setSourceRegion(g, par);
         
         try {
             g->setSlowness(slowness);
@@ -297,7 +357,7 @@ namespace ttcr {
     
 #ifdef VTK
     template<typename T>
-    Grid3D<T,uint32_t> *recti3D_vtr(const input_parameters &par, const size_t nt) {
+    Grid3D<T,uint32_t> *recti3D_vtr(const input_parameters &par, size_t nt) {
         Grid3D<T,uint32_t> *g = nullptr;
         vtkRectilinearGrid *dataSet;
         
@@ -384,9 +444,14 @@ namespace ttcr {
                 
             }
             if ( foundSlowness ) {
+                size_t shared, thread;
                 switch (par.method) {
                     case SHORTEST_PATH:
                         
+                        Grid3Drnsp<T, uint32_t>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                    par.nn[0], par.nn[1], par.nn[2],
+                                                                    shared, thread);
+                        nt = threadsInBudget(par, nt, shared, thread);
                         if ( par.verbose ) { std::cout << "Building grid (Grid3Drnsp) ... "; std::cout.flush(); }
                         if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                         g = new Grid3Drnsp<T, uint32_t>(ncells[0], ncells[1], ncells[2],
@@ -414,12 +479,16 @@ namespace ttcr {
                         
                     case FAST_SWEEPING:
                         
+                        Grid3Drnfs<T, uint32_t>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                    shared, thread);
+                        nt = threadsInBudget(par, nt, shared, thread);
                         if ( par.verbose ) { std::cout << "Building grid (Grid3Drnfs) ... "; std::cout.flush(); }
                         if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                         g = new Grid3Drnfs<T, uint32_t>(ncells[0], ncells[1], ncells[2],
                                                         d[0], xrange[0], yrange[0], zrange[0],
                                                         par.epsilon, par.nitermax,
-                                                        par.weno3, nt);
+                                                        par.weno3, nt, par.nt_sweep);
+                        setSourceRegion(g, par);
                         if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                         if ( par.verbose ) {
                             std::cout << "done.\nTotal number of nodes: " << g->getNumberOfNodes()
@@ -525,21 +594,28 @@ namespace ttcr {
                 }
             }
             if ( foundSlowness ) {
+                size_t shared, thread;
                 switch (par.method) {
                     case SHORTEST_PATH:
                         
+                        Grid3Drcsp<T, uint32_t, Cell<T,Node3Dcsp<T,uint32_t>,sxyz<T>>>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                                                           par.nn[0], par.nn[1], par.nn[2],
+                                                                                                           shared, thread);
+                        nt = threadsInBudget(par, nt, shared, thread);
                         if ( par.verbose ) { std::cout << "Building grid (Grid3Drcsp) ... "; std::cout.flush(); }
                         if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                         if ( foundChi && foundPsi ) {
                             g = new Grid3Drcsp<T, uint32_t, CellElliptical3D<T,Node3Dcsp<T,uint32_t>,sxyz<T>>>(ncells[0], ncells[1], ncells[2],
                                                                                                                d[0], d[1], d[2],
                                                                                                                xrange[0], yrange[0], zrange[0],
-                                                                                                               par.nn[0], par.nn[1], par.nn[2], nt);
+                                                                                                               par.nn[0], par.nn[1], par.nn[2], nt,
+                                                                                                               par.gridCache);
                         } else {
                             g = new Grid3Drcsp<T, uint32_t, Cell<T,Node3Dcsp<T,uint32_t>,sxyz<T>>>(ncells[0], ncells[1], ncells[2],
                                                                                                    d[0], d[1], d[2],
                                                                                                    xrange[0], yrange[0], zrange[0],
-                                                                                                   par.nn[0], par.nn[1], par.nn[2], nt);
+                                                                                                   par.nn[0], par.nn[1], par.nn[2], nt,
+                                                                                                   par.gridCache);
                         }
                         if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                         if ( par.verbose ) {
@@ -565,12 +641,15 @@ namespace ttcr {
                         if ( par.verbose ) std::cout << "done.\n";
                         break;
                     case FAST_SWEEPING:
+                        Grid3Drcfs<T, uint32_t>::estimateMemorySize(ncells[0], ncells[1], ncells[2],
+                                                                    shared, thread);
+                        nt = threadsInBudget(par, nt, shared, thread);
                         if ( par.verbose ) { std::cout << "Building grid (Grid3Drnfs) ... "; std::cout.flush(); }
                         if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                         g = new Grid3Drcfs<T, uint32_t>(ncells[0], ncells[1], ncells[2],
                                                         d[0], xrange[0], yrange[0], zrange[0],
                                                         par.epsilon, par.nitermax,
-                                                        par.weno3, nt);
+                                                        par.weno3, nt, par.nt_sweep);
                         if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                         if ( par.verbose ) {
                             std::cout << "done.\nTotal number of nodes: " << g->getNumberOfNodes()
@@ -608,7 +687,9 @@ namespace ttcr {
     };
     
     template<typename T>
-    Grid3D<T, uint32_t> *unstruct3D_vtu(const input_parameters &par, const size_t nt)
+    Grid3D<T, uint32_t> *unstruct3D_vtu(const input_parameters &par,
+                                        Renumbering<uint32_t> &renum,
+                                        size_t nt)
     {
         
         VTUReader reader( par.modelfile.c_str() );
@@ -648,11 +729,32 @@ namespace ttcr {
             std::cout << std::endl;
         }
         
+        if ( par.renumber ) {
+            if ( par.verbose ) {
+                std::cout << "Renumbering nodes and cells ... ";
+                std::cout.flush();
+            }
+            renum.apply(nodes, tetrahedra);
+            if ( constCells )
+                renum.permuteCellValues(slowness);
+            else
+                renum.permuteNodeValues(slowness);
+            if ( par.verbose ) std::cout << "done.\n";
+        }
+        
         std::chrono::high_resolution_clock::time_point begin, end;
         Grid3D<T, uint32_t> *g;
         switch (par.method) {
             case SHORTEST_PATH:
             {
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Ducsp<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), par.nn[0],
+                                                                shared, thread);
+                else
+                    Grid3Dunsp<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), par.nn[0],
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid using " << par.nn[0] << " secondary nodes ... ";
                     std::cout.flush();
@@ -660,10 +762,14 @@ namespace ttcr {
                 if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                 if ( constCells )
                     g = new Grid3Ducsp<T, uint32_t>(nodes, tetrahedra,par.nn[0], nt,
-                                                    par.verbose);
+                                                    par.verbose, par.gridCache);
+                else if ( par.nDynamic > 0 )
+                    g = new Grid3Dundsp<T, uint32_t>(nodes, tetrahedra,par.nn[0],
+                                                     par.nDynamic, par.dynamic_radius,
+                                                     nt, par.verbose, par.gridCache);
                 else
                     g = new Grid3Dunsp<T, uint32_t>(nodes, tetrahedra,par.nn[0], nt,
-                                                    par.verbose);
+                                                    par.verbose, par.gridCache);
                 if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                 if ( par.verbose ) {
                     std::cout << "done.\nTotal number of nodes: " << g->getNumberOfNodes()
@@ -675,6 +781,14 @@ namespace ttcr {
             }
             case FAST_MARCHING:
             {
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Ducfm<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(),
+                                                                shared, thread);
+                else
+                    Grid3Dunfm<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(),
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid ... ";
                     std::cout.flush();
@@ -682,10 +796,12 @@ namespace ttcr {
                 if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                 if ( constCells )
                     g = new Grid3Ducfm<T, uint32_t>(nodes, tetrahedra,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 else
                     g = new Grid3Dunfm<T, uint32_t>(nodes, tetrahedra,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                 if ( par.verbose ) {
                     std::cout << "done.\n";
@@ -696,6 +812,15 @@ namespace ttcr {
             }
             case FAST_SWEEPING:
             {
+                // sweeps are ordered from the 8 corners of the grid, see below
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Ducfs<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), 8,
+                                                                shared, thread);
+                else
+                    Grid3Dunfs<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), 8,
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid ... ";
                     std::cout.flush();
@@ -704,11 +829,13 @@ namespace ttcr {
                 if ( constCells )
                     g = new Grid3Ducfs<T, uint32_t>(nodes, tetrahedra, par.epsilon,
                                                     par.nitermax,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 else
                     g = new Grid3Dunfs<T, uint32_t>(nodes, tetrahedra, par.epsilon,
                                                     par.nitermax,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 T xmin = g->getXmin();
                 T xmax = g->getXmax();
                 T ymin = g->getYmin();
@@ -726,9 +853,11 @@ namespace ttcr {
                 ptsRef.push_back( {xmax, ymax, zmin} );
                 ptsRef.push_back( {xmax, ymax, zmax} );
                 if ( constCells )
-                    dynamic_cast<Grid3Ducfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order );
+                    dynamic_cast<Grid3Ducfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order,
+                                                                     par.gridCache );
                 else
-                    dynamic_cast<Grid3Dunfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order );
+                    dynamic_cast<Grid3Dunfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order,
+                                                                     par.gridCache );
                 if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                 if ( par.verbose ) {
                     std::cout << "done.\n";
@@ -747,6 +876,7 @@ namespace ttcr {
             std::cout << "Time to build grid: " << std::chrono::duration<double>(end-begin).count() << '\n';
         }
         std::cout.flush();
+        setSourceRegion(g, par);
         if ( par.verbose && par.method == SHORTEST_PATH ) {
             std::cout << "Interpolating slowness at secondary nodes ... ";
             std::cout.flush();
@@ -761,6 +891,11 @@ namespace ttcr {
             delete g;
             return nullptr;
         }
+        
+        if ( !renum.empty() ) {
+            g->setInputOrder( renum.getNodeIndices() );
+        }
+        
         if ( par.verbose && par.method == SHORTEST_PATH ) {
             std::cout << "done.\n";
             std::cout.flush();
@@ -777,7 +912,8 @@ namespace ttcr {
     template<typename T>
     Grid3D<T, uint32_t> *unstruct3D(const input_parameters &par,
                                     std::vector<Rcv<T>> &reflectors,
-                                    const size_t nt, const size_t ns)
+                                    Renumbering<uint32_t> &renum,
+                                    size_t nt, const size_t ns)
     {
         
         MSHReader reader( par.modelfile.c_str() );
@@ -874,11 +1010,36 @@ namespace ttcr {
             std::cout << std::endl;
         }
         
+        if ( par.processReflectors ) {
+            buildReflectors(reader, nodes, ns, par.nn[0], reflectors);
+        }
+        
+        if ( par.renumber ) {
+            if ( par.verbose ) {
+                std::cout << "Renumbering nodes and cells ... ";
+                std::cout.flush();
+            }
+            renum.apply(nodes, tetrahedra);
+            if ( constCells )
+                renum.permuteCellValues(slowness);
+            else
+                renum.permuteNodeValues(slowness);
+            if ( par.verbose ) std::cout << "done.\n";
+        }
+        
         std::chrono::high_resolution_clock::time_point begin, end;
         Grid3D<T, uint32_t> *g = nullptr;
         switch (par.method) {
             case SHORTEST_PATH:
             {
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Ducsp<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), par.nn[0],
+                                                                shared, thread);
+                else
+                    Grid3Dunsp<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), par.nn[0],
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid using " << par.nn[0] << " secondary nodes ... ";
                     std::cout.flush();
@@ -886,10 +1047,14 @@ namespace ttcr {
                 if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                 if ( constCells )
                     g = new Grid3Ducsp<T, uint32_t>(nodes, tetrahedra,par.nn[0], nt,
-                                                    par.verbose);
+                                                    par.verbose, par.gridCache);
+                else if ( par.nDynamic > 0 )
+                    g = new Grid3Dundsp<T, uint32_t>(nodes, tetrahedra,par.nn[0],
+                                                     par.nDynamic, par.dynamic_radius,
+                                                     nt, par.verbose, par.gridCache);
                 else
                     g = new Grid3Dunsp<T, uint32_t>(nodes, tetrahedra,par.nn[0], nt,
-                                                    par.verbose);
+                                                    par.verbose, par.gridCache);
                 if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                 if ( par.verbose ) {
                     std::cout << "done.\nTotal number of nodes: " << g->getNumberOfNodes()
@@ -901,6 +1066,14 @@ namespace ttcr {
             }
             case FAST_MARCHING:
             {
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Ducfm<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(),
+                                                                shared, thread);
+                else
+                    Grid3Dunfm<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(),
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid ... ";
                     std::cout.flush();
@@ -908,10 +1081,12 @@ namespace ttcr {
                 if ( par.time ) { begin = std::chrono::high_resolution_clock::now(); }
                 if ( constCells )
                     g = new Grid3Ducfm<T, uint32_t>(nodes, tetrahedra,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 else
                     g = new Grid3Dunfm<T, uint32_t>(nodes, tetrahedra,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                 if ( par.verbose ) {
                     std::cout << "done.\n";
@@ -928,6 +1103,15 @@ namespace ttcr {
             }
             case FAST_SWEEPING:
             {
+                // sweeps are ordered from the 8 corners of the grid, see below
+                size_t shared, thread;
+                if ( constCells )
+                    Grid3Ducfs<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), 8,
+                                                                shared, thread);
+                else
+                    Grid3Dunfs<T, uint32_t>::estimateMemorySize(nodes.size(), tetrahedra.size(), 8,
+                                                                shared, thread);
+                nt = threadsInBudget(par, nt, shared, thread);
                 if ( par.verbose ) {
                     std::cout << "Creating grid ... ";
                     std::cout.flush();
@@ -936,11 +1120,13 @@ namespace ttcr {
                 if ( constCells )
                     g = new Grid3Ducfs<T, uint32_t>(nodes, tetrahedra, par.epsilon,
                                                     par.nitermax,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 else
                     g = new Grid3Dunfs<T, uint32_t>(nodes, tetrahedra, par.epsilon,
                                                     par.nitermax,
-                                                    par.raypath_high_order, nt);
+                                                    par.raypath_high_order, nt,
+                                                    par.tetGeometry);
                 
                 T xmin = g->getXmin();
                 T xmax = g->getXmax();
@@ -959,9 +1145,11 @@ namespace ttcr {
                 ptsRef.push_back( {xmax, ymax, zmin} );
                 ptsRef.push_back( {xmax, ymax, zmax} );
                 if ( constCells )
-                    dynamic_cast<Grid3Ducfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order );
+                    dynamic_cast<Grid3Ducfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order,
+                                                                     par.gridCache );
                 else
-                    dynamic_cast<Grid3Dunfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order );
+                    dynamic_cast<Grid3Dunfs<T, uint32_t>*>(g)->initOrdering( ptsRef, par.order,
+                                                                     par.gridCache );
                 if ( par.time ) { end = std::chrono::high_resolution_clock::now(); }
                 if ( par.verbose ) {
                     std::cout << "done.\n";
@@ -980,6 +1168,7 @@ namespace ttcr {
             std::cout << "Time to build grid: " << std::chrono::duration<double>(end-begin).count() << '\n';
         }
         std::cout.flush();
+        setSourceRegion(g, par);
         if ( par.verbose && par.method == SHORTEST_PATH ) {
             std::cout << "Interpolating slowness at secondary nodes ... ";
             std::cout.flush();
@@ -994,7 +1183,11 @@ namespace ttcr {
             delete g;
             return nullptr;
         }
-
+        
+        if ( !renum.empty() ) {
+            g->setInputOrder( renum.getNodeIndices() );
+        }
+        
         if ( par.verbose && par.method == SHORTEST_PATH ) {
             std::cout << "done.\n";
             std::cout.flush();
@@ -1004,10 +1197,6 @@ namespace ttcr {
             std::cout << "Time to interpolate slowness values: " << std::chrono::duration<double>(end-begin).count() << '\n';
         }
         
-        if ( par.processReflectors ) {
-            buildReflectors(reader, nodes, ns, par.nn[0], reflectors);
-        }
-        
         if ( par.saveModelVTK ) {
 #ifdef VTK
             std::string filename = par.modelfile;
@@ -1761,6 +1950,7 @@ namespace ttcr {
     template<typename T>
     Grid2D<T,uint32_t,sxz<T>> *unstruct2D(const input_parameters &par,
                                           std::vector<Rcv2D<T>> &reflectors,
+                                          Renumbering<uint32_t> &renum,
                                           const size_t nt, const size_t ns)
     {
         
@@ -1868,6 +2058,19 @@ namespace ttcr {
             std::cout << std::endl;
         }
         
+        if ( par.renumber ) {
+            if ( par.verbose ) {
+                std::cout << "Renumbering nodes and cells ... ";
+                std::cout.flush();
+            }
+            renum.apply(nodes, triangles);
+            if ( constCells )
+                renum.permuteCellValues(slowness);
+            else
+                renum.permuteNodeValues(slowness);
+            if ( par.verbose ) std::cout << "done.\n";
+        }
+        
         std::chrono::high_resolution_clock::time_point begin, end;
         Grid2D<T,uint32_t,sxz<T>> *g=nullptr;
         switch (par.method) {
@@ -1964,6 +2167,10 @@ namespace ttcr {
             return nullptr;
         }
         
+        if ( !renum.empty() ) {
+            g->setInputOrder( renum.getNodeIndices() );
+        }
+        
         if ( par.processReflectors ) {
             std::vector<std::string> reflector_names = reader.getPhysicalNames(1);
             std::vector<int> indices = reader.getPhysicalIndices(1);
@@ -1988,8 +2195,15 @@ namespace ttcr {
                 
                 for ( size_t nl=0; nl<lines.size(); ++nl ) {
                     if ( indices[ni] == lines[nl].physical_entity ) {
-                        pt1 = nodes[ lines[nl].i[0] ];
-                        pt2 = nodes[ lines[nl].i[1] ];
+                        // line elements refer to nodes of the input file
+                        uint32_t i0 = lines[nl].i[0];
+                        uint32_t i1 = lines[nl].i[1];
+                        if ( !renum.empty() ) {
+                            i0 = renum.getNodeIndices()[i0];
+                            i1 = renum.getNodeIndices()[i1];
+                        }
+                        pt1 = nodes[ i0 ];
+                        pt2 = nodes[ i1 ];
                         
                         d.x = (pt2.x-pt1.x)/(nsecondary+1);
                         d.z = (pt2.z-pt1.z)/(nsecondary+1);
@@ -34,7 +34,10 @@ namespace ttcr {
     
     struct input_parameters {
         uint32_t nn[3];
+        uint32_t nDynamic;            // tertiary nodes between secondary nodes around sources (SPM)
         int nt;
+        int nt_sweep;                 // number of threads updating each sweep (FSM)
+        size_t shotBatch;             // number of shots traced together
         int verbose;
         int order;                    // order of l metric
         int nitermax;
@@ -44,29 +47,42 @@ namespace ttcr {
         bool saveModelVTK;
         bool saveM;
         bool saveGridTT;
+        int saveTTbinary;             // all receiver traveltimes in one binary file (1: double, 2: float)
+        int saveMbinary;              // matrix M of all sources in one binary CSR file (1: double, 2: float)
         bool time;
         bool processReflectors;
         bool projectTxRx;
         bool raypath_high_order;
         bool rotated_template;
         bool weno3;
+        bool tetGeometry;             // precompute geometry of tetrahedra for FMM & FSM
+        bool renumber;                // renumber nodes & cells of meshes along a Hilbert curve
+        bool reciprocity;             // trace from receivers when they are fewer than sources
         double epsilon;
         double source_radius;
+        double dynamic_radius;        // radius of the region holding tertiary nodes (SPM)
+        double memoryBudget;          // memory available for the grid, in MB (0: no limit)
+        int source_refinement;        // ratio of cell sizes of the grid & source region grids (FMM & FSM)
         raytracing_method method;
         std::string basename;
         std::string modelfile;
         std::string velfile;
         std::string slofile;
         std::string rcvfile;
+        std::string gridCache;        // file holding the built grid, reused if model is unchanged
         std::vector<std::string> srcfiles;
         
-        input_parameters() : nn(), nt(0), verbose(0), order(2), nitermax(20),
+        input_parameters() : nn(), nDynamic(0), nt(0), nt_sweep(1), shotBatch(1), verbose(0), order(2), nitermax(20),
         inverseDistance(false),	singlePrecision(false), saveRaypaths(false),
-        saveModelVTK(false), saveM(false), saveGridTT(false), time(false),
+        saveModelVTK(false), saveM(false), saveGridTT(false), saveTTbinary(0), saveMbinary(0),
+        time(false),
         processReflectors(false), projectTxRx(false), 
         raypath_high_order(false), rotated_template(false), weno3(false),
-        epsilon(1.e-15), source_radius(0.0), method(SHORTEST_PATH), basename(),
-        modelfile(), velfile(), slofile(), rcvfile(), srcfiles() {}
+        tetGeometry(false), renumber(false), reciprocity(false),
+        epsilon(1.e-15), source_radius(0.0), dynamic_radius(0.0), memoryBudget(0.0),
+        source_refinement(0),
+        method(SHORTEST_PATH), basename(),
+        modelfile(), velfile(), slofile(), rcvfile(), gridCache(), srcfiles() {}
         
     };
     
@@ -31,6 +31,8 @@
 
 #include "Grid2D.h"
 #include "Rcv2D.h"
+#include "Renumbering.h"
+#include "ShotScheduler.h"
 #include "Src2D.h"
 #include "structs_ttcr.h"
 #include "ttcr_io.h"
@@ -64,8 +66,8 @@ int body(const input_parameters &par) {
 		num_threads = par.nt < nTx ? par.nt : nTx;
 	}
 	
-    size_t blk_size = nTx/num_threads;
-    if ( blk_size == 0 ) blk_size++;
+    // shots are handed out to threads one at a time
+    ShotScheduler scheduler(nTx, num_threads);
 	
 	string::size_type idx;
     
@@ -77,6 +79,7 @@ int body(const input_parameters &par) {
     
     Grid2D<T,uint32_t,sxz<T>> *g=nullptr;
     vector<Rcv2D<T>> reflectors;
+    Renumbering<uint32_t> renum;
     if (extension == ".grd") {
         g = recti2D<T>(par, num_threads);
     } else if (extension == ".vtr") {
@@ -94,7 +97,7 @@ int body(const input_parameters &par) {
 		return 1;
 #endif
     } else if (extension == ".msh") {
-        g = unstruct2D<T>(par, reflectors, num_threads, src.size());
+        g = unstruct2D<T>(par, reflectors, renum, num_threads, src.size());
     } else {
         cerr << par.modelfile << " Unknown extenstion: " << extension << endl;
         return 1;
@@ -121,7 +124,7 @@ int body(const input_parameters &par) {
     }
 	if ( par.verbose && num_threads>1 ) {
 		cout << "Calculations will be done using " << num_threads
-        << " threads with " << blk_size << " shots per thread.\n";
+        << " threads.\n";
 	}
     
 	vector<const vector<sxz<T>>*> all_rcv;
@@ -198,50 +201,7 @@ int body(const input_parameters &par) {
 		} else {
 			// threaded jobs
 			
-			vector<thread> threads(num_threads-1);
-			size_t blk_start = 0;
-			for ( size_t i=0; i<num_threads-1; ++i ) {
-                
-				size_t blk_end = blk_start + blk_size;
-				
-				threads[i]=thread( [&g,&src,&rcv,&r_data,&reflectors,&all_rcv,
-                                    &rfl_r_data,&rfl2_r_data,
-                                    blk_start,blk_end,i]{
-                    
-					for ( size_t n=blk_start; n<blk_end; ++n ) {
-                        
-                        vector<vector<T>*> all_tt;
-						all_tt.push_back( &(rcv.get_tt(n)) );
-                        vector<vector<vector<sxz<T>>>*> all_r_data;
-                        all_r_data.push_back( &(r_data[n]) );
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-							all_tt.push_back( &(reflectors[nr].get_tt(n)) );
-                            all_r_data.push_back( &(rfl_r_data[nr][n]) );
-						}
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                        all_tt, all_r_data, i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-                            try {
-                                g->raytrace(reflectors[nr].get_coord(),
-                                            reflectors[nr].get_tt(n), rcv.get_coord(),
-                                            rcv.get_tt(n,nr+1), rfl2_r_data[nr][n], i+1);
-                            } catch (std::exception& e) {
-                                std::cerr << e.what() << std::endl;
-                                abort();
-                            }
-						}
-					}
-				});
-				
-				blk_start = blk_end;
-			}
-			for ( size_t n=blk_start; n<nTx; ++n ) {
+			scheduler.run( [&g,&src,&rcv,&r_data,&reflectors,&all_rcv,&rfl_r_data,&rfl2_r_data](const size_t n, const size_t threadNo){
                 
 				vector<vector<T>*> all_tt;
                 all_tt.push_back( &(rcv.get_tt(n)) );
@@ -253,7 +213,7 @@ int body(const input_parameters &par) {
                 }
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                all_tt, all_r_data, 0);
+                                all_tt, all_r_data, threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
@@ -263,15 +223,13 @@ int body(const input_parameters &par) {
                     try {
                         g->raytrace(reflectors[nr].get_coord(),
                                     reflectors[nr].get_tt(n), rcv.get_coord(),
-                                    rcv.get_tt(n,nr+1), rfl2_r_data[nr][n], 0);
+                                    rcv.get_tt(n,nr+1), rfl2_r_data[nr][n], threadNo);
                     } catch (std::exception& e) {
                         std::cerr << e.what() << std::endl;
                         abort();
                     }
                 }
-			}
-			
-			for_each(threads.begin(),threads.end(), mem_fn(&thread::join));
+			});
 		}
 	} else {
 		if ( num_threads == 1 ) {
@@ -322,48 +280,7 @@ int body(const input_parameters &par) {
 		} else {
 			// threaded jobs
 			
-			vector<thread> threads(num_threads-1);
-			size_t blk_start = 0;
-			for ( size_t i=0; i<num_threads-1; ++i ) {
-				
-				size_t blk_end = blk_start + blk_size;
-                
-				threads[i]=thread( [&par,&g,&src,&rcv,&all_rcv,&reflectors,blk_start,
-                                    blk_end,i]{
-                    
-					for ( size_t n=blk_start; n<blk_end; ++n ) {
-						
-						vector<vector<T>*> all_tt;
-						if ( par.rcvfile != "" )
-                            all_tt.push_back( &(rcv.get_tt(n)) );
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-							all_tt.push_back( &(reflectors[nr].get_tt(n)) );
-						}
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                        all_tt, i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-                            try {
-                                g->raytrace(reflectors[nr].get_coord(),
-                                            reflectors[nr].get_tt(n), rcv.get_coord(),
-                                            rcv.get_tt(n,nr+1), i+1);
-                            } catch (std::exception& e) {
-                                std::cerr << e.what() << std::endl;
-                                abort();
-                            }
-						}
-						
-					}
-				});
-				
-				blk_start = blk_end;
-			}
-			for ( size_t n=blk_start; n<nTx; ++n ) {
+			scheduler.run( [&par,&g,&src,&rcv,&all_rcv,&reflectors](const size_t n, const size_t threadNo){
                 
 				vector<vector<T>*> all_tt;
 				if ( par.rcvfile != "" )
@@ -373,7 +290,7 @@ int body(const input_parameters &par) {
 				}
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                all_tt, 0);
+                                all_tt, threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
@@ -383,16 +300,13 @@ int body(const input_parameters &par) {
                     try {
                         g->raytrace(reflectors[nr].get_coord(),
                                     reflectors[nr].get_tt(n), rcv.get_coord(),
-                                    rcv.get_tt(n,nr+1), 0);
+                                    rcv.get_tt(n,nr+1), threadNo);
                     } catch (std::exception& e) {
                         std::cerr << e.what() << std::endl;
                         abort();
                     }
 				}
-                
-			}
-			
-			for_each(threads.begin(),threads.end(), mem_fn(&thread::join));
+			});
 		}
 	}
 	if ( par.time ) { end = chrono::high_resolution_clock::now(); }
@@ -408,14 +322,30 @@ int body(const input_parameters &par) {
 		cout.precision(12);
 		cout << "Time to perform raytracing: " <<
         chrono::duration<double>(end-begin).count() << '\n';
+        if ( num_threads > 1 ) {
+            for ( size_t i=0; i<num_threads; ++i ) {
+                cout << "  thread " << i << ": " << scheduler.getNshots(i)
+                << " shots, busy " << scheduler.getBusyTime(i) << " s\n";
+            }
+        }
+        if ( Instrumentation::enabled() ) {
+            g->getInstrumentation().report(cout);
+        }
 	}
 	
     delete g;
     
+    if ( par.saveTTbinary > 0 && par.rcvfile != "" ) {
+        string filename = par.basename+"_tt.bin";
+        if ( par.verbose ) cout << "Saving traveltimes of all sources in " << filename <<  " ... ";
+        rcv.save_tt_bin(filename, par.saveTTbinary==2);
+        if ( par.verbose ) cout << "done.\n";
+    }
+    
     if ( src.size() == 1 ) {
 		string filename = par.basename+"_tt.dat";
 		
-        if ( par.rcvfile != "" ) {
+        if ( par.rcvfile != "" && par.saveTTbinary == 0 ) {
             if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
             rcv.save_tt(filename, 0);
             if ( par.verbose ) cout << "done.\n";
@@ -473,7 +403,7 @@ int body(const input_parameters &par) {
             srcname.erase(pos, len);
             
             string filename = par.basename+"_"+srcname+"_tt.dat";
-            if ( par.rcvfile != "" ) {
+            if ( par.rcvfile != "" && par.saveTTbinary == 0 ) {
                 if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
                 rcv.save_tt(filename, ns);
                 if ( par.verbose ) cout << "done.\n";
@@ -27,6 +27,8 @@
 
 #include "Grid2Duc.h"
 #include "Rcv.h"
+#include "ShotScheduler.h"
+#include "SparseMatrix.h"
 #include "Src.h"
 #include "ttcr_io.h"
 #include "grids.h"
@@ -60,8 +62,8 @@ int body(const input_parameters &par) {
 		num_threads = par.nt < nTx ? par.nt : nTx;
 	}
 	
-    size_t blk_size = nTx/num_threads;
-    if ( blk_size == 0 ) blk_size++;
+    // shots are handed out to threads one at a time
+    ShotScheduler scheduler(nTx, num_threads);
     
 	string::size_type idx;
     
@@ -106,7 +108,7 @@ int body(const input_parameters &par) {
     }
 	if ( par.verbose && num_threads>1 ) {
 		cout << "Calculations will be done using " << num_threads
-        << " threads with " << blk_size << " shots per thread.\n";
+        << " threads.\n";
 	}
 
 	chrono::high_resolution_clock::time_point begin, end;
@@ -137,38 +139,15 @@ int body(const input_parameters &par) {
         } else {
             // threaded jobs
             
-            vector<thread> threads(num_threads-1);
-            size_t blk_start = 0;
-            for ( size_t i=0; i<num_threads-1; ++i ) {
-                
-                size_t blk_end = blk_start + blk_size;
-                
-                threads[i]=thread( [&g,&src,&rcv,&r_data,&v0,&m_data,blk_start,blk_end,i]{
-                    
-                    for ( size_t n=blk_start; n<blk_end; ++n ) {
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                        rcv.get_tt(n), r_data[n], v0[n], m_data[n], i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-                    }
-                });
-                
-                blk_start = blk_end;
-            }
-            for ( size_t n=blk_start; n<nTx; ++n ) {
+            scheduler.run( [&g,&src,&rcv,&r_data,&v0,&m_data](const size_t n, const size_t threadNo){
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                rcv.get_tt(n), r_data[n], v0[n], m_data[n], 0);
+                                rcv.get_tt(n), r_data[n], v0[n], m_data[n], threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
                 }
-            }
-            
-            for_each(threads.begin(),threads.end(), mem_fn(&thread::join));
+            });
         }
     } else if ( par.saveRaypaths ) {
 		if ( num_threads == 1 ) {
@@ -184,38 +163,15 @@ int body(const input_parameters &par) {
 		} else {
 			// threaded jobs
 			
-			vector<thread> threads(num_threads-1);
-			size_t blk_start = 0;
-			for ( size_t i=0; i<num_threads-1; ++i ) {
-                
-				size_t blk_end = blk_start + blk_size;
-				
-				threads[i]=thread( [&g,&src,&rcv,&r_data,blk_start,blk_end,i]{
-                    
-					for ( size_t n=blk_start; n<blk_end; ++n ) {
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                        rcv.get_tt(n), r_data[n], i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-					}
-				});
-				
-				blk_start = blk_end;
-			}
-			for ( size_t n=blk_start; n<nTx; ++n ) {
+			scheduler.run( [&g,&src,&rcv,&r_data](const size_t n, const size_t threadNo){
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                rcv.get_tt(n), r_data[n], 0);
+                                rcv.get_tt(n), r_data[n], threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
                 }
-			}
-			
-			for_each(threads.begin(),threads.end(), mem_fn(&thread::join));
+			});
 		}
 	} else {
 		if ( num_threads == 1 ) {
@@ -231,38 +187,15 @@ int body(const input_parameters &par) {
 		} else {
 			// threaded jobs
 			
-			vector<thread> threads(num_threads-1);
-			size_t blk_start = 0;
-			for ( size_t i=0; i<num_threads-1; ++i ) {
-				
-				size_t blk_end = blk_start + blk_size;
-                
-				threads[i]=thread( [&g,&src,&rcv,blk_start,blk_end,i]{
-                    
-					for ( size_t n=blk_start; n<blk_end; ++n ) {
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                        rcv.get_tt(n), i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-					}
-				});
-				
-				blk_start = blk_end;
-			}
-			for ( size_t n=blk_start; n<nTx; ++n ) {
+			scheduler.run( [&g,&src,&rcv](const size_t n, const size_t threadNo){
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                rcv.get_tt(n), 0);
+                                rcv.get_tt(n), threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
                 }
-			}
-			
-			for_each(threads.begin(),threads.end(), mem_fn(&thread::join));
+			});
 		}
 	}
 	if ( par.time ) { end = chrono::high_resolution_clock::now(); }
@@ -271,6 +204,15 @@ int body(const input_parameters &par) {
 		cout.precision(12);
 		cout << "Time to perform raytracing: " <<
         chrono::duration<double>(end-begin).count() << '\n';
+        if ( num_threads > 1 ) {
+            for ( size_t i=0; i<num_threads; ++i ) {
+                cout << "  thread " << i << ": " << scheduler.getNshots(i)
+                << " shots, busy " << scheduler.getBusyTime(i) << " s\n";
+            }
+        }
+        if ( Instrumentation::enabled() ) {
+            g->getInstrumentation().report(cout);
+        }
 	}
 	
 	if ( par.saveGridTT>0 ) {
@@ -284,14 +226,38 @@ int body(const input_parameters &par) {
     
 
 	
+    size_t nNodes = g->getNumberOfNodes();
     delete g;
     
+    if ( par.saveMbinary > 0 ) {
+        string filename = par.basename+"_M.bin";
+        if ( par.verbose ) cout << "Saving matrix of partial derivatives of all sources in " << filename <<  " ... ";
+        CSRMatrix<T> M;
+        M.assemble(m_data, nNodes, num_threads);
+        try {
+            M.save(filename, par.saveMbinary==2);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << '\n';
+            exit(1);
+        }
+        if ( par.verbose ) cout << "done.\n";
+    }
+    
+    if ( par.saveTTbinary > 0 && par.rcvfile != "" ) {
+        string filename = par.basename+"_tt.bin";
+        if ( par.verbose ) cout << "Saving traveltimes of all sources in " << filename <<  " ... ";
+        rcv.save_tt_bin(filename, par.saveTTbinary==2);
+        if ( par.verbose ) cout << "done.\n";
+    }
+    
     if ( src.size() == 1 ) {
 		string filename = par.basename+"_tt.dat";
 		
-		if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
-		rcv.save_tt(filename, 0);
-		if ( par.verbose ) cout << "done.\n";
+        if ( par.saveTTbinary == 0 ) {
+            if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
+            rcv.save_tt(filename, 0);
+            if ( par.verbose ) cout << "done.\n";
+        }
 		
 		if ( par.saveRaypaths ) {
 			filename = par.basename+"_rp.vtp";
@@ -299,7 +265,7 @@ int body(const input_parameters &par) {
 			saveRayPaths(filename, r_data[0]);
 			if ( par.verbose ) cout << "done.\n";
 		}
-        if ( par.saveM ) {
+        if ( par.saveM && par.saveMbinary == 0 ) {
             filename = par.basename+"_M.dat";
             if ( par.verbose ) cout << "Saving matrix of partial derivatives in " << filename <<  " ... ";
             ofstream fout(filename);
@@ -321,9 +287,11 @@ int body(const input_parameters &par) {
             
             string filename = par.basename+"_"+srcname+"_tt.dat";
 			
-            if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
-            rcv.save_tt(filename, ns);
-            if ( par.verbose ) cout << "done.\n";
+            if ( par.saveTTbinary == 0 ) {
+                if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
+                rcv.save_tt(filename, ns);
+                if ( par.verbose ) cout << "done.\n";
+            }
 			
             if ( par.saveRaypaths ) {
                 filename = par.basename+"_"+srcname+"_rp.vtp";
@@ -331,7 +299,7 @@ int body(const input_parameters &par) {
                 saveRayPaths(filename, r_data[ns]);
                 if ( par.verbose ) cout << "done.\n";
 			}
-            if ( par.saveM ) {
+            if ( par.saveM && par.saveMbinary == 0 ) {
                 filename = par.basename+"_"+srcname+"_M.dat";
                 if ( par.verbose ) cout << "Saving matrix of partial derivatives in " << filename <<  " ... ";
                 ofstream fout(filename);
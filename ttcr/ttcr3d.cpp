@@ -31,6 +31,9 @@
 
 #include "Grid3D.h"
 #include "Rcv.h"
+#include "Renumbering.h"
+#include "ShotScheduler.h"
+#include "SparseMatrix.h"
 #include "Src.h"
 #include "structs_ttcr.h"
 #include "ttcr_io.h"
@@ -58,22 +61,40 @@ int body(const input_parameters &par) {
     if ( par.verbose ) cout << "done.\n";
 	
     
+    // Load the receiver file into the Rcv object rcv
+	Rcv<T> rcv( par.rcvfile );
+    if ( par.rcvfile != "" ) {
+        if ( par.verbose ) cout << "Reading receiver file " << par.rcvfile << " ... ";
+        rcv.init( src.size() );
+        if ( par.verbose ) cout << "done.\n";
+    }
+    
     // Calculate the number of threads to be used
 	size_t const nTx = src.size();
 	size_t num_threads = 1;
     size_t const min_per_thread=5;
 
+    // when only traveltimes at the receivers are needed, shots can be traced
+    // par.shotBatch at a time
+    bool const batched = par.shotBatch > 1 && par.rcvfile != "" && !par.saveM &&
+    !par.saveRaypaths && par.saveGridTT == 0 && !par.processReflectors;
+
+    // with reciprocity, receivers act as sources when they are fewer than the
+    // shots; traveltimes and raypaths are transposed after raytracing
+    bool const reciprocal = par.reciprocity && par.rcvfile != "" &&
+    rcv.get_coord().size() < nTx && !par.saveM && par.saveGridTT == 0 &&
+    !par.processReflectors;
+    size_t const nJobs = reciprocal ? rcv.get_coord().size() :
+    (batched ? (nTx+par.shotBatch-1)/par.shotBatch : nTx);
+
 	if ( par.nt == 0 ) {
 		size_t const hardware_threads = std::thread::hardware_concurrency();
-		size_t const max_threads = (nTx+min_per_thread-1)/min_per_thread;
+		size_t const max_threads = (nJobs+min_per_thread-1)/min_per_thread;
 		num_threads = std::min((hardware_threads!=0?hardware_threads:2), max_threads);
 	} else {
-		num_threads = par.nt < nTx ? par.nt : nTx;
+		num_threads = par.nt < nJobs ? par.nt : nJobs;
 	}
 	
-    size_t blk_size = nTx/num_threads;
-    if ( blk_size == 0 ) blk_size++;
-    
     
     // ? Find the generic file name of the input model?
 	string::size_type idx;  // can hold a string of any length
@@ -89,6 +110,7 @@ int body(const input_parameters &par) {
     Grid3D<T,uint32_t> *g=nullptr;
 
     vector<Rcv<T>> reflectors;
+    Renumbering<uint32_t> renum;
     
     // Load the grid file into the GRID3D object g for different formats
     if (extension == ".grd") {
@@ -102,13 +124,13 @@ int body(const input_parameters &par) {
 #endif
     } else if (extension == ".vtu") {
 #ifdef VTK
-        g = unstruct3D_vtu<T>(par, num_threads);
+        g = unstruct3D_vtu<T>(par, renum, num_threads);
 #else
 		cerr << "Error: Program not compiled with VTK support" << endl;
 		return 1;
 #endif
     } else if (extension == ".msh") {
-        g = unstruct3D<T>(par, reflectors, num_threads, src.size());
+        g = unstruct3D<T>(par, reflectors, renum, num_threads, src.size());
     } else {
         cerr << par.modelfile << " Unknown extenstion: " << extension << endl;
         return 1;
@@ -119,16 +141,19 @@ int body(const input_parameters &par) {
 		return 1;
     }
     
-    if ( par.source_radius != 0.0 ) g->setSourceRadius( par.source_radius );
-    
-    // Load the receiver file into the Rcv object rcv
-	Rcv<T> rcv( par.rcvfile );
-    if ( par.rcvfile != "" ) {
-        if ( par.verbose ) cout << "Reading receiver file " << par.rcvfile << " ... ";
-        rcv.init( src.size() );
-        if ( par.verbose ) cout << "done.\n";
+    // fewer threads may have been allocated to fit in the memory budget
+    num_threads = g->getNthreads();
+    if ( par.verbose ) {
+        cout << "Memory used by grid: " << g->getMemorySize()/(1024.0*1024.0)
+        << " MB (" << g->getThreadMemorySize()/(1024.0*1024.0)
+        << " MB per thread)\n";
     }
     
+    // shots (or batches of shots) are handed out to threads one at a time
+    ShotScheduler scheduler(nJobs, num_threads);
+    
+    if ( par.source_radius != 0.0 ) g->setSourceRadius( par.source_radius );
+    
     if ( par.verbose ) {
         if ( par.singlePrecision ) {
             cout << "Calculations will be done in single precision.\n";
@@ -138,7 +163,7 @@ int body(const input_parameters &par) {
     }
 	if ( par.verbose && num_threads>1 ) {
 		cout << "Calculations will be done using " << num_threads
-		<< " threads with " << blk_size << " shots per threads.\n";
+		<< " threads.\n";
 	}
 	
     
@@ -181,38 +206,90 @@ int body(const input_parameters &par) {
         } else {
             // threaded jobs
             
-            vector<thread> threads(num_threads-1);
-            size_t blk_start = 0;
-            for ( size_t i=0; i<num_threads-1; ++i ) {
-                
-                size_t blk_end = blk_start + blk_size;
-                
-                threads[i]=thread( [&g,&src,&rcv,&r_data,&v0,&m_data,blk_start,blk_end,i]{
-                    
-                    for ( size_t n=blk_start; n<blk_end; ++n ) {
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                        rcv.get_tt(n), r_data[n], v0[n], m_data[n], i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-                    }
-                });
-                
-                blk_start = blk_end;
-            }
-            for ( size_t n=blk_start; n<nTx; ++n ) {
+            scheduler.run( [&g,&src,&rcv,&r_data,&v0,&m_data](const size_t n, const size_t threadNo){
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), rcv.get_coord(),
-                                rcv.get_tt(n), r_data[n], v0[n], m_data[n], 0);
+                                rcv.get_tt(n), r_data[n], v0[n], m_data[n], threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
                 }
+            });
+        }
+    } else if ( reciprocal ) {
+        // all source points, traced to at once from each receiver
+        vector<sxyz<T>> all_src;
+        vector<size_t> offset(1, 0);
+        for ( size_t ns=0; ns<src.size(); ++ns ) {
+            all_src.insert(all_src.end(), src[ns].get_coord().begin(),
+                           src[ns].get_coord().end());
+            offset.push_back( all_src.size() );
+            if ( par.saveRaypaths ) r_data[ns].resize( rcv.get_coord().size() );
+        }
+        auto recip = [&par,&g,&src,&rcv,&r_data,&all_src,&offset](const size_t nr, const size_t threadNo){
+            vector<sxyz<T>> Tx(1, rcv.get_coord()[nr]);
+            vector<T> t0(1, 0.0);
+            vector<T> tt;
+            vector<vector<sxyz<T>>> rays;
+            try {
+                if ( par.saveRaypaths ) {
+                    g->raytrace(Tx, t0, all_src, tt, rays, threadNo);
+                } else {
+                    g->raytrace(Tx, t0, all_src, tt, threadNo);
+                }
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                abort();
             }
-            
-            for_each(threads.begin(),threads.end(), mem_fn(&thread::join));
+            for ( size_t ns=0; ns<src.size(); ++ns ) {
+                // first arrival over the points of the source
+                size_t imin = offset[ns];
+                T tmin = src[ns].get_t0()[0] + tt[imin];
+                for ( size_t i=offset[ns]+1; i<offset[ns+1]; ++i ) {
+                    T t = src[ns].get_t0()[i-offset[ns]] + tt[i];
+                    if ( t < tmin ) {
+                        tmin = t;
+                        imin = i;
+                    }
+                }
+                rcv.get_tt(ns)[nr] = tmin;
+                if ( par.saveRaypaths ) {
+                    r_data[ns][nr].assign( rays[imin].rbegin(), rays[imin].rend() );
+                }
+            }
+        };
+        if ( num_threads == 1 ) {
+            for ( size_t nr=0; nr<nJobs; ++nr ) {
+                recip(nr, 0);
+            }
+        } else {
+            // threaded jobs
+            scheduler.run( recip );
+        }
+    } else if ( batched ) {
+        auto batch = [&par,&g,&src,&rcv](const size_t nb, const size_t threadNo){
+            vector<const vector<sxyz<T>>*> Tx;
+            vector<const vector<T>*> t0;
+            vector<vector<T>*> tt;
+            for ( size_t n=nb*par.shotBatch; n<src.size() && n<(nb+1)*par.shotBatch; ++n ) {
+                Tx.push_back( &(src[n].get_coord()) );
+                t0.push_back( &(src[n].get_t0()) );
+                tt.push_back( &(rcv.get_tt(n)) );
+            }
+            try {
+                g->raytrace(Tx, t0, rcv.get_coord(), tt, threadNo);
+            } catch (std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                abort();
+            }
+        };
+        if ( num_threads == 1 ) {
+            for ( size_t nb=0; nb<nJobs; ++nb ) {
+                batch(nb, 0);
+            }
+        } else {
+            // threaded jobs
+            scheduler.run( batch );
         }
     } else if ( par.saveRaypaths && par.rcvfile != "" ) {
 		if ( num_threads == 1 ) {
@@ -262,81 +339,36 @@ int body(const input_parameters &par) {
 		} else {
 			// threaded jobs
 			
-			std::vector<std::thread> threads(num_threads-1);
-			size_t blk_start = 0;
-			for ( size_t i=0; i<num_threads-1; ++i ) {
+			scheduler.run( [&g,&src,&rcv,&r_data,&reflectors,&all_rcv,
+							&rfl_r_data,&rfl2_r_data](const size_t n, const size_t threadNo){
 				
-				size_t blk_end = blk_start + blk_size;
-				
-				threads[i]=thread( [&g,&src,&rcv,&r_data,&reflectors,&all_rcv,
-									&rfl_r_data,&rfl2_r_data,
-									blk_start,blk_end,i]{
-                    
-					for ( size_t n=blk_start; n<blk_end; ++n ) {
-						
-						vector<vector<T>*> all_tt;
-						all_tt.push_back( &(rcv.get_tt(n)) );
-                        vector<vector<vector<sxyz<T>>>*> all_r_data;
-                        all_r_data.push_back( &(r_data[n]) );
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-							all_tt.push_back( &(reflectors[nr].get_tt(n)) );
-                            all_r_data.push_back( &(rfl_r_data[nr][n]) );
-						}
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                        all_tt, all_r_data, i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-                            try {
-                                g->raytrace(reflectors[nr].get_coord(),
-                                            reflectors[nr].get_tt(n), rcv.get_coord(),
-                                            rcv.get_tt(n,nr+1), rfl2_r_data[nr][n], i+1);
-                            } catch (std::exception& e) {
-                                std::cerr << e.what() << std::endl;
-                                abort();
-                            }
-						}
-					}
-				});
-				
-				blk_start = blk_end;
-			}
-			for ( size_t n=blk_start; n<nTx; ++n ) {
-                
 				vector<vector<T>*> all_tt;
-                all_tt.push_back( &(rcv.get_tt(n)) );
+				all_tt.push_back( &(rcv.get_tt(n)) );
                 vector<vector<vector<sxyz<T>>>*> all_r_data;
                 all_r_data.push_back( &(r_data[n]) );
-                for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-                    all_tt.push_back( &(reflectors[nr].get_tt(n)) );
+				for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
+					all_tt.push_back( &(reflectors[nr].get_tt(n)) );
                     all_r_data.push_back( &(rfl_r_data[nr][n]) );
-                }
+				}
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                all_tt, all_r_data, 0);
+                                all_tt, all_r_data, threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
                 }
-
-                for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
+                
+				for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
                     try {
                         g->raytrace(reflectors[nr].get_coord(),
                                     reflectors[nr].get_tt(n), rcv.get_coord(),
-                                    rcv.get_tt(n,nr+1), rfl2_r_data[nr][n], 0);
+                                    rcv.get_tt(n,nr+1), rfl2_r_data[nr][n], threadNo);
                     } catch (std::exception& e) {
                         std::cerr << e.what() << std::endl;
                         abort();
                     }
-                }
-			}
-			
-			std::for_each(threads.begin(),threads.end(),
-						  std::mem_fn(&std::thread::join));
+				}
+			});
 		}
 	} else {
 		if ( num_threads == 1 ) {
@@ -383,47 +415,7 @@ int body(const input_parameters &par) {
 		} else {
 			// threaded jobs
 			
-			vector<thread> threads(num_threads-1);
-			size_t blk_start = 0;
-			for ( size_t i=0; i<num_threads-1; ++i ) {
-				
-				size_t blk_end = blk_start + blk_size;
-				
-				threads[i]=thread( [&par,&g,&src,&rcv,&all_rcv,&reflectors,
-									blk_start,blk_end,i]{
-					
-					for ( size_t n=blk_start; n<blk_end; ++n ) {
-						
-						vector<vector<T>*> all_tt;
-						if ( par.rcvfile != "" )
-                            all_tt.push_back( &(rcv.get_tt(n)) );
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-							all_tt.push_back( &(reflectors[nr].get_tt(n)) );
-						}
-                        try {
-                            g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                        all_tt, i+1);
-                        } catch (std::exception& e) {
-                            std::cerr << e.what() << std::endl;
-                            abort();
-                        }
-
-						for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
-                            try {
-                                g->raytrace(reflectors[nr].get_coord(),
-                                            reflectors[nr].get_tt(n), rcv.get_coord(),
-                                            rcv.get_tt(n,nr+1), i+1);
-                            } catch (std::exception& e) {
-                                std::cerr << e.what() << std::endl;
-                                abort();
-                            }
-						}
-					}
-				});
-				
-				blk_start = blk_end;
-			}
-			for ( size_t n=blk_start; n<nTx; ++n ) {
+			scheduler.run( [&par,&g,&src,&rcv,&all_rcv,&reflectors](const size_t n, const size_t threadNo){
 				
 				vector<vector<T>*> all_tt;
 				if ( par.rcvfile != "" )
@@ -433,26 +425,23 @@ int body(const input_parameters &par) {
 				}
                 try {
                     g->raytrace(src[n].get_coord(), src[n].get_t0(), all_rcv,
-                                all_tt, 0);
+                                all_tt, threadNo);
                 } catch (std::exception& e) {
                     std::cerr << e.what() << std::endl;
                     abort();
                 }
-
+                
 				for ( size_t nr=0; nr<reflectors.size(); ++nr ) {
                     try {
                         g->raytrace(reflectors[nr].get_coord(),
                                     reflectors[nr].get_tt(n), rcv.get_coord(),
-                                    rcv.get_tt(n,nr+1), 0);
+                                    rcv.get_tt(n,nr+1), threadNo);
                     } catch (std::exception& e) {
                         std::cerr << e.what() << std::endl;
                         abort();
                     }
 				}
-			}
-			
-			std::for_each(threads.begin(),threads.end(),
-						  std::mem_fn(&std::thread::join));
+			});
 		}
 	}
 	if ( par.time ) { end = chrono::high_resolution_clock::now(); }
@@ -467,15 +456,53 @@ int body(const input_parameters &par) {
 	if ( par.time ) {
 		cout << "Time to perform raytracing: "
 		<< chrono::duration<double>(end-begin).count() << '\n';
+        if ( num_threads > 1 ) {
+            for ( size_t i=0; i<num_threads; ++i ) {
+                cout << "  thread " << i << ": " << scheduler.getNshots(i)
+                << (reciprocal ? " receivers" : (batched ? " batches" : " shots")) << ", busy " << scheduler.getBusyTime(i) << " s\n";
+            }
+        }
+        if ( Instrumentation::enabled() ) {
+            g->getInstrumentation().report(cout);
+        }
 	}
 	    
 	// Delete stuff and dump the results
+    size_t nNodes = g->getNumberOfNodes();
     delete g;
     
+    if ( par.saveM && !renum.empty() ) {
+        // columns of M in the numbering of the input file
+        for ( size_t n=0; n<m_data.size(); ++n ) {
+            renum.restore( m_data[n] );
+        }
+    }
+    
+    if ( par.saveMbinary > 0 ) {
+        string filename = par.basename+"_M.bin";
+        if ( par.verbose ) cout << "Saving matrix of partial derivatives of all sources in " << filename <<  " ... ";
+        CSRMatrix<T> M;
+        M.assemble(m_data, nNodes, num_threads);
+        try {
+            M.save(filename, par.saveMbinary==2);
+        } catch (std::exception& e) {
+            std::cerr << e.what() << '\n';
+            exit(1);
+        }
+        if ( par.verbose ) cout << "done.\n";
+    }
+    
+    if ( par.saveTTbinary > 0 && par.rcvfile != "" ) {
+        string filename = par.basename+"_tt.bin";
+        if ( par.verbose ) cout << "Saving traveltimes of all sources in " << filename <<  " ... ";
+        rcv.save_tt_bin(filename, par.saveTTbinary==2);
+        if ( par.verbose ) cout << "done.\n";
+    }
+    
     if ( src.size() == 1 ) {
 		string filename = par.basename+"_tt.dat";
 		
-        if ( par.rcvfile != "" ) {
+        if ( par.rcvfile != "" && par.saveTTbinary == 0 ) {
             if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
             rcv.save_tt(filename, 0);
             if ( par.verbose ) cout << "done.\n";
@@ -523,7 +550,7 @@ int body(const input_parameters &par) {
 			}
 		}
         
-        if ( par.saveM ) {
+        if ( par.saveM && par.saveMbinary == 0 ) {
             filename = par.basename+"_M.dat";
             if ( par.verbose ) cout << "Saving matrix of partial derivatives in " << filename <<  " ... ";
             ofstream fout(filename);
@@ -546,7 +573,7 @@ int body(const input_parameters &par) {
             
             string filename = par.basename+"_"+srcname+"_tt.dat";
 			
-            if ( par.rcvfile != "" ) {
+            if ( par.rcvfile != "" && par.saveTTbinary == 0 ) {
                 if ( par.verbose ) cout << "Saving traveltimes in " << filename <<  " ... ";
                 rcv.save_tt(filename, ns);
                 if ( par.verbose ) cout << "done.\n";
@@ -583,7 +610,7 @@ int body(const input_parameters &par) {
 					if ( par.verbose ) cout << "done.\n";
 				}
             }
-            if ( par.saveM ) {
+            if ( par.saveM && par.saveMbinary == 0 ) {
                 filename = par.basename+"_"+srcname+"_M.dat";
                 if ( par.verbose ) cout << "Saving matrix of partial derivatives in " << filename <<  " ... ";
                 ofstream fout(filename);
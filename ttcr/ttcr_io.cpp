@@ -162,6 +162,10 @@ namespace ttcr {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 sin >> ip.rcvfile;
             }
+            else if (par.find("grid cache") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.gridCache;
+            }
             else if (par.find("secondary nodes") < 200) {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 uint32_t val;
@@ -171,10 +175,22 @@ namespace ttcr {
                 }
                 if ( n == 1 ) ip.nn[1] = ip.nn[2] = ip.nn[0];
             }
+            else if (par.find("dynamic nodes") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.nDynamic;
+            }
+            else if (par.find("dynamic radius") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.dynamic_radius;
+            }
             else if (par.find("number of threads") < 200) {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 sin >> ip.nt;
             }
+            else if (par.find("memory budget") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.memoryBudget;
+            }
             else if (par.find("inverse distance") < 200) {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 sin >> ip.inverseDistance;
@@ -195,6 +211,14 @@ namespace ttcr {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 sin >> ip.saveGridTT;
             }
+            else if (par.find("saveTTbinary") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.saveTTbinary;
+            }
+            else if (par.find("saveMbinary") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.saveMbinary;
+            }
             else if (par.find("process reflectors") < 200) {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 sin >> ip.processReflectors;
@@ -235,22 +259,53 @@ namespace ttcr {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 sin >> ip.source_radius;
             }
+            else if (par.find("source refinement") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.source_refinement;
+            }
             else if (par.find("rotated template") < 200) {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 int test;
                 sin >> test;
                 if ( test == 1 ) ip.rotated_template = true;
             }
+            else if (par.find("parallel sweeps") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.nt_sweep;
+            }
+            else if (par.find("shot batch") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                sin >> ip.shotBatch;
+            }
+            else if (par.find("reciprocity") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                int test;
+                sin >> test;
+                if ( test == 1 ) ip.reciprocity = true;
+            }
             else if (par.find("fsm high order") < 200) {
                 sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
                 int test;
                 sin >> test;
                 if ( test == 1 ) ip.weno3 = true;
             }
+            else if (par.find("geometry table") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                int test;
+                sin >> test;
+                if ( test == 1 ) ip.tetGeometry = true;
+            }
+            else if (par.find("renumber mesh") < 200) {
+                sin.str( value ); sin.seekg(0, std::ios_base::beg); sin.clear();
+                int test;
+                sin >> test;
+                if ( test == 1 ) ip.renumber = true;
+            }
             fin.getline(parameter, 200);
         }
         fin.close();
         
+        if ( ip.saveMbinary > 0 ) ip.saveM = true;
     }
     
 }
@@ -26,6 +26,7 @@
 #ifndef __TTCR_T_H__
 #define __TTCR_T_H__
 
+#include <chrono>
 #include <cmath>
 #include <type_traits>
 #include <vector>
@@ -444,6 +445,21 @@ namespace ttcr {
         std::vector<bool> inWater;
     };
 
+    // convergence history of an iterative solver (FSM)
+    template<typename T>
+    struct iterationLog {
+        std::vector<T> change;        // sum of |dt| over the grid at each iteration
+        std::vector<double> time;     // duration of each iteration [s]
+        std::chrono::high_resolution_clock::time_point begin;
+        
+        void clear() { change.clear(); time.clear(); }
+        void start() { begin = std::chrono::high_resolution_clock::now(); }
+        void push_back(const T c) {
+            change.push_back(c);
+            time.push_back( std::chrono::duration<double>(std::chrono::high_resolution_clock::now()-begin).count() );
+        }
+    };
+
     template<typename T>
     struct lineElem {
         T i[2];
@@ -629,6 +645,40 @@ namespace ttcr {
         }
     }
 
+    // index of edge ij of a tetrahedron (i != j), edges are 01 02 03 12 13 23
+    inline size_t tetEdge(const size_t i, const size_t j) {
+        static const size_t e[4][4] = { {0, 0, 1, 2}, {0, 0, 3, 4},
+            {1, 3, 0, 5}, {2, 4, 5, 0} };
+        return e[i][j];
+    }
+
+    // Geometric quantities of a tetrahedron needed by the local updates of
+    // FMM & FSM, which otherwise are computed for every update.  Other
+    // quantities (dot products of edges, projections of nodes on faces)
+    // follow from the law of cosines.
+    template<typename T>
+    struct tetrahedronGeometry {
+        T l[6];      // length of edges, in the order of tetEdge
+        T phi[4];    // twice the area of the face opposite to node i
+        T rho[4];    // distance between node i and the opposite face
+
+        tetrahedronGeometry(const sxyz<T>& p0, const sxyz<T>& p1,
+                            const sxyz<T>& p2, const sxyz<T>& p3) {
+            const sxyz<T> *p[4] = { &p0, &p1, &p2, &p3 };
+            for ( size_t i=0; i<4; ++i ) {
+                for ( size_t j=i+1; j<4; ++j ) {
+                    l[tetEdge(i,j)] = p[i]->getDistance( *(p[j]) );
+                }
+            }
+            T vol6 = std::abs( tripleScalar(p1-p0, p2-p0, p3-p0) );
+            for ( size_t i=0; i<4; ++i ) {
+                const sxyz<T>& a = *(p[(i+1)%4]);
+                phi[i] = norm( cross(*(p[(i+2)%4])-a, *(p[(i+3)%4])-a) );
+                rho[i] = phi[i] > 0.0 ? vol6/phi[i] : 0.0;
+            }
+        }
+    };
+
 #ifndef _MSC_VER
     // following 3 fct from
     // http://stackoverflow.com/questions/1903954/is-there-a-standard-sign-function-signum-sgn-in-c-c
@@ -25,6 +25,7 @@
 #ifndef ttcr_utils_h
 #define ttcr_utils_h
 
+#include <algorithm>
 #include <iostream>
 #include <set>
 #include <vector>
@@ -245,6 +246,37 @@ namespace ttcr {
         
     }
     
+    // number of distinct rows of pts, a n by ndim matrix stored by columns
+    // (as received from matlab)
+    template<typename T>
+    size_t countDistinct(const T* pts, const size_t n, const size_t ndim) {
+        auto less = [pts, n, ndim](const size_t a, const size_t b) {
+            for ( size_t d=0; d<ndim; ++d ) {
+                if ( pts[a+d*n] != pts[b+d*n] ) return pts[a+d*n] < pts[b+d*n];
+            }
+            return false;
+        };
+        std::vector<size_t> ind(n);
+        for ( size_t i=0; i<n; ++i ) ind[i] = i;
+        std::sort(ind.begin(), ind.end(), less);
+        size_t count = n>0 ? 1 : 0;
+        for ( size_t i=1; i<n; ++i ) {
+            if ( less(ind[i-1], ind[i]) ) count++;
+        }
+        return count;
+    }
+    
+    template<typename T>
+    size_t countDistinct(const std::vector<sxyz<T>>& pts) {
+        std::vector<T> tmp(3*pts.size());
+        for ( size_t i=0; i<pts.size(); ++i ) {
+            tmp[i] = pts[i].x;
+            tmp[i+pts.size()] = pts[i].y;
+            tmp[i+2*pts.size()] = pts[i].z;
+        }
+        return countDistinct(tmp.data(), pts.size(), 3);
+    }
+    
     template<typename T>
     std::string to_string( const T & value )
     {
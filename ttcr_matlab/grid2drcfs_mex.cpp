@@ -13,6 +13,7 @@
 #include "class_handle.hpp"
 
 #include "Grid2Drcfs.h"
+#include "utils.h"
 
 using namespace std;
 using namespace ttcr;
@@ -144,7 +145,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
     if (!strcmp("raytrace", cmd)) {
         // Check parameters
         
-        if ( nrhs != 5 && nrhs != 6 ) {
+        if ( nrhs < 5 || nrhs > 7 ) {
             mexErrMsgTxt("raytrace: Unexpected arguments.");
         }
         if (nlhs > 3) {
@@ -216,7 +217,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         // t0
         //
         double *tTx;
-        if ( nrhs == 6 ) {
+        if ( nrhs >= 6 ) {
             if (!(mxIsDouble(prhs[5]))) {
                 mexErrMsgTxt("t0 must be double precision.");
             }
@@ -249,6 +250,33 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         
         mxArray **Rays;
         
+        //
+        // reciprocity
+        //
+        bool reciprocal = false;
+        if ( nrhs == 7 ) {
+            if ( !mxIsLogicalScalar(prhs[6]) ) {
+                mexErrMsgTxt("reciprocal must be a logical scalar.");
+            }
+            reciprocal = mxIsLogicalScalarTrue(prhs[6]);
+        }
+        
+        /*
+         Traveltimes & raypaths only depend on the pair of points: with fewer
+         distinct Rx than distinct Tx, Tx & Rx are swapped, t0 being added to
+         the traveltimes and rays reversed at the end
+         */
+        double *tSrc = tTx;
+        vector<double> zeros;
+        if ( reciprocal && nlhs <= 2 &&
+            countDistinct(Rx, nRx, 2) < countDistinct(Tx, nTx, 2) ) {
+            std::swap(Tx, Rx);
+            zeros.assign(nTx, 0.0);
+            tSrc = zeros.data();
+        } else {
+            reciprocal = false;
+        }
+        
         /*
          Looking for redundants Tx pts
          */
@@ -259,7 +287,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         sxz_tmp.x = Tx[0];
         sxz_tmp.z = Tx[nTx];
         vTx.push_back( vector<sxz<double> >(1, sxz_tmp) );
-        t0.push_back( vector<double>(1, tTx[0]) );
+        t0.push_back( vector<double>(1, tSrc[0]) );
         iTx.push_back( vector<size_t>(1, 0) );  // indices of Rx corresponding to current Tx
         for ( size_t ntx=1; ntx<nTx; ++ntx ) {
             sxz_tmp.x = Tx[ntx];
@@ -276,7 +304,7 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
             }
             if ( !found ) {
                 vTx.push_back( vector<sxz<double>>(1, sxz_tmp) );
-                t0.push_back( vector<double>(1, tTx[ntx]) );
+                t0.push_back( vector<double>(1, tSrc[ntx]) );
                 iTx.push_back( vector<size_t>(1, ntx) );
             }
         }
@@ -392,8 +420,21 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
                 t_arr[ iTx[nv][ni] ] = tt[nv][ni];
             }
         }
+        if ( reciprocal ) {
+            for ( size_t n=0; n<nTx; ++n ) {
+                t_arr[n] += tTx[n];
+            }
+        }
         
         if ( nlhs >= 2 ) {
+            if ( reciprocal ) {
+                // rays were traced from Rx to Tx
+                for ( size_t nv=0; nv<r_data.size(); ++nv ) {
+                    for ( size_t ni=0; ni<r_data[nv].size(); ++ni ) {
+                        std::reverse(r_data[nv][ni].begin(), r_data[nv][ni].end());
+                    }
+                }
+            }
             // 2rd arg: rays.
             plhs[1] = mxCreateCellMatrix(nRx, 1);
             Rays = (mxArray **) mxCalloc(nRx, sizeof(mxArray *));
@@ -601,6 +642,49 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
         return;
     }
 
+    //  ---------------------------------------------------------------------------
+    // getInstrumentation: time spent in each phase (nThreads x 5, in s) and
+    // number of operations (nThreads x 4), zero unless compiled with
+    // -DTTCR_INSTRUMENT; see ttcr/Instrumentation.h for the columns
+    if (!strcmp("getInstrumentation", cmd)) {
+        if ( nrhs > 2 ) {
+            mexErrMsgTxt("getInstrumentation: No arguments needed.");
+        }
+        if (nlhs > 2) {
+            mexErrMsgTxt("getInstrumentation: has a maximum of two output arguments.");
+        }
+        const Instrumentation& instr = grid_instance->getInstrumentation();
+        const size_t nt = instr.getNthreads();
+        
+        plhs[0] = mxCreateDoubleMatrix(nt, N_PHASES, mxREAL);
+        double *time = mxGetPr(plhs[0]);
+        for ( size_t p=0; p<N_PHASES; ++p ) {
+            for ( size_t n=0; n<nt; ++n ) {
+                time[p*nt+n] = instr.getTime(static_cast<InstrumentedPhase>(p), n);
+            }
+        }
+        if ( nlhs == 2 ) {
+            plhs[1] = mxCreateDoubleMatrix(nt, N_COUNTS, mxREAL);
+            double *count = mxGetPr(plhs[1]);
+            for ( size_t c=0; c<N_COUNTS; ++c ) {
+                for ( size_t n=0; n<nt; ++n ) {
+                    count[c*nt+n] = static_cast<double>(instr.getCount(static_cast<InstrumentedCount>(c), n));
+                }
+            }
+        }
+        return;
+    }
+    
+    //  ---------------------------------------------------------------------------
+    // resetInstrumentation
+    if (!strcmp("resetInstrumentation", cmd)) {
+        if ( nrhs > 2 || nlhs > 0 ) {
+            mexErrMsgTxt("resetInstrumentation: Unexpected arguments.");
+        }
+        grid_instance->resetInstrumentation();
+        return;
+    }
+    
     // Got here, so command not recognized
     mexErrMsgTxt("Command not recognized.");
 }
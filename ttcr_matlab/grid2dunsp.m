@@ -20,6 +20,7 @@
 %
 %     [tt] = g.raytrace(s, Tx, Rx, t0)
 %     [tt, rays] = g.raytrace(s, Tx, Rx, t0)
+%     [tt, rays] = g.raytrace(s, Tx, Rx, t0, reciprocal)
 %     [tt, rays, v0] = g.raytrace(s, Tx, Rx, t0)
 %     [tt, rays, v0, M] = g.raytrace(s, Tx, Rx, t0)
 %
@@ -34,6 +35,10 @@
 %           3rd contains Z coordinates
 %     t0: source epoch, nTx by 1
 %           t0 is optional (0 if not given)
+%     reciprocal: if true, traveltimes and rays are computed from the
+%           receivers when there are fewer distinct receivers than distinct
+%           sources; only with one or two output arguments (optional,
+%           false if not given)
 %
 %     *** nTx must be equal to nRx, i.e. each row define one Tx-Rx pair ***
 %     *** nSlowness must equal the number of nodes in g ***
@@ -105,6 +110,16 @@ classdef grid2dunsp < handle
         function varargout = raytrace(this, varargin)
             [varargout{1:nargout}] = grid2dunsp_mex('raytrace', this.objectHandle, varargin{:});
         end
+        
+        % getInstrumentation: [time, count] per thread, see README
+        function varargout = getInstrumentation(this, varargin)
+            [varargout{1:nargout}] = grid2dunsp_mex('getInstrumentation', this.objectHandle, varargin{:});
+        end
+        
+        % resetInstrumentation
+        function resetInstrumentation(this)
+            grid2dunsp_mex('resetInstrumentation', this.objectHandle);
+        end
 
         %% computeD
         function varargout = computeD(this, varargin)
@@ -23,6 +23,7 @@
 %  Raytracing
 %    [tt] = g.raytrace(s, Tx, Rx, t0)
 %    [tt, rays] = g.raytrace(s, Tx, Rx, t0)
+%    [tt, rays] = g.raytrace(s, Tx, Rx, t0, reciprocal)
 %    [tt, rays, L] = g.raytrace(s, Tx, Rx, t0)
 %
 %   Input
@@ -36,6 +37,10 @@
 %          3rd contains Z coordinates
 %    t0: source epoch, nTx by 1
 %          t0 is optional (0 if not given)
+%    reciprocal: if true, traveltimes and rays are computed from the
+%          receivers when there are fewer distinct receivers than distinct
+%          sources; only with one or two output arguments (optional,
+%          false if not given)
 %
 %    *** IMPORTANT: Tx or Rx should _not_ lie on (or close to) an external
 %                   face of the grid when rays are needed ***
@@ -84,6 +89,16 @@ classdef grid3drcfs < handle
             [varargout{1:nargout}] = grid3drcfs_mex('raytrace', this.objectHandle, varargin{:});
         end
         
+        % getInstrumentation: [time, count] per thread, see README
+        function varargout = getInstrumentation(this, varargin)
+            [varargout{1:nargout}] = grid3drcfs_mex('getInstrumentation', this.objectHandle, varargin{:});
+        end
+        
+        % resetInstrumentation
+        function resetInstrumentation(this)
+            grid3drcfs_mex('resetInstrumentation', this.objectHandle);
+        end
+        
         % for saving in mat-files
         function s = saveobj(obj)
             s.xmin = grid2drcfs_mex('get_xmin', obj.objectHandle);
@@ -17,6 +17,7 @@
 %  Raytracing
 %    [tt] = g.raytrace(s, Tx, Rx, t0)
 %    [tt, rays] = g.raytrace(s, Tx, Rx, t0)
+%    [tt, rays] = g.raytrace(s, Tx, Rx, t0, reciprocal)
 %    [tt, rays, v0] = g.raytrace(s, Tx, Rx, t0)
 %    [tt, rays, v0, M] = g.raytrace(s, Tx, Rx, t0)
 %
@@ -31,6 +32,10 @@
 %          3rd contains Z coordinates
 %    t0: source epoch, nTx by 1
 %          t0 is optional (0 if not given)
+%    reciprocal: if true, traveltimes and rays are computed from the
+%          receivers when there are fewer distinct receivers than distinct
+%          sources; only with one or two output arguments (optional,
+%          false if not given)
 %
 %    *** IMPORTANT: Tx or Rx should _not_ lie on (or close to) an external
 %                   face of the grid when rays are needed ***
@@ -93,5 +98,15 @@ classdef grid3dunfs < handle
         function varargout = raytrace(this, varargin)
             [varargout{1:nargout}] = grid3dunfs_mex('raytrace', this.objectHandle, varargin{:});
         end
+        
+        % getInstrumentation: [time, count] per thread, see README
+        function varargout = getInstrumentation(this, varargin)
+            [varargout{1:nargout}] = grid3dunfs_mex('getInstrumentation', this.objectHandle, varargin{:});
+        end
+        
+        % resetInstrumentation
+        function resetInstrumentation(this)
+            grid3dunfs_mex('resetInstrumentation', this.objectHandle);
+        end
     end
 end
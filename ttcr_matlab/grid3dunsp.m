@@ -17,6 +17,7 @@
 %  Raytracing
 %    [tt] = raytrace(g, s, Tx, Rx, t0)
 %    [tt, rays] = raytrace(g, s, Tx, Rx, t0)
+%    [tt, rays] = raytrace(g, s, Tx, Rx, t0, reciprocal)
 %
 %   Input
 %    g: grid instance
@@ -29,6 +30,10 @@
 %          3rd contains Z coordinates
 %    t0: source epoch, nTx by 1
 %          t0 is optional (0 if not given)
+%    reciprocal: if true, traveltimes and rays are computed from the
+%          receivers when there are fewer distinct receivers than distinct
+%          sources; only with one or two output arguments (optional,
+%          false if not given)
 %
 %    *** nTx must be equal to nRx, i.e. each row define one Tx-Rx pair ***
 %    *** nSlowness must equal the number of nodes in g ***
@@ -71,5 +76,15 @@ classdef grid3dunsp < handle
         function varargout = raytrace(this, varargin)
             [varargout{1:nargout}] = grid3dunsp_mex('raytrace', this.objectHandle, varargin{:});
         end
+        
+        % getInstrumentation: [time, count] per thread, see README
+        function varargout = getInstrumentation(this, varargin)
+            [varargout{1:nargout}] = grid3dunsp_mex('getInstrumentation', this.objectHandle, varargin{:});
+        end
+        
+        % resetInstrumentation
+        function resetInstrumentation(this)
+            grid3dunsp_mex('resetInstrumentation', this.objectHandle);
+        end
     end
 end
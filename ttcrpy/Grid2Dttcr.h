@@ -49,6 +49,11 @@ namespace ttcr {
             delete grid_instance;
         }
         std::string getType() const { return type; }
+        size_t getNthreads() const { return grid_instance->getNthreads(); }
+        const Instrumentation& getInstrumentation() const {
+            return grid_instance->getInstrumentation();
+        }
+        void resetInstrumentation() const { grid_instance->resetInstrumentation(); }
         
         void setSlowness(const std::vector<double>& slowness);
         void setXi(const std::vector<double>& xi);
@@ -72,6 +77,15 @@ namespace ttcr {
                       const std::vector<sxz<double>>& Rx,
                       double* traveltimes) const;
         
+        // Tx & Rx are C-ordered arrays of nTx points; runs on thread slot
+        // threadNo only and does not touch python objects
+        void raytrace(const double* Tx,
+                      const double* tTx,
+                      const double* Rx,
+                      const size_t nTx,
+                      double* traveltimes,
+                      const size_t threadNo) const;
+        
         static int Lsr2d(const double* Tx,
                           const double* Rx,
                           const size_t nTx,
@@ -79,7 +93,8 @@ namespace ttcr {
                           const size_t n_grx,
                           const double* grz,
                           const size_t n_grz,
-                          PyObject* L);
+                          PyObject* L,
+                          const size_t nThreads=1);
 
 		static int Lsr2da(const double* Tx,
 						   const double* Rx,
@@ -88,7 +103,8 @@ namespace ttcr {
 						   const size_t n_grx,
 						   const double* grz,
 						   const size_t n_grz,
-						   PyObject* L);
+						   PyObject* L,
+						   const size_t nThreads=1);
 
 		
     private:
@@ -96,6 +112,17 @@ namespace ttcr {
         grid *grid_instance;
 		
         Grid2Dttcr() {}
+
+        static int straightRays(const double* Tx,
+                                const double* Rx,
+                                const size_t nTx,
+                                const double* grx,
+                                const size_t n_grx,
+                                const double* grz,
+                                const size_t n_grz,
+                                PyObject* L,
+                                const bool aniso,
+                                const size_t nThreads);
     };
 	
 }
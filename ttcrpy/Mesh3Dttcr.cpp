@@ -9,6 +9,9 @@
 #include <thread>
 
 #include "Mesh3Dttcr.h"
+#include "ShotScheduler.h"
+#include "SparseMatrix.h"
+#include "utils.h"
 
 using namespace std;
 
@@ -17,7 +20,7 @@ namespace ttcr {
     Mesh3Dttcr::Mesh3Dttcr(const std::vector<sxyz<double>>& no,
                            const std::vector<tetrahedronElem<uint32_t>>& tet,
                            const double eps, const int maxit, const bool rp=false,
-                           const size_t nt=1) {
+                           const size_t nt=1) : reciprocal(false) {
         // find mesh "corners"
         double xmin = no[0].x;
         double xmax = no[0].x;
@@ -59,31 +62,43 @@ namespace ttcr {
                               const std::vector<double>& tTx,
                               const std::vector<sxyz<double>>& Rx,
                               double* traveltimes) const {
+        /*
+         Traveltimes only depend on the pair of points: with fewer distinct
+         Rx than distinct Tx, waves are propagated from the Rx and t0 is
+         added to the traveltimes at the end
+         */
+        const bool swap = reciprocal && countDistinct(Rx) < countDistinct(Tx);
+        vector<double> zeros;
+        if ( swap ) zeros.assign(Tx.size(), 0.0);
+        const vector<sxyz<double>>& src = swap ? Rx : Tx;
+        const vector<sxyz<double>>& rcv = swap ? Tx : Rx;
+        const vector<double>& tsrc = swap ? zeros : tTx;
+        
         /*
          Looking for redundants Tx pts
          */
         
-        size_t nTx = Tx.size();
-        size_t nRx = Rx.size();
+        size_t nTx = src.size();
+        size_t nRx = rcv.size();
         vector<vector<sxyz<double>>> vTx;
         vector<vector<double>> t0;
         vector<vector<size_t>> iTx;
-        vTx.push_back( vector<sxyz<double> >(1, Tx[0]) );
-        t0.push_back( vector<double>(1, tTx[0]) );
+        vTx.push_back( vector<sxyz<double> >(1, src[0]) );
+        t0.push_back( vector<double>(1, tsrc[0]) );
         iTx.push_back( vector<size_t>(1, 0) );  // indices of Rx corresponding to current Tx
         for ( size_t ntx=1; ntx<nTx; ++ntx ) {
             bool found = false;
             
             for ( size_t nv=0; nv<vTx.size(); ++nv ) {
-                if ( vTx[nv][0]==Tx[ntx] ) {
+                if ( vTx[nv][0]==src[ntx] ) {
                     found = true;
                     iTx[nv].push_back( ntx ) ;
                     break;
                 }
             }
             if ( !found ) {
-                vTx.push_back( vector<sxyz<double>>(1, Tx[ntx]) );
-                t0.push_back( vector<double>(1, tTx[ntx]) );
+                vTx.push_back( vector<sxyz<double>>(1, src[ntx]) );
+                t0.push_back( vector<double>(1, tsrc[ntx]) );
                 iTx.push_back( vector<size_t>(1, ntx) );
             }
         }
@@ -100,7 +115,7 @@ namespace ttcr {
                 
                 vRx.resize( 0 );
                 for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
-                    vRx.push_back( Rx[ iTx[nv][ni] ] );
+                    vRx.push_back( rcv[ iTx[nv][ni] ] );
                 }
                 try {
                     mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt[nv]);
@@ -110,54 +125,99 @@ namespace ttcr {
             }
         } else {
             size_t num_threads = mesh_instance->getNthreads();
-            size_t blk_size = vTx.size()/num_threads;
-            if ( blk_size == 0 ) blk_size++;
-            
-            vector<thread> threads(num_threads-1);
-            size_t blk_start = 0;
-            for ( size_t i=0; i<num_threads-1; ++i ) {
-                
-                size_t blk_end = blk_start + blk_size;
-                mesh *mesh_ref = mesh_instance;
-                threads[i]=thread( [&mesh_ref,&vTx,&tt,&t0,&Rx,&iTx,&nRx,
-                                    blk_start,blk_end,i]{
-                    
-                    for ( size_t nv=blk_start; nv<blk_end; ++nv ) {
-                        
-                        vector<sxyz<double>> vRx;
-                        for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
-                            vRx.push_back( Rx[ iTx[nv][ni] ] );
-                        }
-                        try {
-                            mesh_ref->raytrace(vTx[nv], t0[nv], vRx, tt[nv], i+1);
-                        } catch (std::exception& e) {
-                            throw;
-                        }
-                    }
-                });
-                
-                blk_start = blk_end;
-            }
+            ShotScheduler scheduler(vTx.size(), num_threads);
             
-            for ( size_t nv=blk_start; nv<vTx.size(); ++nv ) {
+            scheduler.run( [this,&vTx,&tt,&t0,&rcv,&iTx,&nRx](const size_t nv, const size_t threadNo){
                 vector<sxyz<double>> vRx;
                 for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
-                    vRx.push_back( Rx[ iTx[nv][ni] ] );
+                    vRx.push_back( rcv[ iTx[nv][ni] ] );
                 }
                 try {
-                    mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt[nv], 0);
+                    mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt[nv], threadNo);
                 } catch (std::exception& e) {
                     throw;
                 }
+            });
+        }
+        
+        for ( size_t nv=0; nv<vTx.size(); ++nv ) {
+            for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
+                traveltimes[ iTx[nv][ni] ] = tt[nv][ni];
+            }
+        }
+        if ( swap ) {
+            for ( size_t n=0; n<nTx; ++n ) {
+                traveltimes[n] += tTx[n];
             }
+        }
+    }
+    
+    void Mesh3Dttcr::raytrace(const double* Tx,
+                              const double* tTx,
+                              const double* Rx,
+                              const size_t nTx,
+                              double* traveltimes,
+                              const size_t threadNo) const {
+        
+        vector<sxyz<double>> vTx0( nTx );
+        vector<sxyz<double>> vRx0( nTx );
+        for ( size_t n=0; n<nTx; ++n ) {
+            vTx0[n] = {Tx[3*n], Tx[3*n+1], Tx[3*n+2]};
+            vRx0[n] = {Rx[3*n], Rx[3*n+1], Rx[3*n+2]};
+        }
+        const bool swap = reciprocal && countDistinct(vRx0) < countDistinct(vTx0);
+        const vector<sxyz<double>>& src = swap ? vRx0 : vTx0;
+        const vector<sxyz<double>>& rcv = swap ? vTx0 : vRx0;
+        
+        /*
+         Looking for redundants Tx pts
+         */
+        
+        vector<vector<sxyz<double>>> vTx;
+        vector<vector<double>> t0;
+        vector<vector<size_t>> iTx;
+        vTx.push_back( vector<sxyz<double> >(1, src[0]) );
+        t0.push_back( vector<double>(1, swap ? 0.0 : tTx[0]) );
+        iTx.push_back( vector<size_t>(1, 0) );  // indices of Rx corresponding to current Tx
+        for ( size_t ntx=1; ntx<nTx; ++ntx ) {
+            bool found = false;
             
-            std::for_each(threads.begin(),threads.end(),
-                          std::mem_fn(&std::thread::join));
+            for ( size_t nv=0; nv<vTx.size(); ++nv ) {
+                if ( vTx[nv][0]==src[ntx] ) {
+                    found = true;
+                    iTx[nv].push_back( ntx ) ;
+                    break;
+                }
+            }
+            if ( !found ) {
+                vTx.push_back( vector<sxyz<double>>(1, src[ntx]) );
+                t0.push_back( vector<double>(1, swap ? 0.0 : tTx[ntx]) );
+                iTx.push_back( vector<size_t>(1, ntx) );
+            }
         }
         
+        /*
+         Looping over all non redundant Tx
+         */
+        
+        vector<sxyz<double>> vRx;
+        vector<double> tt;
         for ( size_t nv=0; nv<vTx.size(); ++nv ) {
+            
+            vRx.resize( 0 );
             for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
-                traveltimes[ iTx[nv][ni] ] = tt[nv][ni];
+                vRx.push_back( rcv[ iTx[nv][ni] ] );
+            }
+            
+            mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt, threadNo);
+            
+            for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
+                traveltimes[ iTx[nv][ni] ] = tt[ni];
+            }
+        }
+        if ( swap ) {
+            for ( size_t n=0; n<nTx; ++n ) {
+                traveltimes[n] += tTx[n];
             }
         }
     }
@@ -224,49 +284,19 @@ namespace ttcr {
             }
         } else {
             size_t num_threads = mesh_instance->getNthreads();
-            size_t blk_size = vTx.size()/num_threads;
-            if ( blk_size == 0 ) blk_size++;
-            
-            vector<thread> threads(num_threads-1);
-            size_t blk_start = 0;
-            for ( size_t i=0; i<num_threads-1; ++i ) {
-                
-                size_t blk_end = blk_start + blk_size;
-                mesh *mesh_ref = mesh_instance;
-                threads[i]=thread( [&mesh_ref,&vTx,&tt,&t0,&Rx,&iTx,&nRx,
-                                    &r_data,&v0,blk_start,blk_end,i]{
-                    
-                    for ( size_t nv=blk_start; nv<blk_end; ++nv ) {
-                        
-                        vector<sxyz<double>> vRx;
-                        for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
-                            vRx.push_back( Rx[ iTx[nv][ni] ] );
-                        }
-                        try {
-                            mesh_ref->raytrace(vTx[nv], t0[nv], vRx, tt[nv], r_data[nv], v0[nv], i+1);
-                        } catch (std::exception& e) {
-                            throw;
-                        }
-                    }
-                });
-                
-                blk_start = blk_end;
-            }
+            ShotScheduler scheduler(vTx.size(), num_threads);
             
-            for ( size_t nv=blk_start; nv<vTx.size(); ++nv ) {
+            scheduler.run( [this,&vTx,&tt,&t0,&Rx,&iTx,&nRx,&r_data,&v0](const size_t nv, const size_t threadNo){
                 vector<sxyz<double>> vRx;
                 for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
                     vRx.push_back( Rx[ iTx[nv][ni] ] );
                 }
                 try {
-                    mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt[nv], r_data[nv], v0[nv], 0);
+                    mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt[nv], r_data[nv], v0[nv], threadNo);
                 } catch (std::exception& e) {
                     throw;
                 }
-            }
-            
-            std::for_each(threads.begin(),threads.end(),
-                          std::mem_fn(&std::thread::join));
+            });
         }
         
         for ( size_t nv=0; nv<vTx.size(); ++nv ) {
@@ -361,49 +391,19 @@ namespace ttcr {
             }
         } else {
             size_t num_threads = mesh_instance->getNthreads();
-            size_t blk_size = vTx.size()/num_threads;
-            if ( blk_size == 0 ) blk_size++;
+            ShotScheduler scheduler(vTx.size(), num_threads);
             
-            vector<thread> threads(num_threads-1);
-            size_t blk_start = 0;
-            for ( size_t i=0; i<num_threads-1; ++i ) {
-                
-                size_t blk_end = blk_start + blk_size;
-                mesh *mesh_ref = mesh_instance;
-                threads[i]=thread( [&mesh_ref,&vTx,&tt,&t0,&Rx,&iTx,&nRx,
-                                    &r_data,&v0,&m_data,blk_start,blk_end,i]{
-                    
-                    for ( size_t nv=blk_start; nv<blk_end; ++nv ) {
-                        
-                        vector<sxyz<double>> vRx;
-                        for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
-                            vRx.push_back( Rx[ iTx[nv][ni] ] );
-                        }
-                        try {
-                            mesh_ref->raytrace(vTx[nv], t0[nv], vRx, tt[nv], r_data[nv], v0[nv], m_data[nv], i+1);
-                        } catch (std::exception& e) {
-                            throw;
-                        }
-                    }
-                });
-                
-                blk_start = blk_end;
-            }
-            
-            for ( size_t nv=blk_start; nv<vTx.size(); ++nv ) {
+            scheduler.run( [this,&vTx,&tt,&t0,&Rx,&iTx,&nRx,&r_data,&v0,&m_data](const size_t nv, const size_t threadNo){
                 vector<sxyz<double>> vRx;
                 for ( size_t ni=0; ni<iTx[nv].size(); ++ni ) {
                     vRx.push_back( Rx[ iTx[nv][ni] ] );
                 }
                 try {
-                    mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt[nv], r_data[nv], v0[nv], m_data[nv], 0);
+                    mesh_instance->raytrace(vTx[nv], t0[nv], vRx, tt[nv], r_data[nv], v0[nv], m_data[nv], threadNo);
                 } catch (std::exception& e) {
                     throw;
                 }
-            }
-            
-            std::for_each(threads.begin(),threads.end(),
-                          std::mem_fn(&std::thread::join));
+            });
         }
 
         for ( size_t nv=0; nv<vTx.size(); ++nv ) {
@@ -445,11 +445,9 @@ namespace ttcr {
             
             PyObject* tuple = PyTuple_New(3);
             
-            size_t nRcv = m_data[nv].size();
-            size_t nnz = 0;
-            for ( size_t ni=0; ni<m_data[nv].size(); ++ni ) {
-                nnz += m_data[nv][ni].size();
-            }
+            CSRRows<sijv<double>> rows(m_data[nv]);
+            size_t nRcv = rows.size();
+            size_t nnz = rows.nnz();
             
             
             npy_intp dims[] = {static_cast<npy_intp>(nnz)};
@@ -463,20 +461,7 @@ namespace ttcr {
             int64_t* indptr_p = new int64_t[nRcv+1];
             PyObject* indptr = PyArray_SimpleNewFromData(1, dims, NPY_INT64, indptr_p);
             
-            size_t k = 0;
-            for ( size_t ni=0; ni<nRcv; ++ni ) {
-                indptr_p[ni] = k;
-                for ( size_t j=0; j<nnodes; ++j ) {
-                    for ( size_t n=0; n<m_data[nv][ni].size(); ++n) {
-                        if ( m_data[nv][ni][n].j == j && m_data[nv][ni][n].i == ni ) {
-                            indices_p[k] = j;
-                            data_p[k] = m_data[nv][ni][n].v;
-                            k++;
-                        }
-                    }
-                }
-            }
-            indptr_p[nRcv] = k;
+            rows.fill(indptr_p, indices_p, data_p, nnodes, mesh_instance->getNthreads());
             
             PyTuple_SetItem(tuple, 0, data);
             PyTuple_SetItem(tuple, 1, indices);
@@ -33,11 +33,30 @@ namespace ttcr {
         
         void setSlowness(const std::vector<double>& slowness);
         
+        size_t getNthreads() const { return mesh_instance->getNthreads(); }
+        const Instrumentation& getInstrumentation() const {
+            return mesh_instance->getInstrumentation();
+        }
+        void resetInstrumentation() const { mesh_instance->resetInstrumentation(); }
+        
+        // compute traveltimes from the receivers when there are fewer
+        // distinct receivers than distinct sources
+        void setReciprocity(const bool r) { reciprocal = r; }
+        
         void raytrace(const std::vector<sxyz<double>>& Tx,
                      const std::vector<double>& tTx,
                      const std::vector<sxyz<double>>& Rx,
                      double* traveltimes) const;
 
+        // Tx & Rx are C-ordered arrays of nTx points; runs on thread slot
+        // threadNo only and does not touch python objects
+        void raytrace(const double* Tx,
+                      const double* tTx,
+                      const double* Rx,
+                      const size_t nTx,
+                      double* traveltimes,
+                      const size_t threadNo) const;
+
         void raytrace(const std::vector<sxyz<double>>& Tx,
                      const std::vector<double>& tTx,
                      const std::vector<sxyz<double>>& Rx,
@@ -55,6 +74,7 @@ namespace ttcr {
 
     private:
         mesh *mesh_instance;
+        bool reciprocal;
         
         Mesh3Dttcr() {}
     };
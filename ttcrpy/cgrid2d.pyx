@@ -34,6 +34,8 @@
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libc.stdint cimport uint32_t
+from libcpp cimport bool
+cimport cython
 
 import numpy as np
 cimport numpy as np
@@ -45,21 +47,55 @@ cdef extern from "ttcr_t.h" namespace "ttcr":
         sxz(T, T) except +
 
 
+cdef extern from "Instrumentation.h" namespace "ttcr":
+    cdef enum InstrumentedPhase:
+        N_PHASES
+    cdef enum InstrumentedCount:
+        N_COUNTS
+    cdef cppclass Instrumentation:
+        size_t getNthreads()
+        double getTime(InstrumentedPhase, size_t)
+        size_t getCount(InstrumentedCount, size_t)
+        @staticmethod
+        bool enabled()
+        @staticmethod
+        const char* phaseName(InstrumentedPhase)
+        @staticmethod
+        const char* countName(InstrumentedCount)
+
 cdef extern from "Grid2Dttcr.h" namespace "ttcr":
     cdef cppclass Grid2Dttcr:
         Grid2Dttcr(string&, uint32_t, uint32_t, double, double, double, double, uint32_t, uint32_t, size_t) except +
         string getType()
+        size_t getNthreads()
+        const Instrumentation& getInstrumentation()
+        void resetInstrumentation()
         void setSlowness(const vector[double]&) except +
         void setXi(const vector[double]&) except +
         void setTheta(const vector[double]&) except +
         void raytrace(vector[sxz[double]]&,vector[double]&,vector[sxz[double]]&,double*,object,object) except +
         void raytrace(vector[sxz[double]]&,vector[double]&,vector[sxz[double]]&,double*,object) except +
         void raytrace(vector[sxz[double]]&,vector[double]&,vector[sxz[double]]&,double*) except +
+        void raytrace(const double*,const double*,const double*,size_t,double*,size_t) except + nogil
         @staticmethod
-        int Lsr2d(double*,double*,size_t,double*,size_t,double*,size_t,object)
+        int Lsr2d(double*,double*,size_t,double*,size_t,double*,size_t,object,size_t)
         @staticmethod
-        int Lsr2da(double*,double*,size_t,double*,size_t,double*,size_t,object)
-
+        int Lsr2da(double*,double*,size_t,double*,size_t,double*,size_t,object,size_t)
+
+
+cdef instrumentation_dict(const Instrumentation& instr):
+    cdef size_t n
+    cdef int i
+    cdef size_t nt = instr.getNthreads()
+    time = {}
+    for i in range(N_PHASES):
+        time[Instrumentation.phaseName(<InstrumentedPhase>i).decode()] = np.array(
+            [instr.getTime(<InstrumentedPhase>i, n) for n in range(nt)])
+    count = {}
+    for i in range(N_COUNTS):
+        count[Instrumentation.countName(<InstrumentedCount>i).decode()] = np.array(
+            [instr.getCount(<InstrumentedCount>i, n) for n in range(nt)], dtype=np.int64)
+    return {'enabled': Instrumentation.enabled(), 'time': time, 'count': count}
 
 cdef class Grid2Dcpp:
     """
@@ -93,6 +129,108 @@ cdef class Grid2Dcpp:
     def getType(self):
         return self.grid.getType()
 
+    def get_nthreads(self):
+        """
+        Returns
+        -------
+        number of threads allowed for calculations
+        """
+        return self.grid.getNthreads()
+
+    def get_instrumentation(self):
+        """
+        Returns
+        -------
+        dict with keys
+            enabled : False if compiled without TTCR_INSTRUMENT, in which
+                      case all values are zero
+            time : time spent in each phase of the calculations, in s
+            count : number of operations of each type
+        values of time and count are arrays with one element per thread,
+        cumulated since the grid was created or reset_instrumentation called
+        """
+        return instrumentation_dict(self.grid.getInstrumentation())
+
+    def reset_instrumentation(self):
+        """
+        Set timings and operation counters to zero
+        """
+        self.grid.resetInstrumentation()
+
+    def set_slowness(self, slowness):
+        """
+        Assign slowness at grid cells
+
+        Parameters
+        ----------
+        slowness : vector of slowness at grid cells
+        """
+        cdef const double[::1] slo = np.ascontiguousarray(slowness, dtype=np.double)
+        cdef vector[double] slown
+        slown.assign(&slo[0], &slo[0] + slo.shape[0])
+        self.grid.setSlowness(slown)
+
+    def set_xi(self, xi):
+        """
+        Assign anisotropy ratio at grid cells
+
+        Parameters
+        ----------
+        xi : vector of anisotropy ratio at grid cells
+        """
+        cdef const double[::1] x = np.ascontiguousarray(xi, dtype=np.double)
+        cdef vector[double] cxi
+        cxi.assign(&x[0], &x[0] + x.shape[0])
+        self.grid.setXi(cxi)
+
+    def set_theta(self, theta):
+        """
+        Assign anisotropy angle at grid cells
+
+        Parameters
+        ----------
+        theta : vector of anisotropy angle at grid cells
+        """
+        cdef const double[::1] t = np.ascontiguousarray(theta, dtype=np.double)
+        cdef vector[double] ctheta
+        ctheta.assign(&t[0], &t[0] + t.shape[0])
+        self.grid.setTheta(ctheta)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def raytrace_tt(self, const double[:, ::1] Tx, const double[:, ::1] Rx,
+                    const double[::1] t0, double[::1] tt, size_t thread_no=0):
+        """
+        raytrace_tt(Tx, Rx, t0, tt, thread_no)
+
+        Compute traveltimes without holding the GIL
+
+        Model parameters must have been set beforehand with set_slowness
+        (and set_xi, set_theta).  Python threads can call raytrace_tt
+        concurrently, each with its own thread_no.
+
+        Parameters
+        ----------
+        Tx : source coordinates, nTx by 2 (C-contiguous)
+        Rx : receiver coordinates, nTx by 2 (C-contiguous)
+        t0 : origin time, one value per row of Tx
+        tt : array of size nTx receiving the travel times
+        thread_no : thread number on which computation should be run
+                    (0 <= thread_no < nthreads)
+        """
+        cdef size_t nTx = Tx.shape[0]
+        if thread_no >= self.grid.getNthreads():
+            raise ValueError('thread_no should be smaller than the number of threads')
+        if Tx.shape[1] != 2 or Rx.shape[1] != 2:
+            raise ValueError('Tx and Rx should have 2 columns')
+        if Rx.shape[0] != nTx or t0.shape[0] != nTx or tt.shape[0] != nTx:
+            raise ValueError('Tx, Rx, t0 and tt should have the same number of rows')
+        if nTx == 0:
+            return
+
+        with nogil:
+            self.grid.raytrace(&Tx[0, 0], &t0[0], &Rx[0, 0], nTx, &tt[0], thread_no)
+
     def raytrace(self, slowness, xi, theta, Tx, Rx, t0, nout):
         """
         raytrace(slowness, xi, theta, Tx, Rx, t0, nout) -> tt,L,rays
@@ -196,9 +334,9 @@ cdef class Grid2Dcpp:
 
 
     @staticmethod
-    def Lsr2d(Tx, Rx, grx, grz):
+    def Lsr2d(Tx, Rx, grx, grz, nthreads=1):
         """
-        Lsr2d(Tx, Rx, grx, grz) -> L
+        Lsr2d(Tx, Rx, grx, grz, nthreads) -> L
 
         Raytracing with straight rays in 2D
 
@@ -212,19 +350,25 @@ cdef class Grid2Dcpp:
               2nd contains Z coordinates
         grx : grid node coordinates along x
         grz : grid node coordinates along z
+        nthreads : number of threads
 
         Returns
         -------
         L : data kernel matrix (tt = L*slowness)
         """
 
+        Tx = np.ascontiguousarray(Tx, dtype=np.double)
+        Rx = np.ascontiguousarray(Rx, dtype=np.double)
+        grx = np.ascontiguousarray(grx, dtype=np.double)
+        grz = np.ascontiguousarray(grz, dtype=np.double)
+
         cdef size_t nTx = Tx.shape[0]
         cdef size_t n_grx = grx.shape[0]
         cdef size_t n_grz = grz.shape[0]
 
         Ldata = ([0.0], [0.0], [0.0])
 
-        Grid2Dttcr.Lsr2d(<double*> np.PyArray_DATA(Tx), <double*> np.PyArray_DATA(Rx), nTx, <double*> np.PyArray_DATA(grx), n_grx, <double*> np.PyArray_DATA(grz), n_grz, Ldata)
+        Grid2Dttcr.Lsr2d(<double*> np.PyArray_DATA(Tx), <double*> np.PyArray_DATA(Rx), nTx, <double*> np.PyArray_DATA(grx), n_grx, <double*> np.PyArray_DATA(grz), n_grz, Ldata, nthreads)
 
         M = nTx
         N = (n_grx-1)*(n_grz-1)
@@ -234,9 +378,9 @@ cdef class Grid2Dcpp:
 
 
     @staticmethod
-    def Lsr2da(Tx, Rx, grx, grz):
+    def Lsr2da(Tx, Rx, grx, grz, nthreads=1):
         """
-        Lsr2da(Tx, Rx, grx, grz) -> L
+        Lsr2da(Tx, Rx, grx, grz, nthreads) -> L
 
         Raytracing with straight rays in 2D elliptically anisotropic media
 
@@ -250,19 +394,25 @@ cdef class Grid2Dcpp:
                2nd contains Z coordinates
         grx : grid node coordinates along x
         grz : grid node coordinates along z
+        nthreads : number of threads
 
         Returns
         -------
         L : data kernel matrix (tt = L*slowness)
         """
 
+        Tx = np.ascontiguousarray(Tx, dtype=np.double)
+        Rx = np.ascontiguousarray(Rx, dtype=np.double)
+        grx = np.ascontiguousarray(grx, dtype=np.double)
+        grz = np.ascontiguousarray(grz, dtype=np.double)
+
         cdef size_t nTx = Tx.shape[0]
         cdef size_t n_grx = grx.shape[0]
         cdef size_t n_grz = grz.shape[0]
 
         Ldata = ([0.0], [0.0], [0.0])
 
-        Grid2Dttcr.Lsr2da(<double*> np.PyArray_DATA(Tx), <double*> np.PyArray_DATA(Rx), nTx, <double*> np.PyArray_DATA(grx), n_grx, <double*> np.PyArray_DATA(grz), n_grz, Ldata)
+        Grid2Dttcr.Lsr2da(<double*> np.PyArray_DATA(Tx), <double*> np.PyArray_DATA(Rx), nTx, <double*> np.PyArray_DATA(grx), n_grx, <double*> np.PyArray_DATA(grz), n_grz, Ldata, nthreads)
 
         M = nTx
         N = 2*(n_grx-1)*(n_grz-1)
@@ -25,15 +25,16 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 from libcpp.string cimport string
 from libcpp.vector cimport vector
-from libc.stdint cimport uint32_t
+from libc.stdint cimport int64_t, uint32_t
 from libcpp cimport bool
+cimport cython
 
 import numpy as np
 cimport numpy as np
 
 from scipy.sparse import csr_matrix
 
-cdef extern from "ttcr_t.h" namespace "ttcr":
+cdef extern from "ttcr_t.h" namespace "ttcr" nogil:
     cdef cppclass sxyz[T]:
         sxyz(T, T, T) except +
         T x
@@ -51,16 +52,41 @@ cdef extern from "ttcr_t.h" namespace "ttcr":
         size_t j
         T v
 
+cdef extern from "SparseMatrix.h" namespace "ttcr":
+    cdef cppclass CSRRows[S]:
+        CSRRows(vector[vector[S]]&) except +
+        size_t size()
+        size_t nnz()
+        void fill(int64_t*, int64_t*, double*, size_t, size_t) except +
+
+cdef extern from "Instrumentation.h" namespace "ttcr":
+    cdef enum InstrumentedPhase:
+        N_PHASES
+    cdef enum InstrumentedCount:
+        N_COUNTS
+    cdef cppclass Instrumentation:
+        size_t getNthreads()
+        double getTime(InstrumentedPhase, size_t)
+        size_t getCount(InstrumentedCount, size_t)
+        @staticmethod
+        bool enabled()
+        @staticmethod
+        const char* phaseName(InstrumentedPhase)
+        @staticmethod
+        const char* countName(InstrumentedCount)
+
 cdef extern from "Grid3Drnfs.h" namespace "ttcr":
     cdef cppclass Grid3Drnfs[T1,T2]:
         Grid3Drnfs(T2, T2, T2, T1, T1, T1, T1, T1, int, bool, size_t) except +
         size_t getNthreads()
+        const Instrumentation& getInstrumentation()
+        void resetInstrumentation()
         void setSlowness(vector[T1]&) except +
         void raytrace(vector[sxyz[T1]]&,
                       vector[T1]&,
                       vector[sxyz[T1]]&,
                       vector[T1]&,
-                      size_t) except +
+                      size_t) except + nogil
         void raytrace(vector[sxyz[T1]]&,
                       vector[T1]&,
                       vector[sxyz[T1]]&,
@@ -81,12 +107,14 @@ cdef extern from "Grid3Drcfs.h" namespace "ttcr":
     cdef cppclass Grid3Drcfs[T1,T2]:
         Grid3Drcfs(T2, T2, T2, T1, T1, T1, T1, T1, int, bool, size_t) except +
         size_t getNthreads()
+        const Instrumentation& getInstrumentation()
+        void resetInstrumentation()
         void setSlowness(vector[T1]&) except +
         void raytrace(vector[sxyz[T1]]&,
                       vector[T1]&,
                       vector[sxyz[T1]]&,
                       vector[T1]&,
-                      size_t) except +
+                      size_t) except + nogil
         void raytrace(vector[sxyz[T1]]&,
                       vector[T1]&,
                       vector[sxyz[T1]]&,
@@ -101,6 +129,113 @@ cdef extern from "Grid3Drcfs.h" namespace "ttcr":
                       vector[vector[siv[T1]]]&,
                       size_t) except +
 
+cdef extern from "StraightRays.h" namespace "ttcr":
+    cdef cppclass StraightRays[T]:
+        StraightRays(const T*, size_t, const T*, size_t, const T*, size_t) except +
+        size_t getNcols(bool)
+        size_t count(const T*, const T*, size_t, bool, int64_t*, size_t) except + nogil
+        void fill(const T*, const T*, size_t, bool, const int64_t*, int64_t*,
+                  double*, size_t) except + nogil
+
+cdef instrumentation_dict(const Instrumentation& instr):
+    cdef size_t n
+    cdef int i
+    cdef size_t nt = instr.getNthreads()
+    time = {}
+    for i in range(N_PHASES):
+        time[Instrumentation.phaseName(<InstrumentedPhase>i).decode()] = np.array(
+            [instr.getTime(<InstrumentedPhase>i, n) for n in range(nt)])
+    count = {}
+    for i in range(N_COUNTS):
+        count[Instrumentation.countName(<InstrumentedCount>i).decode()] = np.array(
+            [instr.getCount(<InstrumentedCount>i, n) for n in range(nt)], dtype=np.int64)
+    return {'enabled': Instrumentation.enabled(), 'time': time, 'count': count}
+
+cdef csr_from_m_data(vector[vector[sijv[double]]]& m_data, size_t N):
+    # arrays of the matrix are filled in place by CSRRows
+    cdef CSRRows[sijv[double]]* rows = new CSRRows[sijv[double]](m_data)
+    try:
+        M = rows.size()
+        indptr = np.empty((M+1,), dtype=np.int64)
+        indices = np.empty((rows.nnz(),), dtype=np.int64)
+        val = np.empty((rows.nnz(),))
+        rows.fill(<int64_t*> np.PyArray_DATA(indptr),
+                  <int64_t*> np.PyArray_DATA(indices),
+                  <double*> np.PyArray_DATA(val), N, 1)
+    finally:
+        del rows
+    return csr_matrix((val, indices, indptr), shape=(M,N))
+
+cdef csr_from_l_data(vector[vector[siv[double]]]& l_data, size_t N):
+    cdef CSRRows[siv[double]]* rows = new CSRRows[siv[double]](l_data)
+    try:
+        M = rows.size()
+        indptr = np.empty((M+1,), dtype=np.int64)
+        indices = np.empty((rows.nnz(),), dtype=np.int64)
+        val = np.empty((rows.nnz(),))
+        rows.fill(<int64_t*> np.PyArray_DATA(indptr),
+                  <int64_t*> np.PyArray_DATA(indices),
+                  <double*> np.PyArray_DATA(val), N, 1)
+    finally:
+        del rows
+    return csr_matrix((val, indices, indptr), shape=(M,N))
+
+def Lsr3d(Tx, Rx, grx, gry, grz, size_t nthreads=1):
+    """
+    Lsr3d(Tx, Rx, grx, gry, grz, nthreads) -> L
+
+    Raytracing with straight rays in 3D
+
+    Parameters
+    ----------
+        Tx : source coordinates (nTx x 3)
+        Rx : receiver coordinates (nTx x 3), one receiver per row of Tx
+        grx : grid node coordinates along x
+        gry : grid node coordinates along y
+        grz : grid node coordinates along z
+        nthreads : number of threads
+
+    Returns
+    -------
+        L : data kernel matrix (tt = L*slowness), with cells numbered with
+            z fastest
+    """
+    cdef const double[:, ::1] cTx = np.ascontiguousarray(Tx, dtype=np.double)
+    cdef const double[:, ::1] cRx = np.ascontiguousarray(Rx, dtype=np.double)
+    cdef const double[::1] x = np.ascontiguousarray(grx, dtype=np.double)
+    cdef const double[::1] y = np.ascontiguousarray(gry, dtype=np.double)
+    cdef const double[::1] z = np.ascontiguousarray(grz, dtype=np.double)
+    cdef size_t nTx = cTx.shape[0]
+    if cTx.shape[1] != 3 or cRx.shape[1] != 3 or cRx.shape[0] != nTx:
+        raise ValueError('Tx and Rx should both be nTx x 3')
+    if x.shape[0] < 2 or y.shape[0] < 2 or z.shape[0] < 2:
+        raise ValueError('grid should have at least 2 nodes along each axis')
+
+    cdef StraightRays[double]* sr = new StraightRays[double](&x[0], x.shape[0],
+                                                             &y[0], y.shape[0],
+                                                             &z[0], z.shape[0])
+    cdef int64_t[::1] indptr = np.empty((nTx+1,), dtype=np.int64)
+    cdef int64_t[::1] indices
+    cdef double[::1] val
+    cdef size_t nnz
+    try:
+        N = sr.getNcols(False)
+        if nTx == 0:
+            return csr_matrix((0, N))
+        # rows are counted first, arrays are then allocated at their final size
+        with nogil:
+            nnz = sr.count(&cTx[0, 0], &cRx[0, 0], nTx, False, &indptr[0], nthreads)
+        indices = np.empty((nnz,), dtype=np.int64)
+        val = np.empty((nnz,))
+        if nnz > 0:
+            with nogil:
+                sr.fill(&cTx[0, 0], &cRx[0, 0], nTx, False, &indptr[0],
+                        &indices[0], &val[0], nthreads)
+    finally:
+        del sr
+    return csr_matrix((np.asarray(val), np.asarray(indices), np.asarray(indptr)), shape=(nTx, N))
+
+
 cdef class Grid3Drn:
     """
     Grid3Drn(nx, ny, nz, dx, xmin, ymin, zmin, eps, maxit, weno, nthreads)
@@ -146,6 +281,28 @@ cdef class Grid3Drn:
         """
         return self.grid.getNthreads()
 
+    def get_instrumentation(self):
+        """
+        Returns
+        -------
+        dict with keys
+            enabled : False if compiled without TTCR_INSTRUMENT, in which
+                      case all values are zero
+            time : time spent in each phase of the calculations, in s
+            count : number of operations of each type
+        values of time and count are arrays with one element per thread,
+        cumulated since the grid was created or reset_instrumentation called
+        """
+        return instrumentation_dict(self.grid.getInstrumentation())
+
+    def reset_instrumentation(self):
+        """
+        Set timings and operation counters to zero
+        """
+        self.grid.resetInstrumentation()
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
     def set_slowness(self, slowness):
         """
         Assign slowness at grid nodes
@@ -154,17 +311,70 @@ cdef class Grid3Drn:
         ----------
         slowness : 1D array (in 'C' order)
         """
+        cdef const double[::1] slo = np.ascontiguousarray(slowness, dtype=np.double).ravel()
+        cdef size_t nx = self.nx+1
+        cdef size_t ny = self.ny+1
+        cdef size_t nz = self.nz+1
+        cdef size_t i, j, k
         cdef vector[double] slown
-        nx = self.nx+1
-        ny = self.ny+1
-        nz = self.nz+1
-        for k in range(nz):
-            for j in range(ny):
-                for i in range(nx):
-                    # slowness is in 'C' order and we must pass it in 'F' order
-                    slown.push_back(slowness[(i*ny + j)*nz + k])
+        if slo.shape[0] != nx*ny*nz:
+            raise ValueError('slowness should hold %d values' % (nx*ny*nz))
+        slown.resize(nx*ny*nz)
+        with nogil:
+            for k in range(nz):
+                for j in range(ny):
+                    for i in range(nx):
+                        # slowness is in 'C' order and we must pass it in 'F' order
+                        slown[(k*ny + j)*nx + i] = slo[(i*ny + j)*nz + k]
         self.grid.setSlowness(slown)
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def raytrace_tt(self, const double[:, ::1] Tx, const double[:, ::1] Rx,
+                    double t0, double[::1] tt, size_t thread_no=0):
+        """
+        Compute traveltimes at receivers for a single source, without holding
+        the GIL
+
+        Slowness must have been set beforehand with set_slowness.  Python
+        threads can call raytrace_tt concurrently, each with its own
+        thread_no.
+
+        Parameters
+        ----------
+            Tx : coordinates of source points (npts x 3, C-contiguous)
+            Rx : coordinates of receivers (nrcv x 3, C-contiguous)
+            t0 : time of source event
+            tt : array of size nrcv receiving the traveltimes
+            thread_no : thread/process number on which computation should be
+                        run (0 <= thread_no < nthreads)
+        """
+        cdef vector[sxyz[double]] vTx
+        cdef vector[sxyz[double]] vRx
+        cdef vector[double] vt0
+        cdef vector[double] vtt
+        cdef size_t n
+        if thread_no >= self.grid.getNthreads():
+            raise ValueError('thread_no should be smaller than the number of threads')
+        if Tx.shape[1] != 3 or Rx.shape[1] != 3:
+            raise ValueError('Tx and Rx should have 3 columns')
+        if tt.shape[0] != Rx.shape[0]:
+            raise ValueError('tt should have one element per receiver')
+
+        with nogil:
+            vTx.reserve(Tx.shape[0])
+            for n in range(Tx.shape[0]):
+                vTx.push_back(sxyz[double](Tx[n, 0], Tx[n, 1], Tx[n, 2]))
+            vRx.reserve(Rx.shape[0])
+            for n in range(Rx.shape[0]):
+                vRx.push_back(sxyz[double](Rx[n, 0], Rx[n, 1], Rx[n, 2]))
+            vt0.push_back(t0)
+
+            self.grid.raytrace(vTx, vt0, vRx, vtt, thread_no)
+
+            for n in range(vtt.size()):
+                tt[n] = vtt[n]
+
     def raytrace(self, slowness, Tx, Rx, t0=0.0, nout=1, thread_no=0):
         """
         Perform raytracing for a single source
@@ -191,17 +401,8 @@ cdef class Grid3Drn:
                 M : matrix of partial derivatives of t w/r to velocity
         """
         # assing model data
-        cdef vector[double] slown
         if slowness is not None:
-            nx = self.nx+1
-            ny = self.ny+1
-            nz = self.nz+1
-            for k in range(nz):
-                for j in range(ny):
-                    for i in range(nx):
-                        # slowness is in 'C' order and we must pass it in 'F' order
-                        slown.push_back(slowness[(i*ny + j)*nz + k])
-            self.grid.setSlowness(slown)
+            self.set_slowness(slowness)
 
         cdef vector[sxyz[double]] vTx
         cdef vector[sxyz[double]] vRx
@@ -256,27 +457,8 @@ cdef class Grid3Drn:
                     rays[n][nn, 1] = r_data[n][nn].y
                     rays[n][nn, 2] = r_data[n][nn].z
 
-            nnz = 0
-            for ni in range(m_data.size()):
-                nnz += m_data[ni].size()
-            indptr = np.empty((Rx.shape[0]+1,), dtype=np.int64)
-            indices = np.empty((nnz,), dtype=np.int64)
-            val = np.empty((nnz,))
-
-            k = 0
-            M = Rx.shape[0]
             N = (self.nx+1)*(self.ny+1)*(self.nz+1)
-            for i in range(M):
-                indptr[i] = k
-                for j in range(N):
-                    for n in range(m_data[i].size()):
-                        if m_data[i][n].i == i and m_data[i][n].j == j:
-                            indices[k] = j
-                            val[k] = m_data[i][n].v
-                            k += 1
-
-            indptr[M] = k
-            MM = csr_matrix((val, indices, indptr), shape=(M,N))
+            MM = csr_from_m_data(m_data, N)
 
             return tt, rays, v0, MM
 
@@ -325,6 +507,28 @@ cdef class Grid3Drc:
         """
         return self.grid.getNthreads()
 
+    def get_instrumentation(self):
+        """
+        Returns
+        -------
+        dict with keys
+            enabled : False if compiled without TTCR_INSTRUMENT, in which
+                      case all values are zero
+            time : time spent in each phase of the calculations, in s
+            count : number of operations of each type
+        values of time and count are arrays with one element per thread,
+        cumulated since the grid was created or reset_instrumentation called
+        """
+        return instrumentation_dict(self.grid.getInstrumentation())
+
+    def reset_instrumentation(self):
+        """
+        Set timings and operation counters to zero
+        """
+        self.grid.resetInstrumentation()
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
     def set_slowness(self, slowness):
         """
         Assign slowness at grid cells
@@ -333,14 +537,70 @@ cdef class Grid3Drc:
         ----------
         slowness : 1D array (in 'C' order)
         """
+        cdef const double[::1] slo = np.ascontiguousarray(slowness, dtype=np.double).ravel()
+        cdef size_t nx = self.nx
+        cdef size_t ny = self.ny
+        cdef size_t nz = self.nz
+        cdef size_t i, j, k
         cdef vector[double] slown
-        for k in range(self.nz):
-            for j in range(self.ny):
-                for i in range(self.nx):
-                    # slowness is in 'C' order and we must pass it in 'F' order
-                    slown.push_back(slowness[(i*self.ny + j)*self.nz + k])
+        if slo.shape[0] != nx*ny*nz:
+            raise ValueError('slowness should hold %d values' % (nx*ny*nz))
+        slown.resize(nx*ny*nz)
+        with nogil:
+            for k in range(nz):
+                for j in range(ny):
+                    for i in range(nx):
+                        # slowness is in 'C' order and we must pass it in 'F' order
+                        slown[(k*ny + j)*nx + i] = slo[(i*ny + j)*nz + k]
         self.grid.setSlowness(slown)
 
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def raytrace_tt(self, const double[:, ::1] Tx, const double[:, ::1] Rx,
+                    double t0, double[::1] tt, size_t thread_no=0):
+        """
+        Compute traveltimes at receivers for a single source, without holding
+        the GIL
+
+        Slowness must have been set beforehand with set_slowness.  Python
+        threads can call raytrace_tt concurrently, each with its own
+        thread_no.
+
+        Parameters
+        ----------
+            Tx : coordinates of source points (npts x 3, C-contiguous)
+            Rx : coordinates of receivers (nrcv x 3, C-contiguous)
+            t0 : time of source event
+            tt : array of size nrcv receiving the traveltimes
+            thread_no : thread/process number on which computation should be
+                        run (0 <= thread_no < nthreads)
+        """
+        cdef vector[sxyz[double]] vTx
+        cdef vector[sxyz[double]] vRx
+        cdef vector[double] vt0
+        cdef vector[double] vtt
+        cdef size_t n
+        if thread_no >= self.grid.getNthreads():
+            raise ValueError('thread_no should be smaller than the number of threads')
+        if Tx.shape[1] != 3 or Rx.shape[1] != 3:
+            raise ValueError('Tx and Rx should have 3 columns')
+        if tt.shape[0] != Rx.shape[0]:
+            raise ValueError('tt should have one element per receiver')
+
+        with nogil:
+            vTx.reserve(Tx.shape[0])
+            for n in range(Tx.shape[0]):
+                vTx.push_back(sxyz[double](Tx[n, 0], Tx[n, 1], Tx[n, 2]))
+            vRx.reserve(Rx.shape[0])
+            for n in range(Rx.shape[0]):
+                vRx.push_back(sxyz[double](Rx[n, 0], Rx[n, 1], Rx[n, 2]))
+            vt0.push_back(t0)
+
+            self.grid.raytrace(vTx, vt0, vRx, vtt, thread_no)
+
+            for n in range(vtt.size()):
+                tt[n] = vtt[n]
+
     def raytrace(self, slowness, Tx, Rx, t0, nout=1, thread_no=0):
         """
         Perform raytracing for a single source
@@ -366,14 +626,8 @@ cdef class Grid3Drc:
                 rays : list holding coordinates of ray segments, for each rcv
         """
         # assing model data
-        cdef vector[double] slown
         if slowness is not None:
-            for k in range(self.nz):
-                for j in range(self.ny):
-                    for i in range(self.nx):
-                        # slowness is in 'C' order and we must pass it in 'F' order
-                        slown.push_back(slowness[(i*self.ny + j)*self.nz + k])
-            self.grid.setSlowness(slown)
+            self.set_slowness(slowness)
 
         cdef vector[sxyz[double]] vTx
         cdef vector[sxyz[double]] vRx
@@ -407,24 +661,8 @@ cdef class Grid3Drc:
             for n in range(Rx.shape[0]):
                 tt[n] = vtt[n]
 
-            indptr = np.empty((Rx.shape[0]+1,), dtype=np.int64)
-            indices = np.empty((l_data.size(),), dtype=np.int64)
-            val = np.empty((l_data.size(),))
-
-            k = 0
-            M = Rx.shape[0]
             N = self.nx*self.ny*self.nz
-            for i in range(M):
-                indptr[i] = k
-                for j in range(N):
-                    for n in range(l_data[i].size()):
-                        if l_data[i][n].i == j:
-                            indices[k] = j
-                            val[k] = l_data[i][n].v
-                            k += 1
-
-            indptr[M] = k
-            L = csr_matrix((val, indices, indptr), shape=(M,N))
+            L = csr_from_l_data(l_data, N)
 
             return tt, L
 
@@ -441,23 +679,7 @@ cdef class Grid3Drc:
                     rays[n][nn, 1] = r_data[n][nn].y
                     rays[n][nn, 2] = r_data[n][nn].z
 
-            indptr = np.empty((Rx.shape[0]+1,), dtype=np.int64)
-            indices = np.empty((l_data.size(),), dtype=np.int64)
-            val = np.empty((l_data.size(),))
-
-            k = 0
-            M = Rx.shape[0]
             N = self.nx*self.ny*self.nz
-            for i in range(M):
-                indptr[i] = k
-                for j in range(N):
-                    for n in range(l_data[i].size()):
-                        if l_data[i][n].i == j:
-                            indices[k] = j
-                            val[k] = l_data[i][n].v
-                            k += 1
-
-            indptr[M] = k
-            L = csr_matrix((val, indices, indptr), shape=(M,N))
+            L = csr_from_l_data(l_data, N)
 
             return tt, L, rays
@@ -23,6 +23,7 @@ from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libc.stdint cimport uint32_t
 from libcpp cimport bool
+cimport cython
 
 import numpy as np
 cimport numpy as np
@@ -40,15 +41,39 @@ cdef extern from "ttcr_t.h" namespace "ttcr":
         tetrahedronElem(T, T, T, T) except +
 
 
+cdef extern from "Instrumentation.h" namespace "ttcr":
+    cdef enum InstrumentedPhase:
+        N_PHASES
+    cdef enum InstrumentedCount:
+        N_COUNTS
+    cdef cppclass Instrumentation:
+        size_t getNthreads()
+        double getTime(InstrumentedPhase, size_t)
+        size_t getCount(InstrumentedCount, size_t)
+        @staticmethod
+        bool enabled()
+        @staticmethod
+        const char* phaseName(InstrumentedPhase)
+        @staticmethod
+        const char* countName(InstrumentedCount)
+
 cdef extern from "Mesh3Dttcr.h" namespace "ttcr":
     cdef cppclass Mesh3Dttcr:
         Mesh3Dttcr(vector[sxyz[double]]&, vector[tetrahedronElem[uint32_t]]&,
                    double, int, bool rp, size_t) except +
         void setSlowness(const vector[double]&) except +
+        size_t getNthreads()
+        const Instrumentation& getInstrumentation()
+        void resetInstrumentation()
+        void setReciprocity(bool)
         void raytrace(const vector[sxyz[double]]&,
                      const vector[double]&,
                      const vector[sxyz[double]]&,
                      double*) except +
+        void raytrace(const double*,
+                     const double*,
+                     const double*,
+                     size_t, double*, size_t) except + nogil
         void raytrace(const vector[sxyz[double]]&,
                      const vector[double]&,
                      const vector[sxyz[double]]&,
@@ -58,6 +83,20 @@ cdef extern from "Mesh3Dttcr.h" namespace "ttcr":
                      const vector[sxyz[double]]& Rx,
                      double*, object, double*, object) except +
 
+cdef instrumentation_dict(const Instrumentation& instr):
+    cdef size_t n
+    cdef int i
+    cdef size_t nt = instr.getNthreads()
+    time = {}
+    for i in range(N_PHASES):
+        time[Instrumentation.phaseName(<InstrumentedPhase>i).decode()] = np.array(
+            [instr.getTime(<InstrumentedPhase>i, n) for n in range(nt)])
+    count = {}
+    for i in range(N_COUNTS):
+        count[Instrumentation.countName(<InstrumentedCount>i).decode()] = np.array(
+            [instr.getCount(<InstrumentedCount>i, n) for n in range(nt)], dtype=np.int64)
+    return {'enabled': Instrumentation.enabled(), 'time': time, 'count': count}
+
 cdef class Mesh3Dcpp:
     cdef Mesh3Dttcr* mesh
     def __cinit__(self, nodes, tetra, const double eps, const int maxit, const bool rp, const size_t nt):
@@ -72,14 +111,67 @@ cdef class Mesh3Dcpp:
     def __dealloc__(self):
         del self.mesh
 
-    def raytrace(self, slowness, Tx, Rx, t0):
-        nout = 4#nargout()
+    def get_nthreads(self):
+        return self.mesh.getNthreads()
+
+    def get_instrumentation(self):
+        """
+        Returns
+        -------
+        dict with keys
+            enabled : False if compiled without TTCR_INSTRUMENT, in which
+                      case all values are zero
+            time : time spent in each phase of the calculations, in s
+            count : number of operations of each type
+        values of time and count are arrays with one element per thread,
+        cumulated since the grid was created or reset_instrumentation called
+        """
+        return instrumentation_dict(self.mesh.getInstrumentation())
+
+    def reset_instrumentation(self):
+        """
+        Set timings and operation counters to zero
+        """
+        self.mesh.resetInstrumentation()
+
+    def set_slowness(self, slowness):
+        cdef const double[::1] slo = np.ascontiguousarray(slowness, dtype=np.double)
+        cdef vector[double] slown
+        slown.assign(&slo[0], &slo[0] + slo.shape[0])
+        self.mesh.setSlowness(slown)
+
+    def set_reciprocity(self, bool reciprocal):
+        self.mesh.setReciprocity(reciprocal)
+
+    @cython.boundscheck(False)
+    @cython.wraparound(False)
+    def raytrace_tt(self, const double[:, ::1] Tx, const double[:, ::1] Rx,
+                    const double[::1] t0, double[::1] tt, size_t thread_no=0):
+
+        # traveltimes of Tx-Rx pairs computed on thread slot thread_no without
+        # holding the GIL; slowness (and reciprocity) must be set beforehand
+        cdef size_t nTx = Tx.shape[0]
+        if thread_no >= self.mesh.getNthreads():
+            raise ValueError('thread_no should be smaller than the number of threads')
+        if Tx.shape[1] != 3 or Rx.shape[1] != 3:
+            raise ValueError('Tx and Rx should have 3 columns')
+        if Rx.shape[0] != nTx or t0.shape[0] != nTx or tt.shape[0] != nTx:
+            raise ValueError('Tx, Rx, t0 and tt should have the same number of rows')
+        if nTx == 0:
+            return
+
+        with nogil:
+            self.mesh.raytrace(&Tx[0, 0], &t0[0], &Rx[0, 0], nTx, &tt[0], thread_no)
+
+    def raytrace(self, slowness, Tx, Rx, t0, nout=4, reciprocal=False):
 
         # assing model data
         cdef vector[double] slown
         for tmp in slowness:
             slown.push_back(tmp)
         self.mesh.setSlowness(slown)
+        # only used when traveltimes alone are computed
+        self.mesh.setReciprocity(reciprocal)
 
         # create C++ input variables
         cdef vector[sxyz[double]] cTx
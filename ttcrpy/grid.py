@@ -428,9 +428,9 @@ class Grid2D(Grid):
             grz = np.arange(self.grz[0],self.grz[-1]+small, dz)
 
         if aniso==False:
-            return cgrid2d.Grid2Dcpp.Lsr2d(self.Tx[np.ix_(ind,[0,2])], self.Rx[np.ix_(ind,[0,2])], grx, grz) #  @UndefinedVariable
+            return cgrid2d.Grid2Dcpp.Lsr2d(self.Tx[np.ix_(ind,[0,2])], self.Rx[np.ix_(ind,[0,2])], grx, grz, self.nthreads) #  @UndefinedVariable
         else:
-            return cgrid2d.Grid2Dcpp.Lsr2da(self.Tx[np.ix_(ind,[0,2])], self.Rx[np.ix_(ind,[0,2])], grx, grz) #  @UndefinedVariable
+            return cgrid2d.Grid2Dcpp.Lsr2da(self.Tx[np.ix_(ind,[0,2])], self.Rx[np.ix_(ind,[0,2])], grx, grz, self.nthreads) #  @UndefinedVariable
 
 
     def getCellCenter(self, dx=None, dz=None):
@@ -350,7 +350,7 @@ class MeshTetrahedra(Mesh):
         self.nodes = np.array(nodes[itet,:])
 
 
-    def raytrace(self, slowness, Tx, Rx, t0=()):
+    def raytrace(self, slowness, Tx, Rx, t0=(), reciprocal=False):
         nout = nargout()
         if nout != 1 and nout != 3 and nout != 4:
             raise SyntaxError('MeshTetrahedra.raytrace: 1, 3 or 4 output arguments allowed')
@@ -380,13 +380,13 @@ class MeshTetrahedra(Mesh):
             self.cmesh = cmesh3d.Mesh3Dcpp(self.nodes, self.cells, eps, maxit, rp_ho, self.nthreads)
 
         if nout == 1:
-            tt = self.cmesh.raytrace(slowness, Tx, Rx, t0)
+            tt = self.cmesh.raytrace(slowness, Tx, Rx, t0, nout, reciprocal)
             return tt
         elif nout == 3:
-            tt, rays, v0 = self.cmesh.raytrace(slowness, Tx, Rx, t0)
+            tt, rays, v0 = self.cmesh.raytrace(slowness, Tx, Rx, t0, nout, reciprocal)
             return tt, rays, v0
         elif nout == 4:
-            tt, rays, v0, M = self.cmesh.raytrace(slowness, Tx, Rx, t0)
+            tt, rays, v0, M = self.cmesh.raytrace(slowness, Tx, Rx, t0, nout, reciprocal)
             return tt, rays, v0, M
 
 
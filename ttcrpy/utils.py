@@ -24,6 +24,8 @@
 
 import inspect,dis
 
+import numpy as np
+
 def nargout():
     """
     Return how many values the caller is expecting
@@ -43,3 +45,76 @@ def nargout():
     elif instruction == dis.opmap['POP_TOP']:
         return 0
     return 1
+
+
+def read_tt_table(filename):
+    """
+    Read traveltime table written by ttcr with saveTTbinary
+
+    The file is memory-mapped, traveltimes are not copied.
+
+    Returns
+    -------
+    tt : if shots are stored in order, array of shape (nShots, nComp, nRcv),
+         otherwise list of nShots arrays of shape (nComp, nRcv).  nComp is
+         the number of traveltimes per receiver (direct wave first, then
+         reflected waves)
+    """
+    hdr_t = np.dtype([('magic', 'S8'), ('version', np.uint32),
+                      ('valueSize', np.uint32), ('nShots', np.uint64),
+                      ('nComp', np.uint64), ('nRcv', np.uint64),
+                      ('dataOffset', np.uint64), ('tableOffset', np.uint64),
+                      ('reserved', np.uint64)])
+    hdr = np.fromfile(filename, dtype=hdr_t, count=1)
+    if hdr.size != 1 or hdr['magic'][0] != b'ttcrTT' or hdr['version'][0] != 1:
+        raise ValueError(filename+' is not a traveltime table')
+    hdr = hdr[0]
+    dtype = np.float32 if hdr['valueSize'] == 4 else np.float64
+    ns = int(hdr['nShots'])
+    shape = (int(hdr['nComp']), int(hdr['nRcv']))
+    if hdr['tableOffset'] == 0:
+        return np.memmap(filename, dtype=dtype, mode='r',
+                         offset=int(hdr['dataOffset']), shape=(ns,)+shape)
+    offsets = np.memmap(filename, dtype=np.uint64, mode='r',
+                        offset=int(hdr['tableOffset']), shape=(ns,))
+    return [np.memmap(filename, dtype=dtype, mode='r', offset=int(o),
+                      shape=shape) for o in offsets]
+
+
+def read_csr_matrix(filename):
+    """
+    Read matrix of partial derivatives written by ttcr with saveMbinary
+
+    The arrays of the matrix are memory-mapped, values are not read until
+    they are used.
+
+    Returns
+    -------
+    M : scipy.sparse.csr_matrix of shape (nShots*nRcv, nNodes), rows of the
+        receivers of the first source first
+    nShots : number of sources
+    """
+    from scipy.sparse import csr_matrix
+    hdr_t = np.dtype([('magic', 'S8'), ('version', np.uint32),
+                      ('valueSize', np.uint32), ('nRows', np.uint64),
+                      ('nCols', np.uint64), ('nnz', np.uint64),
+                      ('nShots', np.uint64), ('reserved', np.uint64, (2,))])
+    hdr = np.fromfile(filename, dtype=hdr_t, count=1)
+    if hdr.size != 1 or hdr['magic'][0] != b'ttcrCSR' or hdr['version'][0] != 1:
+        raise ValueError(filename+' is not a sparse matrix file')
+    hdr = hdr[0]
+    dtype = np.float32 if hdr['valueSize'] == 4 else np.float64
+    nr = int(hdr['nRows'])
+    nnz = int(hdr['nnz'])
+    offset = hdr_t.itemsize
+    indptr = np.memmap(filename, dtype=np.int64, mode='r', offset=offset,
+                       shape=(nr+1,))
+    offset += 8*(nr+1)
+    indices = np.memmap(filename, dtype=np.int64, mode='r', offset=offset,
+                        shape=(nnz,))
+    offset += 8*nnz
+    data = np.memmap(filename, dtype=dtype, mode='r', offset=offset,
+                     shape=(nnz,))
+    M = csr_matrix((data, indices, indptr), shape=(nr, int(hdr['nCols'])),
+                   copy=False)
+    return M, int(hdr['nShots'])